@@ -669,6 +669,14 @@ __SYSCALL(__NR_fanotify_init, sys_fanotify_init)
 __SYSCALL(__NR_fanotify_mark, sys_fanotify_mark)
 #define __NR_prlimit64				302
 __SYSCALL(__NR_prlimit64, sys_prlimit64)
+#define __NR_userfaultfd			303
+__SYSCALL(__NR_userfaultfd, sys_userfaultfd)
+#define __NR_io_uring_setup			304
+__SYSCALL(__NR_io_uring_setup, sys_io_uring_setup)
+#define __NR_io_uring_enter			305
+__SYSCALL(__NR_io_uring_enter, sys_io_uring_enter)
+#define __NR_io_uring_register			306
+__SYSCALL(__NR_io_uring_register, sys_io_uring_register)
 
 #ifndef __NO_STUBS
 #define __ARCH_WANT_OLD_READDIR
@@ -0,0 +1,3358 @@
+/*
+ *  BFQ, or budget fair queueing, disk scheduler.
+ *
+ *  Every process gets a queue, as in CFQ, but queues are served in
+ *  budgets of sectors rather than slices of time, and the order in which
+ *  budgets are granted is computed by B-WF2Q+, a fair queueing algorithm
+ *  with proportional-share guarantees. This keeps throughput distribution
+ *  exact even on devices whose speed varies a lot with the workload, like
+ *  flash cards, where a time slice can be worth wildly different amounts
+ *  of I/O.
+ *
+ *  Budgets adapt to what each queue actually manages to consume, with a
+ *  per-queue timeout to keep seeky queues from hogging the device. On top
+ *  of that, interactive and soft real-time processes are detected from
+ *  their I/O pattern and temporarily get a much larger weight, so that
+ *  starting an application or playing a video stays smooth while
+ *  something writes in the background.
+ *
+ *  Queue and cic handling, request sorting and the elevator glue are
+ *  shared in spirit (and largely in code) with cfq-iosched.c.
+ */
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/blkdev.h>
+#include <linux/elevator.h>
+#include <linux/jiffies.h>
+#include <linux/rbtree.h>
+#include <linux/ioprio.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/blktrace_api.h>
+#include "blk-cgroup.h"
+
+/*
+ * tunables
+ */
+/* max requests in flight from the in-service queue */
+static const int bfq_quantum = 4;
+static const int bfq_fifo_expire[2] = { HZ / 4, HZ / 8 };
+/* maximum backwards seek, in KiB */
+static const int bfq_back_max = 16 * 1024;
+/* penalty of a backwards seek */
+static const int bfq_back_penalty = 2;
+static int bfq_slice_idle = HZ / 125;
+/* default maximum budget, in sectors, until the peak rate is known */
+static const int bfq_default_max_budget = 16 * 1024;
+/* max async requests dispatched per budget */
+static const int bfq_max_budget_async_rq = 4;
+/* async requests are charged this many times their size */
+static const int bfq_async_charge_factor = 3;
+static const int bfq_timeout_sync = HZ / 8;
+static int bfq_timeout_async = HZ / 25;
+
+/*
+ * idle class queues get service at least this often, even if there is
+ * higher priority I/O pending
+ */
+#define BFQ_CL_IDLE_TIMEOUT	(HZ / 5)
+
+/* minimum idle slice for seeky queues, in ms */
+#define BFQ_MIN_TT		(2)
+
+/* peak rate samples needed before the maximum budget is autotuned */
+#define BFQ_PEAK_RATE_SAMPLES	32
+/* fixed point shift of the peak rate, in sectors/usec */
+#define BFQ_RATE_SHIFT		16
+
+/* fixed point shift of virtual times */
+#define WFQ_SERVICE_SHIFT	22
+
+#define BFQ_IOPRIO_CLASSES	3
+
+#define BFQQ_SEEK_THR		(sector_t)(8 * 100)
+#define BFQQ_SECT_THR_NONROT	(sector_t)(2 * 32)
+#define BFQQ_SEEKY(bfqq)	(hweight32((bfqq)->seek_history) > 32/8)
+
+#define RQ_CIC(rq)		\
+	((struct bfq_io_context *) (rq)->elevator_private)
+#define RQ_BFQQ(rq)		(struct bfq_queue *) ((rq)->elevator_private2)
+
+static struct kmem_cache *bfq_pool;
+static struct kmem_cache *bfq_ioc_pool;
+
+static DEFINE_PER_CPU(unsigned long, bfq_ioc_count);
+static struct completion *ioc_gone;
+static DEFINE_SPINLOCK(ioc_gone_lock);
+
+static DEFINE_SPINLOCK(cic_index_lock);
+static DEFINE_IDA(cic_index_ida);
+
+#define bfq_class_idle(bfqq)	((bfqq)->ioprio_class == IOPRIO_CLASS_IDLE)
+#define bfq_class_rt(bfqq)	((bfqq)->ioprio_class == IOPRIO_CLASS_RT)
+
+#define sample_valid(samples)	((samples) > 80)
+
+/*
+ * One service tree per ioprio class in every scheduling level. Active
+ * entities are sorted by finish time; each node also caches the minimum
+ * start time in its subtree, so the eligible entity with the smallest
+ * finish time can be found in O(log N).
+ */
+struct bfq_service_tree {
+	struct rb_root active;
+	u64 vtime;
+	unsigned long wsum;
+};
+
+/*
+ * A scheduling level: the root, or the children of a group. The entity
+ * being served is taken off its tree but still counts in ->wsum.
+ */
+struct bfq_sched_data {
+	struct bfq_entity *in_service_entity;
+	struct bfq_service_tree service_tree[BFQ_IOPRIO_CLASSES];
+};
+
+/*
+ * Something that can be scheduled: a queue or a group of queues.
+ * ->on_st is set while the entity is active, i.e. counted in the weight
+ * sum of its service tree, whether it sits on the tree or is in service.
+ */
+struct bfq_entity {
+	struct rb_node rb_node;
+	int on_st;
+
+	u64 start;
+	u64 finish;
+	u64 min_start;
+
+	/* in sectors */
+	unsigned long service;
+	unsigned long budget;
+
+	unsigned int weight;
+	unsigned int new_weight;
+	unsigned int orig_weight;
+
+	unsigned short ioprio_class;
+	unsigned short new_ioprio_class;
+	int ioprio_changed;
+
+	struct bfq_entity *parent;
+	/* level this entity is scheduled in */
+	struct bfq_sched_data *sched_data;
+	/* level this entity schedules, NULL for queues */
+	struct bfq_sched_data *my_sched_data;
+};
+
+struct bfq_group {
+	struct bfq_entity entity;
+	struct bfq_sched_data sched_data;
+#ifdef CONFIG_BFQ_GROUP_IOSCHED
+	struct hlist_node bfqd_node;
+	atomic_t ref;
+	struct blkio_group blkg;
+#endif
+};
+
+/*
+ * Per process-grouping structure
+ */
+struct bfq_queue {
+	/* reference count */
+	atomic_t ref;
+	/* various state flags, see below */
+	unsigned int flags;
+	/* parent bfq_data */
+	struct bfq_data *bfqd;
+	/* scheduling state */
+	struct bfq_entity entity;
+	struct bfq_group *bfqg;
+	/* sorted list of pending requests */
+	struct rb_root sort_list;
+	/* if fifo isn't expired, next request to serve */
+	struct request *next_rq;
+	/* requests queued in sort_list */
+	int queued[2];
+	/* currently allocated requests */
+	int allocated[2];
+	/* fifo list of requests in sort_list */
+	struct list_head fifo;
+
+	/* budget granted next time the queue is scheduled, in sectors */
+	unsigned long max_budget;
+	unsigned long budget_timeout;
+
+	/* number of requests that are on the dispatch list or inside driver */
+	int dispatched;
+
+	/* io prio of this group */
+	unsigned short ioprio, ioprio_class;
+
+	pid_t pid;
+
+	u32 seek_history;
+	sector_t last_request_pos;
+
+	int meta_pending;
+
+	/* weight raising */
+	unsigned int wr_coeff;
+	unsigned long last_wr_start_finish;
+	unsigned long wr_cur_max_time;
+	unsigned long soft_rt_next_start;
+	unsigned long last_idle_bklogged;
+	unsigned long service_from_backlogged;
+};
+
+/*
+ * Per block device queue structure
+ */
+struct bfq_data {
+	struct request_queue *queue;
+
+	struct bfq_group root_group;
+#ifdef CONFIG_BFQ_GROUP_IOSCHED
+	struct hlist_head bfqg_list;
+#endif
+
+	int busy_queues;
+	int wr_busy_queues;
+	int rq_queued;
+	int rq_in_driver;
+	int sync_flight;
+
+	/*
+	 * idle window management
+	 */
+	struct timer_list idle_slice_timer;
+	struct work_struct unplug_work;
+
+	struct bfq_queue *in_service_queue;
+	struct bfq_io_context *in_service_cic;
+	unsigned long in_service_start;
+
+	sector_t last_position;
+
+	/*
+	 * peak rate estimation, used to size the maximum budget
+	 */
+	ktime_t last_budget_start;
+	ktime_t last_idling_start;
+	u64 peak_rate;
+	int peak_rate_samples;
+	unsigned long bfq_max_budget;
+
+	/*
+	 * async queue for each priority case
+	 */
+	struct bfq_queue *async_bfqq[2][IOPRIO_BE_NR];
+	struct bfq_queue *async_idle_bfqq;
+
+	unsigned long bfq_class_idle_last_service;
+
+	/*
+	 * tunables, see top of file
+	 */
+	unsigned int bfq_quantum;
+	unsigned int bfq_fifo_expire[2];
+	unsigned int bfq_back_penalty;
+	unsigned int bfq_back_max;
+	unsigned int bfq_slice_idle;
+	unsigned int bfq_max_budget_async_rq;
+	unsigned int bfq_user_max_budget;
+	unsigned int bfq_timeout[2];
+
+	unsigned int low_latency;
+	unsigned int bfq_wr_coeff;
+	unsigned int bfq_wr_max_time;
+	unsigned int bfq_wr_rt_max_time;
+	unsigned int bfq_wr_min_idle_time;
+	unsigned int bfq_wr_max_softrt_rate;
+
+	struct list_head cic_list;
+
+	/*
+	 * Fallback dummy bfqq for extreme OOM conditions
+	 */
+	struct bfq_queue oom_bfqq;
+
+	unsigned int cic_index;
+	struct rcu_head rcu;
+};
+
+/*
+ * Why the in-service queue stopped being served. Drives both the budget
+ * given to the queue next time and, for a timeout, what it is charged.
+ */
+enum bfqq_expiration {
+	BFQ_BFQQ_TOO_IDLE,		/* idled for too long */
+	BFQ_BFQQ_BUDGET_TIMEOUT,	/* budget took too long to be used */
+	BFQ_BFQQ_BUDGET_EXHAUSTED,	/* budget consumed */
+	BFQ_BFQQ_NO_MORE_REQUESTS,	/* the queue has no more requests */
+};
+
+enum bfqq_state_flags {
+	BFQ_BFQQ_FLAG_busy = 0,		/* has requests or is in service */
+	BFQ_BFQQ_FLAG_wait_request,	/* waiting for a request */
+	BFQ_BFQQ_FLAG_must_alloc,	/* must be allowed rq alloc */
+	BFQ_BFQQ_FLAG_fifo_expire,	/* FIFO checked in this budget */
+	BFQ_BFQQ_FLAG_idle_window,	/* slice idling enabled */
+	BFQ_BFQQ_FLAG_prio_changed,	/* task priority has changed */
+	BFQ_BFQQ_FLAG_sync,		/* synchronous queue */
+	BFQ_BFQQ_FLAG_budget_new,	/* no completion with this budget */
+};
+
+#define BFQ_BFQQ_FNS(name)						\
+static inline void bfq_mark_bfqq_##name(struct bfq_queue *bfqq)		\
+{									\
+	(bfqq)->flags |= (1 << BFQ_BFQQ_FLAG_##name);			\
+}									\
+static inline void bfq_clear_bfqq_##name(struct bfq_queue *bfqq)	\
+{									\
+	(bfqq)->flags &= ~(1 << BFQ_BFQQ_FLAG_##name);			\
+}									\
+static inline int bfq_bfqq_##name(const struct bfq_queue *bfqq)		\
+{									\
+	return ((bfqq)->flags & (1 << BFQ_BFQQ_FLAG_##name)) != 0;	\
+}
+
+BFQ_BFQQ_FNS(busy);
+BFQ_BFQQ_FNS(wait_request);
+BFQ_BFQQ_FNS(must_alloc);
+BFQ_BFQQ_FNS(fifo_expire);
+BFQ_BFQQ_FNS(idle_window);
+BFQ_BFQQ_FNS(prio_changed);
+BFQ_BFQQ_FNS(sync);
+BFQ_BFQQ_FNS(budget_new);
+#undef BFQ_BFQQ_FNS
+
+#define bfq_log_bfqq(bfqd, bfqq, fmt, args...)	\
+	blk_add_trace_msg((bfqd)->queue, "bfq%d " fmt, (bfqq)->pid, ##args)
+#define bfq_log(bfqd, fmt, args...)	\
+	blk_add_trace_msg((bfqd)->queue, "bfq " fmt, ##args)
+
+#ifdef CONFIG_BFQ_GROUP_IOSCHED
+static inline void bfq_blkiocg_update_io_add_stats(struct bfq_queue *bfqq,
+						   struct request *rq)
+{
+	struct bfq_queue *in_service = bfqq->bfqd->in_service_queue;
+
+	blkiocg_update_io_add_stats(&bfqq->bfqg->blkg,
+			in_service ? &in_service->bfqg->blkg : NULL,
+			rq_data_dir(rq), rq_is_sync(rq));
+}
+
+static inline void bfq_blkiocg_update_io_remove_stats(struct bfq_queue *bfqq,
+						      struct request *rq)
+{
+	blkiocg_update_io_remove_stats(&bfqq->bfqg->blkg, rq_data_dir(rq),
+				       rq_is_sync(rq));
+}
+
+static inline void bfq_blkiocg_update_io_merged_stats(struct bfq_queue *bfqq,
+					bool direction, bool sync)
+{
+	blkiocg_update_io_merged_stats(&bfqq->bfqg->blkg, direction, sync);
+}
+
+static inline void bfq_blkiocg_update_dispatch_stats(struct bfq_queue *bfqq,
+						     struct request *rq)
+{
+	blkiocg_update_dispatch_stats(&bfqq->bfqg->blkg, blk_rq_bytes(rq),
+				      rq_data_dir(rq), rq_is_sync(rq));
+}
+
+static inline void
+bfq_blkiocg_update_completion_stats(struct bfq_queue *bfqq, struct request *rq)
+{
+	blkiocg_update_completion_stats(&bfqq->bfqg->blkg,
+			rq_start_time_ns(rq), rq_io_start_time_ns(rq),
+			rq_data_dir(rq), rq_is_sync(rq));
+}
+
+static inline void bfq_blkiocg_update_timeslice_used(struct bfq_queue *bfqq,
+						     unsigned long time)
+{
+	blkiocg_update_timeslice_used(&bfqq->bfqg->blkg, time);
+}
+#else /* BFQ_GROUP_IOSCHED */
+static inline void bfq_blkiocg_update_io_add_stats(struct bfq_queue *bfqq,
+						   struct request *rq) {}
+static inline void bfq_blkiocg_update_io_remove_stats(struct bfq_queue *bfqq,
+						      struct request *rq) {}
+static inline void bfq_blkiocg_update_io_merged_stats(struct bfq_queue *bfqq,
+					bool direction, bool sync) {}
+static inline void bfq_blkiocg_update_dispatch_stats(struct bfq_queue *bfqq,
+						     struct request *rq) {}
+static inline void
+bfq_blkiocg_update_completion_stats(struct bfq_queue *bfqq,
+				    struct request *rq) {}
+static inline void bfq_blkiocg_update_timeslice_used(struct bfq_queue *bfqq,
+						     unsigned long time) {}
+#endif /* BFQ_GROUP_IOSCHED */
+
+static void bfq_dispatch_insert(struct request_queue *, struct request *);
+static struct bfq_queue *bfq_get_queue(struct bfq_data *, bool,
+				       struct io_context *, gfp_t);
+static struct bfq_io_context *bfq_cic_lookup(struct bfq_data *,
+					     struct io_context *);
+
+static inline struct bfq_queue *cic_to_bfqq(struct bfq_io_context *cic,
+					    bool is_sync)
+{
+	return cic->bfqq[is_sync];
+}
+
+static inline void cic_set_bfqq(struct bfq_io_context *cic,
+				struct bfq_queue *bfqq, bool is_sync)
+{
+	cic->bfqq[is_sync] = bfqq;
+}
+
+#define CIC_DEAD_KEY	1ul
+#define CIC_DEAD_INDEX_SHIFT	1
+
+static inline void *bfqd_dead_key(struct bfq_data *bfqd)
+{
+	return (void *)(bfqd->cic_index << CIC_DEAD_INDEX_SHIFT | CIC_DEAD_KEY);
+}
+
+static inline struct bfq_data *cic_to_bfqd(struct bfq_io_context *cic)
+{
+	struct bfq_data *bfqd = cic->key;
+
+	if (unlikely((unsigned long) bfqd & CIC_DEAD_KEY))
+		return NULL;
+
+	return bfqd;
+}
+
+/*
+ * We regard a request as SYNC, if it's either a read or has the SYNC bit
+ * set (in which case it could also be direct WRITE).
+ */
+static inline bool bfq_bio_sync(struct bio *bio)
+{
+	return bio_data_dir(bio) == READ || (bio->bi_rw & REQ_SYNC);
+}
+
+/*
+ * scheduler run of queue, if there are requests pending and no one in the
+ * driver that will restart queueing
+ */
+static inline void bfq_schedule_dispatch(struct bfq_data *bfqd)
+{
+	if (bfqd->busy_queues) {
+		bfq_log(bfqd, "schedule dispatch");
+		kblockd_schedule_work(bfqd->queue, &bfqd->unplug_work);
+	}
+}
+
+static int bfq_queue_empty(struct request_queue *q)
+{
+	struct bfq_data *bfqd = q->elevator->elevator_data;
+
+	return !bfqd->rq_queued;
+}
+
+/*
+ * Jiffies values far enough in the past, or in the future, to never
+ * compare the wrong way during the lifetime of a queue.
+ */
+static inline unsigned long bfq_smallest_from_now(void)
+{
+	return jiffies - MAX_JIFFY_OFFSET;
+}
+
+static inline unsigned long bfq_infinity_from_now(unsigned long now)
+{
+	return now + ULONG_MAX / 2;
+}
+
+/*
+ * Weights of the queues of the best effort levels, scaled so that the
+ * default priority gets the blkio default weight: queues and groups
+ * then compete on the same footing in the root level.
+ */
+static inline unsigned int bfq_ioprio_to_weight(int ioprio)
+{
+	WARN_ON(ioprio < 0 || ioprio >= IOPRIO_BE_NR);
+	return BLKIO_WEIGHT_DEFAULT * (IOPRIO_BE_NR - ioprio) /
+		(IOPRIO_BE_NR / 2);
+}
+
+/*
+ * Virtual time arithmetic: compare with wraparound, and turn service into
+ * virtual time for a given weight.
+ */
+static inline int bfq_gt(u64 a, u64 b)
+{
+	return (s64)(a - b) > 0;
+}
+
+static inline u64 bfq_delta(unsigned long service, unsigned long weight)
+{
+	return div_u64((u64)service << WFQ_SERVICE_SHIFT, weight);
+}
+
+static inline void bfq_calc_finish(struct bfq_entity *entity,
+				   unsigned long service)
+{
+	entity->finish = entity->start + bfq_delta(service, entity->weight);
+}
+
+static inline struct bfq_queue *bfq_entity_to_bfqq(struct bfq_entity *entity)
+{
+	if (entity->my_sched_data)
+		return NULL;
+	return container_of(entity, struct bfq_queue, entity);
+}
+
+static inline struct bfq_service_tree *
+bfq_entity_service_tree(struct bfq_entity *entity)
+{
+	return entity->sched_data->service_tree + entity->ioprio_class - 1;
+}
+
+static inline bool bfq_sd_empty(struct bfq_sched_data *sd)
+{
+	int i;
+
+	if (sd->in_service_entity)
+		return false;
+	for (i = 0; i < BFQ_IOPRIO_CLASSES; i++)
+		if (!RB_EMPTY_ROOT(&sd->service_tree[i].active))
+			return false;
+	return true;
+}
+
+/*
+ * Keep ->min_start of a node equal to the minimum start time in the
+ * subtree rooted at it.
+ */
+static void bfq_update_min(struct rb_node *node, void *data)
+{
+	struct bfq_entity *entity, *child;
+
+	entity = rb_entry(node, struct bfq_entity, rb_node);
+	entity->min_start = entity->start;
+
+	if (node->rb_left) {
+		child = rb_entry(node->rb_left, struct bfq_entity, rb_node);
+		if (bfq_gt(entity->min_start, child->min_start))
+			entity->min_start = child->min_start;
+	}
+	if (node->rb_right) {
+		child = rb_entry(node->rb_right, struct bfq_entity, rb_node);
+		if (bfq_gt(entity->min_start, child->min_start))
+			entity->min_start = child->min_start;
+	}
+}
+
+static void bfq_st_insert(struct bfq_service_tree *st,
+			  struct bfq_entity *entity)
+{
+	struct rb_node **p = &st->active.rb_node;
+	struct rb_node *parent = NULL;
+	struct bfq_entity *entry;
+
+	while (*p) {
+		parent = *p;
+		entry = rb_entry(parent, struct bfq_entity, rb_node);
+
+		if (bfq_gt(entry->finish, entity->finish))
+			p = &parent->rb_left;
+		else
+			p = &parent->rb_right;
+	}
+
+	rb_link_node(&entity->rb_node, parent, p);
+	rb_insert_color(&entity->rb_node, &st->active);
+	rb_augment_insert(&entity->rb_node, bfq_update_min, NULL);
+}
+
+static void bfq_st_extract(struct bfq_service_tree *st,
+			   struct bfq_entity *entity)
+{
+	struct rb_node *deepest;
+
+	deepest = rb_augment_erase_begin(&entity->rb_node);
+	rb_erase(&entity->rb_node, &st->active);
+	RB_CLEAR_NODE(&entity->rb_node);
+	rb_augment_erase_end(deepest, bfq_update_min, NULL);
+}
+
+/*
+ * Apply a pending weight or class change. The caller takes care of the
+ * weight sum of the service tree(s) involved.
+ */
+static void bfq_entity_apply_changes(struct bfq_entity *entity)
+{
+	if (!entity->ioprio_changed)
+		return;
+
+	smp_rmb();
+	entity->weight = entity->new_weight;
+	entity->ioprio_class = entity->new_ioprio_class;
+	entity->ioprio_changed = 0;
+}
+
+/*
+ * Make an idle entity, and its ancestors if needed, active. A queue
+ * comes back with its old finish time as start time if that is still in
+ * the future, so going briefly idle does not earn it extra service.
+ */
+static void bfq_activate_entity(struct bfq_data *bfqd,
+				struct bfq_entity *entity)
+{
+	struct bfq_service_tree *st;
+
+	for (; entity; entity = entity->parent) {
+		if (entity->on_st)
+			break;
+
+		if (entity->ioprio_changed) {
+			if (entity->new_ioprio_class != entity->ioprio_class)
+				entity->finish = 0;
+			bfq_entity_apply_changes(entity);
+		}
+
+		if (entity->my_sched_data)
+			entity->budget = bfqd->bfq_max_budget;
+
+		st = bfq_entity_service_tree(entity);
+		entity->start = st->vtime;
+		if (bfq_gt(entity->finish, st->vtime))
+			entity->start = entity->finish;
+		bfq_calc_finish(entity, entity->budget);
+
+		bfq_st_insert(st, entity);
+		st->wsum += entity->weight;
+		entity->on_st = 1;
+	}
+}
+
+/*
+ * Make an entity that is not in service idle, and its ancestors too if
+ * they are left with nothing to schedule.
+ */
+static void bfq_deactivate_entity(struct bfq_entity *entity)
+{
+	struct bfq_service_tree *st;
+
+	for (; entity; entity = entity->parent) {
+		BUG_ON(!entity->on_st);
+
+		/* an entity in service is dealt with at expiration */
+		if (entity->sched_data->in_service_entity == entity)
+			break;
+
+		st = bfq_entity_service_tree(entity);
+		bfq_st_extract(st, entity);
+		st->wsum -= entity->weight;
+		entity->on_st = 0;
+
+		if (!bfq_sd_empty(entity->sched_data))
+			break;
+	}
+}
+
+/*
+ * Put an entity that was in service back on its tree, after it has been
+ * charged for the service received.
+ */
+static void bfq_requeue_entity(struct bfq_entity *entity)
+{
+	struct bfq_service_tree *st = bfq_entity_service_tree(entity);
+
+	if (entity->ioprio_changed) {
+		unsigned short old_class = entity->ioprio_class;
+
+		st->wsum -= entity->weight;
+		bfq_entity_apply_changes(entity);
+		st = bfq_entity_service_tree(entity);
+		st->wsum += entity->weight;
+		if (entity->ioprio_class != old_class)
+			entity->start = st->vtime;
+	}
+
+	bfq_calc_finish(entity, entity->budget);
+	bfq_st_insert(st, entity);
+}
+
+/*
+ * The in-service queue stopped being served: charge every entity on the
+ * path to the root for the service it received, and requeue those that
+ * still have work.
+ */
+static void bfq_expire_entities(struct bfq_data *bfqd,
+				struct bfq_entity *entity, bool requeue)
+{
+	struct bfq_service_tree *st;
+
+	for (; entity; entity = entity->parent) {
+		BUG_ON(entity->sched_data->in_service_entity != entity);
+		entity->sched_data->in_service_entity = NULL;
+
+		bfq_calc_finish(entity, entity->service);
+		entity->start = entity->finish;
+		entity->service = 0;
+
+		if (entity->my_sched_data) {
+			requeue = !bfq_sd_empty(entity->my_sched_data);
+			entity->budget = bfqd->bfq_max_budget;
+		}
+
+		if (requeue)
+			bfq_requeue_entity(entity);
+		else {
+			st = bfq_entity_service_tree(entity);
+			st->wsum -= entity->weight;
+			entity->on_st = 0;
+		}
+	}
+}
+
+/*
+ * Move a queue whose budget changed to its new place in the tree.
+ */
+static void bfq_reposition_entity(struct bfq_entity *entity)
+{
+	struct bfq_service_tree *st = bfq_entity_service_tree(entity);
+
+	if (RB_EMPTY_NODE(&entity->rb_node))
+		return;
+
+	bfq_st_extract(st, entity);
+	bfq_calc_finish(entity, entity->budget);
+	bfq_st_insert(st, entity);
+}
+
+/*
+ * If no active entity is eligible, i.e. has start <= vtime, jump the
+ * virtual time forward to the smallest start time.
+ */
+static void bfq_update_vtime(struct bfq_service_tree *st)
+{
+	struct bfq_entity *entry;
+	struct rb_node *node = st->active.rb_node;
+
+	entry = rb_entry(node, struct bfq_entity, rb_node);
+	if (bfq_gt(entry->min_start, st->vtime))
+		st->vtime = entry->min_start;
+}
+
+/*
+ * Find the eligible entity with the smallest finish time: go left as
+ * long as the left subtree holds eligible entities.
+ */
+static struct bfq_entity *bfq_first_active_entity(struct bfq_service_tree *st)
+{
+	struct bfq_entity *entry, *first = NULL;
+	struct rb_node *node = st->active.rb_node;
+
+	while (node) {
+		entry = rb_entry(node, struct bfq_entity, rb_node);
+left:
+		if (!bfq_gt(entry->start, st->vtime))
+			first = entry;
+
+		if (node->rb_left) {
+			entry = rb_entry(node->rb_left, struct bfq_entity,
+					 rb_node);
+			if (!bfq_gt(entry->min_start, st->vtime)) {
+				node = node->rb_left;
+				goto left;
+			}
+		}
+		if (first)
+			break;
+		node = node->rb_right;
+	}
+
+	return first;
+}
+
+static struct bfq_entity *__bfq_lookup_next_entity(struct bfq_service_tree *st)
+{
+	if (RB_EMPTY_ROOT(&st->active))
+		return NULL;
+
+	bfq_update_vtime(st);
+	return bfq_first_active_entity(st);
+}
+
+/*
+ * Pick the next entity to serve in a level and take it off its tree.
+ * Classes are served in strict priority order, except that the idle
+ * class is not starved forever.
+ */
+static struct bfq_entity *bfq_lookup_next_entity(struct bfq_data *bfqd,
+						 struct bfq_sched_data *sd)
+{
+	struct bfq_service_tree *st = sd->service_tree;
+	struct bfq_entity *entity;
+	int i = 0;
+
+	BUG_ON(sd->in_service_entity);
+
+	if (!RB_EMPTY_ROOT(&st[BFQ_IOPRIO_CLASSES - 1].active) &&
+	    time_after(jiffies, bfqd->bfq_class_idle_last_service +
+				BFQ_CL_IDLE_TIMEOUT))
+		i = BFQ_IOPRIO_CLASSES - 1;
+
+	for (; i < BFQ_IOPRIO_CLASSES; i++) {
+		entity = __bfq_lookup_next_entity(st + i);
+		if (entity) {
+			bfq_st_extract(st + i, entity);
+			sd->in_service_entity = entity;
+			return entity;
+		}
+	}
+
+	return NULL;
+}
+
+static struct bfq_queue *bfq_get_next_queue(struct bfq_data *bfqd)
+{
+	struct bfq_sched_data *sd = &bfqd->root_group.sched_data;
+	struct bfq_entity *entity;
+
+	if (!bfqd->busy_queues)
+		return NULL;
+
+	for (;;) {
+		entity = bfq_lookup_next_entity(bfqd, sd);
+		BUG_ON(!entity);
+		if (!entity->my_sched_data)
+			return bfq_entity_to_bfqq(entity);
+		sd = entity->my_sched_data;
+	}
+}
+
+/*
+ * Account service to the in-service queue and all its ancestors, and
+ * advance the virtual time of every level accordingly.
+ */
+static void bfq_bfqq_served(struct bfq_queue *bfqq, unsigned long served)
+{
+	struct bfq_entity *entity = &bfqq->entity;
+	struct bfq_service_tree *st;
+
+	for (; entity; entity = entity->parent) {
+		st = bfq_entity_service_tree(entity);
+		entity->service += served;
+		st->vtime += bfq_delta(served, st->wsum);
+	}
+
+	bfqq->service_from_backlogged += served;
+}
+
+/*
+ * A queue that wasted its budget timeout is charged as if it had used
+ * its whole budget, so that seeky queues get the throughput they deserve
+ * and not the share of time.
+ */
+static void bfq_bfqq_charge_full_budget(struct bfq_queue *bfqq)
+{
+	struct bfq_entity *entity = &bfqq->entity;
+
+	if (entity->service < entity->budget)
+		bfq_bfqq_served(bfqq, entity->budget - entity->service);
+}
+
+static inline unsigned long bfq_min_budget(struct bfq_data *bfqd)
+{
+	return bfqd->bfq_max_budget / 32;
+}
+
+static inline unsigned long bfq_bfqq_budget_left(struct bfq_queue *bfqq)
+{
+	struct bfq_entity *entity = &bfqq->entity;
+
+	return entity->budget - entity->service;
+}
+
+/*
+ * Async requests are charged more than their size, so that a writer
+ * cannot take a large share of the device away from sync readers just
+ * because its requests complete quickly into the device cache.
+ */
+static inline unsigned long bfq_serv_to_charge(struct request *rq,
+					       struct bfq_queue *bfqq)
+{
+	if (bfq_bfqq_sync(bfqq) || bfqq->wr_coeff > 1)
+		return blk_rq_sectors(rq);
+
+	return blk_rq_sectors(rq) * bfq_async_charge_factor;
+}
+
+static inline void bfq_update_entity_weight(struct bfq_queue *bfqq)
+{
+	struct bfq_entity *entity = &bfqq->entity;
+
+	entity->new_weight = entity->orig_weight * bfqq->wr_coeff;
+	entity->new_ioprio_class = bfqq->ioprio_class;
+	smp_wmb();
+	entity->ioprio_changed = 1;
+}
+
+/*
+ * Lifted from AS - choose which of rq1 and rq2 that is best served now.
+ * We choose the request that is closest to the head right now. Distance
+ * behind the head is penalized and only allowed to a certain extent.
+ */
+static struct request *
+bfq_choose_req(struct bfq_data *bfqd, struct request *rq1, struct request *rq2, sector_t last)
+{
+	sector_t s1, s2, d1 = 0, d2 = 0;
+	unsigned long back_max;
+#define BFQ_RQ1_WRAP	0x01 /* request 1 wraps */
+#define BFQ_RQ2_WRAP	0x02 /* request 2 wraps */
+	unsigned wrap = 0; /* bit mask: requests behind the disk head? */
+
+	if (rq1 == NULL || rq1 == rq2)
+		return rq2;
+	if (rq2 == NULL)
+		return rq1;
+
+	if (rq_is_sync(rq1) && !rq_is_sync(rq2))
+		return rq1;
+	else if (rq_is_sync(rq2) && !rq_is_sync(rq1))
+		return rq2;
+	if ((rq1->cmd_flags & REQ_META) && !(rq2->cmd_flags & REQ_META))
+		return rq1;
+	else if ((rq2->cmd_flags & REQ_META) &&
+		 !(rq1->cmd_flags & REQ_META))
+		return rq2;
+
+	s1 = blk_rq_pos(rq1);
+	s2 = blk_rq_pos(rq2);
+
+	/*
+	 * by definition, 1KiB is 2 sectors
+	 */
+	back_max = bfqd->bfq_back_max * 2;
+
+	/*
+	 * Strict one way elevator _except_ in the case where we allow
+	 * short backward seeks which are biased as twice the cost of a
+	 * similar forward seek.
+	 */
+	if (s1 >= last)
+		d1 = s1 - last;
+	else if (s1 + back_max >= last)
+		d1 = (last - s1) * bfqd->bfq_back_penalty;
+	else
+		wrap |= BFQ_RQ1_WRAP;
+
+	if (s2 >= last)
+		d2 = s2 - last;
+	else if (s2 + back_max >= last)
+		d2 = (last - s2) * bfqd->bfq_back_penalty;
+	else
+		wrap |= BFQ_RQ2_WRAP;
+
+	/* Found required data */
+
+	/*
+	 * By doing switch() on the bit mask "wrap" we avoid having to
+	 * check two variables for all permutations: --> faster!
+	 */
+	switch (wrap) {
+	case 0: /* common case: rq1 and rq2 not wrapped */
+		if (d1 < d2)
+			return rq1;
+		else if (d2 < d1)
+			return rq2;
+		else {
+			if (s1 >= s2)
+				return rq1;
+			else
+				return rq2;
+		}
+
+	case BFQ_RQ2_WRAP:
+		return rq1;
+	case BFQ_RQ1_WRAP:
+		return rq2;
+	case (BFQ_RQ1_WRAP|BFQ_RQ2_WRAP): /* both rqs wrapped */
+	default:
+		/*
+		 * Since both rqs are wrapped,
+		 * start with the one that's further behind head
+		 * (--> only *one* back seek required),
+		 * since back seek takes more time than forward.
+		 */
+		if (s1 <= s2)
+			return rq1;
+		else
+			return rq2;
+	}
+}
+
+static struct request *
+bfq_find_next_rq(struct bfq_data *bfqd, struct bfq_queue *bfqq,
+		 struct request *last)
+{
+	struct rb_node *rbnext = rb_next(&last->rb_node);
+	struct rb_node *rbprev = rb_prev(&last->rb_node);
+	struct request *next = NULL, *prev = NULL;
+
+	BUG_ON(RB_EMPTY_NODE(&last->rb_node));
+
+	if (rbprev)
+		prev = rb_entry_rq(rbprev);
+
+	if (rbnext)
+		next = rb_entry_rq(rbnext);
+	else {
+		rbnext = rb_first(&bfqq->sort_list);
+		if (rbnext && rbnext != &last->rb_node)
+			next = rb_entry_rq(rbnext);
+	}
+
+	return bfq_choose_req(bfqd, next, prev, blk_rq_pos(last));
+}
+
+/*
+ * The next request of a queue waiting to be served changed: make sure
+ * its budget is large enough to serve it.
+ */
+static void bfq_updated_next_req(struct bfq_data *bfqd,
+				 struct bfq_queue *bfqq)
+{
+	struct bfq_entity *entity = &bfqq->entity;
+	unsigned long new_budget;
+
+	if (!bfqq->next_rq || bfqq == bfqd->in_service_queue)
+		return;
+
+	new_budget = max_t(unsigned long, bfqq->max_budget,
+			   bfq_serv_to_charge(bfqq->next_rq, bfqq));
+	if (entity->budget != new_budget) {
+		entity->budget = new_budget;
+		bfq_reposition_entity(entity);
+	}
+}
+
+/*
+ * Soft real-time queues issue their I/O in bursts at a bounded rate and
+ * go idle in between. The queue is considered soft real-time on its next
+ * activation only if that happens after the time at which, had the
+ * queue kept to the maximum rate, its last burst would have completed.
+ */
+static unsigned long bfq_bfqq_softrt_next_start(struct bfq_data *bfqd,
+						struct bfq_queue *bfqq)
+{
+	return max(bfqq->last_idle_bklogged +
+		   HZ * bfqq->service_from_backlogged /
+		   bfqd->bfq_wr_max_softrt_rate,
+		   jiffies + bfqd->bfq_slice_idle + 4);
+}
+
+/*
+ * Decide, as a queue becomes busy, whether it deserves weight raising:
+ * either it was idle for a long time (a newly started or woken up
+ * interactive application), or it behaves as a soft real-time one.
+ */
+static void bfq_bfqq_handle_wr(struct bfq_data *bfqd, struct bfq_queue *bfqq)
+{
+	int idle_for_long_time, soft_rt;
+	unsigned int old_wr_coeff = bfqq->wr_coeff;
+
+	if (!bfqd->low_latency || !bfq_bfqq_sync(bfqq))
+		return;
+
+	idle_for_long_time = time_after(jiffies, bfqq->budget_timeout +
+					bfqd->bfq_wr_min_idle_time);
+	soft_rt = bfqd->bfq_wr_max_softrt_rate > 0 &&
+		time_after(jiffies, bfqq->soft_rt_next_start);
+
+	if (idle_for_long_time) {
+		bfqq->wr_coeff = bfqd->bfq_wr_coeff;
+		bfqq->wr_cur_max_time = bfqd->bfq_wr_max_time;
+		bfqq->last_wr_start_finish = jiffies;
+	} else if (soft_rt && (bfqq->wr_coeff == 1 ||
+		   bfqq->wr_cur_max_time == bfqd->bfq_wr_rt_max_time)) {
+		bfqq->wr_coeff = bfqd->bfq_wr_coeff;
+		bfqq->wr_cur_max_time = bfqd->bfq_wr_rt_max_time;
+		bfqq->last_wr_start_finish = jiffies;
+	}
+
+	if (bfqq->wr_coeff != old_wr_coeff) {
+		bfq_log_bfqq(bfqd, bfqq, "wr start %s",
+			     idle_for_long_time ? "interactive" : "soft-rt");
+		bfq_update_entity_weight(bfqq);
+	}
+}
+
+static void bfq_bfqq_end_wr(struct bfq_data *bfqd, struct bfq_queue *bfqq)
+{
+	if (bfq_bfqq_busy(bfqq))
+		bfqd->wr_busy_queues--;
+	bfqq->wr_coeff = 1;
+	bfqq->last_wr_start_finish = jiffies;
+	bfq_update_entity_weight(bfqq);
+	bfq_log_bfqq(bfqd, bfqq, "wr end");
+}
+
+/*
+ * Called on dispatch from the in-service queue: stop raising its weight
+ * once the raising period is over.
+ */
+static void bfq_update_wr_data(struct bfq_data *bfqd, struct bfq_queue *bfqq)
+{
+	if (bfqq->wr_coeff == 1)
+		return;
+
+	if (!bfqd->low_latency ||
+	    time_after(jiffies, bfqq->last_wr_start_finish +
+				bfqq->wr_cur_max_time))
+		bfq_bfqq_end_wr(bfqd, bfqq);
+}
+
+/*
+ * Add a queue to the set of queues competing for the device.
+ */
+static void bfq_add_bfqq_busy(struct bfq_data *bfqd, struct bfq_queue *bfqq)
+{
+	struct bfq_entity *entity = &bfqq->entity;
+
+	BUG_ON(bfq_bfqq_busy(bfqq));
+
+	if (!bfqq->dispatched) {
+		bfqq->last_idle_bklogged = jiffies;
+		bfqq->service_from_backlogged = 0;
+	}
+
+	bfq_bfqq_handle_wr(bfqd, bfqq);
+
+	entity->budget = max_t(unsigned long, bfqq->max_budget,
+			       bfq_serv_to_charge(bfqq->next_rq, bfqq));
+
+	bfq_log_bfqq(bfqd, bfqq, "add_to_busy budget %lu", entity->budget);
+	bfq_mark_bfqq_busy(bfqq);
+	bfqd->busy_queues++;
+	if (bfqq->wr_coeff > 1)
+		bfqd->wr_busy_queues++;
+
+	bfq_activate_entity(bfqd, entity);
+}
+
+/*
+ * Remove a queue from the busy set. Its entity is taken care of by the
+ * caller, as that depends on whether the queue is in service.
+ */
+static void bfq_del_bfqq_busy(struct bfq_data *bfqd, struct bfq_queue *bfqq)
+{
+	BUG_ON(!bfq_bfqq_busy(bfqq));
+
+	bfq_log_bfqq(bfqd, bfqq, "del_from_busy");
+	bfq_clear_bfqq_busy(bfqq);
+	BUG_ON(!bfqd->busy_queues);
+	bfqd->busy_queues--;
+	if (bfqq->wr_coeff > 1)
+		bfqd->wr_busy_queues--;
+}
+
+/*
+ * rb tree support functions
+ */
+static void bfq_del_rq_rb(struct request *rq)
+{
+	struct bfq_queue *bfqq = RQ_BFQQ(rq);
+	struct bfq_data *bfqd = bfqq->bfqd;
+	const int sync = rq_is_sync(rq);
+
+	BUG_ON(!bfqq->queued[sync]);
+	bfqq->queued[sync]--;
+
+	elv_rb_del(&bfqq->sort_list, rq);
+
+	/*
+	 * The in-service queue is only deactivated when it expires,
+	 * any other queue goes idle as soon as it is empty.
+	 */
+	if (bfq_bfqq_busy(bfqq) && bfqq != bfqd->in_service_queue &&
+	    RB_EMPTY_ROOT(&bfqq->sort_list)) {
+		bfq_del_bfqq_busy(bfqd, bfqq);
+		bfq_deactivate_entity(&bfqq->entity);
+	}
+}
+
+static void bfq_add_rq_rb(struct request *rq)
+{
+	struct bfq_queue *bfqq = RQ_BFQQ(rq);
+	struct bfq_data *bfqd = bfqq->bfqd;
+	struct request *__alias, *prev;
+
+	bfqq->queued[rq_is_sync(rq)]++;
+
+	/*
+	 * looks a little odd, but the first insert might return an alias.
+	 * if that happens, put the alias on the dispatch list
+	 */
+	while ((__alias = elv_rb_add(&bfqq->sort_list, rq)) != NULL)
+		bfq_dispatch_insert(bfqd->queue, __alias);
+
+	/*
+	 * check if this request is a better next-serve candidate
+	 */
+	prev = bfqq->next_rq;
+	bfqq->next_rq = bfq_choose_req(bfqd, bfqq->next_rq, rq,
+				       bfqd->last_position);
+	BUG_ON(!bfqq->next_rq);
+
+	if (!bfq_bfqq_busy(bfqq))
+		bfq_add_bfqq_busy(bfqd, bfqq);
+	else if (prev != bfqq->next_rq)
+		bfq_updated_next_req(bfqd, bfqq);
+}
+
+static void bfq_reposition_rq_rb(struct bfq_queue *bfqq, struct request *rq)
+{
+	elv_rb_del(&bfqq->sort_list, rq);
+	bfqq->queued[rq_is_sync(rq)]--;
+	bfq_blkiocg_update_io_remove_stats(bfqq, rq);
+	bfq_add_rq_rb(rq);
+	bfq_blkiocg_update_io_add_stats(bfqq, rq);
+}
+
+static struct request *
+bfq_find_rq_fmerge(struct bfq_data *bfqd, struct bio *bio)
+{
+	struct task_struct *tsk = current;
+	struct bfq_io_context *cic;
+	struct bfq_queue *bfqq;
+
+	cic = bfq_cic_lookup(bfqd, tsk->io_context);
+	if (!cic)
+		return NULL;
+
+	bfqq = cic_to_bfqq(cic, bfq_bio_sync(bio));
+	if (bfqq) {
+		sector_t sector = bio->bi_sector + bio_sectors(bio);
+
+		return elv_rb_find(&bfqq->sort_list, sector);
+	}
+
+	return NULL;
+}
+
+static void bfq_activate_request(struct request_queue *q, struct request *rq)
+{
+	struct bfq_data *bfqd = q->elevator->elevator_data;
+
+	bfqd->rq_in_driver++;
+	bfqd->last_position = blk_rq_pos(rq) + blk_rq_sectors(rq);
+	bfq_log_bfqq(bfqd, RQ_BFQQ(rq), "activate rq, drv=%d",
+		     bfqd->rq_in_driver);
+}
+
+static void bfq_deactivate_request(struct request_queue *q, struct request *rq)
+{
+	struct bfq_data *bfqd = q->elevator->elevator_data;
+
+	WARN_ON(!bfqd->rq_in_driver);
+	bfqd->rq_in_driver--;
+	bfq_log_bfqq(bfqd, RQ_BFQQ(rq), "deactivate rq, drv=%d",
+		     bfqd->rq_in_driver);
+}
+
+static void bfq_remove_request(struct request *rq)
+{
+	struct bfq_queue *bfqq = RQ_BFQQ(rq);
+	struct bfq_data *bfqd = bfqq->bfqd;
+
+	if (bfqq->next_rq == rq) {
+		bfqq->next_rq = bfq_find_next_rq(bfqd, bfqq, rq);
+		bfq_updated_next_req(bfqd, bfqq);
+	}
+
+	list_del_init(&rq->queuelist);
+	bfq_del_rq_rb(rq);
+
+	bfqd->rq_queued--;
+	bfq_blkiocg_update_io_remove_stats(bfqq, rq);
+	if (rq->cmd_flags & REQ_META) {
+		WARN_ON(!bfqq->meta_pending);
+		bfqq->meta_pending--;
+	}
+}
+
+static int bfq_merge(struct request_queue *q, struct request **req,
+		     struct bio *bio)
+{
+	struct bfq_data *bfqd = q->elevator->elevator_data;
+	struct request *__rq;
+
+	__rq = bfq_find_rq_fmerge(bfqd, bio);
+	if (__rq && elv_rq_merge_ok(__rq, bio)) {
+		*req = __rq;
+		return ELEVATOR_FRONT_MERGE;
+	}
+
+	return ELEVATOR_NO_MERGE;
+}
+
+static void bfq_merged_request(struct request_queue *q, struct request *req,
+			       int type)
+{
+	if (type == ELEVATOR_FRONT_MERGE) {
+		struct bfq_queue *bfqq = RQ_BFQQ(req);
+
+		bfq_reposition_rq_rb(bfqq, req);
+	}
+}
+
+static void bfq_bio_merged(struct request_queue *q, struct request *req,
+			   struct bio *bio)
+{
+	bfq_blkiocg_update_io_merged_stats(RQ_BFQQ(req), bio_data_dir(bio),
+					   bfq_bio_sync(bio));
+}
+
+static void
+bfq_merged_requests(struct request_queue *q, struct request *rq,
+		    struct request *next)
+{
+	struct bfq_queue *bfqq = RQ_BFQQ(rq);
+
+	/*
+	 * reposition in fifo if next is older than rq
+	 */
+	if (!list_empty(&rq->queuelist) && !list_empty(&next->queuelist) &&
+	    time_before(rq_fifo_time(next), rq_fifo_time(rq))) {
+		list_move(&rq->queuelist, &next->queuelist);
+		rq_set_fifo_time(rq, rq_fifo_time(next));
+	}
+
+	if (bfqq->next_rq == next)
+		bfqq->next_rq = rq;
+	bfq_remove_request(next);
+	bfq_blkiocg_update_io_merged_stats(bfqq, rq_data_dir(next),
+					   rq_is_sync(next));
+}
+
+static int bfq_allow_merge(struct request_queue *q, struct request *rq,
+			   struct bio *bio)
+{
+	struct bfq_data *bfqd = q->elevator->elevator_data;
+	struct bfq_io_context *cic;
+	struct bfq_queue *bfqq;
+
+	/*
+	 * Disallow merge of a sync bio into an async request.
+	 */
+	if (bfq_bio_sync(bio) && !rq_is_sync(rq))
+		return false;
+
+	/*
+	 * Lookup the bfqq that this bio will be queued with. Allow
+	 * merge only if rq is queued there.
+	 */
+	cic = bfq_cic_lookup(bfqd, current->io_context);
+	if (!cic)
+		return false;
+
+	bfqq = cic_to_bfqq(cic, bfq_bio_sync(bio));
+	return bfqq == RQ_BFQQ(rq);
+}
+
+static void __bfq_set_in_service_queue(struct bfq_data *bfqd,
+				       struct bfq_queue *bfqq)
+{
+	if (bfqq) {
+		bfq_log_bfqq(bfqd, bfqq, "set_in_service budget %lu",
+			     bfqq->entity.budget);
+		bfq_mark_bfqq_budget_new(bfqq);
+		bfq_clear_bfqq_fifo_expire(bfqq);
+		bfq_mark_bfqq_must_alloc(bfqq);
+		bfqd->in_service_start = jiffies;
+	}
+
+	bfqd->in_service_queue = bfqq;
+}
+
+/*
+ * Get and set a new queue for service.
+ */
+static struct bfq_queue *bfq_set_in_service_queue(struct bfq_data *bfqd)
+{
+	struct bfq_queue *bfqq = bfq_get_next_queue(bfqd);
+
+	__bfq_set_in_service_queue(bfqd, bfqq);
+	return bfqq;
+}
+
+/*
+ * The budget timeout only starts with the first completion of a new
+ * budget, so that the time the device takes to get to the queue's
+ * requests is not held against it.
+ */
+static void bfq_set_budget_timeout(struct bfq_data *bfqd,
+				   struct bfq_queue *bfqq)
+{
+	unsigned int timeout_coeff;
+
+	timeout_coeff = bfqq->entity.weight / bfqq->entity.orig_weight;
+	if (!timeout_coeff)
+		timeout_coeff = 1;
+
+	bfqd->last_budget_start = ktime_get();
+	bfq_clear_bfqq_budget_new(bfqq);
+	bfqq->budget_timeout = jiffies +
+		bfqd->bfq_timeout[bfq_bfqq_sync(bfqq)] * timeout_coeff;
+}
+
+static inline int bfq_may_expire_for_budg_timeout(struct bfq_queue *bfqq)
+{
+	return !bfq_bfqq_budget_new(bfqq) &&
+		time_after(jiffies, bfqq->budget_timeout);
+}
+
+static inline int bfq_bfqq_must_idle(struct bfq_queue *bfqq)
+{
+	struct bfq_data *bfqd = bfqq->bfqd;
+
+	return RB_EMPTY_ROOT(&bfqq->sort_list) && bfqd->bfq_slice_idle &&
+		bfq_bfqq_idle_window(bfqq);
+}
+
+static void bfq_arm_slice_timer(struct bfq_data *bfqd)
+{
+	struct bfq_queue *bfqq = bfqd->in_service_queue;
+	struct bfq_io_context *cic;
+	unsigned long sl;
+
+	WARN_ON(!RB_EMPTY_ROOT(&bfqq->sort_list));
+
+	/*
+	 * task has exited, don't wait
+	 */
+	cic = bfqd->in_service_cic;
+	if (!cic || !atomic_read(&cic->ioc->nr_tasks))
+		return;
+
+	bfq_mark_bfqq_wait_request(bfqq);
+
+	/*
+	 * Seeky queues are not worth waiting long for, while raised ones
+	 * get a longer wait so that the next burst of an application being
+	 * started does not lose the device.
+	 */
+	sl = bfqd->bfq_slice_idle;
+	if (BFQQ_SEEKY(bfqq) && bfqq->wr_coeff == 1)
+		sl = min_t(unsigned long, sl, msecs_to_jiffies(BFQ_MIN_TT));
+	else if (bfqq->wr_coeff > 1)
+		sl = sl * 3;
+
+	bfqd->last_idling_start = ktime_get();
+	mod_timer(&bfqd->idle_slice_timer, jiffies + sl);
+	bfq_log(bfqd, "arm idle: %lu", sl);
+}
+
+/*
+ * Move request from internal lists to the request queue dispatch list.
+ */
+static void bfq_dispatch_insert(struct request_queue *q, struct request *rq)
+{
+	struct bfq_data *bfqd = q->elevator->elevator_data;
+	struct bfq_queue *bfqq = RQ_BFQQ(rq);
+
+	bfq_log_bfqq(bfqd, bfqq, "dispatch_insert");
+
+	bfqq->next_rq = bfq_find_next_rq(bfqd, bfqq, rq);
+	bfq_remove_request(rq);
+	bfqq->dispatched++;
+	elv_dispatch_sort(q, rq);
+
+	if (bfq_bfqq_sync(bfqq))
+		bfqd->sync_flight++;
+	bfq_blkiocg_update_dispatch_stats(bfqq, rq);
+}
+
+/*
+ * return expired entry, or NULL to just start from scratch in rbtree
+ */
+static struct request *bfq_check_fifo(struct bfq_queue *bfqq)
+{
+	struct request *rq = NULL;
+
+	if (bfq_bfqq_fifo_expire(bfqq))
+		return NULL;
+
+	bfq_mark_bfqq_fifo_expire(bfqq);
+
+	if (list_empty(&bfqq->fifo))
+		return NULL;
+
+	rq = rq_entry_fifo(bfqq->fifo.next);
+	if (time_before(jiffies, rq_fifo_time(rq)))
+		rq = NULL;
+
+	bfq_log_bfqq(bfqq->bfqd, bfqq, "fifo=%p", rq);
+	return rq;
+}
+
+static inline u64 bfq_calc_max_budget(u64 peak_rate, u64 timeout)
+{
+	u64 max_budget;
+
+	/* sectors/usec << BFQ_RATE_SHIFT, times usecs in the timeout */
+	max_budget = peak_rate * 1000 * timeout;
+	return max_budget >> BFQ_RATE_SHIFT;
+}
+
+/*
+ * Estimate the peak rate of the device from the rate at which sync
+ * queues consume their budgets, and derive from it the maximum budget,
+ * i.e. how much a sequential reader can do within the sync timeout.
+ * Idle time is not counted when the queue was expired for idling.
+ */
+static void bfq_update_peak_rate(struct bfq_data *bfqd,
+				 struct bfq_queue *bfqq, int compensate,
+				 enum bfqq_expiration reason)
+{
+	u64 bw, usecs, timeout;
+	ktime_t delta;
+	int update = 0;
+
+	if (!bfq_bfqq_sync(bfqq) || bfq_bfqq_budget_new(bfqq))
+		return;
+
+	if (compensate)
+		delta = bfqd->last_idling_start;
+	else
+		delta = ktime_get();
+	delta = ktime_sub(delta, bfqd->last_budget_start);
+	usecs = ktime_to_us(delta);
+
+	/* Only long enough intervals give a trustworthy rate. */
+	if (usecs < 20000 || usecs >= LONG_MAX)
+		return;
+
+	bw = div64_u64((u64)bfqq->entity.service << BFQ_RATE_SHIFT, usecs);
+
+	if (bw > bfqd->peak_rate ||
+	    (!BFQQ_SEEKY(bfqq) && reason == BFQ_BFQQ_BUDGET_TIMEOUT)) {
+		bfqd->peak_rate = (bfqd->peak_rate * 7 + bw) >> 3;
+		update = 1;
+	}
+
+	if (bfqd->peak_rate_samples < BFQ_PEAK_RATE_SAMPLES)
+		bfqd->peak_rate_samples++;
+
+	if (bfqd->peak_rate_samples == BFQ_PEAK_RATE_SAMPLES && update &&
+	    !bfqd->bfq_user_max_budget) {
+		timeout = jiffies_to_msecs(bfqd->bfq_timeout[BLK_RW_SYNC]);
+		bfqd->bfq_max_budget = max_t(unsigned long,
+				bfq_calc_max_budget(bfqd->peak_rate, timeout),
+				bfq_default_max_budget / 32);
+		bfq_log(bfqd, "new max_budget %lu", bfqd->bfq_max_budget);
+	}
+}
+
+/*
+ * Size the next budget of a sync queue from how it used this one: a
+ * queue that ran out of budget gets more, one that went idle or only
+ * had a few requests gets less. Async queues always get the maximum.
+ */
+static void __bfq_bfqq_recalc_budget(struct bfq_data *bfqd,
+				     struct bfq_queue *bfqq,
+				     enum bfqq_expiration reason)
+{
+	unsigned long budget, min_budget;
+
+	min_budget = bfq_min_budget(bfqd);
+	budget = bfqq->max_budget;
+
+	if (!bfq_bfqq_sync(bfqq))
+		budget = bfqd->bfq_max_budget;
+	else switch (reason) {
+	case BFQ_BFQQ_TOO_IDLE:
+		if (budget > min_budget + bfqd->bfq_max_budget / 8)
+			budget -= bfqd->bfq_max_budget / 8;
+		else
+			budget = min_budget;
+		break;
+	case BFQ_BFQQ_BUDGET_TIMEOUT:
+		budget *= 2;
+		break;
+	case BFQ_BFQQ_BUDGET_EXHAUSTED:
+		budget *= 4;
+		break;
+	case BFQ_BFQQ_NO_MORE_REQUESTS:
+		budget = bfqq->entity.service;
+		break;
+	}
+
+	bfqq->max_budget = clamp(budget, min_budget, bfqd->bfq_max_budget);
+	bfq_log_bfqq(bfqd, bfqq, "recalc_budget reason %d budget %lu",
+		     reason, bfqq->max_budget);
+}
+
+static void __bfq_bfqq_expire(struct bfq_data *bfqd, struct bfq_queue *bfqq)
+{
+	struct bfq_entity *entity = &bfqq->entity;
+
+	BUG_ON(bfqq != bfqd->in_service_queue);
+	bfq_log_bfqq(bfqd, bfqq, "expire service %lu/%lu", entity->service,
+		     entity->budget);
+
+	bfq_blkiocg_update_timeslice_used(bfqq,
+					  jiffies - bfqd->in_service_start);
+
+	if (bfq_bfqq_wait_request(bfqq)) {
+		bfq_clear_bfqq_wait_request(bfqq);
+		del_timer(&bfqd->idle_slice_timer);
+	}
+
+	if (RB_EMPTY_ROOT(&bfqq->sort_list)) {
+		bfq_del_bfqq_busy(bfqd, bfqq);
+		bfq_expire_entities(bfqd, entity, false);
+	} else {
+		entity->budget = max_t(unsigned long, bfqq->max_budget,
+				bfq_serv_to_charge(bfqq->next_rq, bfqq));
+		bfq_expire_entities(bfqd, entity, true);
+	}
+
+	bfqd->in_service_queue = NULL;
+
+	if (bfqd->in_service_cic) {
+		put_io_context(bfqd->in_service_cic->ioc);
+		bfqd->in_service_cic = NULL;
+	}
+}
+
+/*
+ * Stop serving bfqq. @compensate is set when the queue expires after
+ * idling, in which case the idle time is not held against its rate.
+ */
+static void bfq_bfqq_expire(struct bfq_data *bfqd, struct bfq_queue *bfqq,
+			    int compensate, enum bfqq_expiration reason)
+{
+	bfq_update_peak_rate(bfqd, bfqq, compensate, reason);
+
+	if (reason == BFQ_BFQQ_BUDGET_TIMEOUT && bfqq->wr_coeff == 1)
+		bfq_bfqq_charge_full_budget(bfqq);
+
+	if (bfqd->low_latency && bfq_bfqq_sync(bfqq)) {
+		if (RB_EMPTY_ROOT(&bfqq->sort_list))
+			bfqq->soft_rt_next_start =
+				bfq_bfqq_softrt_next_start(bfqd, bfqq);
+		else
+			bfqq->soft_rt_next_start =
+				bfq_infinity_from_now(jiffies);
+	}
+
+	__bfq_bfqq_recalc_budget(bfqd, bfqq, reason);
+	__bfq_bfqq_expire(bfqd, bfqq);
+}
+
+/*
+ * Select a queue for service. If we have a current queue with budget
+ * left, let it keep going.
+ */
+static struct bfq_queue *bfq_select_queue(struct bfq_data *bfqd)
+{
+	struct bfq_queue *bfqq = bfqd->in_service_queue;
+	struct request *next_rq;
+	enum bfqq_expiration reason = BFQ_BFQQ_BUDGET_TIMEOUT;
+
+	if (!bfqq)
+		goto new_queue;
+
+	if (bfq_may_expire_for_budg_timeout(bfqq))
+		goto expire;
+
+	next_rq = bfqq->next_rq;
+	if (next_rq) {
+		if (bfq_serv_to_charge(next_rq, bfqq) >
+		    bfq_bfqq_budget_left(bfqq)) {
+			reason = BFQ_BFQQ_BUDGET_EXHAUSTED;
+			goto expire;
+		}
+
+		/*
+		 * The queue we were idling for has a request now, stop
+		 * waiting and serve it.
+		 */
+		if (timer_pending(&bfqd->idle_slice_timer)) {
+			bfq_clear_bfqq_wait_request(bfqq);
+			del_timer(&bfqd->idle_slice_timer);
+		}
+		goto keep_queue;
+	}
+
+	/*
+	 * No requests pending. If we are idling, or the queue may still
+	 * issue more once its in-flight requests complete, wait for it.
+	 */
+	if (timer_pending(&bfqd->idle_slice_timer) ||
+	    (bfqq->dispatched && bfq_bfqq_must_idle(bfqq))) {
+		bfqq = NULL;
+		goto keep_queue;
+	}
+
+	reason = BFQ_BFQQ_NO_MORE_REQUESTS;
+expire:
+	bfq_bfqq_expire(bfqd, bfqq, 0, reason);
+new_queue:
+	bfqq = bfq_set_in_service_queue(bfqd);
+keep_queue:
+	return bfqq;
+}
+
+/*
+ * Dispatch one request from bfqq, the in-service queue.
+ */
+static void bfq_dispatch_request(struct bfq_data *bfqd,
+				 struct bfq_queue *bfqq)
+{
+	struct request *rq;
+	unsigned long service_to_charge;
+
+	BUG_ON(RB_EMPTY_ROOT(&bfqq->sort_list));
+
+	/*
+	 * An expired fifo request is only taken if it fits in what is
+	 * left of the budget; the next request always does.
+	 */
+	rq = bfq_check_fifo(bfqq);
+	if (!rq || bfq_serv_to_charge(rq, bfqq) > bfq_bfqq_budget_left(bfqq))
+		rq = bfqq->next_rq;
+
+	service_to_charge = bfq_serv_to_charge(rq, bfqq);
+	bfq_bfqq_served(bfqq, service_to_charge);
+	bfq_dispatch_insert(bfqd->queue, rq);
+	bfq_update_wr_data(bfqd, bfqq);
+
+	if (!bfqd->in_service_cic) {
+		struct bfq_io_context *cic = RQ_CIC(rq);
+
+		atomic_long_inc(&cic->ioc->refcount);
+		bfqd->in_service_cic = cic;
+	}
+
+	if (bfq_class_idle(bfqq))
+		bfqd->bfq_class_idle_last_service = jiffies;
+
+	/*
+	 * Async and idle class queues are served a few requests at a time
+	 * when there is other work.
+	 */
+	if (bfqd->busy_queues > 1 &&
+	    ((!bfq_bfqq_sync(bfqq) &&
+	      bfqq->dispatched >= bfqd->bfq_max_budget_async_rq) ||
+	     bfq_class_idle(bfqq)))
+		bfq_bfqq_expire(bfqd, bfqq, 0, BFQ_BFQQ_BUDGET_EXHAUSTED);
+}
+
+static int __bfq_forced_dispatch_bfqq(struct bfq_queue *bfqq)
+{
+	int dispatched = 0;
+
+	while (bfqq->next_rq) {
+		bfq_dispatch_insert(bfqq->bfqd->queue, bfqq->next_rq);
+		dispatched++;
+	}
+
+	BUG_ON(!list_empty(&bfqq->fifo));
+
+	__bfq_bfqq_expire(bfqq->bfqd, bfqq);
+	return dispatched;
+}
+
+/*
+ * Drain our current requests. Used for barriers and when switching
+ * io schedulers on-the-fly.
+ */
+static int bfq_forced_dispatch(struct bfq_data *bfqd)
+{
+	struct bfq_queue *bfqq;
+	int dispatched = 0;
+
+	if (bfqd->in_service_queue)
+		__bfq_bfqq_expire(bfqd, bfqd->in_service_queue);
+
+	while ((bfqq = bfq_get_next_queue(bfqd)) != NULL) {
+		__bfq_set_in_service_queue(bfqd, bfqq);
+		dispatched += __bfq_forced_dispatch_bfqq(bfqq);
+	}
+
+	BUG_ON(bfqd->busy_queues);
+
+	bfq_log(bfqd, "forced_dispatch=%d", dispatched);
+	return dispatched;
+}
+
+/*
+ * Find the queue we want to serve and dispatch one request from it.
+ */
+static int bfq_dispatch_requests(struct request_queue *q, int force)
+{
+	struct bfq_data *bfqd = q->elevator->elevator_data;
+	struct bfq_queue *bfqq;
+	int max_dispatch;
+
+	if (!bfqd->busy_queues)
+		return 0;
+
+	if (unlikely(force))
+		return bfq_forced_dispatch(bfqd);
+
+	bfqq = bfq_select_queue(bfqd);
+	if (!bfqq)
+		return 0;
+
+	max_dispatch = bfqd->bfq_quantum;
+	if (bfq_class_idle(bfqq))
+		max_dispatch = 1;
+	if (!bfq_bfqq_sync(bfqq))
+		max_dispatch = bfqd->bfq_max_budget_async_rq;
+
+	if (bfqq->dispatched >= max_dispatch) {
+		if (bfqd->busy_queues > 1)
+			return 0;
+		if (bfqq->dispatched >= 4 * max_dispatch)
+			return 0;
+	}
+
+	/*
+	 * Don't let async requests queue up in the device behind sync
+	 * ones still in flight, it would only add to the sync latency.
+	 */
+	if (bfqd->sync_flight && !bfq_bfqq_sync(bfqq))
+		return 0;
+
+	bfq_clear_bfqq_wait_request(bfqq);
+	BUG_ON(timer_pending(&bfqd->idle_slice_timer));
+
+	bfq_dispatch_request(bfqd, bfqq);
+
+	bfq_log_bfqq(bfqd, bfqq, "dispatched a request");
+	return 1;
+}
+
+#ifdef CONFIG_BFQ_GROUP_IOSCHED
+static void bfq_put_group(struct bfq_group *bfqg)
+{
+	BUG_ON(atomic_read(&bfqg->ref) <= 0);
+	if (!atomic_dec_and_test(&bfqg->ref))
+		return;
+	BUG_ON(bfqg->entity.on_st || !bfq_sd_empty(&bfqg->sched_data));
+	kfree(bfqg);
+}
+#else
+static inline void bfq_put_group(struct bfq_group *bfqg) {}
+#endif
+
+/*
+ * task holds one reference to the queue, dropped when task exits. each rq
+ * in-flight on this queue also holds a reference, dropped when rq is freed.
+ *
+ * Each bfq queue took a reference on the parent group. Drop it now.
+ * queue lock must be held here.
+ */
+static void bfq_put_queue(struct bfq_queue *bfqq)
+{
+	struct bfq_data *bfqd = bfqq->bfqd;
+	struct bfq_group *bfqg;
+
+	BUG_ON(atomic_read(&bfqq->ref) <= 0);
+
+	if (!atomic_dec_and_test(&bfqq->ref))
+		return;
+
+	bfq_log_bfqq(bfqd, bfqq, "put_queue");
+	BUG_ON(rb_first(&bfqq->sort_list));
+	BUG_ON(bfqq->allocated[READ] + bfqq->allocated[WRITE]);
+	bfqg = bfqq->bfqg;
+
+	if (unlikely(bfqd->in_service_queue == bfqq)) {
+		__bfq_bfqq_expire(bfqd, bfqq);
+		bfq_schedule_dispatch(bfqd);
+	}
+
+	BUG_ON(bfq_bfqq_busy(bfqq));
+	kmem_cache_free(bfq_pool, bfqq);
+	bfq_put_group(bfqg);
+}
+
+/*
+ * Must always be called with the rcu_read_lock() held
+ */
+static void
+__call_for_each_cic(struct io_context *ioc,
+		    void (*func)(struct io_context *, struct bfq_io_context *))
+{
+	struct bfq_io_context *cic;
+	struct hlist_node *n;
+
+	hlist_for_each_entry_rcu(cic, n, &ioc->bfq_cic_list, cic_list)
+		func(ioc, cic);
+}
+
+/*
+ * Call func for each cic attached to this ioc.
+ */
+static void
+call_for_each_cic(struct io_context *ioc,
+		  void (*func)(struct io_context *, struct bfq_io_context *))
+{
+	rcu_read_lock();
+	__call_for_each_cic(ioc, func);
+	rcu_read_unlock();
+}
+
+static void bfq_cic_free_rcu(struct rcu_head *head)
+{
+	struct bfq_io_context *cic;
+
+	cic = container_of(head, struct bfq_io_context, rcu_head);
+
+	kmem_cache_free(bfq_ioc_pool, cic);
+	elv_ioc_count_dec(bfq_ioc_count);
+
+	if (ioc_gone) {
+		/*
+		 * BFQ scheduler is exiting, grab exit lock and check
+		 * the pending io context count. If it hits zero,
+		 * complete ioc_gone and set it back to NULL
+		 */
+		spin_lock(&ioc_gone_lock);
+		if (ioc_gone && !elv_ioc_count_read(bfq_ioc_count)) {
+			complete(ioc_gone);
+			ioc_gone = NULL;
+		}
+		spin_unlock(&ioc_gone_lock);
+	}
+}
+
+static void bfq_cic_free(struct bfq_io_context *cic)
+{
+	call_rcu(&cic->rcu_head, bfq_cic_free_rcu);
+}
+
+static void cic_free_func(struct io_context *ioc, struct bfq_io_context *cic)
+{
+	unsigned long flags;
+	unsigned long dead_key = (unsigned long) cic->key;
+
+	BUG_ON(!(dead_key & CIC_DEAD_KEY));
+
+	spin_lock_irqsave(&ioc->lock, flags);
+	radix_tree_delete(&ioc->bfq_radix_root,
+			  dead_key >> CIC_DEAD_INDEX_SHIFT);
+	hlist_del_rcu(&cic->cic_list);
+	spin_unlock_irqrestore(&ioc->lock, flags);
+
+	bfq_cic_free(cic);
+}
+
+/*
+ * Must be called with rcu_read_lock() held or preemption otherwise disabled.
+ * Only two callers of this - ->dtor() which is called with the rcu_read_lock(),
+ * and ->trim() which is called with the task lock held
+ */
+static void bfq_free_io_context(struct io_context *ioc)
+{
+	/*
+	 * ioc->refcount is zero here, or we are called from elv_unregister(),
+	 * so no more cic's are allowed to be linked into this ioc.  So it
+	 * should be ok to iterate over the known list, we will see all cic's
+	 * since no new ones are added.
+	 */
+	__call_for_each_cic(ioc, cic_free_func);
+}
+
+static void bfq_exit_bfqq(struct bfq_data *bfqd, struct bfq_queue *bfqq)
+{
+	if (unlikely(bfqq == bfqd->in_service_queue)) {
+		__bfq_bfqq_expire(bfqd, bfqq);
+		bfq_schedule_dispatch(bfqd);
+	}
+
+	bfq_put_queue(bfqq);
+}
+
+static void __bfq_exit_single_io_context(struct bfq_data *bfqd,
+					 struct bfq_io_context *cic)
+{
+	struct io_context *ioc = cic->ioc;
+
+	list_del_init(&cic->queue_list);
+
+	/*
+	 * Make sure dead mark is seen for dead queues
+	 */
+	smp_wmb();
+	cic->key = bfqd_dead_key(bfqd);
+
+	if (ioc->bfq_ioc_data == cic)
+		rcu_assign_pointer(ioc->bfq_ioc_data, NULL);
+
+	if (cic->bfqq[BLK_RW_ASYNC]) {
+		bfq_exit_bfqq(bfqd, cic->bfqq[BLK_RW_ASYNC]);
+		cic->bfqq[BLK_RW_ASYNC] = NULL;
+	}
+
+	if (cic->bfqq[BLK_RW_SYNC]) {
+		bfq_exit_bfqq(bfqd, cic->bfqq[BLK_RW_SYNC]);
+		cic->bfqq[BLK_RW_SYNC] = NULL;
+	}
+}
+
+static void bfq_exit_single_io_context(struct io_context *ioc,
+				       struct bfq_io_context *cic)
+{
+	struct bfq_data *bfqd = cic_to_bfqd(cic);
+
+	if (bfqd) {
+		struct request_queue *q = bfqd->queue;
+		unsigned long flags;
+
+		spin_lock_irqsave(q->queue_lock, flags);
+
+		/*
+		 * Ensure we get a fresh copy of the ->key to prevent
+		 * race between exiting task and queue
+		 */
+		smp_read_barrier_depends();
+		if (cic->key == bfqd)
+			__bfq_exit_single_io_context(bfqd, cic);
+
+		spin_unlock_irqrestore(q->queue_lock, flags);
+	}
+}
+
+/*
+ * The process that ioc belongs to has exited, we need to clean up
+ * and put the internal structures we have that belongs to that process.
+ */
+static void bfq_exit_io_context(struct io_context *ioc)
+{
+	call_for_each_cic(ioc, bfq_exit_single_io_context);
+}
+
+static struct bfq_io_context *
+bfq_alloc_io_context(struct bfq_data *bfqd, gfp_t gfp_mask)
+{
+	struct bfq_io_context *cic;
+
+	cic = kmem_cache_alloc_node(bfq_ioc_pool, gfp_mask | __GFP_ZERO,
+							bfqd->queue->node);
+	if (cic) {
+		cic->last_end_request = jiffies;
+		INIT_LIST_HEAD(&cic->queue_list);
+		INIT_HLIST_NODE(&cic->cic_list);
+		cic->dtor = bfq_free_io_context;
+		cic->exit = bfq_exit_io_context;
+		elv_ioc_count_inc(bfq_ioc_count);
+	}
+
+	return cic;
+}
+
+static void bfq_init_prio_data(struct bfq_queue *bfqq, struct io_context *ioc)
+{
+	struct task_struct *tsk = current;
+	int ioprio_class;
+
+	if (!bfq_bfqq_prio_changed(bfqq))
+		return;
+
+	ioprio_class = IOPRIO_PRIO_CLASS(ioc->ioprio);
+	switch (ioprio_class) {
+	default:
+		printk(KERN_ERR "bfq: bad prio %x\n", ioprio_class);
+	case IOPRIO_CLASS_NONE:
+		/*
+		 * no prio set, inherit CPU scheduling settings
+		 */
+		bfqq->ioprio = task_nice_ioprio(tsk);
+		bfqq->ioprio_class = task_nice_ioclass(tsk);
+		break;
+	case IOPRIO_CLASS_RT:
+		bfqq->ioprio = task_ioprio(ioc);
+		bfqq->ioprio_class = IOPRIO_CLASS_RT;
+		break;
+	case IOPRIO_CLASS_BE:
+		bfqq->ioprio = task_ioprio(ioc);
+		bfqq->ioprio_class = IOPRIO_CLASS_BE;
+		break;
+	case IOPRIO_CLASS_IDLE:
+		bfqq->ioprio_class = IOPRIO_CLASS_IDLE;
+		bfqq->ioprio = 7;
+		bfq_clear_bfqq_idle_window(bfqq);
+		break;
+	}
+
+	bfqq->entity.orig_weight = bfq_ioprio_to_weight(bfqq->ioprio);
+	bfq_update_entity_weight(bfqq);
+	bfq_clear_bfqq_prio_changed(bfqq);
+}
+
+static void changed_ioprio(struct io_context *ioc, struct bfq_io_context *cic)
+{
+	struct bfq_data *bfqd = cic_to_bfqd(cic);
+	struct bfq_queue *bfqq;
+	unsigned long flags;
+
+	if (unlikely(!bfqd))
+		return;
+
+	spin_lock_irqsave(bfqd->queue->queue_lock, flags);
+
+	bfqq = cic->bfqq[BLK_RW_ASYNC];
+	if (bfqq) {
+		struct bfq_queue *new_bfqq;
+		new_bfqq = bfq_get_queue(bfqd, BLK_RW_ASYNC, cic->ioc,
+					 GFP_ATOMIC);
+		if (new_bfqq) {
+			cic->bfqq[BLK_RW_ASYNC] = new_bfqq;
+			bfq_put_queue(bfqq);
+		}
+	}
+
+	bfqq = cic->bfqq[BLK_RW_SYNC];
+	if (bfqq)
+		bfq_mark_bfqq_prio_changed(bfqq);
+
+	spin_unlock_irqrestore(bfqd->queue->queue_lock, flags);
+}
+
+static void bfq_ioc_set_ioprio(struct io_context *ioc)
+{
+	call_for_each_cic(ioc, changed_ioprio);
+}
+
+static void bfq_init_bfqq(struct bfq_data *bfqd, struct bfq_queue *bfqq,
+			  pid_t pid, bool is_sync)
+{
+	RB_CLEAR_NODE(&bfqq->entity.rb_node);
+	INIT_LIST_HEAD(&bfqq->fifo);
+
+	atomic_set(&bfqq->ref, 0);
+	bfqq->bfqd = bfqd;
+
+	bfq_mark_bfqq_prio_changed(bfqq);
+
+	if (is_sync) {
+		if (!bfq_class_idle(bfqq))
+			bfq_mark_bfqq_idle_window(bfqq);
+		bfq_mark_bfqq_sync(bfqq);
+	}
+	bfqq->pid = pid;
+
+	bfqq->max_budget = (2 * bfqd->bfq_max_budget) / 3;
+	bfqq->wr_coeff = 1;
+	/* a new queue counts as having been idle for a long time */
+	bfqq->budget_timeout = bfq_smallest_from_now();
+	bfqq->soft_rt_next_start = bfq_infinity_from_now(jiffies);
+}
+
+static void bfq_init_sched_data(struct bfq_sched_data *sd)
+{
+	int i;
+
+	sd->in_service_entity = NULL;
+	for (i = 0; i < BFQ_IOPRIO_CLASSES; i++)
+		sd->service_tree[i].active = RB_ROOT;
+}
+
+#ifdef CONFIG_BFQ_GROUP_IOSCHED
+static struct blkio_policy_type blkio_policy_bfq;
+
+static inline struct bfq_group *bfqg_of_blkg(struct blkio_group *blkg)
+{
+	if (blkg)
+		return container_of(blkg, struct bfq_group, blkg);
+	return NULL;
+}
+
+static void bfq_update_blkio_group_weight(void *key, struct blkio_group *blkg,
+					  unsigned int weight)
+{
+	struct bfq_entity *entity = &bfqg_of_blkg(blkg)->entity;
+
+	entity->orig_weight = weight;
+	entity->new_weight = weight;
+	smp_wmb();
+	entity->ioprio_changed = 1;
+}
+
+static struct bfq_group *
+bfq_find_alloc_group(struct bfq_data *bfqd, struct cgroup *cgroup, int create)
+{
+	struct blkio_cgroup *blkcg = cgroup_to_blkio_cgroup(cgroup);
+	struct bfq_group *bfqg = NULL;
+	void *key = bfqd;
+	struct backing_dev_info *bdi = &bfqd->queue->backing_dev_info;
+	unsigned int major, minor;
+	dev_t dev = 0;
+
+	bfqg = bfqg_of_blkg(blkiocg_lookup_group(blkcg, key));
+	if (bfqg && !bfqg->blkg.dev && bdi->dev && dev_name(bdi->dev)) {
+		sscanf(dev_name(bdi->dev), "%u:%u", &major, &minor);
+		bfqg->blkg.dev = MKDEV(major, minor);
+		goto done;
+	}
+	if (bfqg || !create)
+		goto done;
+
+	bfqg = kzalloc_node(sizeof(*bfqg), GFP_ATOMIC, bfqd->queue->node);
+	if (!bfqg)
+		goto done;
+
+	bfq_init_sched_data(&bfqg->sched_data);
+	RB_CLEAR_NODE(&bfqg->entity.rb_node);
+	bfqg->entity.sched_data = &bfqd->root_group.sched_data;
+	bfqg->entity.my_sched_data = &bfqg->sched_data;
+
+	/*
+	 * Take the initial reference that will be released on destroy
+	 * This can be thought of a joint reference by cgroup and
+	 * elevator which will be dropped by either elevator exit
+	 * or cgroup deletion path depending on who is exiting first.
+	 */
+	atomic_set(&bfqg->ref, 1);
+
+	/*
+	 * Add group onto cgroup list. It might happen that bdi->dev is
+	 * not initialized yet. Initialize this new group without major
+	 * and minor info and this info will be filled in once a new thread
+	 * comes for IO. See code above.
+	 */
+	if (bdi->dev) {
+		sscanf(dev_name(bdi->dev), "%u:%u", &major, &minor);
+		dev = MKDEV(major, minor);
+	}
+	bfqg->blkg.blkiop = &blkio_policy_bfq;
+	blkiocg_add_blkio_group(blkcg, &bfqg->blkg, (void *)bfqd, dev,
+				BLKIO_POLICY_PROP);
+
+	bfqg->entity.orig_weight = blkcg_get_weight(blkcg, bfqg->blkg.dev);
+	bfqg->entity.new_weight = bfqg->entity.orig_weight;
+	bfqg->entity.new_ioprio_class = IOPRIO_CLASS_BE;
+	bfqg->entity.ioprio_changed = 1;
+
+	/* Add group on bfqd list */
+	hlist_add_head(&bfqg->bfqd_node, &bfqd->bfqg_list);
+
+done:
+	return bfqg;
+}
+
+/*
+ * Search for the bfq group current task belongs to. If create = 1, then also
+ * create the bfq group if it does not exist. request_queue lock must be held.
+ */
+static struct bfq_group *bfq_get_group(struct bfq_data *bfqd, int create)
+{
+	struct cgroup *cgroup;
+	struct bfq_group *bfqg = NULL;
+
+	rcu_read_lock();
+	cgroup = task_cgroup(current, blkio_subsys_id);
+	bfqg = bfq_find_alloc_group(bfqd, cgroup, create);
+	if (!bfqg && create)
+		bfqg = &bfqd->root_group;
+	rcu_read_unlock();
+	return bfqg;
+}
+
+static void bfq_link_bfqq_bfqg(struct bfq_queue *bfqq, struct bfq_group *bfqg)
+{
+	struct bfq_data *bfqd = bfqq->bfqd;
+
+	/* Currently, all async queues are mapped to root group */
+	if (!bfq_bfqq_sync(bfqq))
+		bfqg = &bfqd->root_group;
+
+	bfqq->bfqg = bfqg;
+	bfqq->entity.sched_data = &bfqg->sched_data;
+	bfqq->entity.parent = bfqg == &bfqd->root_group ? NULL : &bfqg->entity;
+	/* bfqq reference on bfqg */
+	atomic_inc(&bfqg->ref);
+}
+
+static void bfq_destroy_group(struct bfq_data *bfqd, struct bfq_group *bfqg)
+{
+	/* Something wrong if we are trying to remove same group twice */
+	BUG_ON(hlist_unhashed(&bfqg->bfqd_node));
+
+	hlist_del_init(&bfqg->bfqd_node);
+
+	/*
+	 * Put the reference taken at the time of creation so that when all
+	 * queues are gone, group can be destroyed.
+	 */
+	bfq_put_group(bfqg);
+}
+
+static void bfq_release_groups(struct bfq_data *bfqd)
+{
+	struct hlist_node *pos, *n;
+	struct bfq_group *bfqg;
+
+	hlist_for_each_entry_safe(bfqg, pos, n, &bfqd->bfqg_list, bfqd_node) {
+		/*
+		 * If cgroup removal path got to blk_group first and removed
+		 * it from cgroup list, then it will take care of destroying
+		 * bfqg also.
+		 */
+		if (!blkiocg_del_blkio_group(&bfqg->blkg))
+			bfq_destroy_group(bfqd, bfqg);
+	}
+}
+
+/*
+ * Blk cgroup controller notification saying that blkio_group object is being
+ * delinked as associated cgroup object is going away. Pending I/O keeps the
+ * group alive, see cfq_unlink_blkio_group() for the locking rules.
+ */
+static void bfq_unlink_blkio_group(void *key, struct blkio_group *blkg)
+{
+	unsigned long flags;
+	struct bfq_data *bfqd = key;
+
+	spin_lock_irqsave(bfqd->queue->queue_lock, flags);
+	bfq_destroy_group(bfqd, bfqg_of_blkg(blkg));
+	spin_unlock_irqrestore(bfqd->queue->queue_lock, flags);
+}
+
+static void changed_cgroup(struct io_context *ioc, struct bfq_io_context *cic)
+{
+	struct bfq_queue *sync_bfqq = cic_to_bfqq(cic, 1);
+	struct bfq_data *bfqd = cic_to_bfqd(cic);
+	unsigned long flags;
+	struct request_queue *q;
+
+	if (unlikely(!bfqd))
+		return;
+
+	q = bfqd->queue;
+
+	spin_lock_irqsave(q->queue_lock, flags);
+
+	if (sync_bfqq) {
+		/*
+		 * Drop reference to sync queue. A new sync queue will be
+		 * assigned in new group upon arrival of a fresh request.
+		 */
+		bfq_log_bfqq(bfqd, sync_bfqq, "changed cgroup");
+		cic_set_bfqq(cic, NULL, 1);
+		bfq_put_queue(sync_bfqq);
+	}
+
+	spin_unlock_irqrestore(q->queue_lock, flags);
+}
+
+static void bfq_ioc_set_cgroup(struct io_context *ioc)
+{
+	call_for_each_cic(ioc, changed_cgroup);
+}
+#else /* BFQ_GROUP_IOSCHED */
+static struct bfq_group *bfq_get_group(struct bfq_data *bfqd, int create)
+{
+	return &bfqd->root_group;
+}
+
+static inline void
+bfq_link_bfqq_bfqg(struct bfq_queue *bfqq, struct bfq_group *bfqg)
+{
+	bfqq->bfqg = bfqg;
+	bfqq->entity.sched_data = &bfqg->sched_data;
+	bfqq->entity.parent = NULL;
+}
+
+static void bfq_release_groups(struct bfq_data *bfqd) {}
+#endif /* BFQ_GROUP_IOSCHED */
+
+static struct bfq_queue *
+bfq_find_alloc_queue(struct bfq_data *bfqd, bool is_sync,
+		     struct io_context *ioc, gfp_t gfp_mask)
+{
+	struct bfq_queue *bfqq, *new_bfqq = NULL;
+	struct bfq_io_context *cic;
+	struct bfq_group *bfqg;
+
+retry:
+	bfqg = bfq_get_group(bfqd, 1);
+	cic = bfq_cic_lookup(bfqd, ioc);
+	/* cic always exists here */
+	bfqq = cic_to_bfqq(cic, is_sync);
+
+	/*
+	 * Always try a new alloc if we fell back to the OOM bfqq
+	 * originally, since it should just be a temporary situation.
+	 */
+	if (!bfqq || bfqq == &bfqd->oom_bfqq) {
+		bfqq = NULL;
+		if (new_bfqq) {
+			bfqq = new_bfqq;
+			new_bfqq = NULL;
+		} else if (gfp_mask & __GFP_WAIT) {
+			spin_unlock_irq(bfqd->queue->queue_lock);
+			new_bfqq = kmem_cache_alloc_node(bfq_pool,
+					gfp_mask | __GFP_ZERO,
+					bfqd->queue->node);
+			spin_lock_irq(bfqd->queue->queue_lock);
+			if (new_bfqq)
+				goto retry;
+		} else {
+			bfqq = kmem_cache_alloc_node(bfq_pool,
+					gfp_mask | __GFP_ZERO,
+					bfqd->queue->node);
+		}
+
+		if (bfqq) {
+			bfq_init_bfqq(bfqd, bfqq, current->pid, is_sync);
+			bfq_init_prio_data(bfqq, ioc);
+			bfq_link_bfqq_bfqg(bfqq, bfqg);
+			bfq_log_bfqq(bfqd, bfqq, "alloced");
+		} else
+			bfqq = &bfqd->oom_bfqq;
+	}
+
+	if (new_bfqq)
+		kmem_cache_free(bfq_pool, new_bfqq);
+
+	return bfqq;
+}
+
+static struct bfq_queue **
+bfq_async_queue_prio(struct bfq_data *bfqd, int ioprio_class, int ioprio)
+{
+	switch (ioprio_class) {
+	case IOPRIO_CLASS_RT:
+		return &bfqd->async_bfqq[0][ioprio];
+	case IOPRIO_CLASS_BE:
+		return &bfqd->async_bfqq[1][ioprio];
+	case IOPRIO_CLASS_IDLE:
+		return &bfqd->async_idle_bfqq;
+	default:
+		BUG();
+	}
+}
+
+static struct bfq_queue *
+bfq_get_queue(struct bfq_data *bfqd, bool is_sync, struct io_context *ioc,
+	      gfp_t gfp_mask)
+{
+	const int ioprio = task_ioprio(ioc);
+	const int ioprio_class = task_ioprio_class(ioc);
+	struct bfq_queue **async_bfqq = NULL;
+	struct bfq_queue *bfqq = NULL;
+
+	if (!is_sync) {
+		async_bfqq = bfq_async_queue_prio(bfqd, ioprio_class, ioprio);
+		bfqq = *async_bfqq;
+	}
+
+	if (!bfqq)
+		bfqq = bfq_find_alloc_queue(bfqd, is_sync, ioc, gfp_mask);
+
+	/*
+	 * pin the queue now that it's allocated, scheduler exit will prune it
+	 */
+	if (!is_sync && !(*async_bfqq)) {
+		atomic_inc(&bfqq->ref);
+		*async_bfqq = bfqq;
+	}
+
+	atomic_inc(&bfqq->ref);
+	return bfqq;
+}
+
+/*
+ * We drop bfq io contexts lazily, so we may find a dead one.
+ */
+static void
+bfq_drop_dead_cic(struct bfq_data *bfqd, struct io_context *ioc,
+		  struct bfq_io_context *cic)
+{
+	unsigned long flags;
+
+	WARN_ON(!list_empty(&cic->queue_list));
+	BUG_ON(cic->key != bfqd_dead_key(bfqd));
+
+	spin_lock_irqsave(&ioc->lock, flags);
+
+	BUG_ON(ioc->bfq_ioc_data == cic);
+
+	radix_tree_delete(&ioc->bfq_radix_root, bfqd->cic_index);
+	hlist_del_rcu(&cic->cic_list);
+	spin_unlock_irqrestore(&ioc->lock, flags);
+
+	bfq_cic_free(cic);
+}
+
+static struct bfq_io_context *
+bfq_cic_lookup(struct bfq_data *bfqd, struct io_context *ioc)
+{
+	struct bfq_io_context *cic;
+	unsigned long flags;
+
+	if (unlikely(!ioc))
+		return NULL;
+
+	rcu_read_lock();
+
+	/*
+	 * we maintain a last-hit cache, to avoid browsing over the tree
+	 */
+	cic = rcu_dereference(ioc->bfq_ioc_data);
+	if (cic && cic->key == bfqd) {
+		rcu_read_unlock();
+		return cic;
+	}
+
+	do {
+		cic = radix_tree_lookup(&ioc->bfq_radix_root, bfqd->cic_index);
+		rcu_read_unlock();
+		if (!cic)
+			break;
+		if (unlikely(cic->key != bfqd)) {
+			bfq_drop_dead_cic(bfqd, ioc, cic);
+			rcu_read_lock();
+			continue;
+		}
+
+		spin_lock_irqsave(&ioc->lock, flags);
+		rcu_assign_pointer(ioc->bfq_ioc_data, cic);
+		spin_unlock_irqrestore(&ioc->lock, flags);
+		break;
+	} while (1);
+
+	return cic;
+}
+
+/*
+ * Add cic into ioc, using bfqd as the search key. This enables us to lookup
+ * the process specific bfq io context when entered from the block layer.
+ * Also adds the cic to a per-bfqd list, used when this queue is removed.
+ */
+static int bfq_cic_link(struct bfq_data *bfqd, struct io_context *ioc,
+			struct bfq_io_context *cic, gfp_t gfp_mask)
+{
+	unsigned long flags;
+	int ret;
+
+	ret = radix_tree_preload(gfp_mask);
+	if (!ret) {
+		cic->ioc = ioc;
+		cic->key = bfqd;
+
+		spin_lock_irqsave(&ioc->lock, flags);
+		ret = radix_tree_insert(&ioc->bfq_radix_root,
+					bfqd->cic_index, cic);
+		if (!ret)
+			hlist_add_head_rcu(&cic->cic_list, &ioc->bfq_cic_list);
+		spin_unlock_irqrestore(&ioc->lock, flags);
+
+		radix_tree_preload_end();
+
+		if (!ret) {
+			spin_lock_irqsave(bfqd->queue->queue_lock, flags);
+			list_add(&cic->queue_list, &bfqd->cic_list);
+			spin_unlock_irqrestore(bfqd->queue->queue_lock, flags);
+		}
+	}
+
+	if (ret)
+		printk(KERN_ERR "bfq: cic link failed!\n");
+
+	return ret;
+}
+
+/*
+ * Setup general io context and bfq io context. There can be several bfq
+ * io contexts per general io context, if this process is doing io to more
+ * than one device managed by bfq.
+ */
+static struct bfq_io_context *
+bfq_get_io_context(struct bfq_data *bfqd, gfp_t gfp_mask)
+{
+	struct io_context *ioc = NULL;
+	struct bfq_io_context *cic;
+
+	might_sleep_if(gfp_mask & __GFP_WAIT);
+
+	ioc = get_io_context(gfp_mask, bfqd->queue->node);
+	if (!ioc)
+		return NULL;
+
+	cic = bfq_cic_lookup(bfqd, ioc);
+	if (cic)
+		goto out;
+
+	cic = bfq_alloc_io_context(bfqd, gfp_mask);
+	if (cic == NULL)
+		goto err;
+
+	if (bfq_cic_link(bfqd, ioc, cic, gfp_mask))
+		goto err_free;
+
+out:
+	smp_read_barrier_depends();
+	if (unlikely(test_and_clear_bit(IOC_BFQ_CHANGED, &ioc->ioprio_changed)))
+		bfq_ioc_set_ioprio(ioc);
+
+#ifdef CONFIG_BFQ_GROUP_IOSCHED
+	if (unlikely(test_and_clear_bit(IOC_BFQ_CHANGED, &ioc->cgroup_changed)))
+		bfq_ioc_set_cgroup(ioc);
+#endif
+	return cic;
+err_free:
+	bfq_cic_free(cic);
+err:
+	put_io_context(ioc);
+	return NULL;
+}
+
+static void
+bfq_update_io_thinktime(struct bfq_data *bfqd, struct bfq_io_context *cic)
+{
+	unsigned long elapsed = jiffies - cic->last_end_request;
+	unsigned long ttime = min(elapsed, 2UL * bfqd->bfq_slice_idle);
+
+	cic->ttime_samples = (7*cic->ttime_samples + 256) / 8;
+	cic->ttime_total = (7*cic->ttime_total + 256*ttime) / 8;
+	cic->ttime_mean = (cic->ttime_total + 128) / cic->ttime_samples;
+}
+
+static void
+bfq_update_io_seektime(struct bfq_data *bfqd, struct bfq_queue *bfqq,
+		       struct request *rq)
+{
+	sector_t sdist = 0;
+	sector_t n_sec = blk_rq_sectors(rq);
+	if (bfqq->last_request_pos) {
+		if (bfqq->last_request_pos < blk_rq_pos(rq))
+			sdist = blk_rq_pos(rq) - bfqq->last_request_pos;
+		else
+			sdist = bfqq->last_request_pos - blk_rq_pos(rq);
+	}
+
+	bfqq->seek_history <<= 1;
+	if (blk_queue_nonrot(bfqd->queue))
+		bfqq->seek_history |= (n_sec < BFQQ_SECT_THR_NONROT);
+	else
+		bfqq->seek_history |= (sdist > BFQQ_SEEK_THR);
+}
+
+/*
+ * Disable idle window if the process thinks too long, or if it seeks on
+ * a device where seeking is cheap, unless its weight is being raised.
+ */
+static void
+bfq_update_idle_window(struct bfq_data *bfqd, struct bfq_queue *bfqq,
+		       struct bfq_io_context *cic)
+{
+	int old_idle, enable_idle;
+
+	/*
+	 * Don't idle for async or idle io prio class
+	 */
+	if (!bfq_bfqq_sync(bfqq) || bfq_class_idle(bfqq))
+		return;
+
+	enable_idle = old_idle = bfq_bfqq_idle_window(bfqq);
+
+	if (!atomic_read(&cic->ioc->nr_tasks) || !bfqd->bfq_slice_idle ||
+	    (blk_queue_nonrot(bfqd->queue) && BFQQ_SEEKY(bfqq) &&
+	     bfqq->wr_coeff == 1))
+		enable_idle = 0;
+	else if (sample_valid(cic->ttime_samples)) {
+		if (cic->ttime_mean > bfqd->bfq_slice_idle &&
+		    bfqq->wr_coeff == 1)
+			enable_idle = 0;
+		else
+			enable_idle = 1;
+	}
+
+	if (old_idle != enable_idle) {
+		bfq_log_bfqq(bfqd, bfqq, "idle=%d", enable_idle);
+		if (enable_idle)
+			bfq_mark_bfqq_idle_window(bfqq);
+		else
+			bfq_clear_bfqq_idle_window(bfqq);
+	}
+}
+
+/*
+ * Called when a new fs request (rq) is added (to bfqq). Check if there's
+ * something we should do about it
+ */
+static void
+bfq_rq_enqueued(struct bfq_data *bfqd, struct bfq_queue *bfqq,
+		struct request *rq)
+{
+	struct bfq_io_context *cic = RQ_CIC(rq);
+
+	bfqd->rq_queued++;
+	if (rq->cmd_flags & REQ_META)
+		bfqq->meta_pending++;
+
+	bfq_update_io_thinktime(bfqd, cic);
+	bfq_update_io_seektime(bfqd, bfqq, rq);
+	bfq_update_idle_window(bfqd, bfqq, cic);
+
+	bfqq->last_request_pos = blk_rq_pos(rq) + blk_rq_sectors(rq);
+
+	if (bfqq == bfqd->in_service_queue && bfq_bfqq_wait_request(bfqq)) {
+		/*
+		 * The queue we were idling for has work again: stop the
+		 * idle timer and start dispatching right away.
+		 */
+		bfq_clear_bfqq_wait_request(bfqq);
+		del_timer(&bfqd->idle_slice_timer);
+		__blk_run_queue(bfqd->queue, false);
+	}
+}
+
+static void bfq_insert_request(struct request_queue *q, struct request *rq)
+{
+	struct bfq_data *bfqd = q->elevator->elevator_data;
+	struct bfq_queue *bfqq = RQ_BFQQ(rq);
+
+	bfq_log_bfqq(bfqd, bfqq, "insert_request");
+	bfq_init_prio_data(bfqq, RQ_CIC(rq)->ioc);
+
+	rq_set_fifo_time(rq, jiffies + bfqd->bfq_fifo_expire[rq_is_sync(rq)]);
+	list_add_tail(&rq->queuelist, &bfqq->fifo);
+	bfq_add_rq_rb(rq);
+	bfq_blkiocg_update_io_add_stats(bfqq, rq);
+	bfq_rq_enqueued(bfqd, bfqq, rq);
+}
+
+static void bfq_completed_request(struct request_queue *q, struct request *rq)
+{
+	struct bfq_queue *bfqq = RQ_BFQQ(rq);
+	struct bfq_data *bfqd = bfqq->bfqd;
+
+	bfq_log_bfqq(bfqd, bfqq, "complete");
+
+	WARN_ON(!bfqd->rq_in_driver);
+	WARN_ON(!bfqq->dispatched);
+	bfqd->rq_in_driver--;
+	bfqq->dispatched--;
+	bfq_blkiocg_update_completion_stats(bfqq, rq);
+
+	if (bfq_bfqq_sync(bfqq)) {
+		bfqd->sync_flight--;
+		RQ_CIC(rq)->last_end_request = jiffies;
+	}
+
+	/*
+	 * If this is the in-service queue, check if it needs to be expired,
+	 * or if we want to idle in case it has no pending requests.
+	 */
+	if (bfqd->in_service_queue == bfqq) {
+		if (bfq_bfqq_budget_new(bfqq))
+			bfq_set_budget_timeout(bfqd, bfqq);
+
+		if (bfq_may_expire_for_budg_timeout(bfqq))
+			bfq_bfqq_expire(bfqd, bfqq, 0, BFQ_BFQQ_BUDGET_TIMEOUT);
+		else if (RB_EMPTY_ROOT(&bfqq->sort_list) &&
+			 (!bfqq->dispatched || !bfq_bfqq_must_idle(bfqq))) {
+			if (bfq_bfqq_must_idle(bfqq))
+				bfq_arm_slice_timer(bfqd);
+			else
+				bfq_bfqq_expire(bfqd, bfqq, 0,
+						BFQ_BFQQ_NO_MORE_REQUESTS);
+		}
+	}
+
+	if (!bfqd->rq_in_driver)
+		bfq_schedule_dispatch(bfqd);
+}
+
+static inline int __bfq_may_queue(struct bfq_queue *bfqq)
+{
+	if (bfq_bfqq_wait_request(bfqq) && bfq_bfqq_must_alloc(bfqq)) {
+		bfq_clear_bfqq_must_alloc(bfqq);
+		return ELV_MQUEUE_MUST;
+	}
+
+	return ELV_MQUEUE_MAY;
+}
+
+static int bfq_may_queue(struct request_queue *q, int rw)
+{
+	struct bfq_data *bfqd = q->elevator->elevator_data;
+	struct task_struct *tsk = current;
+	struct bfq_io_context *cic;
+	struct bfq_queue *bfqq;
+
+	/*
+	 * don't force setup of a queue from here, as a call to may_queue
+	 * does not necessarily imply that a request actually will be queued.
+	 * so just lookup a possibly existing queue, or return 'may queue'
+	 * if that fails
+	 */
+	cic = bfq_cic_lookup(bfqd, tsk->io_context);
+	if (!cic)
+		return ELV_MQUEUE_MAY;
+
+	bfqq = cic_to_bfqq(cic, rw_is_sync(rw));
+	if (bfqq) {
+		bfq_init_prio_data(bfqq, cic->ioc);
+
+		return __bfq_may_queue(bfqq);
+	}
+
+	return ELV_MQUEUE_MAY;
+}
+
+/*
+ * queue lock held here
+ */
+static void bfq_put_request(struct request *rq)
+{
+	struct bfq_queue *bfqq = RQ_BFQQ(rq);
+
+	if (bfqq) {
+		const int rw = rq_data_dir(rq);
+
+		BUG_ON(!bfqq->allocated[rw]);
+		bfqq->allocated[rw]--;
+
+		put_io_context(RQ_CIC(rq)->ioc);
+
+		rq->elevator_private = NULL;
+		rq->elevator_private2 = NULL;
+
+		bfq_put_queue(bfqq);
+	}
+}
+
+/*
+ * Allocate bfq data structures associated with this request.
+ */
+static int
+bfq_set_request(struct request_queue *q, struct request *rq, gfp_t gfp_mask)
+{
+	struct bfq_data *bfqd = q->elevator->elevator_data;
+	struct bfq_io_context *cic;
+	const int rw = rq_data_dir(rq);
+	const bool is_sync = rq_is_sync(rq);
+	struct bfq_queue *bfqq;
+	unsigned long flags;
+
+	might_sleep_if(gfp_mask & __GFP_WAIT);
+
+	cic = bfq_get_io_context(bfqd, gfp_mask);
+
+	spin_lock_irqsave(q->queue_lock, flags);
+
+	if (!cic)
+		goto queue_fail;
+
+	bfqq = cic_to_bfqq(cic, is_sync);
+	if (!bfqq || bfqq == &bfqd->oom_bfqq) {
+		bfqq = bfq_get_queue(bfqd, is_sync, cic->ioc, gfp_mask);
+		cic_set_bfqq(cic, bfqq, is_sync);
+	}
+
+	bfqq->allocated[rw]++;
+	atomic_inc(&bfqq->ref);
+
+	spin_unlock_irqrestore(q->queue_lock, flags);
+
+	rq->elevator_private = cic;
+	rq->elevator_private2 = bfqq;
+	return 0;
+
+queue_fail:
+	if (cic)
+		put_io_context(cic->ioc);
+
+	bfq_schedule_dispatch(bfqd);
+	spin_unlock_irqrestore(q->queue_lock, flags);
+	bfq_log(bfqd, "set_request fail");
+	return 1;
+}
+
+static void bfq_kick_queue(struct work_struct *work)
+{
+	struct bfq_data *bfqd =
+		container_of(work, struct bfq_data, unplug_work);
+	struct request_queue *q = bfqd->queue;
+
+	spin_lock_irq(q->queue_lock);
+	__blk_run_queue(bfqd->queue, false);
+	spin_unlock_irq(q->queue_lock);
+}
+
+/*
+ * Timer running if the in-service queue is idling, waiting for a new
+ * request after its last one completed.
+ */
+static void bfq_idle_slice_timer(unsigned long data)
+{
+	struct bfq_data *bfqd = (struct bfq_data *) data;
+	struct bfq_queue *bfqq;
+	unsigned long flags;
+	enum bfqq_expiration reason;
+
+	spin_lock_irqsave(bfqd->queue->queue_lock, flags);
+
+	bfqq = bfqd->in_service_queue;
+	/*
+	 * The queue may have been expired, or got a request, while the
+	 * timer was firing.
+	 */
+	if (bfqq && bfq_bfqq_wait_request(bfqq)) {
+		bfq_clear_bfqq_wait_request(bfqq);
+
+		if (bfq_may_expire_for_budg_timeout(bfqq))
+			reason = BFQ_BFQQ_BUDGET_TIMEOUT;
+		else if (RB_EMPTY_ROOT(&bfqq->sort_list))
+			reason = BFQ_BFQQ_TOO_IDLE;
+		else
+			goto schedule_dispatch;
+
+		bfq_bfqq_expire(bfqd, bfqq, 1, reason);
+	}
+
+schedule_dispatch:
+	bfq_schedule_dispatch(bfqd);
+	spin_unlock_irqrestore(bfqd->queue->queue_lock, flags);
+}
+
+static void bfq_shutdown_timer_wq(struct bfq_data *bfqd)
+{
+	del_timer_sync(&bfqd->idle_slice_timer);
+	cancel_work_sync(&bfqd->unplug_work);
+}
+
+static void bfq_put_async_queues(struct bfq_data *bfqd)
+{
+	int i;
+
+	for (i = 0; i < IOPRIO_BE_NR; i++) {
+		if (bfqd->async_bfqq[0][i])
+			bfq_put_queue(bfqd->async_bfqq[0][i]);
+		if (bfqd->async_bfqq[1][i])
+			bfq_put_queue(bfqd->async_bfqq[1][i]);
+	}
+
+	if (bfqd->async_idle_bfqq)
+		bfq_put_queue(bfqd->async_idle_bfqq);
+}
+
+static void bfq_bfqd_free(struct rcu_head *head)
+{
+	kfree(container_of(head, struct bfq_data, rcu));
+}
+
+static void bfq_exit_queue(struct elevator_queue *e)
+{
+	struct bfq_data *bfqd = e->elevator_data;
+	struct request_queue *q = bfqd->queue;
+
+	bfq_shutdown_timer_wq(bfqd);
+
+	spin_lock_irq(q->queue_lock);
+
+	if (bfqd->in_service_queue)
+		__bfq_bfqq_expire(bfqd, bfqd->in_service_queue);
+
+	while (!list_empty(&bfqd->cic_list)) {
+		struct bfq_io_context *cic = list_entry(bfqd->cic_list.next,
+							struct bfq_io_context,
+							queue_list);
+
+		__bfq_exit_single_io_context(bfqd, cic);
+	}
+
+	bfq_put_async_queues(bfqd);
+	bfq_release_groups(bfqd);
+#ifdef CONFIG_BFQ_GROUP_IOSCHED
+	blkiocg_del_blkio_group(&bfqd->root_group.blkg);
+#endif
+
+	spin_unlock_irq(q->queue_lock);
+
+	bfq_shutdown_timer_wq(bfqd);
+
+	spin_lock(&cic_index_lock);
+	ida_remove(&cic_index_ida, bfqd->cic_index);
+	spin_unlock(&cic_index_lock);
+
+	/* Wait for bfqg->blkg->key accessors to exit their grace periods. */
+	call_rcu(&bfqd->rcu, bfq_bfqd_free);
+}
+
+static int bfq_alloc_cic_index(void)
+{
+	int index, error;
+
+	do {
+		if (!ida_pre_get(&cic_index_ida, GFP_KERNEL))
+			return -ENOMEM;
+
+		spin_lock(&cic_index_lock);
+		error = ida_get_new(&cic_index_ida, &index);
+		spin_unlock(&cic_index_lock);
+		if (error && error != -EAGAIN)
+			return error;
+	} while (error);
+
+	return index;
+}
+
+static void *bfq_init_queue(struct request_queue *q)
+{
+	struct bfq_data *bfqd;
+	struct bfq_group *bfqg;
+	int i;
+
+	i = bfq_alloc_cic_index();
+	if (i < 0)
+		return NULL;
+
+	bfqd = kmalloc_node(sizeof(*bfqd), GFP_KERNEL | __GFP_ZERO, q->node);
+	if (!bfqd)
+		return NULL;
+
+	bfqd->cic_index = i;
+
+	/*
+	 * The root group only schedules, it is never scheduled itself.
+	 */
+	bfqg = &bfqd->root_group;
+	bfq_init_sched_data(&bfqg->sched_data);
+	bfqg->entity.my_sched_data = &bfqg->sched_data;
+
+#ifdef CONFIG_BFQ_GROUP_IOSCHED
+	/*
+	 * Take a reference to root group which we never drop. This is just
+	 * to make sure that bfq_put_group() does not try to kfree root group
+	 */
+	atomic_set(&bfqg->ref, 1);
+	bfqg->blkg.blkiop = &blkio_policy_bfq;
+	rcu_read_lock();
+	blkiocg_add_blkio_group(&blkio_root_cgroup, &bfqg->blkg, (void *)bfqd,
+				0, BLKIO_POLICY_PROP);
+	rcu_read_unlock();
+#endif
+
+	bfqd->queue = q;
+
+	/*
+	 * Tunables first: the oom queue below takes its budget from them.
+	 */
+	bfqd->bfq_quantum = bfq_quantum;
+	bfqd->bfq_fifo_expire[0] = bfq_fifo_expire[0];
+	bfqd->bfq_fifo_expire[1] = bfq_fifo_expire[1];
+	bfqd->bfq_back_max = bfq_back_max;
+	bfqd->bfq_back_penalty = bfq_back_penalty;
+	bfqd->bfq_slice_idle = bfq_slice_idle;
+	bfqd->bfq_max_budget = bfq_default_max_budget;
+	bfqd->bfq_max_budget_async_rq = bfq_max_budget_async_rq;
+	bfqd->bfq_timeout[BLK_RW_ASYNC] = bfq_timeout_async;
+	bfqd->bfq_timeout[BLK_RW_SYNC] = bfq_timeout_sync;
+
+	bfqd->low_latency = 1;
+	bfqd->bfq_wr_coeff = 20;
+	bfqd->bfq_wr_max_time = msecs_to_jiffies(7500);
+	bfqd->bfq_wr_rt_max_time = msecs_to_jiffies(300);
+	bfqd->bfq_wr_min_idle_time = msecs_to_jiffies(2000);
+	bfqd->bfq_wr_max_softrt_rate = 7000;
+
+	/*
+	 * Our fallback bfqq if bfq_find_alloc_queue() runs into OOM issues.
+	 * Grab a permanent reference to it, so that the normal code flow
+	 * will not attempt to free it.
+	 */
+	bfq_init_bfqq(bfqd, &bfqd->oom_bfqq, 1, 0);
+	atomic_inc(&bfqd->oom_bfqq.ref);
+	bfqd->oom_bfqq.ioprio = IOPRIO_NORM;
+	bfqd->oom_bfqq.ioprio_class = IOPRIO_CLASS_BE;
+	bfqd->oom_bfqq.entity.orig_weight = bfq_ioprio_to_weight(IOPRIO_NORM);
+	bfq_update_entity_weight(&bfqd->oom_bfqq);
+	bfq_clear_bfqq_prio_changed(&bfqd->oom_bfqq);
+	bfq_link_bfqq_bfqg(&bfqd->oom_bfqq, &bfqd->root_group);
+
+	INIT_LIST_HEAD(&bfqd->cic_list);
+
+	init_timer(&bfqd->idle_slice_timer);
+	bfqd->idle_slice_timer.function = bfq_idle_slice_timer;
+	bfqd->idle_slice_timer.data = (unsigned long) bfqd;
+
+	INIT_WORK(&bfqd->unplug_work, bfq_kick_queue);
+
+	bfqd->bfq_class_idle_last_service = jiffies;
+
+	return bfqd;
+}
+
+static void bfq_slab_kill(void)
+{
+	/*
+	 * Caller already ensured that pending RCU callbacks are completed,
+	 * so we should have no busy allocations at this point.
+	 */
+	if (bfq_pool)
+		kmem_cache_destroy(bfq_pool);
+	if (bfq_ioc_pool)
+		kmem_cache_destroy(bfq_ioc_pool);
+}
+
+static int __init bfq_slab_setup(void)
+{
+	bfq_pool = KMEM_CACHE(bfq_queue, 0);
+	if (!bfq_pool)
+		goto fail;
+
+	bfq_ioc_pool = KMEM_CACHE(bfq_io_context, 0);
+	if (!bfq_ioc_pool)
+		goto fail;
+
+	return 0;
+fail:
+	bfq_slab_kill();
+	return -ENOMEM;
+}
+
+/*
+ * sysfs parts below -->
+ */
+static ssize_t
+bfq_var_show(unsigned int var, char *page)
+{
+	return sprintf(page, "%d\n", var);
+}
+
+static ssize_t
+bfq_var_store(unsigned int *var, const char *page, size_t count)
+{
+	char *p = (char *) page;
+
+	*var = simple_strtoul(p, &p, 10);
+	return count;
+}
+
+#define SHOW_FUNCTION(__FUNC, __VAR, __CONV)				\
+static ssize_t __FUNC(struct elevator_queue *e, char *page)		\
+{									\
+	struct bfq_data *bfqd = e->elevator_data;			\
+	unsigned int __data = __VAR;					\
+	if (__CONV)							\
+		__data = jiffies_to_msecs(__data);			\
+	return bfq_var_show(__data, (page));				\
+}
+SHOW_FUNCTION(bfq_quantum_show, bfqd->bfq_quantum, 0);
+SHOW_FUNCTION(bfq_fifo_expire_sync_show, bfqd->bfq_fifo_expire[1], 1);
+SHOW_FUNCTION(bfq_fifo_expire_async_show, bfqd->bfq_fifo_expire[0], 1);
+SHOW_FUNCTION(bfq_back_seek_max_show, bfqd->bfq_back_max, 0);
+SHOW_FUNCTION(bfq_back_seek_penalty_show, bfqd->bfq_back_penalty, 0);
+SHOW_FUNCTION(bfq_slice_idle_show, bfqd->bfq_slice_idle, 1);
+SHOW_FUNCTION(bfq_max_budget_show, bfqd->bfq_user_max_budget, 0);
+SHOW_FUNCTION(bfq_max_budget_async_rq_show, bfqd->bfq_max_budget_async_rq, 0);
+SHOW_FUNCTION(bfq_timeout_sync_show, bfqd->bfq_timeout[BLK_RW_SYNC], 1);
+SHOW_FUNCTION(bfq_timeout_async_show, bfqd->bfq_timeout[BLK_RW_ASYNC], 1);
+SHOW_FUNCTION(bfq_low_latency_show, bfqd->low_latency, 0);
+SHOW_FUNCTION(bfq_wr_coeff_show, bfqd->bfq_wr_coeff, 0);
+SHOW_FUNCTION(bfq_wr_max_time_show, bfqd->bfq_wr_max_time, 1);
+SHOW_FUNCTION(bfq_wr_rt_max_time_show, bfqd->bfq_wr_rt_max_time, 1);
+SHOW_FUNCTION(bfq_wr_min_idle_time_show, bfqd->bfq_wr_min_idle_time, 1);
+SHOW_FUNCTION(bfq_wr_max_softrt_rate_show, bfqd->bfq_wr_max_softrt_rate, 0);
+#undef SHOW_FUNCTION
+
+#define STORE_FUNCTION(__FUNC, __PTR, MIN, MAX, __CONV)			\
+static ssize_t __FUNC(struct elevator_queue *e, const char *page, size_t count)	\
+{									\
+	struct bfq_data *bfqd = e->elevator_data;			\
+	unsigned int __data;						\
+	int ret = bfq_var_store(&__data, (page), count);		\
+	if (__data < (MIN))						\
+		__data = (MIN);						\
+	else if (__data > (MAX))					\
+		__data = (MAX);						\
+	if (__CONV)							\
+		*(__PTR) = msecs_to_jiffies(__data);			\
+	else								\
+		*(__PTR) = __data;					\
+	return ret;							\
+}
+STORE_FUNCTION(bfq_quantum_store, &bfqd->bfq_quantum, 1, UINT_MAX, 0);
+STORE_FUNCTION(bfq_fifo_expire_sync_store, &bfqd->bfq_fifo_expire[1], 1,
+		UINT_MAX, 1);
+STORE_FUNCTION(bfq_fifo_expire_async_store, &bfqd->bfq_fifo_expire[0], 1,
+		UINT_MAX, 1);
+STORE_FUNCTION(bfq_back_seek_max_store, &bfqd->bfq_back_max, 0, UINT_MAX, 0);
+STORE_FUNCTION(bfq_back_seek_penalty_store, &bfqd->bfq_back_penalty, 1,
+		UINT_MAX, 0);
+STORE_FUNCTION(bfq_slice_idle_store, &bfqd->bfq_slice_idle, 0, UINT_MAX, 1);
+STORE_FUNCTION(bfq_max_budget_async_rq_store, &bfqd->bfq_max_budget_async_rq,
+		1, UINT_MAX, 0);
+STORE_FUNCTION(bfq_timeout_async_store, &bfqd->bfq_timeout[BLK_RW_ASYNC], 0,
+		UINT_MAX, 1);
+STORE_FUNCTION(bfq_low_latency_store, &bfqd->low_latency, 0, 1, 0);
+STORE_FUNCTION(bfq_wr_coeff_store, &bfqd->bfq_wr_coeff, 1, 100, 0);
+STORE_FUNCTION(bfq_wr_max_time_store, &bfqd->bfq_wr_max_time, 0, UINT_MAX, 1);
+STORE_FUNCTION(bfq_wr_rt_max_time_store, &bfqd->bfq_wr_rt_max_time, 0,
+		UINT_MAX, 1);
+STORE_FUNCTION(bfq_wr_min_idle_time_store, &bfqd->bfq_wr_min_idle_time, 0,
+		UINT_MAX, 1);
+STORE_FUNCTION(bfq_wr_max_softrt_rate_store, &bfqd->bfq_wr_max_softrt_rate, 0,
+		UINT_MAX, 0);
+#undef STORE_FUNCTION
+
+/*
+ * With max_budget 0, the maximum budget follows the estimated peak rate
+ * of the device, once enough samples have been collected.
+ */
+static void bfq_update_max_budget(struct bfq_data *bfqd)
+{
+	if (bfqd->bfq_user_max_budget)
+		bfqd->bfq_max_budget = bfqd->bfq_user_max_budget;
+	else if (bfqd->peak_rate_samples >= BFQ_PEAK_RATE_SAMPLES)
+		bfqd->bfq_max_budget = max_t(unsigned long,
+			bfq_calc_max_budget(bfqd->peak_rate,
+			jiffies_to_msecs(bfqd->bfq_timeout[BLK_RW_SYNC])),
+			bfq_default_max_budget / 32);
+	else
+		bfqd->bfq_max_budget = bfq_default_max_budget;
+}
+
+static ssize_t bfq_max_budget_store(struct elevator_queue *e,
+				    const char *page, size_t count)
+{
+	struct bfq_data *bfqd = e->elevator_data;
+	unsigned int __data;
+	int ret = bfq_var_store(&__data, (page), count);
+
+	bfqd->bfq_user_max_budget = min_t(unsigned int, __data, 1 << 20);
+	bfq_update_max_budget(bfqd);
+	return ret;
+}
+
+static ssize_t bfq_timeout_sync_store(struct elevator_queue *e,
+				      const char *page, size_t count)
+{
+	struct bfq_data *bfqd = e->elevator_data;
+	unsigned int __data;
+	int ret = bfq_var_store(&__data, (page), count);
+
+	if (__data < 1)
+		__data = 1;
+	bfqd->bfq_timeout[BLK_RW_SYNC] = msecs_to_jiffies(__data);
+	bfq_update_max_budget(bfqd);
+	return ret;
+}
+
+#define BFQ_ATTR(name) \
+	__ATTR(name, S_IRUGO|S_IWUSR, bfq_##name##_show, bfq_##name##_store)
+
+static struct elv_fs_entry bfq_attrs[] = {
+	BFQ_ATTR(quantum),
+	BFQ_ATTR(fifo_expire_sync),
+	BFQ_ATTR(fifo_expire_async),
+	BFQ_ATTR(back_seek_max),
+	BFQ_ATTR(back_seek_penalty),
+	BFQ_ATTR(slice_idle),
+	BFQ_ATTR(max_budget),
+	BFQ_ATTR(max_budget_async_rq),
+	BFQ_ATTR(timeout_sync),
+	BFQ_ATTR(timeout_async),
+	BFQ_ATTR(low_latency),
+	BFQ_ATTR(wr_coeff),
+	BFQ_ATTR(wr_max_time),
+	BFQ_ATTR(wr_rt_max_time),
+	BFQ_ATTR(wr_min_idle_time),
+	BFQ_ATTR(wr_max_softrt_rate),
+	__ATTR_NULL
+};
+
+static struct elevator_type iosched_bfq = {
+	.ops = {
+		.elevator_merge_fn = 		bfq_merge,
+		.elevator_merged_fn =		bfq_merged_request,
+		.elevator_merge_req_fn =	bfq_merged_requests,
+		.elevator_allow_merge_fn =	bfq_allow_merge,
+		.elevator_bio_merged_fn =	bfq_bio_merged,
+		.elevator_dispatch_fn =		bfq_dispatch_requests,
+		.elevator_add_req_fn =		bfq_insert_request,
+		.elevator_activate_req_fn =	bfq_activate_request,
+		.elevator_deactivate_req_fn =	bfq_deactivate_request,
+		.elevator_queue_empty_fn =	bfq_queue_empty,
+		.elevator_completed_req_fn =	bfq_completed_request,
+		.elevator_former_req_fn =	elv_rb_former_request,
+		.elevator_latter_req_fn =	elv_rb_latter_request,
+		.elevator_set_req_fn =		bfq_set_request,
+		.elevator_put_req_fn =		bfq_put_request,
+		.elevator_may_queue_fn =	bfq_may_queue,
+		.elevator_init_fn =		bfq_init_queue,
+		.elevator_exit_fn =		bfq_exit_queue,
+		.trim =				bfq_free_io_context,
+	},
+	.elevator_attrs =	bfq_attrs,
+	.elevator_name =	"bfq",
+	.elevator_owner =	THIS_MODULE,
+};
+
+#ifdef CONFIG_BFQ_GROUP_IOSCHED
+static struct blkio_policy_type blkio_policy_bfq = {
+	.ops = {
+		.blkio_unlink_group_fn =	bfq_unlink_blkio_group,
+		.blkio_update_group_weight_fn =	bfq_update_blkio_group_weight,
+	},
+	.plid = BLKIO_POLICY_PROP,
+};
+#else
+static struct blkio_policy_type blkio_policy_bfq;
+#endif
+
+static int __init bfq_init(void)
+{
+	/*
+	 * could be 0 on HZ < 1000 setups
+	 */
+	if (!bfq_slice_idle)
+		bfq_slice_idle = 1;
+	if (!bfq_timeout_async)
+		bfq_timeout_async = 1;
+
+	if (bfq_slab_setup())
+		return -ENOMEM;
+
+	elv_register(&iosched_bfq);
+	blkio_policy_register(&blkio_policy_bfq);
+
+	return 0;
+}
+
+static void __exit bfq_exit(void)
+{
+	DECLARE_COMPLETION_ONSTACK(all_gone);
+	blkio_policy_unregister(&blkio_policy_bfq);
+	elv_unregister(&iosched_bfq);
+	ioc_gone = &all_gone;
+	/* ioc_gone's update must be visible before reading ioc_count */
+	smp_wmb();
+
+	/*
+	 * this also protects us from entering bfq_slab_kill() with
+	 * pending RCU callbacks
+	 */
+	if (elv_ioc_count_read(bfq_ioc_count))
+		wait_for_completion(&all_gone);
+	ida_destroy(&cic_index_ida);
+	bfq_slab_kill();
+}
+
+module_init(bfq_init);
+module_exit(bfq_exit);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("Budget Fair Queueing IO scheduler");
@@ -114,6 +114,18 @@ struct blkio_cgroup *cgroup_to_blkio_cgroup(struct cgroup *cgroup)
 }
 EXPORT_SYMBOL_GPL(cgroup_to_blkio_cgroup);
 
+/*
+ * cfq and bfq both implement BLKIO_POLICY_PROP, so for groups they create
+ * the plid alone does not tell which of them the group belongs to.
+ */
+static inline bool blkio_policy_owns_blkg(struct blkio_policy_type *blkiop,
+					  struct blkio_group *blkg)
+{
+	if (blkiop->plid != blkg->plid)
+		return false;
+	return !blkg->blkiop || blkg->blkiop == blkiop;
+}
+
 static inline void
 blkio_update_group_weight(struct blkio_group *blkg, unsigned int weight)
 {
@@ -121,7 +133,7 @@ blkio_update_group_weight(struct blkio_group *blkg, unsigned int weight)
 
 	list_for_each_entry(blkiop, &blkio_list, list) {
 		/* If this policy does not own the blkg, do not send updates */
-		if (blkiop->plid != blkg->plid)
+		if (!blkio_policy_owns_blkg(blkiop, blkg))
 			continue;
 		if (blkiop->ops.blkio_update_group_weight_fn)
 			blkiop->ops.blkio_update_group_weight_fn(blkg->key,
@@ -137,7 +149,7 @@ static inline void blkio_update_group_bps(struct blkio_group *blkg, u64 bps,
 	list_for_each_entry(blkiop, &blkio_list, list) {
 
 		/* If this policy does not own the blkg, do not send updates */
-		if (blkiop->plid != blkg->plid)
+		if (!blkio_policy_owns_blkg(blkiop, blkg))
 			continue;
 
 		if (fileid == BLKIO_THROTL_read_bps_device
@@ -160,7 +172,7 @@ static inline void blkio_update_group_iops(struct blkio_group *blkg,
 	list_for_each_entry(blkiop, &blkio_list, list) {
 
 		/* If this policy does not own the blkg, do not send updates */
-		if (blkiop->plid != blkg->plid)
+		if (!blkio_policy_owns_blkg(blkiop, blkg))
 			continue;
 
 		if (fileid == BLKIO_THROTL_read_iops_device
@@ -1423,7 +1435,7 @@ static void blkiocg_destroy(struct cgroup_subsys *subsys, struct cgroup *cgroup)
 		 */
 		spin_lock(&blkio_list_lock);
 		list_for_each_entry(blkiop, &blkio_list, list) {
-			if (blkiop->plid != blkg->plid)
+			if (!blkio_policy_owns_blkg(blkiop, blkg))
 				continue;
 			blkiop->ops.blkio_unlink_group_fn(key, blkg);
 		}
@@ -1501,7 +1513,7 @@ static void blkiocg_attach(struct cgroup_subsys *subsys, struct cgroup *cgroup,
 	task_lock(tsk);
 	ioc = tsk->io_context;
 	if (ioc)
-		ioc->cgroup_changed = 1;
+		ioc->cgroup_changed = IOC_CHANGED_ALL;
 	task_unlock(tsk);
 }
 
@@ -151,6 +151,8 @@ struct blkio_group {
 	dev_t dev;
 	/* policy which owns this blk group */
 	enum blkio_policy_id plid;
+	/* owning policy type if several share plid, NULL otherwise */
+	struct blkio_policy_type *blkiop;
 
 	/* Need to serialize the stats in the case of reset/update */
 	spinlock_t stats_lock;
@@ -27,6 +27,17 @@ static void cfq_dtor(struct io_context *ioc)
 	}
 }
 
+static void bfq_dtor(struct io_context *ioc)
+{
+	if (!hlist_empty(&ioc->bfq_cic_list)) {
+		struct bfq_io_context *cic;
+
+		cic = list_entry(ioc->bfq_cic_list.first, struct bfq_io_context,
+								cic_list);
+		cic->dtor(ioc);
+	}
+}
+
 /*
  * IO Context helper functions. put_io_context() returns 1 if there are no
  * more users of this io context, 0 otherwise.
@@ -41,6 +52,7 @@ int put_io_context(struct io_context *ioc)
 	if (atomic_long_dec_and_test(&ioc->refcount)) {
 		rcu_read_lock();
 		cfq_dtor(ioc);
+		bfq_dtor(ioc);
 		rcu_read_unlock();
 
 		kmem_cache_free(iocontext_cachep, ioc);
@@ -64,6 +76,20 @@ static void cfq_exit(struct io_context *ioc)
 	rcu_read_unlock();
 }
 
+static void bfq_exit(struct io_context *ioc)
+{
+	rcu_read_lock();
+
+	if (!hlist_empty(&ioc->bfq_cic_list)) {
+		struct bfq_io_context *cic;
+
+		cic = list_entry(ioc->bfq_cic_list.first, struct bfq_io_context,
+								cic_list);
+		cic->exit(ioc);
+	}
+	rcu_read_unlock();
+}
+
 /* Called by the exitting task */
 void exit_io_context(struct task_struct *task)
 {
@@ -76,7 +102,7 @@ void exit_io_context(struct task_struct *task)
 
 	if (atomic_dec_and_test(&ioc->nr_tasks)) {
 		cfq_exit(ioc);
-
+		bfq_exit(ioc);
 	}
 	put_io_context(ioc);
 }
@@ -91,12 +117,18 @@ struct io_context *alloc_io_context(gfp_t gfp_flags, int node)
 		atomic_set(&ret->nr_tasks, 1);
 		spin_lock_init(&ret->lock);
 		ret->ioprio_changed = 0;
+#if defined(CONFIG_BLK_CGROUP) || defined(CONFIG_BLK_CGROUP_MODULE)
+		ret->cgroup_changed = 0;
+#endif
 		ret->ioprio = 0;
 		ret->last_waited = 0; /* doesn't matter... */
 		ret->nr_batch_requests = 0; /* because this is 0 */
 		INIT_RADIX_TREE(&ret->radix_root, GFP_ATOMIC | __GFP_HIGH);
 		INIT_HLIST_HEAD(&ret->cic_list);
 		ret->ioc_data = NULL;
+		INIT_RADIX_TREE(&ret->bfq_radix_root, GFP_ATOMIC | __GFP_HIGH);
+		INIT_HLIST_HEAD(&ret->bfq_cic_list);
+		ret->bfq_ioc_data = NULL;
 	}
 
 	return ret;
@@ -0,0 +1,131 @@
+/*
+ * Tag allocation for blk-mq
+ *
+ * Every hardware queue owns a fixed set of tags, one per preallocated
+ * request. The tags are a plain bitmap that is allocated from without
+ * any lock: each cpu starts searching where it last succeeded, so cpus
+ * mostly touch different words of the map. The first reserved_tags
+ * tags are kept aside for callers that must not fail or wait behind
+ * normal I/O.
+ */
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/bitops.h>
+#include <linux/percpu.h>
+#include <linux/wait.h>
+#include <linux/sched.h>
+#include <linux/blkdev.h>
+
+#include "blk-mq.h"
+
+struct blk_mq_tags {
+	unsigned int		nr_tags;
+	unsigned int		nr_reserved_tags;
+	unsigned int __percpu	*hint;
+	wait_queue_head_t	wait;
+	unsigned long		bitmap[0];
+};
+
+static unsigned int __blk_mq_get_tag(struct blk_mq_tags *tags,
+				     unsigned int start, unsigned int end)
+{
+	unsigned int hint, tag, from, to;
+	int pass;
+
+	hint = this_cpu_read(*tags->hint);
+	if (hint < start || hint >= end)
+		hint = start;
+
+	/* search [hint, end) first, then wrap around to [start, hint) */
+	for (pass = 0; pass < 2; pass++) {
+		from = pass ? start : hint;
+		to = pass ? hint : end;
+
+		tag = from;
+		while ((tag = find_next_zero_bit(tags->bitmap, to, tag)) < to) {
+			if (!test_and_set_bit(tag, tags->bitmap)) {
+				this_cpu_write(*tags->hint, tag + 1);
+				return tag;
+			}
+			tag++;
+		}
+	}
+
+	return BLK_MQ_TAG_FAIL;
+}
+
+unsigned int blk_mq_get_tag(struct blk_mq_tags *tags, gfp_t gfp,
+			    bool reserved)
+{
+	unsigned int start, end, tag;
+	DEFINE_WAIT(wait);
+
+	if (reserved) {
+		start = 0;
+		end = tags->nr_reserved_tags;
+	} else {
+		start = tags->nr_reserved_tags;
+		end = tags->nr_tags;
+	}
+	if (unlikely(start == end))
+		return BLK_MQ_TAG_FAIL;
+
+	tag = __blk_mq_get_tag(tags, start, end);
+	if (tag != BLK_MQ_TAG_FAIL || !(gfp & __GFP_WAIT))
+		return tag;
+
+	for (;;) {
+		prepare_to_wait_exclusive(&tags->wait, &wait,
+					  TASK_UNINTERRUPTIBLE);
+		tag = __blk_mq_get_tag(tags, start, end);
+		if (tag != BLK_MQ_TAG_FAIL)
+			break;
+		io_schedule();
+	}
+	finish_wait(&tags->wait, &wait);
+
+	return tag;
+}
+
+void blk_mq_put_tag(struct blk_mq_tags *tags, unsigned int tag)
+{
+	BUG_ON(tag >= tags->nr_tags);
+
+	clear_bit(tag, tags->bitmap);
+	smp_mb__after_clear_bit();
+	if (waitqueue_active(&tags->wait))
+		wake_up(&tags->wait);
+}
+
+struct blk_mq_tags *blk_mq_init_tags(unsigned int nr_tags,
+				     unsigned int reserved_tags, int node)
+{
+	struct blk_mq_tags *tags;
+
+	if (!nr_tags || reserved_tags >= nr_tags)
+		return NULL;
+
+	tags = kzalloc_node(sizeof(*tags) +
+			    BITS_TO_LONGS(nr_tags) * sizeof(unsigned long),
+			    GFP_KERNEL, node);
+	if (!tags)
+		return NULL;
+
+	tags->hint = alloc_percpu(unsigned int);
+	if (!tags->hint) {
+		kfree(tags);
+		return NULL;
+	}
+
+	tags->nr_tags = nr_tags;
+	tags->nr_reserved_tags = reserved_tags;
+	init_waitqueue_head(&tags->wait);
+	return tags;
+}
+
+void blk_mq_free_tags(struct blk_mq_tags *tags)
+{
+	free_percpu(tags->hint);
+	kfree(tags);
+}
@@ -0,0 +1,914 @@
+/*
+ * Block multiqueue core code
+ *
+ * Requests are staged on per-cpu software queues without touching a
+ * shared lock, and handed to the driver from one or more hardware
+ * dispatch queues. Requests are preallocated per hardware queue and
+ * looked up by tag, and completions are steered back to the cpu that
+ * submitted them.
+ */
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/backing-dev.h>
+#include <linux/bio.h>
+#include <linux/blkdev.h>
+#include <linux/mm.h>
+#include <linux/init.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/workqueue.h>
+#include <linux/smp.h>
+#include <linux/sched.h>
+#include <linux/list_sort.h>
+#include <linux/cpumask.h>
+#include <linux/hardirq.h>
+#include <linux/hrtimer.h>
+#include <linux/math64.h>
+#include <linux/blk-mq.h>
+#include <trace/events/block.h>
+
+#include "blk.h"
+#include "blk-mq.h"
+#include "blk-wbt.h"
+
+static struct blk_mq_ctx *__blk_mq_get_ctx(struct request_queue *q,
+					   unsigned int cpu)
+{
+	return per_cpu_ptr(q->queue_ctx, cpu);
+}
+
+/*
+ * Check if any of the ctx's have pending work in this hardware queue
+ */
+static bool blk_mq_hctx_has_pending(struct blk_mq_hw_ctx *hctx)
+{
+	return find_first_bit(hctx->ctx_map, hctx->nr_ctx) < hctx->nr_ctx ||
+		!list_empty_careful(&hctx->dispatch);
+}
+
+/*
+ * Mark this ctx as having pending work in this hardware queue
+ */
+static void blk_mq_hctx_mark_pending(struct blk_mq_hw_ctx *hctx,
+				     struct blk_mq_ctx *ctx)
+{
+	if (!test_bit(ctx->index_hw, hctx->ctx_map))
+		set_bit(ctx->index_hw, hctx->ctx_map);
+}
+
+/*
+ * Default mapping to a hardware queue
+ */
+struct blk_mq_hw_ctx *blk_mq_map_queue(struct request_queue *q, const int cpu)
+{
+	return q->queue_hw_ctx[q->mq_map[cpu]];
+}
+EXPORT_SYMBOL(blk_mq_map_queue);
+
+static struct blk_mq_hw_ctx *blk_mq_rq_hctx(struct request *rq)
+{
+	struct request_queue *q = rq->q;
+
+	return q->mq_ops->map_queue(q, rq->mq_ctx->cpu);
+}
+
+/*
+ * Allocate a request from the hardware queue of the current cpu. The tag
+ * may be waited for, in which case we could end up running elsewhere;
+ * that is fine, the request stays with the software queue we picked.
+ */
+static struct request *__blk_mq_alloc_request(struct request_queue *q,
+					      int rw, gfp_t gfp, bool reserved)
+{
+	unsigned int cpu = raw_smp_processor_id();
+	struct blk_mq_ctx *ctx = __blk_mq_get_ctx(q, cpu);
+	struct blk_mq_hw_ctx *hctx = q->mq_ops->map_queue(q, cpu);
+	struct request *rq;
+	unsigned int tag;
+
+	tag = blk_mq_get_tag(hctx->tags, gfp, reserved);
+	if (tag == BLK_MQ_TAG_FAIL)
+		return NULL;
+
+	rq = hctx->rqs[tag];
+	blk_rq_init(q, rq);
+	rq->tag = tag;
+	rq->mq_ctx = ctx;
+	rq->cmd_flags = rw;
+	rq->cpu = cpu;
+	return rq;
+}
+
+struct request *blk_mq_alloc_request(struct request_queue *q, int rw,
+				     gfp_t gfp, bool reserved)
+{
+	return __blk_mq_alloc_request(q, rw, gfp, reserved);
+}
+EXPORT_SYMBOL(blk_mq_alloc_request);
+
+void blk_mq_free_request(struct request *rq)
+{
+	struct blk_mq_hw_ctx *hctx = blk_mq_rq_hctx(rq);
+
+	wbt_done(rq->q, rq);
+	rq->mq_ctx = NULL;
+	blk_mq_put_tag(hctx->tags, rq->tag);
+}
+EXPORT_SYMBOL(blk_mq_free_request);
+
+/*
+ * Fold the completion time of @rq into the average of its software queue,
+ * the same way CFQ tracks think time.
+ */
+static void blk_mq_stat_add(struct request *rq)
+{
+	struct blk_mq_ctx *ctx = rq->mq_ctx;
+	const int dir = rq_data_dir(rq);
+	s64 lat = ktime_to_ns(ktime_get()) - rq->issue_time_ns;
+
+	if (lat < 0)
+		return;
+
+	ctx->lat_samples[dir] = (7 * ctx->lat_samples[dir] + 256) / 8;
+	ctx->lat_total[dir] = (7 * ctx->lat_total[dir] + 256 * lat) / 8;
+	ctx->lat_mean[dir] = div_u64(ctx->lat_total[dir] + 128,
+				     ctx->lat_samples[dir]);
+}
+
+/**
+ * blk_mq_end_io - end I/O on a request
+ * @rq:		the request being completed
+ * @error:	0 for success, < 0 for error
+ *
+ * Description:
+ *     Completes all bios of @rq and gives its tag back. Requests that
+ *     have an ->end_io callback are handed to it instead and must be
+ *     freed by the owner with blk_mq_free_request().
+ */
+void blk_mq_end_io(struct request *rq, int error)
+{
+	if (rq->issue_time_ns)
+		blk_mq_stat_add(rq);
+	wbt_done(rq->q, rq);
+
+	if (blk_update_request(rq, error, blk_rq_bytes(rq)))
+		BUG();
+
+	if (rq->end_io)
+		rq->end_io(rq, error);
+	else
+		blk_mq_free_request(rq);
+}
+EXPORT_SYMBOL(blk_mq_end_io);
+
+static void blk_mq_softirq_done(struct request *rq)
+{
+	blk_mq_end_io(rq, rq->errors);
+}
+
+/**
+ * blk_mq_complete_request - end I/O on a request from interrupt context
+ * @rq:		the request being completed, with ->errors set
+ *
+ * Description:
+ *     Like blk_complete_request(), the completion is deferred to the
+ *     block softirq, which runs on the cpu that submitted @rq (or one
+ *     sharing a cache with it) so that the bios are completed where
+ *     their data is hot.
+ */
+void blk_mq_complete_request(struct request *rq)
+{
+	blk_complete_request(rq);
+}
+EXPORT_SYMBOL(blk_mq_complete_request);
+
+static void blk_mq_start_request(struct blk_mq_hw_ctx *hctx,
+				 struct request *rq)
+{
+	struct request_queue *q = hctx->queue;
+
+	trace_block_rq_issue(q, rq);
+
+	/* completion times are only needed to size hybrid poll sleeps */
+	if (test_bit(QUEUE_FLAG_POLL, &q->queue_flags))
+		rq->issue_time_ns = ktime_to_ns(ktime_get());
+	wbt_issue(q, rq);
+}
+
+/*
+ * Run this hardware queue, pulling any software queues mapped to it in.
+ * Note that this function currently has various problems around ordering
+ * of IO. In particular, we'd like FIFO behaviour on handling existing
+ * items on the hctx->dispatch list. Ignore that for now.
+ */
+static void __blk_mq_run_hw_queue(struct blk_mq_hw_ctx *hctx)
+{
+	struct request_queue *q = hctx->queue;
+	struct blk_mq_ctx *ctx;
+	struct request *rq;
+	LIST_HEAD(rq_list);
+	int bit, queued;
+
+	if (unlikely(test_bit(BLK_MQ_S_STOPPED, &hctx->state)))
+		return;
+
+	hctx->run++;
+
+	/*
+	 * Touch any software queue that has pending entries.
+	 */
+	for_each_set_bit(bit, hctx->ctx_map, hctx->nr_ctx) {
+		clear_bit(bit, hctx->ctx_map);
+		ctx = hctx->ctxs[bit];
+		BUG_ON(bit != ctx->index_hw);
+
+		spin_lock(&ctx->lock);
+		list_splice_tail_init(&ctx->rq_list, &rq_list);
+		spin_unlock(&ctx->lock);
+	}
+
+	/*
+	 * If we have previous entries on our dispatch list, grab them
+	 * and stuff them at the front for more fair dispatch.
+	 */
+	if (!list_empty_careful(&hctx->dispatch)) {
+		spin_lock(&hctx->lock);
+		if (!list_empty(&hctx->dispatch))
+			list_splice_init(&hctx->dispatch, &rq_list);
+		spin_unlock(&hctx->lock);
+	}
+
+	/*
+	 * Now process all the entries, sending them to the driver.
+	 */
+	queued = 0;
+	while (!list_empty(&rq_list)) {
+		int ret;
+
+		rq = list_first_entry(&rq_list, struct request, queuelist);
+		list_del_init(&rq->queuelist);
+
+		blk_mq_start_request(hctx, rq);
+
+		ret = q->mq_ops->queue_rq(hctx, rq);
+		if (ret == BLK_MQ_RQ_QUEUE_OK) {
+			queued++;
+			continue;
+		}
+		if (ret == BLK_MQ_RQ_QUEUE_BUSY) {
+			/*
+			 * The driver is out of resources and is expected to
+			 * have stopped the queue; it restarts it once it
+			 * can take more.
+			 */
+			list_add(&rq->queuelist, &rq_list);
+			break;
+		}
+
+		if (ret != BLK_MQ_RQ_QUEUE_ERROR)
+			printk(KERN_ERR "blk-mq: bad return on queue: %d\n",
+			       ret);
+		rq->errors = -EIO;
+		blk_mq_end_io(rq, rq->errors);
+	}
+
+	hctx->queued += queued;
+
+	/*
+	 * Any items that need requeuing? Stuff them into hctx->dispatch,
+	 * that is where we will continue on next queue run.
+	 */
+	if (!list_empty(&rq_list)) {
+		spin_lock(&hctx->lock);
+		list_splice(&rq_list, &hctx->dispatch);
+		spin_unlock(&hctx->lock);
+	}
+}
+
+static void blk_mq_run_hw_queue(struct blk_mq_hw_ctx *hctx, bool async)
+{
+	if (unlikely(test_bit(BLK_MQ_S_STOPPED, &hctx->state)))
+		return;
+	if (!blk_mq_hctx_has_pending(hctx))
+		return;
+
+	if (!async && !in_interrupt() && !irqs_disabled())
+		__blk_mq_run_hw_queue(hctx);
+	else
+		kblockd_schedule_work(hctx->queue, &hctx->run_work);
+}
+
+void blk_mq_run_queues(struct request_queue *q, bool async)
+{
+	struct blk_mq_hw_ctx *hctx;
+	int i;
+
+	queue_for_each_hw_ctx(q, hctx, i)
+		blk_mq_run_hw_queue(hctx, async);
+}
+EXPORT_SYMBOL(blk_mq_run_queues);
+
+void blk_mq_stop_hw_queue(struct blk_mq_hw_ctx *hctx)
+{
+	set_bit(BLK_MQ_S_STOPPED, &hctx->state);
+}
+EXPORT_SYMBOL(blk_mq_stop_hw_queue);
+
+void blk_mq_start_hw_queue(struct blk_mq_hw_ctx *hctx)
+{
+	clear_bit(BLK_MQ_S_STOPPED, &hctx->state);
+	blk_mq_run_hw_queue(hctx, false);
+}
+EXPORT_SYMBOL(blk_mq_start_hw_queue);
+
+void blk_mq_start_stopped_hw_queues(struct request_queue *q)
+{
+	struct blk_mq_hw_ctx *hctx;
+	int i;
+
+	queue_for_each_hw_ctx(q, hctx, i) {
+		if (!test_bit(BLK_MQ_S_STOPPED, &hctx->state))
+			continue;
+
+		clear_bit(BLK_MQ_S_STOPPED, &hctx->state);
+		blk_mq_run_hw_queue(hctx, true);
+	}
+}
+EXPORT_SYMBOL(blk_mq_start_stopped_hw_queues);
+
+static void blk_mq_work_fn(struct work_struct *work)
+{
+	struct blk_mq_hw_ctx *hctx;
+
+	hctx = container_of(work, struct blk_mq_hw_ctx, run_work);
+	__blk_mq_run_hw_queue(hctx);
+}
+
+static void __blk_mq_insert_request(struct blk_mq_hw_ctx *hctx,
+				    struct blk_mq_ctx *ctx,
+				    struct request *rq)
+{
+	trace_block_rq_insert(hctx->queue, rq);
+
+	list_add_tail(&rq->queuelist, &ctx->rq_list);
+	blk_mq_hctx_mark_pending(hctx, ctx);
+}
+
+static void blk_mq_insert_request(struct request *rq, bool async)
+{
+	struct blk_mq_ctx *ctx = rq->mq_ctx;
+	struct blk_mq_hw_ctx *hctx = blk_mq_rq_hctx(rq);
+
+	spin_lock(&ctx->lock);
+	__blk_mq_insert_request(hctx, ctx, rq);
+	spin_unlock(&ctx->lock);
+
+	blk_mq_run_hw_queue(hctx, async);
+}
+
+static int plug_ctx_cmp(void *priv, struct list_head *a, struct list_head *b)
+{
+	struct request *rqa = container_of(a, struct request, queuelist);
+	struct request *rqb = container_of(b, struct request, queuelist);
+
+	if (rqa->mq_ctx != rqb->mq_ctx)
+		return rqa->mq_ctx < rqb->mq_ctx ? -1 : 1;
+	return blk_rq_pos(rqa) < blk_rq_pos(rqb) ? -1 : 1;
+}
+
+/*
+ * Move the requests collected under an on-stack plug to their software
+ * queues, one lock round trip per software queue, and kick the hardware
+ * queues they map to. ->queue_rq() may block, so when the plug is flushed
+ * from schedule() the queues are run from kblockd.
+ */
+void blk_mq_flush_plug_list(struct blk_plug *plug, bool from_schedule)
+{
+	struct blk_mq_hw_ctx *this_hctx = NULL;
+	struct blk_mq_ctx *this_ctx = NULL;
+	struct request *rq;
+	LIST_HEAD(list);
+
+	list_splice_init(&plug->mq_list, &list);
+	list_sort(NULL, &list, plug_ctx_cmp);
+
+	while (!list_empty(&list)) {
+		rq = list_entry_rq(list.next);
+		list_del_init(&rq->queuelist);
+
+		if (rq->mq_ctx != this_ctx) {
+			if (this_ctx) {
+				spin_unlock(&this_ctx->lock);
+				blk_mq_run_hw_queue(this_hctx, from_schedule);
+			}
+			this_ctx = rq->mq_ctx;
+			this_hctx = blk_mq_rq_hctx(rq);
+			spin_lock(&this_ctx->lock);
+		}
+		__blk_mq_insert_request(this_hctx, this_ctx, rq);
+	}
+
+	if (this_ctx) {
+		spin_unlock(&this_ctx->lock);
+		blk_mq_run_hw_queue(this_hctx, from_schedule);
+	}
+}
+
+/*
+ * Try to merge the bio into one of the last few requests still sitting
+ * on the software queue of this cpu.
+ */
+static bool blk_mq_attempt_merge(struct request_queue *q, struct bio *bio)
+{
+	struct blk_mq_ctx *ctx;
+	struct request *rq;
+	bool merged = false;
+	int checked = 8;
+
+	ctx = __blk_mq_get_ctx(q, get_cpu());
+	spin_lock(&ctx->lock);
+
+	list_for_each_entry_reverse(rq, &ctx->rq_list, queuelist) {
+		int el_ret;
+
+		if (!checked--)
+			break;
+
+		el_ret = elv_try_merge(rq, bio);
+		if (el_ret == ELEVATOR_BACK_MERGE)
+			merged = bio_attempt_back_merge(q, rq, bio);
+		else if (el_ret == ELEVATOR_FRONT_MERGE)
+			merged = bio_attempt_front_merge(q, rq, bio);
+		if (merged)
+			break;
+	}
+
+	spin_unlock(&ctx->lock);
+	put_cpu();
+	return merged;
+}
+
+static int blk_mq_make_request(struct request_queue *q, struct bio *bio)
+{
+	const bool is_sync = rw_is_sync(bio->bi_rw);
+	const bool is_flush_fua = bio->bi_rw & (REQ_FLUSH | REQ_FUA);
+	struct blk_plug *plug;
+	struct request *rq;
+	unsigned int rw_flags;
+	bool wb_acct;
+
+	blk_queue_bounce(q, &bio);
+
+	if (!is_flush_fua && !blk_queue_nomerges(q)) {
+		if (blk_attempt_plug_merge(q, bio))
+			return 0;
+		if ((q->queue_hw_ctx[0]->flags & BLK_MQ_F_SHOULD_MERGE) &&
+		    blk_mq_attempt_merge(q, bio))
+			return 0;
+	}
+
+	rw_flags = bio_data_dir(bio);
+	if (is_sync)
+		rw_flags |= REQ_SYNC;
+
+	wb_acct = wbt_wait(q, bio, NULL);
+
+	rq = __blk_mq_alloc_request(q, rw_flags, GFP_NOIO, false);
+	init_request_from_bio(rq, bio);
+	wbt_track(rq, wb_acct);
+	bio->bi_cookie = blk_tag_to_qc_t(rq->tag, blk_mq_rq_hctx(rq)->queue_num);
+	if (!blk_rq_cpu_valid(rq))
+		rq->cpu = rq->mq_ctx->cpu;
+
+	/*
+	 * Flushes are not sequenced here, they go straight to the driver
+	 * which is expected to honour REQ_FLUSH and REQ_FUA itself.
+	 */
+	plug = current->plug;
+	if (plug && !is_flush_fua) {
+		if (list_empty(&plug->mq_list))
+			trace_block_plug(q);
+		else if (!plug->should_sort) {
+			struct request *last = list_entry_rq(plug->mq_list.prev);
+
+			if (last->q != q)
+				plug->should_sort = 1;
+		}
+		list_add_tail(&rq->queuelist, &plug->mq_list);
+		if (++plug->count >= BLK_MAX_REQUEST_COUNT)
+			blk_flush_plug_list(plug, false);
+		return 0;
+	}
+
+	blk_mq_insert_request(rq, false);
+	return 0;
+}
+
+/*
+ * How long to sleep before polling for @rq: half its expected completion
+ * time, so that we wake up a little before it is done. 0 if there is no
+ * estimate yet.
+ */
+static unsigned long blk_mq_poll_nsecs(struct request *rq)
+{
+	struct blk_mq_ctx *ctx = rq->mq_ctx;
+	const int dir = rq_data_dir(rq);
+
+	if (!ctx || ctx->lat_samples[dir] <= 80)
+		return 0;
+
+	return ctx->lat_mean[dir] / 2;
+}
+
+/*
+ * Sleep once per request before polling for it, either for a fixed time
+ * or for an estimate of when it will complete. Polling the whole time
+ * from submission would burn a cpu for no gain on all but the fastest
+ * devices. Returns true if we slept, the caller then checks whether the
+ * request completed before polling.
+ */
+static bool blk_mq_poll_hybrid_sleep(struct request_queue *q,
+				     struct request *rq)
+{
+	struct hrtimer_sleeper hs;
+	unsigned long nsecs;
+
+	if (q->poll_nsec < 0 ||
+	    test_bit(REQ_ATOM_POLL_SLEPT, &rq->atomic_flags))
+		return false;
+
+	if (q->poll_nsec > 0)
+		nsecs = q->poll_nsec;
+	else
+		nsecs = blk_mq_poll_nsecs(rq);
+	if (!nsecs)
+		return false;
+
+	set_bit(REQ_ATOM_POLL_SLEPT, &rq->atomic_flags);
+
+	hrtimer_init_on_stack(&hs.timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+	hrtimer_init_sleeper(&hs, current);
+
+	/* the completion of our request wakes us up early, that is fine */
+	set_current_state(TASK_UNINTERRUPTIBLE);
+	hrtimer_start(&hs.timer, ktime_set(0, nsecs), HRTIMER_MODE_REL);
+	if (hs.task)
+		io_schedule();
+	hrtimer_cancel(&hs.timer);
+	__set_current_state(TASK_RUNNING);
+
+	destroy_hrtimer_on_stack(&hs.timer);
+	return true;
+}
+
+/**
+ * blk_poll - wait for a request by polling the device
+ * @q:		the queue the bio was submitted to
+ * @cookie:	->bi_cookie of the bio
+ *
+ * Description:
+ *    For a task that set itself TASK_UNINTERRUPTIBLE and will be woken
+ *    by the completion of the bio, like a synchronous direct I/O
+ *    submitter. Instead of sleeping until the interrupt, reap completions
+ *    from the driver's ->poll() until the task is woken or needs to
+ *    reschedule. Depending on queue/io_poll_delay, first sleep for part
+ *    of the expected completion time.
+ *
+ *    Returns true if the caller should recheck its wait condition, false
+ *    if it should go to sleep as usual.
+ */
+bool blk_poll(struct request_queue *q, blk_qc_t cookie)
+{
+	struct blk_mq_hw_ctx *hctx;
+	struct blk_plug *plug;
+	struct request *rq;
+	long state;
+
+	if (!q->mq_ops || !q->mq_ops->poll || !blk_qc_t_valid(cookie) ||
+	    !test_bit(QUEUE_FLAG_POLL, &q->queue_flags))
+		return false;
+
+	/* the request may still be sitting in our plug */
+	plug = current->plug;
+	if (plug)
+		blk_flush_plug_list(plug, false);
+
+	hctx = q->queue_hw_ctx[blk_qc_t_to_queue_num(cookie)];
+	rq = hctx->rqs[blk_qc_t_to_tag(cookie)];
+
+	if (blk_mq_poll_hybrid_sleep(q, rq))
+		return true;
+
+	hctx->poll_considered++;
+
+	state = current->state;
+	while (!need_resched()) {
+		int ret;
+
+		hctx->poll_invoked++;
+
+		ret = q->mq_ops->poll(hctx, blk_qc_t_to_tag(cookie));
+		if (ret > 0) {
+			hctx->poll_success++;
+			__set_current_state(TASK_RUNNING);
+			return true;
+		}
+
+		if (signal_pending_state(state, current))
+			__set_current_state(TASK_RUNNING);
+
+		if (current->state == TASK_RUNNING)
+			return true;
+		if (ret < 0)
+			break;
+		cpu_relax();
+	}
+
+	__set_current_state(TASK_RUNNING);
+	return false;
+}
+EXPORT_SYMBOL_GPL(blk_poll);
+
+/*
+ * queue/io_poll_stats: poll counters of every hardware queue, and the
+ * completion time averages hybrid polling works from.
+ */
+ssize_t blk_mq_poll_stats_show(struct request_queue *q, char *page)
+{
+	struct blk_mq_hw_ctx *hctx;
+	struct blk_mq_ctx *ctx;
+	u64 mean[2] = { 0, 0 };
+	unsigned long samples[2] = { 0, 0 };
+	unsigned int i, j, dir;
+	ssize_t len = 0;
+
+	if (!q->mq_ops)
+		return -EINVAL;
+
+	queue_for_each_hw_ctx(q, hctx, i) {
+		len += snprintf(page + len, PAGE_SIZE - len,
+				"hctx%u: considered=%lu invoked=%lu success=%lu\n",
+				i, hctx->poll_considered, hctx->poll_invoked,
+				hctx->poll_success);
+
+		hctx_for_each_ctx(hctx, ctx, j) {
+			for (dir = 0; dir < 2; dir++) {
+				mean[dir] += ctx->lat_mean[dir] *
+					     ctx->lat_samples[dir];
+				samples[dir] += ctx->lat_samples[dir];
+			}
+		}
+	}
+
+	for (dir = 0; dir < 2; dir++)
+		if (samples[dir])
+			mean[dir] = div64_u64(mean[dir], samples[dir]);
+
+	len += snprintf(page + len, PAGE_SIZE - len,
+			"read: mean_ns=%llu\nwrite: mean_ns=%llu\n",
+			(unsigned long long)mean[READ],
+			(unsigned long long)mean[WRITE]);
+	return len;
+}
+
+/*
+ * Spread the cpus over the hardware queues in contiguous chunks, so that
+ * neighbouring cpus, which usually share caches, share a queue.
+ */
+static unsigned int *blk_mq_make_queue_map(unsigned int nr_hw_queues,
+					   int node)
+{
+	unsigned int *map;
+	unsigned int cpu;
+
+	map = kzalloc_node(sizeof(*map) * nr_cpu_ids, GFP_KERNEL, node);
+	if (!map)
+		return NULL;
+
+	for_each_possible_cpu(cpu)
+		map[cpu] = (unsigned long long) cpu * nr_hw_queues / nr_cpu_ids;
+
+	return map;
+}
+
+static int blk_mq_init_rq_map(struct blk_mq_hw_ctx *hctx,
+			      struct blk_mq_reg *reg)
+{
+	size_t rq_size = ALIGN(sizeof(struct request) + reg->cmd_size,
+			       cache_line_size());
+	unsigned int i;
+
+	hctx->rqs = kzalloc_node(reg->queue_depth * sizeof(struct request *),
+				 GFP_KERNEL, reg->numa_node);
+	if (!hctx->rqs)
+		return -ENOMEM;
+
+	hctx->rq_mem = vzalloc_node(reg->queue_depth * rq_size,
+				    reg->numa_node);
+	if (!hctx->rq_mem)
+		goto err_rqs;
+
+	for (i = 0; i < reg->queue_depth; i++) {
+		hctx->rqs[i] = hctx->rq_mem + i * rq_size;
+		hctx->rqs[i]->tag = i;
+	}
+
+	hctx->tags = blk_mq_init_tags(reg->queue_depth, reg->reserved_tags,
+				      reg->numa_node);
+	if (!hctx->tags)
+		goto err_mem;
+
+	return 0;
+
+err_mem:
+	vfree(hctx->rq_mem);
+err_rqs:
+	kfree(hctx->rqs);
+	return -ENOMEM;
+}
+
+static void blk_mq_free_hw_queues(struct request_queue *q, unsigned int nr)
+{
+	struct blk_mq_hw_ctx *hctx;
+	unsigned int i;
+
+	for (i = 0; i < nr; i++) {
+		hctx = q->queue_hw_ctx[i];
+		if (!hctx)
+			continue;
+
+		cancel_work_sync(&hctx->run_work);
+		if (q->mq_ops->exit_hctx &&
+		    test_bit(BLK_MQ_S_DRIVER_INIT, &hctx->state))
+			q->mq_ops->exit_hctx(hctx, i);
+		if (hctx->tags)
+			blk_mq_free_tags(hctx->tags);
+		vfree(hctx->rq_mem);
+		kfree(hctx->rqs);
+		kfree(hctx->ctxs);
+		kfree(hctx->ctx_map);
+		free_cpumask_var(hctx->cpumask);
+		kfree(hctx);
+	}
+}
+
+static int blk_mq_init_hw_queues(struct request_queue *q,
+				 struct blk_mq_reg *reg, void *driver_data)
+{
+	struct blk_mq_hw_ctx *hctx;
+	struct blk_mq_ctx *ctx;
+	unsigned int i, cpu;
+
+	for (i = 0; i < reg->nr_hw_queues; i++) {
+		hctx = kzalloc_node(sizeof(*hctx), GFP_KERNEL, reg->numa_node);
+		if (!hctx)
+			return -ENOMEM;
+		q->queue_hw_ctx[i] = hctx;
+
+		spin_lock_init(&hctx->lock);
+		INIT_LIST_HEAD(&hctx->dispatch);
+		INIT_WORK(&hctx->run_work, blk_mq_work_fn);
+		if (!zalloc_cpumask_var(&hctx->cpumask, GFP_KERNEL))
+			return -ENOMEM;
+
+		hctx->queue = q;
+		hctx->flags = reg->flags;
+		hctx->queue_num = i;
+		hctx->numa_node = reg->numa_node;
+
+		if (blk_mq_init_rq_map(hctx, reg))
+			return -ENOMEM;
+	}
+
+	/*
+	 * Map the software queues. Count them per hardware queue first, so
+	 * the ctx arrays and pending bitmaps can be sized.
+	 */
+	for_each_possible_cpu(cpu) {
+		ctx = __blk_mq_get_ctx(q, cpu);
+		memset(ctx, 0, sizeof(*ctx));
+		spin_lock_init(&ctx->lock);
+		INIT_LIST_HEAD(&ctx->rq_list);
+		ctx->cpu = cpu;
+		ctx->queue = q;
+
+		hctx = q->mq_ops->map_queue(q, cpu);
+		cpumask_set_cpu(cpu, hctx->cpumask);
+		hctx->nr_ctx++;
+	}
+
+	queue_for_each_hw_ctx(q, hctx, i) {
+		hctx->ctxs = kmalloc_node(hctx->nr_ctx * sizeof(void *),
+					  GFP_KERNEL, reg->numa_node);
+		hctx->ctx_map = kzalloc_node(BITS_TO_LONGS(hctx->nr_ctx) *
+					     sizeof(unsigned long),
+					     GFP_KERNEL, reg->numa_node);
+		if (!hctx->ctxs || !hctx->ctx_map)
+			return -ENOMEM;
+		hctx->nr_ctx = 0;
+	}
+
+	for_each_possible_cpu(cpu) {
+		ctx = __blk_mq_get_ctx(q, cpu);
+		hctx = q->mq_ops->map_queue(q, cpu);
+		ctx->index_hw = hctx->nr_ctx;
+		hctx->ctxs[hctx->nr_ctx++] = ctx;
+	}
+
+	if (!reg->ops->init_hctx)
+		return 0;
+
+	queue_for_each_hw_ctx(q, hctx, i) {
+		if (reg->ops->init_hctx(hctx, driver_data, i))
+			return -ENOMEM;
+		set_bit(BLK_MQ_S_DRIVER_INIT, &hctx->state);
+	}
+
+	return 0;
+}
+
+/**
+ * blk_mq_init_queue - set up a multi-queue request queue
+ * @reg:	the hardware queue layout and driver operations
+ * @driver_data: passed to ->init_hctx() for every hardware queue
+ *
+ * Description:
+ *    Returns the new queue or an ERR_PTR(). The queue is bio based as far
+ *    as the rest of the block layer is concerned: there is no elevator,
+ *    requests are sorted and merged only within a task's plug and the
+ *    per-cpu software queues. ->queue_rq() is called from process context
+ *    without any block layer lock held and may sleep. Tear the queue down
+ *    with blk_cleanup_queue().
+ */
+struct request_queue *blk_mq_init_queue(struct blk_mq_reg *reg,
+					void *driver_data)
+{
+	struct request_queue *q;
+
+	if (!reg->nr_hw_queues || !reg->ops->queue_rq ||
+	    !reg->ops->map_queue)
+		return ERR_PTR(-EINVAL);
+
+	if (!reg->queue_depth)
+		reg->queue_depth = BLK_MQ_MAX_DEPTH;
+	else if (reg->queue_depth > BLK_MQ_MAX_DEPTH) {
+		printk(KERN_ERR "blk-mq: queuedepth too large (%u)\n",
+		       reg->queue_depth);
+		reg->queue_depth = BLK_MQ_MAX_DEPTH;
+	}
+	if (reg->queue_depth <= reg->reserved_tags)
+		return ERR_PTR(-EINVAL);
+
+	if (reg->nr_hw_queues > nr_cpu_ids)
+		reg->nr_hw_queues = nr_cpu_ids;
+
+	q = blk_alloc_queue_node(GFP_KERNEL, reg->numa_node);
+	if (!q)
+		return ERR_PTR(-ENOMEM);
+
+	q->mq_ops = reg->ops;
+	q->nr_hw_queues = reg->nr_hw_queues;
+	q->queue_flags |= QUEUE_FLAG_MQ_DEFAULT;
+
+	q->queue_ctx = alloc_percpu(struct blk_mq_ctx);
+	q->queue_hw_ctx = kzalloc_node(reg->nr_hw_queues * sizeof(void *),
+				       GFP_KERNEL, reg->numa_node);
+	q->mq_map = blk_mq_make_queue_map(reg->nr_hw_queues, reg->numa_node);
+	if (!q->queue_ctx || !q->queue_hw_ctx || !q->mq_map)
+		goto err;
+
+	blk_queue_make_request(q, blk_mq_make_request);
+	blk_queue_softirq_done(q, blk_mq_softirq_done);
+	q->nr_requests = reg->queue_depth;
+
+	if (reg->ops->poll)
+		q->queue_flags |= 1 << QUEUE_FLAG_POLL;
+
+	if (blk_mq_init_hw_queues(q, reg, driver_data))
+		goto err;
+
+	return q;
+
+err:
+	blk_cleanup_queue(q);
+	return ERR_PTR(-ENOMEM);
+}
+EXPORT_SYMBOL(blk_mq_init_queue);
+
+/*
+ * Called from blk_cleanup_queue(), the queue must be idle.
+ */
+void blk_mq_free_queue(struct request_queue *q)
+{
+	if (q->queue_hw_ctx)
+		blk_mq_free_hw_queues(q, q->nr_hw_queues);
+	kfree(q->queue_hw_ctx);
+	free_percpu(q->queue_ctx);
+	kfree(q->mq_map);
+
+	q->queue_hw_ctx = NULL;
+	q->queue_ctx = NULL;
+	q->mq_map = NULL;
+	q->nr_hw_queues = 0;
+}
+EXPORT_SYMBOL(blk_mq_free_queue);
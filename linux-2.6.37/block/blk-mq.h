@@ -0,0 +1,47 @@
+#ifndef INT_BLK_MQ_H
+#define INT_BLK_MQ_H
+
+/*
+ * Per-cpu software staging queue
+ */
+struct blk_mq_ctx {
+	struct {
+		spinlock_t		lock;
+		struct list_head	rq_list;
+	} ____cacheline_aligned_in_smp;
+
+	unsigned int		cpu;
+	unsigned int		index_hw;	/* bit in hctx->ctx_map */
+
+	/*
+	 * Decaying average of the completion time of requests, per data
+	 * direction, for hybrid polling. Updated without locking: requests
+	 * mostly complete on the cpu that queued them, and the value is
+	 * only a hint.
+	 */
+	unsigned long		lat_samples[2];
+	u64			lat_total[2];
+	u64			lat_mean[2];
+
+	struct request_queue	*queue;
+} ____cacheline_aligned_in_smp;
+
+/* hctx->state bit: ->init_hctx() succeeded, call ->exit_hctx() on teardown */
+#define BLK_MQ_S_DRIVER_INIT	1
+
+void blk_mq_flush_plug_list(struct blk_plug *plug, bool from_schedule);
+ssize_t blk_mq_poll_stats_show(struct request_queue *q, char *page);
+
+/*
+ * Tag allocation, blk-mq-tag.c
+ */
+struct blk_mq_tags *blk_mq_init_tags(unsigned int nr_tags,
+				     unsigned int reserved_tags, int node);
+void blk_mq_free_tags(struct blk_mq_tags *tags);
+unsigned int blk_mq_get_tag(struct blk_mq_tags *tags, gfp_t gfp,
+			    bool reserved);
+void blk_mq_put_tag(struct blk_mq_tags *tags, unsigned int tag);
+
+#define BLK_MQ_TAG_FAIL		((unsigned int) -1)
+
+#endif
@@ -7,8 +7,11 @@
 #include <linux/bio.h>
 #include <linux/blkdev.h>
 #include <linux/blktrace_api.h>
+#include <linux/blk-mq.h>
 
 #include "blk.h"
+#include "blk-mq.h"
+#include "blk-wbt.h"
 
 struct queue_sysfs_entry {
 	struct attribute attr;
@@ -265,6 +268,98 @@ queue_rq_affinity_store(struct request_queue *q, const char *page, size_t count)
 	return ret;
 }
 
+static ssize_t queue_poll_show(struct request_queue *q, char *page)
+{
+	return queue_var_show(test_bit(QUEUE_FLAG_POLL, &q->queue_flags), page);
+}
+
+static ssize_t queue_poll_store(struct request_queue *q, const char *page,
+				size_t count)
+{
+	unsigned long poll_on;
+	ssize_t ret;
+
+	if (!q->mq_ops || !q->mq_ops->poll)
+		return -EINVAL;
+
+	ret = queue_var_store(&poll_on, page, count);
+
+	spin_lock_irq(q->queue_lock);
+	if (poll_on)
+		queue_flag_set(QUEUE_FLAG_POLL, q);
+	else
+		queue_flag_clear(QUEUE_FLAG_POLL, q);
+	spin_unlock_irq(q->queue_lock);
+
+	return ret;
+}
+
+/*
+ * -1 polls right away, 0 sleeps for half the mean completion time first,
+ * anything else is a fixed sleep in usecs.
+ */
+static ssize_t queue_poll_delay_show(struct request_queue *q, char *page)
+{
+	int val = q->poll_nsec;
+
+	if (val > 0)
+		val /= 1000;
+	return sprintf(page, "%d\n", val);
+}
+
+static ssize_t queue_poll_delay_store(struct request_queue *q,
+				      const char *page, size_t count)
+{
+	char *p = (char *)page;
+	long val;
+
+	if (!q->mq_ops || !q->mq_ops->poll)
+		return -EINVAL;
+
+	val = simple_strtol(p, &p, 10);
+	if (val < -1 || val > INT_MAX / 1000)
+		return -EINVAL;
+
+	q->poll_nsec = val > 0 ? val * 1000 : val;
+	return count;
+}
+
+static ssize_t queue_poll_stats_show(struct request_queue *q, char *page)
+{
+	return blk_mq_poll_stats_show(q, page);
+}
+
+#ifdef CONFIG_BLK_WBT
+static ssize_t queue_wb_lat_show(struct request_queue *q, char *page)
+{
+	if (!q->rq_wb)
+		return -EINVAL;
+
+	return sprintf(page, "%llu\n",
+		       (unsigned long long) div_u64(q->rq_wb->min_lat_nsec, 1000));
+}
+
+static ssize_t queue_wb_lat_store(struct request_queue *q, const char *page,
+				  size_t count)
+{
+	char *p = (char *)page;
+	long long val;
+
+	if (!q->rq_wb)
+		return -EINVAL;
+
+	val = simple_strtoll(p, &p, 10);
+	if (val < -1)
+		return -EINVAL;
+
+	if (val == -1)
+		wbt_set_min_lat(q, wbt_default_latency_nsec(q));
+	else
+		wbt_set_min_lat(q, val * 1000);
+	return count;
+}
+#endif
+
 static struct queue_sysfs_entry queue_requests_entry = {
 	.attr = {.name = "nr_requests", .mode = S_IRUGO | S_IWUSR },
 	.show = queue_requests_show,
@@ -379,6 +474,31 @@ static struct queue_sysfs_entry queue_random_entry = {
 	.store = queue_store_random,
 };
 
+static struct queue_sysfs_entry queue_poll_entry = {
+	.attr = {.name = "io_poll", .mode = S_IRUGO | S_IWUSR },
+	.show = queue_poll_show,
+	.store = queue_poll_store,
+};
+
+static struct queue_sysfs_entry queue_poll_delay_entry = {
+	.attr = {.name = "io_poll_delay", .mode = S_IRUGO | S_IWUSR },
+	.show = queue_poll_delay_show,
+	.store = queue_poll_delay_store,
+};
+
+static struct queue_sysfs_entry queue_poll_stats_entry = {
+	.attr = {.name = "io_poll_stats", .mode = S_IRUGO },
+	.show = queue_poll_stats_show,
+};
+
+#ifdef CONFIG_BLK_WBT
+static struct queue_sysfs_entry queue_wb_lat_entry = {
+	.attr = {.name = "wbt_lat_usec", .mode = S_IRUGO | S_IWUSR },
+	.show = queue_wb_lat_show,
+	.store = queue_wb_lat_store,
+};
+#endif
+
 static struct attribute *default_attrs[] = {
 	&queue_requests_entry.attr,
 	&queue_ra_entry.attr,
@@ -401,6 +521,12 @@ static struct attribute *default_attrs[] = {
 	&queue_rq_affinity_entry.attr,
 	&queue_iostats_entry.attr,
 	&queue_random_entry.attr,
+	&queue_poll_entry.attr,
+	&queue_poll_delay_entry.attr,
+	&queue_poll_stats_entry.attr,
+#ifdef CONFIG_BLK_WBT
+	&queue_wb_lat_entry.attr,
+#endif
 	NULL,
 };
 
@@ -472,6 +598,7 @@ static void blk_release_queue(struct kobject *kobj)
 	blk_sync_queue(q);
 
 	blk_throtl_exit(q);
+	wbt_exit(q);
 
 	if (rl->rq_pool)
 		mempool_destroy(rl->rq_pool);
@@ -516,6 +643,10 @@ int blk_register_queue(struct gendisk *disk)
 
 	kobject_uevent(&q->kobj, KOBJ_ADD);
 
+	/* throttling is only done for queues that make requests */
+	if (q->request_fn || q->mq_ops)
+		wbt_init(q);
+
 	if (!q->request_fn)
 		return 0;
 
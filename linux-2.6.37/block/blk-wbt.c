@@ -0,0 +1,456 @@
+/*
+ * Writeback throttling
+ *
+ * Background writeback can fill the device queue with writes, and every
+ * read issued after that has to wait for them. This is what makes a
+ * machine feel stuck while a large file is being written out. We limit
+ * how many buffered writes a queue may have in flight, and size that
+ * limit by watching read completion latencies, much like CoDel does for
+ * network queues: if the lowest read latency seen in a monitoring window
+ * exceeds the target, the depth allowed to writes is halved and the next
+ * window made shorter. Once latencies are fine again, or there are no
+ * reads to protect, the depth is scaled back up.
+ *
+ * Reads, sync writes (O_DIRECT, O_SYNC, fsync), flushes and discards
+ * are never throttled.
+ */
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/bio.h>
+#include <linux/blkdev.h>
+#include <linux/backing-dev.h>
+#include <linux/slab.h>
+#include <linux/swap.h>
+#include <linux/sched.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+
+#include "blk-wbt.h"
+
+#define CREATE_TRACE_POINTS
+#include <trace/events/wbt.h>
+
+enum {
+	/* depth of a queue that has not been scaled down */
+	RWB_DEF_DEPTH		= 16,
+
+	/* writes a window needs without reads to count as write only */
+	RWB_MIN_WRITE_SAMPLES	= 3,
+
+	/* windows without samples before the depth drifts back up */
+	RWB_UNKNOWN_BUMP	= 5,
+};
+
+#define RWB_WINDOW_NSEC		(100 * 1000 * 1000ULL)
+#define RWB_LAT_ROT_NSEC	(75 * 1000 * 1000ULL)
+#define RWB_LAT_NONROT_NSEC	(2 * 1000 * 1000ULL)
+
+enum wbt_lat_status {
+	LAT_OK = 1,
+	LAT_UNKNOWN,
+	LAT_UNKNOWN_WRITES,
+	LAT_EXCEEDED,
+};
+
+static inline bool rwb_enabled(struct rq_wb *rwb)
+{
+	return rwb && rwb->min_lat_nsec != 0;
+}
+
+/*
+ * Only buffered writes are throttled, anything somebody is waiting for
+ * goes straight through.
+ */
+static inline bool wbt_should_throttle(struct bio *bio)
+{
+	const unsigned long mask = REQ_WRITE | REQ_SYNC | REQ_FLUSH |
+				   REQ_FUA | REQ_DISCARD;
+
+	return (bio->bi_rw & mask) == REQ_WRITE;
+}
+
+static void calc_wb_limits(struct rq_wb *rwb)
+{
+	unsigned int depth = rwb->queue->nr_requests;
+
+	if (!depth || depth > RWB_DEF_DEPTH)
+		depth = RWB_DEF_DEPTH;
+
+	rwb->wb_max = 1 + ((depth - 1) >> min(31, rwb->scale_step));
+	rwb->wb_normal = (rwb->wb_max + 1) / 2;
+	rwb->wb_background = (rwb->wb_max + 3) / 4;
+}
+
+static void rwb_trace_step(struct rq_wb *rwb, const char *msg)
+{
+	trace_wbt_step(&rwb->queue->backing_dev_info, msg, rwb->scale_step,
+		       rwb->cur_win_nsec, rwb->wb_background, rwb->wb_normal,
+		       rwb->wb_max);
+}
+
+static void scale_up(struct rq_wb *rwb)
+{
+	if (!rwb->scale_step)
+		return;
+
+	rwb->scale_step--;
+	rwb->unknown_cnt = 0;
+	calc_wb_limits(rwb);
+	rwb_trace_step(rwb, "step up");
+
+	wake_up_all(&rwb->wait);
+}
+
+static void scale_down(struct rq_wb *rwb)
+{
+	/* no point going below one write in flight */
+	if (rwb->wb_max == 1)
+		return;
+
+	rwb->scale_step++;
+	rwb->unknown_cnt = 0;
+	calc_wb_limits(rwb);
+	rwb_trace_step(rwb, "step down");
+}
+
+static void rwb_arm_timer(struct rq_wb *rwb)
+{
+	/*
+	 * Like the CoDel interval, the window shrinks with the square root
+	 * of how far we scaled down: win_nsec / sqrt(scale_step + 1),
+	 * computed in fixed point.
+	 */
+	if (rwb->scale_step > 0)
+		rwb->cur_win_nsec = div_u64(rwb->win_nsec << 4,
+					int_sqrt((rwb->scale_step + 1) << 8));
+	else
+		rwb->cur_win_nsec = rwb->win_nsec;
+
+	mod_timer(&rwb->window_timer,
+		  jiffies + max(1UL, nsecs_to_jiffies(rwb->cur_win_nsec)));
+}
+
+static void wb_timer_fn(unsigned long data)
+{
+	struct rq_wb *rwb = (struct rq_wb *) data;
+	struct backing_dev_info *bdi = &rwb->queue->backing_dev_info;
+	unsigned int inflight = atomic_read(&rwb->inflight);
+	unsigned int rd_nr, wr_nr;
+	unsigned long flags;
+	u64 rd_min_lat;
+	int status;
+
+	spin_lock_irqsave(&rwb->lock, flags);
+	rd_min_lat = rwb->rd_min_lat;
+	rd_nr = rwb->rd_nr;
+	wr_nr = rwb->wr_nr;
+	rwb->rd_min_lat = 0;
+	rwb->rd_nr = rwb->wr_nr = 0;
+	spin_unlock_irqrestore(&rwb->lock, flags);
+
+	trace_wbt_stat(bdi, rd_min_lat, rd_nr, wr_nr);
+
+	if (!rwb_enabled(rwb))
+		return;
+
+	if (!rd_nr) {
+		/*
+		 * Nothing to protect. If writes went through fine, there is
+		 * no reason to hold them back.
+		 */
+		if (wr_nr >= RWB_MIN_WRITE_SAMPLES)
+			status = LAT_UNKNOWN_WRITES;
+		else
+			status = LAT_UNKNOWN;
+	} else if (rd_min_lat > rwb->min_lat_nsec && (wr_nr || inflight)) {
+		/*
+		 * Only blame writes if there were some; a device that is
+		 * just slow to read must not starve writeback.
+		 */
+		trace_wbt_lat(bdi, (unsigned long) div_u64(rd_min_lat, 1000));
+		status = LAT_EXCEEDED;
+	} else
+		status = LAT_OK;
+
+	trace_wbt_timer(bdi, status, rwb->scale_step, inflight);
+
+	switch (status) {
+	case LAT_EXCEEDED:
+		scale_down(rwb);
+		break;
+	case LAT_OK:
+	case LAT_UNKNOWN_WRITES:
+		scale_up(rwb);
+		break;
+	case LAT_UNKNOWN:
+		if (++rwb->unknown_cnt >= RWB_UNKNOWN_BUMP)
+			scale_up(rwb);
+		break;
+	}
+
+	/* keep monitoring until we are back at full depth and idle */
+	if (rwb->scale_step > 0 || inflight)
+		rwb_arm_timer(rwb);
+}
+
+/*
+ * Whether a read or sync request was issued or completed recently: then
+ * writeback only gets the background depth, so that it does not fill
+ * the queue in front of it.
+ */
+static bool close_io(struct rq_wb *rwb)
+{
+	const unsigned long now = jiffies;
+
+	return time_before(now, rwb->last_issue + HZ / 10) ||
+	       time_before(now, rwb->last_comp + HZ / 10);
+}
+
+static unsigned int get_wb_limit(struct rq_wb *rwb)
+{
+	struct backing_dev_info *bdi = &rwb->queue->backing_dev_info;
+
+	/*
+	 * Somebody is waiting for pages to be cleaned, either to allocate
+	 * memory or because it was throttled for dirtying too many: let
+	 * writeback use the full depth.
+	 */
+	if (current_is_kswapd() ||
+	    time_before(jiffies, bdi->dirty_sleep + HZ / 10))
+		return rwb->wb_max;
+
+	if (close_io(rwb))
+		return rwb->wb_background;
+
+	return rwb->wb_normal;
+}
+
+static bool atomic_inc_below(atomic_t *v, int below)
+{
+	int cur = atomic_read(v);
+
+	for (;;) {
+		int old;
+
+		if (cur >= below)
+			return false;
+		old = atomic_cmpxchg(v, cur, cur + 1);
+		if (old == cur)
+			break;
+		cur = old;
+	}
+
+	return true;
+}
+
+/**
+ * wbt_wait - throttle a bio before a request is allocated for it
+ * @q:		the queue the bio is for
+ * @bio:	the bio
+ * @lock:	queue lock held by the caller with irqs off, or NULL
+ *
+ * Description:
+ *     Waits until @bio may be issued if it is a buffered write and the
+ *     queue has as many of those in flight as it currently allows.
+ *     @lock is dropped while sleeping. Returns true if the request made
+ *     for @bio must be tracked, see wbt_track().
+ */
+bool wbt_wait(struct request_queue *q, struct bio *bio, spinlock_t *lock)
+{
+	struct rq_wb *rwb = q->rq_wb;
+	DEFINE_WAIT(wait);
+
+	if (!rwb_enabled(rwb) || !wbt_should_throttle(bio))
+		return false;
+
+	if (atomic_inc_below(&rwb->inflight, get_wb_limit(rwb)))
+		return true;
+
+	for (;;) {
+		prepare_to_wait_exclusive(&rwb->wait, &wait,
+					  TASK_UNINTERRUPTIBLE);
+
+		if (!rwb_enabled(rwb)) {
+			finish_wait(&rwb->wait, &wait);
+			return false;
+		}
+		if (atomic_inc_below(&rwb->inflight, get_wb_limit(rwb)))
+			break;
+
+		if (lock) {
+			spin_unlock_irq(lock);
+			io_schedule();
+			spin_lock_irq(lock);
+		} else
+			io_schedule();
+	}
+
+	finish_wait(&rwb->wait, &wait);
+	return true;
+}
+
+/**
+ * wbt_issue - note that a request is handed to the driver
+ * @q:		the queue
+ * @rq:		the request
+ */
+void wbt_issue(struct request_queue *q, struct request *rq)
+{
+	struct rq_wb *rwb = q->rq_wb;
+
+	if (!rwb_enabled(rwb) || rq->cmd_type != REQ_TYPE_FS)
+		return;
+
+	if (!(rq->wbt_flags & WBT_TRACKED))
+		rwb->last_issue = jiffies;
+
+	rq->issue_time_ns = ktime_to_ns(ktime_get());
+	rq->wbt_flags |= WBT_STAT;
+}
+
+static void wbt_account(struct rq_wb *rwb, struct request *rq)
+{
+	s64 lat = ktime_to_ns(ktime_get()) - rq->issue_time_ns;
+	unsigned long flags;
+
+	if (!(rq->wbt_flags & WBT_TRACKED))
+		rwb->last_comp = jiffies;
+
+	if (lat < 0)
+		return;
+
+	spin_lock_irqsave(&rwb->lock, flags);
+	if (rq_data_dir(rq) == READ) {
+		if (!rwb->rd_nr || lat < rwb->rd_min_lat)
+			rwb->rd_min_lat = lat;
+		rwb->rd_nr++;
+	} else
+		rwb->wr_nr++;
+	spin_unlock_irqrestore(&rwb->lock, flags);
+
+	if (!timer_pending(&rwb->window_timer))
+		rwb_arm_timer(rwb);
+}
+
+static void wbt_rqw_done(struct rq_wb *rwb)
+{
+	int inflight = atomic_dec_return(&rwb->inflight);
+	int limit;
+
+	if (!rwb_enabled(rwb)) {
+		wake_up_all(&rwb->wait);
+		return;
+	}
+
+	/*
+	 * Let a few completions pile up before waking the next writer,
+	 * rather than switching to it for every single one. Wake anyway
+	 * once the queue is idle.
+	 */
+	limit = close_io(rwb) ? rwb->wb_background : rwb->wb_normal;
+	if (inflight && inflight >= limit)
+		return;
+
+	if (waitqueue_active(&rwb->wait)) {
+		int diff = limit - inflight;
+
+		if (!inflight || diff >= rwb->wb_background / 2)
+			wake_up(&rwb->wait);
+	}
+}
+
+/**
+ * wbt_done - account a request that completed or is freed
+ * @q:		the queue
+ * @rq:		the request
+ *
+ * Description:
+ *     May be called more than once for the same request, only the first
+ *     call counts.
+ */
+void wbt_done(struct request_queue *q, struct request *rq)
+{
+	struct rq_wb *rwb = q->rq_wb;
+
+	if (!rwb || !rq->wbt_flags)
+		return;
+
+	if (rq->wbt_flags & WBT_STAT)
+		wbt_account(rwb, rq);
+	if (rq->wbt_flags & WBT_TRACKED)
+		wbt_rqw_done(rwb);
+
+	rq->wbt_flags = 0;
+}
+
+/*
+ * Reads from a disk take a seek or two when the queue is not full of
+ * writes, from flash barely anything.
+ */
+u64 wbt_default_latency_nsec(struct request_queue *q)
+{
+	if (blk_queue_nonrot(q))
+		return RWB_LAT_NONROT_NSEC;
+
+	return RWB_LAT_ROT_NSEC;
+}
+
+/*
+ * Set the target read latency, 0 turns throttling off. Starts over from
+ * the full depth.
+ */
+void wbt_set_min_lat(struct request_queue *q, u64 nsec)
+{
+	struct rq_wb *rwb = q->rq_wb;
+
+	if (!rwb)
+		return;
+
+	rwb->min_lat_nsec = nsec;
+	rwb->scale_step = 0;
+	rwb->unknown_cnt = 0;
+	calc_wb_limits(rwb);
+	rwb_trace_step(rwb, "reset");
+
+	wake_up_all(&rwb->wait);
+}
+
+int wbt_init(struct request_queue *q)
+{
+	struct rq_wb *rwb;
+
+	/* several disks may share a queue */
+	if (q->rq_wb)
+		return 0;
+
+	rwb = kzalloc_node(sizeof(*rwb), GFP_KERNEL, q->node);
+	if (!rwb)
+		return -ENOMEM;
+
+	atomic_set(&rwb->inflight, 0);
+	init_waitqueue_head(&rwb->wait);
+	spin_lock_init(&rwb->lock);
+	setup_timer(&rwb->window_timer, wb_timer_fn, (unsigned long) rwb);
+
+	rwb->queue = q;
+	rwb->win_nsec = RWB_WINDOW_NSEC;
+	rwb->cur_win_nsec = RWB_WINDOW_NSEC;
+	rwb->min_lat_nsec = wbt_default_latency_nsec(q);
+	rwb->last_issue = rwb->last_comp = jiffies;
+	calc_wb_limits(rwb);
+
+	q->rq_wb = rwb;
+	return 0;
+}
+
+void wbt_exit(struct request_queue *q)
+{
+	struct rq_wb *rwb = q->rq_wb;
+
+	if (!rwb)
+		return;
+
+	del_timer_sync(&rwb->window_timer);
+	q->rq_wb = NULL;
+	kfree(rwb);
+}
@@ -0,0 +1,99 @@
+#ifndef BLK_WBT_H
+#define BLK_WBT_H
+
+#include <linux/atomic.h>
+#include <linux/wait.h>
+#include <linux/timer.h>
+#include <linux/spinlock.h>
+
+struct request_queue;
+struct request;
+struct bio;
+
+/* rq->wbt_flags */
+enum {
+	WBT_TRACKED	= 1,	/* counted in rwb->inflight */
+	WBT_STAT	= 2,	/* issue_time_ns is valid, account latency */
+};
+
+/*
+ * Writeback throttling state of a queue, see blk-wbt.c
+ */
+struct rq_wb {
+	/*
+	 * Allowed depths of background writes for the three kinds of
+	 * writers: background flushing while other I/O is going on,
+	 * normal writeback, and tasks throttled in balance_dirty_pages()
+	 * or kswapd, which must not be starved.
+	 */
+	unsigned int		wb_background;
+	unsigned int		wb_normal;
+	unsigned int		wb_max;
+
+	int			scale_step;	/* 0 is the full depth */
+	unsigned int		unknown_cnt;	/* windows without samples */
+
+	u64			win_nsec;	/* base monitoring window */
+	u64			cur_win_nsec;	/* shrinks as scale_step grows */
+	u64			min_lat_nsec;	/* target read latency, 0: off */
+
+	struct timer_list	window_timer;
+
+	atomic_t		inflight;	/* tracked writes issued */
+	wait_queue_head_t	wait;
+
+	unsigned long		last_issue;	/* jiffies, last other I/O */
+	unsigned long		last_comp;
+
+	/* completions in the current window, under lock */
+	spinlock_t		lock;
+	u64			rd_min_lat;
+	unsigned int		rd_nr;
+	unsigned int		wr_nr;
+
+	struct request_queue	*queue;
+};
+
+#ifdef CONFIG_BLK_WBT
+
+int wbt_init(struct request_queue *q);
+void wbt_exit(struct request_queue *q);
+bool wbt_wait(struct request_queue *q, struct bio *bio, spinlock_t *lock);
+void wbt_issue(struct request_queue *q, struct request *rq);
+void wbt_done(struct request_queue *q, struct request *rq);
+u64 wbt_default_latency_nsec(struct request_queue *q);
+void wbt_set_min_lat(struct request_queue *q, u64 nsec);
+
+static inline void wbt_track(struct request *rq, bool tracked)
+{
+	if (tracked)
+		rq->wbt_flags |= WBT_TRACKED;
+}
+
+#else
+
+static inline int wbt_init(struct request_queue *q)
+{
+	return 0;
+}
+static inline void wbt_exit(struct request_queue *q)
+{
+}
+static inline bool wbt_wait(struct request_queue *q, struct bio *bio,
+			    spinlock_t *lock)
+{
+	return false;
+}
+static inline void wbt_issue(struct request_queue *q, struct request *rq)
+{
+}
+static inline void wbt_done(struct request_queue *q, struct request *rq)
+{
+}
+static inline void wbt_track(struct request *rq, bool tracked)
+{
+}
+
+#endif /* CONFIG_BLK_WBT */
+
+#endif
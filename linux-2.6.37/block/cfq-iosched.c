@@ -979,6 +979,8 @@ static void cfq_group_served(struct cfq_data *cfqd, struct cfq_group *cfqg,
 }
 
 #ifdef CONFIG_CFQ_GROUP_IOSCHED
+static struct blkio_policy_type blkio_policy_cfq;
+
 static inline struct cfq_group *cfqg_of_blkg(struct blkio_group *blkg)
 {
 	if (blkg)
@@ -1034,6 +1036,7 @@ cfq_find_alloc_cfqg(struct cfq_data *cfqd, struct cgroup *cgroup, int create)
 	 * and minor info and this info will be filled in once a new thread
 	 * comes for IO. See code above.
 	 */
+	cfqg->blkg.blkiop = &blkio_policy_cfq;
 	if (bdi->dev) {
 		sscanf(dev_name(bdi->dev), "%u:%u", &major, &minor);
 		cfq_blkiocg_add_blkio_group(blkcg, &cfqg->blkg, (void *)cfqd,
@@ -2833,7 +2836,6 @@ static void changed_ioprio(struct io_context *ioc, struct cfq_io_context *cic)
 static void cfq_ioc_set_ioprio(struct io_context *ioc)
 {
 	call_for_each_cic(ioc, changed_ioprio);
-	ioc->ioprio_changed = 0;
 }
 
 static void cfq_init_cfqq(struct cfq_data *cfqd, struct cfq_queue *cfqq,
@@ -2887,7 +2889,6 @@ static void changed_cgroup(struct io_context *ioc, struct cfq_io_context *cic)
 static void cfq_ioc_set_cgroup(struct io_context *ioc)
 {
 	call_for_each_cic(ioc, changed_cgroup);
-	ioc->cgroup_changed = 0;
 }
 #endif  /* CONFIG_CFQ_GROUP_IOSCHED */
 
@@ -3118,11 +3119,11 @@ cfq_get_io_context(struct cfq_data *cfqd, gfp_t gfp_mask)
 
 out:
 	smp_read_barrier_depends();
-	if (unlikely(ioc->ioprio_changed))
+	if (unlikely(test_and_clear_bit(IOC_CFQ_CHANGED, &ioc->ioprio_changed)))
 		cfq_ioc_set_ioprio(ioc);
 
 #ifdef CONFIG_CFQ_GROUP_IOSCHED
-	if (unlikely(ioc->cgroup_changed))
+	if (unlikely(test_and_clear_bit(IOC_CFQ_CHANGED, &ioc->cgroup_changed)))
 		cfq_ioc_set_cgroup(ioc);
 #endif
 	return cic;
@@ -3886,6 +3887,7 @@ static void *cfq_init_queue(struct request_queue *q)
 	 * to make sure that cfq_put_cfqg() does not try to kfree root group
 	 */
 	atomic_set(&cfqg->ref, 1);
+	cfqg->blkg.blkiop = &blkio_policy_cfq;
 	rcu_read_lock();
 	cfq_blkiocg_add_blkio_group(&blkio_root_cgroup, &cfqg->blkg,
 					(void *)cfqd, 0);
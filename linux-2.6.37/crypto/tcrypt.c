@@ -26,6 +26,7 @@
 #include <linux/jiffies.h>
 #include <linux/timex.h>
 #include <linux/interrupt.h>
+#include <linux/slab.h>
 #include "tcrypt.h"
 #include "internal.h"
 
@@ -57,7 +58,7 @@ static char *check[] = {
 	"cast6", "arc4", "michael_mic", "deflate", "crc32c", "tea", "xtea",
 	"khazad", "wp512", "wp384", "wp256", "tnepres", "xeta",  "fcrypt",
 	"camellia", "seed", "salsa20", "rmd128", "rmd160", "rmd256", "rmd320",
-	"lzo", "cts", "zlib", NULL
+	"lzo", "cts", "zlib", "lz4", "lz4hc", NULL
 };
 
 static int test_cipher_jiffies(struct blkcipher_desc *desc, int enc,
@@ -711,6 +712,178 @@ out:
 	crypto_free_ahash(tfm);
 }
 
+/*
+ * Fill a buffer with word-salad text, so the compression ratios reported
+ * below are in the same ballpark as for real file data rather than for
+ * all-zero or random pages.
+ */
+static void comp_speed_fill(u8 *buf, unsigned int len)
+{
+	static const char * const words[] = {
+		"the ", "kernel ", "page ", "cache ", "block ", "inode ",
+		"of ", "and ", "to ", "write ", "read ", "data ", "is ",
+		"a ", "buffer ", "in ", "flash ", "compress ", "\n",
+	};
+	u32 seed = 0x12345678;
+	unsigned int pos = 0;
+
+	while (pos < len) {
+		const char *w;
+		unsigned int n;
+
+		seed = seed * 1103515245 + 12345;
+		w = words[(seed >> 16) % ARRAY_SIZE(words)];
+		n = min_t(unsigned int, strlen(w), len - pos);
+		memcpy(buf + pos, w, n);
+		pos += n;
+	}
+}
+
+static int test_comp_jiffies(struct crypto_comp *tfm, int comp,
+			     const u8 *src, unsigned int slen, u8 *dst,
+			     unsigned int dsize, int sec)
+{
+	unsigned long start, end;
+	unsigned int dlen;
+	int bcount;
+	int ret;
+
+	for (start = jiffies, end = start + sec * HZ, bcount = 0;
+	     time_before(jiffies, end); bcount++) {
+		dlen = dsize;
+		if (comp)
+			ret = crypto_comp_compress(tfm, src, slen, dst, &dlen);
+		else
+			ret = crypto_comp_decompress(tfm, src, slen, dst,
+						     &dlen);
+		if (ret)
+			return ret;
+	}
+
+	printk("%s: %d operations in %d seconds (%ld bytes)\n",
+	       comp ? "compress" : "decompress", bcount, sec,
+	       (long)bcount * (comp ? slen : dlen));
+	return 0;
+}
+
+static int test_comp_cycles(struct crypto_comp *tfm, int comp,
+			    const u8 *src, unsigned int slen, u8 *dst,
+			    unsigned int dsize)
+{
+	unsigned long cycles = 0;
+	unsigned int dlen = 0;
+	int ret = 0;
+	int i;
+
+	/* Warm-up run. */
+	for (i = 0; i < 4; i++) {
+		dlen = dsize;
+		if (comp)
+			ret = crypto_comp_compress(tfm, src, slen, dst, &dlen);
+		else
+			ret = crypto_comp_decompress(tfm, src, slen, dst,
+						     &dlen);
+		if (ret)
+			return ret;
+	}
+
+	/* The real thing. */
+	for (i = 0; i < 8; i++) {
+		cycles_t start, end;
+
+		dlen = dsize;
+		start = get_cycles();
+		if (comp)
+			ret = crypto_comp_compress(tfm, src, slen, dst, &dlen);
+		else
+			ret = crypto_comp_decompress(tfm, src, slen, dst,
+						     &dlen);
+		end = get_cycles();
+
+		if (ret)
+			return ret;
+
+		cycles += end - start;
+	}
+
+	printk("%s: 1 operation in %lu cycles (%u bytes)\n",
+	       comp ? "compress" : "decompress", (cycles + 4) / 8,
+	       comp ? slen : dlen);
+	return 0;
+}
+
+static void test_comp_speed(const char *algo, unsigned int sec,
+			    unsigned int *blen)
+{
+	struct crypto_comp *tfm;
+	unsigned int max = 0, clen;
+	u8 *src, *dst, *out;
+	int i;
+	int ret;
+
+	printk(KERN_INFO "\ntesting speed of %s\n", algo);
+
+	tfm = crypto_alloc_comp(algo, 0, 0);
+	if (IS_ERR(tfm)) {
+		printk(KERN_ERR "failed to load transform for %s: %ld\n", algo,
+		       PTR_ERR(tfm));
+		return;
+	}
+
+	for (i = 0; blen[i]; i++)
+		max = max(max, blen[i]);
+
+	/* Leave room for incompressible expansion in the output buffers. */
+	src = kmalloc(max, GFP_KERNEL);
+	dst = kmalloc(2 * max, GFP_KERNEL);
+	out = kmalloc(2 * max, GFP_KERNEL);
+	if (!src || !dst || !out) {
+		printk(KERN_ERR "tcrypt: failed to allocate buffers\n");
+		goto out;
+	}
+	comp_speed_fill(src, max);
+
+	for (i = 0; blen[i]; i++) {
+		clen = 2 * max;
+		ret = crypto_comp_compress(tfm, src, blen[i], dst, &clen);
+		if (ret) {
+			printk(KERN_ERR "compression failed ret=%d\n", ret);
+			break;
+		}
+
+		printk(KERN_INFO "test%3u (%5u byte blocks, %5u compressed, "
+		       "ratio %u%%)\n", i, blen[i], clen, clen * 100 / blen[i]);
+
+		if (sec)
+			ret = test_comp_jiffies(tfm, 1, src, blen[i], out,
+						2 * max, sec);
+		else
+			ret = test_comp_cycles(tfm, 1, src, blen[i], out,
+					       2 * max);
+		if (ret) {
+			printk(KERN_ERR "compression failed ret=%d\n", ret);
+			break;
+		}
+
+		if (sec)
+			ret = test_comp_jiffies(tfm, 0, dst, clen, out,
+						2 * max, sec);
+		else
+			ret = test_comp_cycles(tfm, 0, dst, clen, out,
+					       2 * max);
+		if (ret) {
+			printk(KERN_ERR "decompression failed ret=%d\n", ret);
+			break;
+		}
+	}
+
+out:
+	kfree(out);
+	kfree(dst);
+	kfree(src);
+	crypto_free_comp(tfm);
+}
+
 static void test_available(void)
 {
 	char **name = check;
@@ -936,6 +1109,14 @@ static int do_test(int m)
 		ret += tcrypt_test("rfc4309(ccm(aes))");
 		break;
 
+	case 46:
+		ret += tcrypt_test("lz4");
+		break;
+
+	case 47:
+		ret += tcrypt_test("lz4hc");
+		break;
+
 	case 100:
 		ret += tcrypt_test("hmac(md5)");
 		break;
@@ -1215,6 +1396,28 @@ static int do_test(int m)
 	case 499:
 		break;
 
+	case 500:
+		/* fall through */
+
+	case 501:
+		test_comp_speed("deflate", sec, comp_speed_template);
+		if (mode > 500 && mode < 600) break;
+
+	case 502:
+		test_comp_speed("lzo", sec, comp_speed_template);
+		if (mode > 500 && mode < 600) break;
+
+	case 503:
+		test_comp_speed("lz4", sec, comp_speed_template);
+		if (mode > 500 && mode < 600) break;
+
+	case 504:
+		test_comp_speed("lz4hc", sec, comp_speed_template);
+		if (mode > 500 && mode < 600) break;
+
+	case 599:
+		break;
+
 	case 1000:
 		test_available();
 		break;
@@ -13,6 +13,7 @@
 #include <linux/moduleparam.h>
 #include <linux/major.h>
 #include <linux/blkdev.h>
+#include <linux/blk-mq.h>
 #include <linux/bio.h>
 #include <linux/highmem.h>
 #include <linux/mutex.h>
@@ -367,6 +368,55 @@ out:
 	return 0;
 }
 
+/*
+ * Multi-queue mode: requests are handled synchronously on the submitting
+ * cpu, exactly like bios are in brd_make_request().
+ */
+static int brd_queue_rq(struct blk_mq_hw_ctx *hctx, struct request *rq)
+{
+	struct brd_device *brd = hctx->driver_data;
+	sector_t sector = blk_rq_pos(rq);
+	struct req_iterator iter;
+	struct bio_vec *bvec;
+	int rw = rq_data_dir(rq);
+	int err = -EIO;
+
+	if (sector + blk_rq_sectors(rq) > get_capacity(brd->brd_disk))
+		goto out;
+
+	err = 0;
+	if (unlikely(rq->cmd_flags & REQ_DISCARD)) {
+		discard_from_brd(brd, sector, blk_rq_bytes(rq));
+		goto out;
+	}
+
+	rq_for_each_segment(bvec, rq, iter) {
+		unsigned int len = bvec->bv_len;
+		err = brd_do_bvec(brd, bvec->bv_page, len,
+					bvec->bv_offset, rw, sector);
+		if (err)
+			break;
+		sector += len >> SECTOR_SHIFT;
+	}
+
+out:
+	blk_mq_end_io(rq, err);
+	return BLK_MQ_RQ_QUEUE_OK;
+}
+
+static int brd_init_hctx(struct blk_mq_hw_ctx *hctx, void *data,
+			 unsigned int index)
+{
+	hctx->driver_data = data;
+	return 0;
+}
+
+static struct blk_mq_ops brd_mq_ops = {
+	.queue_rq	= brd_queue_rq,
+	.map_queue	= blk_mq_map_queue,
+	.init_hctx	= brd_init_hctx,
+};
+
 #ifdef CONFIG_BLK_DEV_XIP
 static int brd_direct_access(struct block_device *bdev, sector_t sector,
 			void **kaddr, unsigned long *pfn)
@@ -440,12 +490,15 @@ static int rd_nr;
 int rd_size = CONFIG_BLK_DEV_RAM_SIZE;
 static int max_part;
 static int part_shift;
+static bool use_mq;
 module_param(rd_nr, int, 0);
 MODULE_PARM_DESC(rd_nr, "Maximum number of brd devices");
 module_param(rd_size, int, 0);
 MODULE_PARM_DESC(rd_size, "Size of each RAM disk in kbytes.");
 module_param(max_part, int, 0);
 MODULE_PARM_DESC(max_part, "Maximum number of partitions per RAM disk");
+module_param(use_mq, bool, 0);
+MODULE_PARM_DESC(use_mq, "Use the multi-queue block layer");
 MODULE_LICENSE("GPL");
 MODULE_ALIAS_BLOCKDEV_MAJOR(RAMDISK_MAJOR);
 MODULE_ALIAS("rd");
@@ -479,10 +532,24 @@ static struct brd_device *brd_alloc(int i)
 	spin_lock_init(&brd->brd_lock);
 	INIT_RADIX_TREE(&brd->brd_pages, GFP_ATOMIC);
 
-	brd->brd_queue = blk_alloc_queue(GFP_KERNEL);
-	if (!brd->brd_queue)
-		goto out_free_dev;
-	blk_queue_make_request(brd->brd_queue, brd_make_request);
+	if (use_mq) {
+		struct blk_mq_reg reg = {
+			.ops		= &brd_mq_ops,
+			.nr_hw_queues	= nr_cpu_ids,
+			.queue_depth	= 64,
+			.numa_node	= -1,
+			.flags		= BLK_MQ_F_SHOULD_MERGE,
+		};
+
+		brd->brd_queue = blk_mq_init_queue(&reg, brd);
+		if (IS_ERR(brd->brd_queue))
+			goto out_free_dev;
+	} else {
+		brd->brd_queue = blk_alloc_queue(GFP_KERNEL);
+		if (!brd->brd_queue)
+			goto out_free_dev;
+		blk_queue_make_request(brd->brd_queue, brd_make_request);
+	}
 	blk_queue_max_hw_sectors(brd->brd_queue, 1024);
 	blk_queue_bounce_limit(brd->brd_queue, BLK_BOUNCE_ANY);
 
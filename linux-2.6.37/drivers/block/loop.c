@@ -59,6 +59,7 @@
 #include <linux/major.h>
 #include <linux/wait.h>
 #include <linux/blkdev.h>
+#include <linux/blk-mq.h>
 #include <linux/blkpg.h>
 #include <linux/init.h>
 #include <linux/swap.h>
@@ -72,7 +73,6 @@
 #include <linux/buffer_head.h>		/* for invalidate_bdev() */
 #include <linux/completion.h>
 #include <linux/highmem.h>
-#include <linux/kthread.h>
 #include <linux/splice.h>
 #include <linux/sysfs.h>
 
@@ -503,47 +503,108 @@ out:
 }
 
 /*
- * Add bio to back of pending list
+ * Requests are handed from ->queue_rq() to a per-device workqueue, so
+ * that reads from any number of submitters are serviced in parallel.
+ * Writes are kept in submission order on a single list, drained by one
+ * work item, as the backing file write paths expect a single writer.
  */
-static void loop_add_bio(struct loop_device *lo, struct bio *bio)
+struct loop_cmd {
+	struct work_struct work;
+	struct list_head list;
+	struct request *rq;
+};
+
+static void loop_handle_cmd(struct loop_device *lo, struct loop_cmd *cmd)
+{
+	struct request *rq = cmd->rq;
+	struct bio *bio;
+	int ret = 0;
+
+	__rq_for_each_bio(bio, rq) {
+		ret = do_bio_filebacked(lo, bio);
+		if (ret)
+			break;
+	}
+	blk_mq_end_io(rq, ret);
+
+	if (atomic_dec_and_test(&lo->lo_pending))
+		wake_up(&lo->lo_event);
+}
+
+static void loop_read_work(struct work_struct *work)
 {
-	bio_list_add(&lo->lo_bio_list, bio);
+	struct loop_cmd *cmd = container_of(work, struct loop_cmd, work);
+
+	loop_handle_cmd(cmd->rq->q->queuedata, cmd);
+}
+
+static void loop_write_work(struct work_struct *work)
+{
+	struct loop_device *lo = container_of(work, struct loop_device,
+					      lo_write_work);
+	struct loop_cmd *cmd;
+	LIST_HEAD(list);
+
+	spin_lock_irq(&lo->lo_lock);
+	while (!list_empty(&lo->lo_write_list)) {
+		list_splice_init(&lo->lo_write_list, &list);
+		spin_unlock_irq(&lo->lo_lock);
+
+		while (!list_empty(&list)) {
+			cmd = list_first_entry(&list, struct loop_cmd, list);
+			list_del_init(&cmd->list);
+			loop_handle_cmd(lo, cmd);
+		}
+
+		spin_lock_irq(&lo->lo_lock);
+	}
+	spin_unlock_irq(&lo->lo_lock);
 }
 
 /*
- * Grab first pending buffer
+ * Hand a command to the workqueue. Called with lo_lock held.
  */
-static struct bio *loop_get_bio(struct loop_device *lo)
+static void loop_queue_cmd(struct loop_device *lo, struct loop_cmd *cmd)
 {
-	return bio_list_pop(&lo->lo_bio_list);
+	atomic_inc(&lo->lo_pending);
+
+	if (rq_data_dir(cmd->rq) == WRITE) {
+		list_add_tail(&cmd->list, &lo->lo_write_list);
+		queue_work(lo->lo_wq, &lo->lo_write_work);
+	} else {
+		INIT_WORK(&cmd->work, loop_read_work);
+		queue_work(lo->lo_wq, &cmd->work);
+	}
 }
 
-static int loop_make_request(struct request_queue *q, struct bio *old_bio)
+static int loop_queue_rq(struct blk_mq_hw_ctx *hctx, struct request *rq)
 {
-	struct loop_device *lo = q->queuedata;
-	int rw = bio_rw(old_bio);
-
-	if (rw == READA)
-		rw = READ;
+	struct loop_device *lo = rq->q->queuedata;
+	struct loop_cmd *cmd = blk_mq_rq_to_pdu(rq);
+	int ret = BLK_MQ_RQ_QUEUE_OK;
 
-	BUG_ON(!lo || (rw != READ && rw != WRITE));
+	cmd->rq = rq;
 
 	spin_lock_irq(&lo->lo_lock);
 	if (lo->lo_state != Lo_bound)
-		goto out;
-	if (unlikely(rw == WRITE && (lo->lo_flags & LO_FLAGS_READ_ONLY)))
-		goto out;
-	loop_add_bio(lo, old_bio);
-	wake_up(&lo->lo_event);
+		ret = BLK_MQ_RQ_QUEUE_ERROR;
+	else if (unlikely(rq_data_dir(rq) == WRITE &&
+			  (lo->lo_flags & LO_FLAGS_READ_ONLY)))
+		ret = BLK_MQ_RQ_QUEUE_ERROR;
+	else if (unlikely(lo->lo_switching))
+		list_add_tail(&cmd->list, &lo->lo_held_list);
+	else
+		loop_queue_cmd(lo, cmd);
 	spin_unlock_irq(&lo->lo_lock);
-	return 0;
 
-out:
-	spin_unlock_irq(&lo->lo_lock);
-	bio_io_error(old_bio);
-	return 0;
+	return ret;
 }
 
+static struct blk_mq_ops loop_mq_ops = {
+	.queue_rq	= loop_queue_rq,
+	.map_queue	= blk_mq_map_queue,
+};
+
 /*
  * kick off io on the underlying address space
  */
@@ -555,119 +616,63 @@ static void loop_unplug(struct request_queue *q)
 	blk_run_address_space(lo->lo_backing_file->f_mapping);
 }
 
-struct switch_request {
-	struct file *file;
-	struct completion wait;
-};
-
-static void do_loop_switch(struct loop_device *, struct switch_request *);
-
-static inline void loop_handle_bio(struct loop_device *lo, struct bio *bio)
-{
-	if (unlikely(!bio->bi_bdev)) {
-		do_loop_switch(lo, bio->bi_private);
-		bio_put(bio);
-	} else {
-		int ret = do_bio_filebacked(lo, bio);
-		bio_endio(bio, ret);
-	}
-}
-
 /*
- * worker thread that handles reads/writes to file backed loop devices,
- * to avoid blocking in our make_request_fn. it also does loop decrypting
- * on reads for block backed loop, as that is too heavy to do from
- * b_end_io context where irqs may be disabled.
- *
- * Loop explanation:  loop_clr_fd() sets lo_state to Lo_rundown before
- * calling kthread_stop().  Therefore once kthread_should_stop() is
- * true, make_request will not place any more requests.  Therefore
- * once kthread_should_stop() is true and lo_bio is NULL, we are
- * done with the loop.
+ * Do the actual switch, with no commands in flight
  */
-static int loop_thread(void *data)
+static void do_loop_switch(struct loop_device *lo, struct file *file)
 {
-	struct loop_device *lo = data;
-	struct bio *bio;
-
-	set_user_nice(current, -20);
-
-	while (!kthread_should_stop() || !bio_list_empty(&lo->lo_bio_list)) {
-
-		wait_event_interruptible(lo->lo_event,
-				!bio_list_empty(&lo->lo_bio_list) ||
-				kthread_should_stop());
-
-		if (bio_list_empty(&lo->lo_bio_list))
-			continue;
-		spin_lock_irq(&lo->lo_lock);
-		bio = loop_get_bio(lo);
-		spin_unlock_irq(&lo->lo_lock);
-
-		BUG_ON(!bio);
-		loop_handle_bio(lo, bio);
-	}
+	struct file *old_file = lo->lo_backing_file;
+	struct address_space *mapping = file->f_mapping;
 
-	return 0;
+	mapping_set_gfp_mask(old_file->f_mapping, lo->old_gfp_mask);
+	lo->lo_backing_file = file;
+	lo->lo_blocksize = S_ISBLK(mapping->host->i_mode) ?
+		mapping->host->i_bdev->bd_block_size : PAGE_SIZE;
+	lo->old_gfp_mask = mapping_gfp_mask(mapping);
+	mapping_set_gfp_mask(mapping, lo->old_gfp_mask & ~(__GFP_IO|__GFP_FS));
 }
 
 /*
  * loop_switch performs the hard work of switching a backing store.
- * First it needs to flush existing IO, it does this by sending a magic
- * BIO down the pipe. The completion of this BIO does the actual switch.
+ * New commands are held back while the ones already handed to the
+ * workqueue drain, then the file is switched and the held commands are
+ * released. With a NULL file this only waits for outstanding IO.
  */
 static int loop_switch(struct loop_device *lo, struct file *file)
 {
-	struct switch_request w;
-	struct bio *bio = bio_alloc(GFP_KERNEL, 0);
-	if (!bio)
-		return -ENOMEM;
-	init_completion(&w.wait);
-	w.file = file;
-	bio->bi_private = &w;
-	bio->bi_bdev = NULL;
-	loop_make_request(lo->lo_queue, bio);
-	wait_for_completion(&w.wait);
+	struct loop_cmd *cmd, *next;
+
+	spin_lock_irq(&lo->lo_lock);
+	lo->lo_switching = true;
+	spin_unlock_irq(&lo->lo_lock);
+
+	wait_event(lo->lo_event, !atomic_read(&lo->lo_pending));
+
+	if (file)
+		do_loop_switch(lo, file);
+
+	spin_lock_irq(&lo->lo_lock);
+	lo->lo_switching = false;
+	list_for_each_entry_safe(cmd, next, &lo->lo_held_list, list) {
+		list_del_init(&cmd->list);
+		loop_queue_cmd(lo, cmd);
+	}
+	spin_unlock_irq(&lo->lo_lock);
 	return 0;
 }
 
 /*
- * Helper to flush the IOs in loop, but keeping loop thread running
+ * Helper to flush the IOs in loop, but keeping the device bound
  */
 static int loop_flush(struct loop_device *lo)
 {
-	/* loop not yet configured, no running thread, nothing to flush */
-	if (!lo->lo_thread)
+	/* loop not yet configured, nothing to flush */
+	if (!lo->lo_wq)
 		return 0;
 
 	return loop_switch(lo, NULL);
 }
 
-/*
- * Do the actual switch; called from the BIO completion routine
- */
-static void do_loop_switch(struct loop_device *lo, struct switch_request *p)
-{
-	struct file *file = p->file;
-	struct file *old_file = lo->lo_backing_file;
-	struct address_space *mapping;
-
-	/* if no new file, only flush of queued bios requested */
-	if (!file)
-		goto out;
-
-	mapping = file->f_mapping;
-	mapping_set_gfp_mask(old_file->f_mapping, lo->old_gfp_mask);
-	lo->lo_backing_file = file;
-	lo->lo_blocksize = S_ISBLK(mapping->host->i_mode) ?
-		mapping->host->i_bdev->bd_block_size : PAGE_SIZE;
-	lo->old_gfp_mask = mapping_gfp_mask(mapping);
-	mapping_set_gfp_mask(mapping, lo->old_gfp_mask & ~(__GFP_IO|__GFP_FS));
-out:
-	complete(&p->wait);
-}
-
-
 /*
  * loop_change_fd switched the backing store of a loopback device to
  * a new file. This is useful for operating system installers to free up
@@ -913,14 +918,6 @@ static int loop_set_fd(struct loop_device *lo, fmode_t mode,
 	lo->old_gfp_mask = mapping_gfp_mask(mapping);
 	mapping_set_gfp_mask(mapping, lo->old_gfp_mask & ~(__GFP_IO|__GFP_FS));
 
-	bio_list_init(&lo->lo_bio_list);
-
-	/*
-	 * set queue make_request_fn, and add limits based on lower level
-	 * device
-	 */
-	blk_queue_make_request(lo->lo_queue, loop_make_request);
-	lo->lo_queue->queuedata = lo;
 	lo->lo_queue->unplug_fn = loop_unplug;
 
 	if (!(lo_flags & LO_FLAGS_READ_ONLY) && file->f_op->fsync)
@@ -934,21 +931,20 @@ static int loop_set_fd(struct loop_device *lo, fmode_t mode,
 
 	set_blocksize(bdev, lo_blocksize);
 
-	lo->lo_thread = kthread_create(loop_thread, lo, "loop%d",
-						lo->lo_number);
-	if (IS_ERR(lo->lo_thread)) {
-		error = PTR_ERR(lo->lo_thread);
+	error = -ENOMEM;
+	lo->lo_wq = alloc_workqueue("kloopd", WQ_MEM_RECLAIM | WQ_HIGHPRI |
+				    WQ_NON_REENTRANT, 0);
+	if (!lo->lo_wq)
 		goto out_clr;
-	}
+	spin_lock_irq(&lo->lo_lock);
 	lo->lo_state = Lo_bound;
-	wake_up_process(lo->lo_thread);
+	spin_unlock_irq(&lo->lo_lock);
 	if (max_part > 0)
 		ioctl_by_bdev(bdev, BLKRRPART, 0);
 	return 0;
 
 out_clr:
 	loop_sysfs_exit(lo);
-	lo->lo_thread = NULL;
 	lo->lo_device = NULL;
 	lo->lo_backing_file = NULL;
 	lo->lo_flags = 0;
@@ -1021,7 +1017,10 @@ static int loop_clr_fd(struct loop_device *lo, struct block_device *bdev)
 	lo->lo_state = Lo_rundown;
 	spin_unlock_irq(&lo->lo_lock);
 
-	kthread_stop(lo->lo_thread);
+	/* no new commands are queued once the state has changed */
+	wait_event(lo->lo_event, !atomic_read(&lo->lo_pending));
+	destroy_workqueue(lo->lo_wq);
+	lo->lo_wq = NULL;
 
 	lo->lo_queue->unplug_fn = NULL;
 	lo->lo_backing_file = NULL;
@@ -1035,7 +1034,6 @@ static int loop_clr_fd(struct loop_device *lo, struct block_device *bdev)
 	lo->lo_sizelimit = 0;
 	lo->lo_encrypt_key_size = 0;
 	lo->lo_flags = 0;
-	lo->lo_thread = NULL;
 	memset(lo->lo_encrypt_key, 0, LO_KEY_SIZE);
 	memset(lo->lo_crypt_name, 0, LO_NAME_SIZE);
 	memset(lo->lo_file_name, 0, LO_NAME_SIZE);
@@ -1605,13 +1603,23 @@ static struct loop_device *loop_alloc(int i)
 	struct loop_device *lo;
 	struct gendisk *disk;
 
+	struct blk_mq_reg reg = {
+		.ops		= &loop_mq_ops,
+		.nr_hw_queues	= 1,
+		.queue_depth	= 128,
+		.cmd_size	= sizeof(struct loop_cmd),
+		.numa_node	= -1,
+		.flags		= BLK_MQ_F_SHOULD_MERGE,
+	};
+
 	lo = kzalloc(sizeof(*lo), GFP_KERNEL);
 	if (!lo)
 		goto out;
 
-	lo->lo_queue = blk_alloc_queue(GFP_KERNEL);
-	if (!lo->lo_queue)
+	lo->lo_queue = blk_mq_init_queue(&reg, lo);
+	if (IS_ERR(lo->lo_queue))
 		goto out_free_dev;
+	lo->lo_queue->queuedata = lo;
 
 	disk = lo->lo_disk = alloc_disk(1 << part_shift);
 	if (!disk)
@@ -1619,9 +1627,12 @@ static struct loop_device *loop_alloc(int i)
 
 	mutex_init(&lo->lo_ctl_mutex);
 	lo->lo_number		= i;
-	lo->lo_thread		= NULL;
 	init_waitqueue_head(&lo->lo_event);
 	spin_lock_init(&lo->lo_lock);
+	atomic_set(&lo->lo_pending, 0);
+	INIT_LIST_HEAD(&lo->lo_write_list);
+	INIT_LIST_HEAD(&lo->lo_held_list);
+	INIT_WORK(&lo->lo_write_work, loop_write_work);
 	disk->major		= LOOP_MAJOR;
 	disk->first_minor	= i << part_shift;
 	disk->fops		= &lo_fops;
@@ -0,0 +1,460 @@
+/*
+ * Null test block driver
+ *
+ * Completes every request without touching any data, so that the cost
+ * of the block layer itself can be measured. The queueing model is
+ * selectable: plain bio based, the classic single request queue with its
+ * queue lock, or blk-mq with one or more hardware queues. Completions can
+ * be done inline, from the block softirq or after a delay from a timer.
+ * See Documentation/block/null_blk.txt.
+ */
+
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/sched.h>
+#include <linux/fs.h>
+#include <linux/blkdev.h>
+#include <linux/slab.h>
+#include <linux/blk-mq.h>
+#include <linux/hrtimer.h>
+#include <linux/interrupt.h>
+#include <linux/percpu.h>
+
+struct nullb_cmd {
+	struct list_head list;
+	struct request *rq;
+	ktime_t deadline;	/* completion time in timer mode */
+};
+
+struct nullb_queue {
+	unsigned int queue_depth;
+};
+
+struct nullb {
+	struct list_head list;
+	unsigned int index;
+	struct request_queue *q;
+	struct gendisk *disk;
+	struct nullb_queue *queues;
+	unsigned int nr_queues;
+	spinlock_t lock;
+};
+
+/* per-cpu list of commands waiting for the completion timer */
+struct completion_queue {
+	spinlock_t lock;
+	struct list_head list;
+	struct hrtimer timer;
+};
+
+static LIST_HEAD(nullb_list);
+static DEFINE_MUTEX(lock);
+static int null_major;
+static int nullb_indexes;
+
+static struct completion_queue __percpu *completion_queues;
+
+enum {
+	NULL_IRQ_NONE		= 0,
+	NULL_IRQ_SOFTIRQ	= 1,
+	NULL_IRQ_TIMER		= 2,
+};
+
+enum {
+	NULL_Q_BIO		= 0,
+	NULL_Q_RQ		= 1,
+	NULL_Q_MQ		= 2,
+};
+
+static int submit_queues = 1;
+module_param(submit_queues, int, S_IRUGO);
+MODULE_PARM_DESC(submit_queues, "Number of submission queues");
+
+static int home_node = -1;
+module_param(home_node, int, S_IRUGO);
+MODULE_PARM_DESC(home_node, "Home node for the device");
+
+static int queue_mode = NULL_Q_MQ;
+module_param(queue_mode, int, S_IRUGO);
+MODULE_PARM_DESC(queue_mode, "Block interface to use (0=bio,1=rq,2=multiqueue)");
+
+static int gb = 250;
+module_param(gb, int, S_IRUGO);
+MODULE_PARM_DESC(gb, "Size in GB");
+
+static int bs = 512;
+module_param(bs, int, S_IRUGO);
+MODULE_PARM_DESC(bs, "Block size (in bytes)");
+
+static int nr_devices = 2;
+module_param(nr_devices, int, S_IRUGO);
+MODULE_PARM_DESC(nr_devices, "Number of devices to register");
+
+static int irqmode = NULL_IRQ_SOFTIRQ;
+module_param(irqmode, int, S_IRUGO);
+MODULE_PARM_DESC(irqmode, "IRQ completion handler. 0-none, 1-softirq, 2-timer (multiqueue only)");
+
+static int completion_nsec = 10000;
+module_param(completion_nsec, int, S_IRUGO);
+MODULE_PARM_DESC(completion_nsec, "Time in ns to complete a request in hardware. Default: 10,000ns");
+
+static int hw_queue_depth = 64;
+module_param(hw_queue_depth, int, S_IRUGO);
+MODULE_PARM_DESC(hw_queue_depth, "Queue depth for each hardware queue. Default: 64");
+
+static void end_cmd(struct nullb_cmd *cmd)
+{
+	struct request *rq = cmd->rq;
+
+	if (queue_mode == NULL_Q_MQ)
+		blk_mq_end_io(rq, 0);
+	else
+		blk_end_request_all(rq, 0);
+}
+
+static enum hrtimer_restart null_cmd_timer_expired(struct hrtimer *timer)
+{
+	struct completion_queue *cq;
+	struct nullb_cmd *cmd, *next;
+	unsigned long flags;
+	LIST_HEAD(list);
+
+	cq = container_of(timer, struct completion_queue, timer);
+
+	spin_lock_irqsave(&cq->lock, flags);
+	list_splice_init(&cq->list, &list);
+	spin_unlock_irqrestore(&cq->lock, flags);
+
+	list_for_each_entry_safe(cmd, next, &list, list) {
+		list_del_init(&cmd->list);
+		end_cmd(cmd);
+	}
+
+	return HRTIMER_NORESTART;
+}
+
+static void null_cmd_end_timer(struct nullb_cmd *cmd)
+{
+	struct completion_queue *cq;
+	unsigned long flags;
+	bool first;
+
+	cq = per_cpu_ptr(completion_queues, get_cpu());
+	cmd->deadline = ktime_add_ns(ktime_get(), completion_nsec);
+
+	spin_lock_irqsave(&cq->lock, flags);
+	first = list_empty(&cq->list);
+	list_add_tail(&cmd->list, &cq->list);
+	spin_unlock_irqrestore(&cq->lock, flags);
+
+	if (first)
+		hrtimer_start(&cq->timer, ktime_set(0, completion_nsec),
+			      HRTIMER_MODE_REL);
+
+	put_cpu();
+}
+
+/*
+ * Complete the commands of this cpu that are due, ahead of the timer.
+ * Commands are queued in deadline order, so stop at the first one that
+ * is not; those queued on other cpus are left to their timer.
+ */
+static int null_poll(struct blk_mq_hw_ctx *hctx, unsigned int tag)
+{
+	struct completion_queue *cq;
+	struct nullb_cmd *cmd, *next;
+	unsigned long flags;
+	ktime_t now = ktime_get();
+	int nr = 0;
+	LIST_HEAD(list);
+
+	cq = per_cpu_ptr(completion_queues, get_cpu());
+
+	spin_lock_irqsave(&cq->lock, flags);
+	list_for_each_entry_safe(cmd, next, &cq->list, list) {
+		if (ktime_to_ns(cmd->deadline) > ktime_to_ns(now))
+			break;
+		list_move_tail(&cmd->list, &list);
+	}
+	spin_unlock_irqrestore(&cq->lock, flags);
+
+	put_cpu();
+
+	list_for_each_entry_safe(cmd, next, &list, list) {
+		list_del_init(&cmd->list);
+		end_cmd(cmd);
+		nr++;
+	}
+
+	return nr;
+}
+
+static void null_softirq_done_fn(struct request *rq)
+{
+	blk_end_request_all(rq, 0);
+}
+
+static void null_handle_cmd(struct nullb_cmd *cmd)
+{
+	/* Complete IO by inline, softirq or timer */
+	switch (irqmode) {
+	case NULL_IRQ_SOFTIRQ:
+		if (queue_mode == NULL_Q_MQ)
+			blk_mq_complete_request(cmd->rq);
+		else
+			blk_complete_request(cmd->rq);
+		break;
+	case NULL_IRQ_NONE:
+		end_cmd(cmd);
+		break;
+	case NULL_IRQ_TIMER:
+		null_cmd_end_timer(cmd);
+		break;
+	}
+}
+
+static int null_queue_bio(struct request_queue *q, struct bio *bio)
+{
+	bio_endio(bio, 0);
+	return 0;
+}
+
+static void null_request_fn(struct request_queue *q)
+{
+	struct nullb_cmd cmd;
+	struct request *rq;
+
+	while ((rq = blk_fetch_request(q)) != NULL) {
+		spin_unlock_irq(q->queue_lock);
+		cmd.rq = rq;
+		null_handle_cmd(&cmd);
+		spin_lock_irq(q->queue_lock);
+	}
+}
+
+static int null_queue_rq(struct blk_mq_hw_ctx *hctx, struct request *rq)
+{
+	struct nullb_cmd *cmd = blk_mq_rq_to_pdu(rq);
+
+	cmd->rq = rq;
+	null_handle_cmd(cmd);
+	return BLK_MQ_RQ_QUEUE_OK;
+}
+
+static int null_init_hctx(struct blk_mq_hw_ctx *hctx, void *data,
+			  unsigned int index)
+{
+	struct nullb *nullb = data;
+	struct nullb_queue *nq = &nullb->queues[index];
+
+	hctx->driver_data = nq;
+	nq->queue_depth = hw_queue_depth;
+	return 0;
+}
+
+static struct blk_mq_ops null_mq_ops = {
+	.queue_rq	= null_queue_rq,
+	.map_queue	= blk_mq_map_queue,
+	.init_hctx	= null_init_hctx,
+};
+
+static struct blk_mq_reg null_mq_reg = {
+	.ops		= &null_mq_ops,
+	.cmd_size	= sizeof(struct nullb_cmd),
+	.flags		= BLK_MQ_F_SHOULD_MERGE,
+};
+
+static void null_del_dev(struct nullb *nullb)
+{
+	list_del_init(&nullb->list);
+
+	del_gendisk(nullb->disk);
+	blk_cleanup_queue(nullb->q);
+	put_disk(nullb->disk);
+	kfree(nullb->queues);
+	kfree(nullb);
+}
+
+static int null_open(struct block_device *bdev, fmode_t mode)
+{
+	return 0;
+}
+
+static int null_release(struct gendisk *disk, fmode_t mode)
+{
+	return 0;
+}
+
+static const struct block_device_operations null_fops = {
+	.owner =	THIS_MODULE,
+	.open =		null_open,
+	.release =	null_release,
+};
+
+static int null_add_dev(void)
+{
+	struct gendisk *disk;
+	struct nullb *nullb;
+	sector_t size;
+
+	nullb = kzalloc_node(sizeof(*nullb), GFP_KERNEL, home_node);
+	if (!nullb)
+		return -ENOMEM;
+
+	spin_lock_init(&nullb->lock);
+
+	if (queue_mode == NULL_Q_MQ) {
+		nullb->nr_queues = submit_queues;
+		nullb->queues = kzalloc_node(submit_queues *
+					     sizeof(struct nullb_queue),
+					     GFP_KERNEL, home_node);
+		if (!nullb->queues)
+			goto err;
+
+		null_mq_reg.numa_node = home_node;
+		null_mq_reg.queue_depth = hw_queue_depth;
+		null_mq_reg.nr_hw_queues = submit_queues;
+
+		nullb->q = blk_mq_init_queue(&null_mq_reg, nullb);
+		if (IS_ERR(nullb->q)) {
+			nullb->q = NULL;
+			goto err;
+		}
+	} else if (queue_mode == NULL_Q_BIO) {
+		nullb->q = blk_alloc_queue_node(GFP_KERNEL, home_node);
+		if (!nullb->q)
+			goto err;
+		blk_queue_make_request(nullb->q, null_queue_bio);
+	} else {
+		nullb->q = blk_init_queue_node(null_request_fn, &nullb->lock,
+					       home_node);
+		if (!nullb->q)
+			goto err;
+		blk_queue_softirq_done(nullb->q, null_softirq_done_fn);
+	}
+
+	nullb->q->queuedata = nullb;
+	queue_flag_set_unlocked(QUEUE_FLAG_NONROT, nullb->q);
+
+	disk = nullb->disk = alloc_disk_node(1, home_node);
+	if (!disk)
+		goto err_queue;
+
+	mutex_lock(&lock);
+	list_add_tail(&nullb->list, &nullb_list);
+	nullb->index = nullb_indexes++;
+	mutex_unlock(&lock);
+
+	blk_queue_logical_block_size(nullb->q, bs);
+	blk_queue_physical_block_size(nullb->q, bs);
+
+	size = gb * 1024 * 1024 * 1024ULL;
+	sector_div(size, bs);
+	set_capacity(disk, size);
+
+	disk->flags |= GENHD_FL_EXT_DEVT;
+	disk->major		= null_major;
+	disk->first_minor	= nullb->index;
+	disk->fops		= &null_fops;
+	disk->private_data	= nullb;
+	disk->queue		= nullb->q;
+	sprintf(disk->disk_name, "nullb%d", nullb->index);
+	add_disk(disk);
+	return 0;
+
+err_queue:
+	blk_cleanup_queue(nullb->q);
+err:
+	kfree(nullb->queues);
+	kfree(nullb);
+	return -ENOMEM;
+}
+
+static void null_exit(void)
+{
+	struct nullb *nullb;
+	unsigned int cpu;
+
+	unregister_blkdev(null_major, "nullb");
+
+	mutex_lock(&lock);
+	while (!list_empty(&nullb_list)) {
+		nullb = list_entry(nullb_list.next, struct nullb, list);
+		null_del_dev(nullb);
+	}
+	mutex_unlock(&lock);
+
+	if (irqmode == NULL_IRQ_TIMER)
+		for_each_possible_cpu(cpu)
+			hrtimer_cancel(&per_cpu_ptr(completion_queues,
+						    cpu)->timer);
+	free_percpu(completion_queues);
+}
+
+static int __init null_init(void)
+{
+	unsigned int i;
+
+	if (bs > PAGE_SIZE) {
+		pr_warning("null_blk: invalid block size\n");
+		pr_warning("null_blk: defaults block size to %lu\n", PAGE_SIZE);
+		bs = PAGE_SIZE;
+	}
+
+	if (queue_mode == NULL_Q_MQ) {
+		if (submit_queues < 1)
+			submit_queues = 1;
+		else if (submit_queues > nr_cpu_ids)
+			submit_queues = nr_cpu_ids;
+	}
+
+	if (irqmode == NULL_IRQ_TIMER && queue_mode != NULL_Q_MQ) {
+		pr_warning("null_blk: timer completion needs queue_mode=2, "
+			   "using softirq\n");
+		irqmode = NULL_IRQ_SOFTIRQ;
+	}
+
+	/* only timer completions leave something to poll for */
+	if (irqmode == NULL_IRQ_TIMER)
+		null_mq_ops.poll = null_poll;
+
+	/* Initialize a separate list for each CPU for issuing softirqs */
+	completion_queues = alloc_percpu(struct completion_queue);
+	if (!completion_queues)
+		return -ENOMEM;
+
+	for_each_possible_cpu(i) {
+		struct completion_queue *cq = per_cpu_ptr(completion_queues, i);
+
+		spin_lock_init(&cq->lock);
+		INIT_LIST_HEAD(&cq->list);
+
+		if (irqmode != NULL_IRQ_TIMER)
+			continue;
+
+		hrtimer_init(&cq->timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+		cq->timer.function = null_cmd_timer_expired;
+	}
+
+	null_major = register_blkdev(0, "nullb");
+	if (null_major < 0) {
+		free_percpu(completion_queues);
+		return null_major;
+	}
+
+	for (i = 0; i < nr_devices; i++) {
+		if (null_add_dev()) {
+			null_exit();
+			return -EINVAL;
+		}
+	}
+
+	pr_info("null: module loaded\n");
+	return 0;
+}
+
+module_init(null_init);
+module_exit(null_exit);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("Null test block driver");
@@ -90,6 +90,9 @@ static int do_blktrans_request(struct mtd_blktrans_ops *tr,
 	if (req->cmd_type != REQ_TYPE_FS)
 		return -EIO;
 
+	if (req->cmd_flags & REQ_FLUSH)
+		return tr->flush(dev);
+
 	if (blk_rq_pos(req) + blk_rq_cur_sectors(req) >
 	    get_capacity(req->rq_disk))
 		return -EIO;
@@ -383,6 +386,10 @@ int add_mtd_blktrans_dev(struct mtd_blktrans_dev *new)
 		queue_flag_set_unlocked(QUEUE_FLAG_DISCARD,
 					new->rq);
 
+	/* Translation layers which cache writes are told about barriers */
+	if (tr->flush)
+		blk_queue_flush(new->rq, REQ_FLUSH);
+
 	gd->queue = new->rq;
 
 	/* Create processing thread */
@@ -20,28 +20,51 @@
  *
  */
 
+#include <linux/err.h>
 #include <linux/fs.h>
 #include <linux/init.h>
 #include <linux/kernel.h>
 #include <linux/module.h>
+#include <linux/moduleparam.h>
 #include <linux/sched.h>
 #include <linux/slab.h>
 #include <linux/types.h>
 #include <linux/vmalloc.h>
+#include <linux/workqueue.h>
 
 #include <linux/mtd/mtd.h>
 #include <linux/mtd/blktrans.h>
 #include <linux/mutex.h>
 
+static unsigned int cache_blocks = 4;
+module_param(cache_blocks, uint, 0644);
+MODULE_PARM_DESC(cache_blocks, "Number of flash sectors cached per device, "
+		 "applies from the next open (default: 4)");
+
+static unsigned int cache_expire_ms = 5000;
+module_param(cache_expire_ms, uint, 0644);
+MODULE_PARM_DESC(cache_expire_ms, "Time in milliseconds after which dirty "
+		 "cached sectors are written back, 0 to only write them back "
+		 "when evicted or flushed (default: 5000)");
+
+struct mtdblk_cache {
+	struct list_head list;
+	unsigned char *data;
+	unsigned long offset;
+	unsigned long dirtied;
+	enum { STATE_EMPTY, STATE_CLEAN, STATE_DIRTY } state;
+};
 
 struct mtdblk_dev {
 	struct mtd_blktrans_dev mbd;
 	int count;
 	struct mutex cache_mutex;
-	unsigned char *cache_data;
-	unsigned long cache_offset;
+	struct mtdblk_cache *cache;
+	struct list_head cache_lru;
+	unsigned int cache_count;
 	unsigned int cache_size;
-	enum { STATE_EMPTY, STATE_CLEAN, STATE_DIRTY } cache_state;
+	unsigned long cache_expire;
+	struct delayed_work flush_work;
 };
 
 static struct mutex mtdblks_lock;
@@ -52,8 +75,11 @@ static struct mutex mtdblks_lock;
  * Since typical flash erasable sectors are much larger than what Linux's
  * buffer cache can handle, we must implement read-modify-write on flash
  * sectors for each block write requests.  To avoid over-erasing flash sectors
- * and to speed things up, we locally cache a whole flash sector while it is
- * being written to until a different sector is required.
+ * and to speed things up, we locally cache a few whole flash sectors while
+ * they are being written to.  When a sector which is not cached is written
+ * to, the least recently written one is written back to make room for it.
+ * Dirty sectors are also written back after cache_expire_ms, and when the
+ * block layer asks for a cache flush.
  */
 
 static void erase_callback(struct erase_info *done)
@@ -111,20 +137,20 @@ static int erase_write (struct mtd_info *mtd, unsigned long pos,
 }
 
 
-static int write_cached_data (struct mtdblk_dev *mtdblk)
+static int write_cached_data (struct mtdblk_dev *mtdblk,
+			      struct mtdblk_cache *c)
 {
 	struct mtd_info *mtd = mtdblk->mbd.mtd;
 	int ret;
 
-	if (mtdblk->cache_state != STATE_DIRTY)
+	if (c->state != STATE_DIRTY)
 		return 0;
 
 	DEBUG(MTD_DEBUG_LEVEL2, "mtdblock: writing cached data for \"%s\" "
 			"at 0x%lx, size 0x%x\n", mtd->name,
-			mtdblk->cache_offset, mtdblk->cache_size);
+			c->offset, mtdblk->cache_size);
 
-	ret = erase_write (mtd, mtdblk->cache_offset,
-			   mtdblk->cache_size, mtdblk->cache_data);
+	ret = erase_write (mtd, c->offset, mtdblk->cache_size, c->data);
 	if (ret)
 		return ret;
 
@@ -135,16 +161,100 @@ static int write_cached_data (struct mtdblk_dev *mtdblk)
 	 * means.  Let's declare it empty and leave buffering tasks to
 	 * the buffer cache instead.
 	 */
-	mtdblk->cache_state = STATE_EMPTY;
+	c->state = STATE_EMPTY;
 	return 0;
 }
 
+static int write_all_cached_data (struct mtdblk_dev *mtdblk)
+{
+	struct mtdblk_cache *c;
+	int ret, err = 0;
+
+	list_for_each_entry(c, &mtdblk->cache_lru, list) {
+		ret = write_cached_data(mtdblk, c);
+		if (ret && !err)
+			err = ret;
+	}
+	return err;
+}
+
+static struct mtdblk_cache *find_cache (struct mtdblk_dev *mtdblk,
+					unsigned long sect_start)
+{
+	struct mtdblk_cache *c;
+
+	list_for_each_entry(c, &mtdblk->cache_lru, list)
+		if (c->state != STATE_EMPTY && c->offset == sect_start)
+			return c;
+	return NULL;
+}
+
+/*
+ * Return the cache slot of the flash sector at @sect_start, filling the
+ * least recently written slot with it if it is not cached yet.  The slot
+ * becomes the most recently written one.
+ */
+static struct mtdblk_cache *get_cache (struct mtdblk_dev *mtdblk,
+				       unsigned long sect_start)
+{
+	struct mtd_info *mtd = mtdblk->mbd.mtd;
+	struct mtdblk_cache *c;
+	size_t retlen;
+	int ret;
+
+	c = find_cache(mtdblk, sect_start);
+	if (c)
+		goto out;
+
+	/* An empty slot costs nothing, otherwise evict the oldest one */
+	list_for_each_entry_reverse(c, &mtdblk->cache_lru, list)
+		if (c->state == STATE_EMPTY)
+			goto fill;
+	c = list_entry(mtdblk->cache_lru.prev, struct mtdblk_cache, list);
+
+fill:
+	if (unlikely(!c->data)) {
+		c->data = vmalloc(mtdblk->cache_size);
+		if (!c->data) {
+			/* Make do with the slots we already have buffers for */
+			list_for_each_entry_reverse(c, &mtdblk->cache_lru, list)
+				if (c->data)
+					goto evict;
+			/* -EINTR is not really correct, but it is the best
+			 * match documented in man 2 write for all cases.  We
+			 * could also return -EAGAIN sometimes, but why bother?
+			 */
+			return ERR_PTR(-EINTR);
+		}
+	}
+
+evict:
+	ret = write_cached_data(mtdblk, c);
+	if (ret)
+		return ERR_PTR(ret);
+
+	/* fill the cache with the current sector */
+	c->state = STATE_EMPTY;
+	ret = mtd->read(mtd, sect_start, mtdblk->cache_size, &retlen, c->data);
+	if (ret)
+		return ERR_PTR(ret);
+	if (retlen != mtdblk->cache_size)
+		return ERR_PTR(-EIO);
+
+	c->offset = sect_start;
+	c->state = STATE_CLEAN;
+out:
+	list_move(&c->list, &mtdblk->cache_lru);
+	return c;
+}
+
 
 static int do_cached_write (struct mtdblk_dev *mtdblk, unsigned long pos,
 			    int len, const char *buf)
 {
 	struct mtd_info *mtd = mtdblk->mbd.mtd;
 	unsigned int sect_size = mtdblk->cache_size;
+	struct mtdblk_cache *c;
 	size_t retlen;
 	int ret;
 
@@ -165,40 +275,30 @@ static int do_cached_write (struct mtdblk_dev *mtdblk, unsigned long pos,
 			/*
 			 * We are covering a whole sector.  Thus there is no
 			 * need to bother with the cache while it may still be
-			 * useful for other partial writes.
+			 * useful for other partial writes.  A cached copy of
+			 * this sector is stale now, though.
 			 */
+			c = find_cache(mtdblk, sect_start);
+			if (c)
+				c->state = STATE_EMPTY;
 			ret = erase_write (mtd, pos, size, buf);
 			if (ret)
 				return ret;
 		} else {
 			/* Partial sector: need to use the cache */
-
-			if (mtdblk->cache_state == STATE_DIRTY &&
-			    mtdblk->cache_offset != sect_start) {
-				ret = write_cached_data(mtdblk);
-				if (ret)
-					return ret;
-			}
-
-			if (mtdblk->cache_state == STATE_EMPTY ||
-			    mtdblk->cache_offset != sect_start) {
-				/* fill the cache with the current sector */
-				mtdblk->cache_state = STATE_EMPTY;
-				ret = mtd->read(mtd, sect_start, sect_size,
-						&retlen, mtdblk->cache_data);
-				if (ret)
-					return ret;
-				if (retlen != sect_size)
-					return -EIO;
-
-				mtdblk->cache_offset = sect_start;
-				mtdblk->cache_size = sect_size;
-				mtdblk->cache_state = STATE_CLEAN;
-			}
+			c = get_cache(mtdblk, sect_start);
+			if (IS_ERR(c))
+				return PTR_ERR(c);
 
 			/* write data to our local cache */
-			memcpy (mtdblk->cache_data + offset, buf, size);
-			mtdblk->cache_state = STATE_DIRTY;
+			memcpy (c->data + offset, buf, size);
+			if (c->state != STATE_DIRTY) {
+				c->state = STATE_DIRTY;
+				c->dirtied = jiffies;
+				if (mtdblk->cache_expire)
+					schedule_delayed_work(&mtdblk->flush_work,
+							      mtdblk->cache_expire);
+			}
 		}
 
 		buf += size;
@@ -215,6 +315,7 @@ static int do_cached_read (struct mtdblk_dev *mtdblk, unsigned long pos,
 {
 	struct mtd_info *mtd = mtdblk->mbd.mtd;
 	unsigned int sect_size = mtdblk->cache_size;
+	struct mtdblk_cache *c;
 	size_t retlen;
 	int ret;
 
@@ -237,9 +338,9 @@ static int do_cached_read (struct mtdblk_dev *mtdblk, unsigned long pos,
 		 * contains what we want, otherwise we read the data directly
 		 * from flash.
 		 */
-		if (mtdblk->cache_state != STATE_EMPTY &&
-		    mtdblk->cache_offset == sect_start) {
-			memcpy (buf, mtdblk->cache_data + offset, size);
+		c = find_cache(mtdblk, sect_start);
+		if (c) {
+			memcpy (buf, c->data + offset, size);
 		} else {
 			ret = mtd->read(mtd, pos, size, &retlen, buf);
 			if (ret)
@@ -256,27 +357,97 @@ static int do_cached_read (struct mtdblk_dev *mtdblk, unsigned long pos,
 	return 0;
 }
 
+/*
+ * Write back the dirty sectors which have been cached for long enough, and
+ * come back for the others when they are due.
+ */
+static void mtdblock_flush_work(struct work_struct *work)
+{
+	struct mtdblk_dev *mtdblk = container_of(work, struct mtdblk_dev,
+						 flush_work.work);
+	struct mtdblk_cache *c;
+	unsigned long due, next = 0;
+	int pending = 0;
+
+	mutex_lock(&mtdblk->cache_mutex);
+	list_for_each_entry(c, &mtdblk->cache_lru, list) {
+		if (c->state != STATE_DIRTY)
+			continue;
+		due = c->dirtied + mtdblk->cache_expire;
+		if (time_after_eq(jiffies, due) &&
+		    !write_cached_data(mtdblk, c))
+			continue;
+		/* Not due yet, or failed and to be retried */
+		if (time_after_eq(jiffies, due))
+			due = jiffies + mtdblk->cache_expire;
+		if (!pending || time_before(due, next))
+			next = due;
+		pending = 1;
+	}
+	if (pending)
+		schedule_delayed_work(&mtdblk->flush_work,
+				      max_t(long, next - jiffies, 1));
+	mutex_unlock(&mtdblk->cache_mutex);
+}
+
+static int alloc_cache(struct mtdblk_dev *mtdblk)
+{
+	unsigned int i;
+
+	/* The sector buffers themselves are allocated as they get used */
+	mtdblk->cache = kcalloc(mtdblk->cache_count, sizeof(*mtdblk->cache),
+				GFP_KERNEL);
+	if (!mtdblk->cache)
+		return -ENOMEM;
+
+	for (i = 0; i < mtdblk->cache_count; i++)
+		list_add_tail(&mtdblk->cache[i].list, &mtdblk->cache_lru);
+	return 0;
+}
+
+static void free_cache(struct mtdblk_dev *mtdblk)
+{
+	unsigned int i;
+
+	if (!mtdblk->cache)
+		return;
+
+	for (i = 0; i < mtdblk->cache_count; i++)
+		vfree(mtdblk->cache[i].data);
+	kfree(mtdblk->cache);
+	mtdblk->cache = NULL;
+	INIT_LIST_HEAD(&mtdblk->cache_lru);
+}
+
 static int mtdblock_readsect(struct mtd_blktrans_dev *dev,
 			      unsigned long block, char *buf)
 {
 	struct mtdblk_dev *mtdblk = container_of(dev, struct mtdblk_dev, mbd);
-	return do_cached_read(mtdblk, block<<9, 512, buf);
+	int ret;
+
+	mutex_lock(&mtdblk->cache_mutex);
+	ret = do_cached_read(mtdblk, block<<9, 512, buf);
+	mutex_unlock(&mtdblk->cache_mutex);
+	return ret;
 }
 
 static int mtdblock_writesect(struct mtd_blktrans_dev *dev,
 			      unsigned long block, char *buf)
 {
 	struct mtdblk_dev *mtdblk = container_of(dev, struct mtdblk_dev, mbd);
-	if (unlikely(!mtdblk->cache_data && mtdblk->cache_size)) {
-		mtdblk->cache_data = vmalloc(mtdblk->mbd.mtd->erasesize);
-		if (!mtdblk->cache_data)
-			return -EINTR;
-		/* -EINTR is not really correct, but it is the best match
-		 * documented in man 2 write for all cases.  We could also
-		 * return -EAGAIN sometimes, but why bother?
-		 */
+	int ret;
+
+	mutex_lock(&mtdblk->cache_mutex);
+	if (unlikely(!mtdblk->cache && mtdblk->cache_size)) {
+		ret = alloc_cache(mtdblk);
+		if (ret) {
+			mutex_unlock(&mtdblk->cache_mutex);
+			return ret;
+		}
 	}
-	return do_cached_write(mtdblk, block<<9, 512, buf);
+	ret = do_cached_write(mtdblk, block<<9, 512, buf);
+	mutex_unlock(&mtdblk->cache_mutex);
+	return ret;
 }
 
 static int mtdblock_open(struct mtd_blktrans_dev *mbd)
@@ -295,10 +466,13 @@ static int mtdblock_open(struct mtd_blktrans_dev *mbd)
 	/* OK, it's not open. Create cache info for it */
 	mtdblk->count = 1;
 	mutex_init(&mtdblk->cache_mutex);
-	mtdblk->cache_state = STATE_EMPTY;
+	INIT_LIST_HEAD(&mtdblk->cache_lru);
+	INIT_DELAYED_WORK(&mtdblk->flush_work, mtdblock_flush_work);
+	mtdblk->cache = NULL;
 	if (!(mbd->mtd->flags & MTD_NO_ERASE) && mbd->mtd->erasesize) {
 		mtdblk->cache_size = mbd->mtd->erasesize;
-		mtdblk->cache_data = NULL;
+		mtdblk->cache_count = max(cache_blocks, 1U);
+		mtdblk->cache_expire = msecs_to_jiffies(cache_expire_ms);
 	}
 
 	mutex_unlock(&mtdblks_lock);
@@ -317,14 +491,15 @@ static int mtdblock_release(struct mtd_blktrans_dev *mbd)
 	mutex_lock(&mtdblks_lock);
 
 	mutex_lock(&mtdblk->cache_mutex);
-	write_cached_data(mtdblk);
+	write_all_cached_data(mtdblk);
 	mutex_unlock(&mtdblk->cache_mutex);
 
 	if (!--mtdblk->count) {
 		/* It was the last usage. Free the cache */
+		cancel_delayed_work_sync(&mtdblk->flush_work);
 		if (mbd->mtd->sync)
 			mbd->mtd->sync(mbd->mtd);
-		vfree(mtdblk->cache_data);
+		free_cache(mtdblk);
 	}
 
 	mutex_unlock(&mtdblks_lock);
@@ -337,14 +512,15 @@ static int mtdblock_release(struct mtd_blktrans_dev *mbd)
 static int mtdblock_flush(struct mtd_blktrans_dev *dev)
 {
 	struct mtdblk_dev *mtdblk = container_of(dev, struct mtdblk_dev, mbd);
+	int ret;
 
 	mutex_lock(&mtdblk->cache_mutex);
-	write_cached_data(mtdblk);
+	ret = write_all_cached_data(mtdblk);
 	mutex_unlock(&mtdblk->cache_mutex);
 
 	if (dev->mtd->sync)
 		dev->mtd->sync(dev->mtd);
-	return 0;
+	return ret;
 }
 
 static void mtdblock_add_mtd(struct mtd_blktrans_ops *tr, struct mtd_info *mtd)
@@ -769,6 +769,10 @@ static void fsmc_write_buf_dma(struct mtd_info *mtd, const uint8_t *buf,
  * data(512 byte) -> ecc(13 byte)
  * After this read, fsmc hardware generates and reports error data bits(upto a
  * max of 8 bits)
+ *
+ * On large page devices the steps are walked with random data output from the
+ * page register, instead of reloading the page from the array for each of
+ * them. This also keeps the page register intact during a cache read.
  */
 static int fsmc_read_page_hwecc(struct mtd_info *mtd, struct nand_chip *chip,
 				 uint8_t *buf, int page)
@@ -779,6 +783,7 @@ static int fsmc_read_page_hwecc(struct mtd_info *mtd, struct nand_chip *chip,
 	int i, j, s, stat, eccsize = chip->ecc.size;
 	int eccbytes = chip->ecc.bytes;
 	int eccsteps = chip->ecc.steps;
+	int largepage = mtd->writesize > 512;
 	uint8_t *p = buf;
 	uint8_t *ecc_calc = chip->buffers->ecccalc;
 	uint8_t *ecc_code = chip->buffers->ecccode;
@@ -792,7 +797,10 @@ static int fsmc_read_page_hwecc(struct mtd_info *mtd, struct nand_chip *chip,
 	uint8_t *oob = (uint8_t *)&ecc_oob[0];
 
 	for (i = 0, s = 0; s < eccsteps; s++, i += eccbytes, p += eccsize) {
-		chip->cmdfunc(mtd, NAND_CMD_READ0, s * eccsize, page);
+		if (largepage)
+			chip->cmdfunc(mtd, NAND_CMD_RNDOUT, s * eccsize, -1);
+		else
+			chip->cmdfunc(mtd, NAND_CMD_READ0, s * eccsize, page);
 		chip->ecc.hwctl(mtd, NAND_ECC_READ);
 		chip->read_buf(mtd, p, eccsize);
 
@@ -809,7 +817,11 @@ static int fsmc_read_page_hwecc(struct mtd_info *mtd, struct nand_chip *chip,
 			if (chip->options & NAND_BUSWIDTH_16)
 				len = roundup(len, 2);
 
-			chip->cmdfunc(mtd, NAND_CMD_READOOB, off, page);
+			if (largepage)
+				chip->cmdfunc(mtd, NAND_CMD_RNDOUT,
+					      mtd->writesize + off, -1);
+			else
+				chip->cmdfunc(mtd, NAND_CMD_READOOB, off, page);
 			chip->read_buf(mtd, oob + j, len);
 			j += len;
 		}
@@ -1072,9 +1084,15 @@ static int __init fsmc_nand_probe(struct platform_device *pdev)
 	nand->cmd_ctrl = fsmc_cmd_ctrl;
 	nand->chip_delay = 30;
 
-	nand->ecc.mode = NAND_ECC_HW;
-	nand->ecc.hwctl = fsmc_enable_hwecc;
 	nand->ecc.size = 512;
+	if (pdata->bch_ecc_bits) {
+		/* 13 bits of ecc per bit corrected for 512 byte blocks */
+		nand->ecc.mode = NAND_ECC_SOFT_BCH;
+		nand->ecc.bytes = DIV_ROUND_UP(13 * pdata->bch_ecc_bits, 8);
+	} else {
+		nand->ecc.mode = NAND_ECC_HW;
+		nand->ecc.hwctl = fsmc_enable_hwecc;
+	}
 	nand->options = pdata->options;
 	nand->select_chip = fsmc_select_chip;
 	nand->badblockbits = 7;
@@ -1133,7 +1151,9 @@ static int __init fsmc_nand_probe(struct platform_device *pdev)
 				nand->options & NAND_BUSWIDTH_16,
 				&host->dev_timings, &host->rbpin);
 
-	if (get_fsmc_version(host->regs_va) == FSMC_VER8) {
+	if (nand->ecc.mode == NAND_ECC_SOFT_BCH) {
+		/* nand_scan_tail() sets up the BCH functions */
+	} else if (get_fsmc_version(host->regs_va) == FSMC_VER8) {
 		nand->ecc.read_page = fsmc_read_page_hwecc;
 		nand->ecc.calculate = fsmc_read_hwecc_ecc4;
 		nand->ecc.correct = fsmc_bch8_correct_data;
@@ -1153,7 +1173,20 @@ static int __init fsmc_nand_probe(struct platform_device *pdev)
 		goto err_scan_ident;
 	}
 
-	if (get_fsmc_version(host->regs_va) == FSMC_VER8) {
+	/*
+	 * Cache read and cache program can not be told from the ID of most
+	 * chips, the board says whether they are there. Our page read only
+	 * works on the page register, so the core may pipeline multi-page
+	 * reads and writes with them.
+	 */
+	nand->options |= pdata->options & (NAND_CACHEPRG | NAND_CACHERD);
+	nand->options |= NAND_USE_CACHE_OPS;
+
+	if (nand->ecc.mode == NAND_ECC_SOFT_BCH) {
+		/* nand_bch_init() places the ecc at the end of the OOB */
+		dev_info(&pdev->dev, "software BCH ECC, %u bits per 512 bytes\n",
+			 pdata->bch_ecc_bits);
+	} else if (get_fsmc_version(host->regs_va) == FSMC_VER8) {
 		switch (host->mtd.oobsize) {
 		case 16:
 			nand->ecc.layout = &fsmc_ecc4_16_layout;
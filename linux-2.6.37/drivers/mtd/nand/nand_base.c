@@ -42,6 +42,7 @@
 #include <linux/mtd/mtd.h>
 #include <linux/mtd/nand.h>
 #include <linux/mtd/nand_ecc.h>
+#include <linux/mtd/nand_bch.h>
 #include <linux/interrupt.h>
 #include <linux/bitops.h>
 #include <linux/leds.h>
@@ -738,6 +739,8 @@ static void nand_command_lp(struct mtd_info *mtd, unsigned int command,
 			       NAND_NCE | NAND_CTRL_CHANGE);
 
 		/* This applies to read commands */
+	case NAND_CMD_READCACHESEQ:
+	case NAND_CMD_READCACHEEND:
 	default:
 		/*
 		 * If we don't have access to the busy pin, we apply the given
@@ -1439,6 +1442,22 @@ static uint8_t *nand_transfer_oob(struct nand_chip *chip, uint8_t *oob,
 	return NULL;
 }
 
+/*
+ * Cache read and cache program are only used on large page chips which
+ * have them, and only if the board driver copes with the sequences.
+ */
+static inline int nand_use_cache_read(struct nand_chip *chip)
+{
+	return NAND_HAS_CACHEREAD(chip) && chip->page_shift > 9 &&
+		(chip->options & NAND_USE_CACHE_OPS);
+}
+
+static inline int nand_use_cache_prog(struct nand_chip *chip)
+{
+	return NAND_HAS_CACHEPROG(chip) && chip->page_shift > 9 &&
+		(chip->options & NAND_USE_CACHE_OPS);
+}
+
 /**
  * nand_do_read_ops - [Internal] Read data with ECC
  *
@@ -1456,6 +1475,7 @@ static int nand_do_read_ops(struct mtd_info *mtd, loff_t from,
 	struct mtd_ecc_stats stats;
 	int blkcheck = (1 << (chip->phys_erase_shift - chip->page_shift)) - 1;
 	int sndcmd = 1;
+	int cacheread = 0;
 	int ret = 0;
 	uint32_t readlen = ops->len;
 	uint32_t oobreadlen = ops->ooblen;
@@ -1482,12 +1502,27 @@ static int nand_do_read_ops(struct mtd_info *mtd, loff_t from,
 		aligned = (bytes == mtd->writesize);
 
 		/* Is the current page in the buffer ? */
-		if (realpage != chip->pagebuf || oob) {
+		if (realpage != chip->pagebuf || oob || cacheread) {
+			/* More pages of this block follow ? */
+			int more = readlen > bytes && ((page + 1) & blkcheck);
+
 			bufpoi = aligned ? buf : chip->buffers->databuf;
 
 			if (likely(sndcmd)) {
 				chip->cmdfunc(mtd, NAND_CMD_READ0, 0x00, page);
 				sndcmd = 0;
+				cacheread = more && nand_use_cache_read(chip);
+			}
+
+			/*
+			 * In a cache read the chip loads the next page from
+			 * the array while we transfer this one out of the
+			 * page register.
+			 */
+			if (cacheread) {
+				chip->cmdfunc(mtd, more ? NAND_CMD_READCACHESEQ :
+					      NAND_CMD_READCACHEEND, -1, -1);
+				cacheread = more;
 			}
 
 			/* Now read the page into the buffer */
@@ -1563,7 +1598,7 @@ static int nand_do_read_ops(struct mtd_info *mtd, loff_t from,
 		/* Check, if the chip supports auto page increment
 		 * or if we have hit a block boundary.
 		 */
-		if (!NAND_CANAUTOINCR(chip) || !(page & blkcheck))
+		if (!cacheread && (!NAND_CANAUTOINCR(chip) || !(page & blkcheck)))
 			sndcmd = 1;
 	}
 
@@ -2069,12 +2104,15 @@ static int nand_write_page(struct mtd_info *mtd, struct nand_chip *chip,
 		chip->ecc.write_page(mtd, chip, buf);
 
 	/*
-	 * Cached progamming disabled for now, Not sure if its worth the
-	 * trouble. The speed gain is not very impressive. (2.3->2.6Mib/s)
+	 * With cached programming the chip programs this page from its page
+	 * register while the next one is loaded into the cache register. The
+	 * read back for verification would break the sequence.
 	 */
+#ifdef CONFIG_MTD_NAND_VERIFY_WRITE
 	cached = 0;
+#endif
 
-	if (!cached || !(chip->options & NAND_CACHEPRG)) {
+	if (!cached || !nand_use_cache_prog(chip)) {
 
 		chip->cmdfunc(mtd, NAND_CMD_PAGEPROG, -1, -1);
 		status = chip->waitfunc(mtd, chip);
@@ -2091,6 +2129,9 @@ static int nand_write_page(struct mtd_info *mtd, struct nand_chip *chip,
 	} else {
 		chip->cmdfunc(mtd, NAND_CMD_CACHEDPROG, -1, -1);
 		status = chip->waitfunc(mtd, chip);
+		/* Failure of the previous page is reported in bit 1 */
+		if (status & (NAND_STATUS_FAIL | NAND_STATUS_FAIL_N1))
+			return -EIO;
 	}
 
 #ifdef CONFIG_MTD_NAND_VERIFY_WRITE
@@ -2219,7 +2260,7 @@ static int nand_do_write_ops(struct mtd_info *mtd, loff_t to,
 
 	while (1) {
 		int bytes = mtd->writesize;
-		int cached = writelen > bytes && page != blockmask;
+		int cached = writelen > bytes && (page & blockmask) != blockmask;
 		uint8_t *wbuf = buf;
 
 		/* Partial page write ? */
@@ -2900,6 +2941,12 @@ static int nand_flash_detect_onfi(struct mtd_info *mtd, struct nand_chip *chip,
 	chip->options |= (NAND_NO_READRDY |
 			NAND_NO_AUTOINCR) & NAND_CHIPOPTIONS_MSK;
 
+	/* Optional commands: page cache program and read cache */
+	if (le16_to_cpu(p->opt_cmd) & (1 << 0))
+		chip->options |= NAND_CACHEPRG;
+	if (le16_to_cpu(p->opt_cmd) & (1 << 1))
+		chip->options |= NAND_CACHERD;
+
 	return 1;
 }
 
@@ -3249,9 +3296,10 @@ int nand_scan_tail(struct mtd_info *mtd)
 	chip->oob_poi = chip->buffers->databuf + mtd->writesize;
 
 	/*
-	 * If no default placement scheme is given, select an appropriate one
+	 * If no default placement scheme is given, select an appropriate one.
+	 * For software BCH, nand_bch_init() builds one to fit the ecc size.
 	 */
-	if (!chip->ecc.layout) {
+	if (!chip->ecc.layout && (chip->ecc.mode != NAND_ECC_SOFT_BCH)) {
 		switch (mtd->oobsize) {
 		case 8:
 			chip->ecc.layout = &nand_oob_8;
@@ -3354,6 +3402,39 @@ int nand_scan_tail(struct mtd_info *mtd)
 		chip->ecc.bytes = 3;
 		break;
 
+	case NAND_ECC_SOFT_BCH:
+		if (!mtd_nand_has_bch()) {
+			printk(KERN_WARNING "CONFIG_MTD_NAND_ECC_BCH not enabled\n");
+			BUG();
+		}
+		chip->ecc.calculate = nand_bch_calculate_ecc;
+		chip->ecc.correct = nand_bch_correct_data;
+		chip->ecc.read_page = nand_read_page_swecc;
+		chip->ecc.write_page = nand_write_page_swecc;
+		chip->ecc.read_page_raw = nand_read_page_raw;
+		chip->ecc.write_page_raw = nand_write_page_raw;
+		chip->ecc.read_oob = nand_read_oob_std;
+		chip->ecc.write_oob = nand_write_oob_std;
+		/*
+		 * Board driver should supply ecc.size and ecc.bytes values to
+		 * select how many bits are correctable; see nand_bch_init()
+		 * for details. Otherwise, default to 4 bits for large page
+		 * devices.
+		 */
+		if (!chip->ecc.size && (mtd->oobsize >= 64)) {
+			chip->ecc.size = 512;
+			chip->ecc.bytes = 7;
+		}
+		chip->ecc.priv = nand_bch_init(mtd,
+					       chip->ecc.size,
+					       chip->ecc.bytes,
+					       &chip->ecc.layout);
+		if (!chip->ecc.priv) {
+			printk(KERN_WARNING "BCH ECC initialization failed!\n");
+			BUG();
+		}
+		break;
+
 	case NAND_ECC_NONE:
 		printk(KERN_WARNING "NAND_ECC_NONE selected by board driver. "
 		       "This is not recommended !!\n");
@@ -3503,6 +3584,9 @@ void nand_release(struct mtd_info *mtd)
 {
 	struct nand_chip *chip = mtd->priv;
 
+	if (chip->ecc.mode == NAND_ECC_SOFT_BCH)
+		nand_bch_free((struct nand_bch_control *)chip->ecc.priv);
+
 #ifdef CONFIG_MTD_PARTITIONS
 	/* Deregister partitions */
 	del_mtd_partitions(mtd);
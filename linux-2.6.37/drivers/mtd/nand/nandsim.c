@@ -108,6 +108,7 @@ static unsigned int rptwear = 0;
 static unsigned int overridesize = 0;
 static char *cache_file = NULL;
 static unsigned int bbt;
+static unsigned int cache_ops;
 
 module_param(first_id_byte,  uint, 0400);
 module_param(second_id_byte, uint, 0400);
@@ -132,6 +133,7 @@ module_param(rptwear,        uint, 0400);
 module_param(overridesize,   uint, 0400);
 module_param(cache_file,     charp, 0400);
 module_param(bbt,	     uint, 0400);
+module_param(cache_ops,      uint, 0400);
 
 MODULE_PARM_DESC(first_id_byte,  "The first byte returned by NAND Flash 'read ID' command (manufacturer ID)");
 MODULE_PARM_DESC(second_id_byte, "The second byte returned by NAND Flash 'read ID' command (chip ID)");
@@ -165,6 +167,7 @@ MODULE_PARM_DESC(overridesize,   "Specifies the NAND Flash size overriding the I
 				 " e.g. 5 means a size of 32 erase blocks");
 MODULE_PARM_DESC(cache_file,     "File to use to cache nand pages instead of memory");
 MODULE_PARM_DESC(bbt,		 "0 OOB, 1 BBT with marker in OOB, 2 BBT with marker in data area");
+MODULE_PARM_DESC(cache_ops,      "Support cache read and cache program (large page chips) if not zero");
 
 /* The largest possible page size */
 #define NS_LARGEST_PAGE_SIZE	4096
@@ -221,6 +224,7 @@ MODULE_PARM_DESC(bbt,		 "0 OOB, 1 BBT with marker in OOB, 2 BBT with marker in d
 #define STATE_CMD_RESET        0x0000000C /* reset */
 #define STATE_CMD_RNDOUT       0x0000000D /* random output command */
 #define STATE_CMD_RNDOUTSTART  0x0000000E /* random output start command */
+#define STATE_CMD_READCACHE    0x0000000F /* sequential cache read command */
 #define STATE_CMD_MASK         0x0000000F /* command states mask */
 
 /* After an address is input, the simulator goes to one of these states */
@@ -255,7 +259,7 @@ MODULE_PARM_DESC(bbt,		 "0 OOB, 1 BBT with marker in OOB, 2 BBT with marker in d
 #define ACTION_OOBOFF    0x00600000 /* add to address OOB offset */
 #define ACTION_MASK      0x00700000 /* action mask */
 
-#define NS_OPER_NUM      13 /* Number of operations supported by the simulator */
+#define NS_OPER_NUM      14 /* Number of operations supported by the simulator */
 #define NS_OPER_STATES   6  /* Maximum number of states in operation */
 
 #define OPT_ANY          0xFFFFFFFF /* any chip supports this operation */
@@ -347,6 +351,8 @@ struct nandsim {
 		uint     off;     /* fixed page offset */
 	} regs;
 
+	int cachepg;            /* page in the cache register, -1 if no cache read */
+
 	/* NAND flash lines state */
         struct {
                 int ce;  /* chip Enable */
@@ -406,6 +412,8 @@ static struct nandsim_operations {
 	/* Large page devices random page read */
 	{OPT_LARGEPAGE, {STATE_CMD_RNDOUT, STATE_ADDR_COLUMN, STATE_CMD_RNDOUTSTART | ACTION_CPY,
 			       STATE_DATAOUT, STATE_READY}},
+	/* Large page devices sequential cache read */
+	{OPT_LARGEPAGE, {STATE_CMD_READCACHE | ACTION_CPY, STATE_DATAOUT, STATE_READY}},
 };
 
 struct weak_block {
@@ -1030,6 +1038,8 @@ static char *get_state_name(uint32_t state)
 			return "STATE_CMD_RNDOUT";
 		case STATE_CMD_RNDOUTSTART:
 			return "STATE_CMD_RNDOUTSTART";
+		case STATE_CMD_READCACHE:
+			return "STATE_CMD_READCACHE";
 		case STATE_ADDR_PAGE:
 			return "STATE_ADDR_PAGE";
 		case STATE_ADDR_SEC:
@@ -1082,6 +1092,11 @@ static int check_command(int cmd)
 	case NAND_CMD_RNDOUTSTART:
 		return 0;
 
+	case NAND_CMD_CACHEDPROG:
+	case NAND_CMD_READCACHESEQ:
+	case NAND_CMD_READCACHEEND:
+		return !cache_ops;
+
 	case NAND_CMD_STATUS_MULTI:
 	default:
 		return 1;
@@ -1122,6 +1137,12 @@ static uint32_t get_state_by_command(unsigned command)
 			return STATE_CMD_RNDOUT;
 		case NAND_CMD_RNDOUTSTART:
 			return STATE_CMD_RNDOUTSTART;
+		/* Programming is synchronous, so a cached one is no different */
+		case NAND_CMD_CACHEDPROG:
+			return STATE_CMD_PAGEPROG;
+		case NAND_CMD_READCACHESEQ:
+		case NAND_CMD_READCACHEEND:
+			return STATE_CMD_READCACHE;
 	}
 
 	NS_ERR("get_state_by_command: unknown command, BUG\n");
@@ -1586,7 +1607,7 @@ static int do_state_action(struct nandsim *ns, uint32_t action)
 {
 	int num;
 	int busdiv = ns->busw == 8 ? 1 : 2;
-	unsigned int erase_block_no, page_no;
+	unsigned int erase_block_no, page_no, xfer;
 
 	action &= ACTION_MASK;
 
@@ -1621,8 +1642,17 @@ static int do_state_action(struct nandsim *ns, uint32_t action)
 		else
 			NS_LOG("read OOB of page %d\n", ns->regs.row);
 
-		NS_UDELAY(access_delay);
-		NS_UDELAY(input_cycle * ns->geom.pgsz / 1000 / busdiv);
+		xfer = input_cycle * ns->geom.pgsz / 1000 / busdiv;
+		/*
+		 * In a cache read the page was loaded from the array while
+		 * the previous one was output.
+		 */
+		if (ns->regs.command == NAND_CMD_READCACHESEQ ||
+		    ns->regs.command == NAND_CMD_READCACHEEND)
+			NS_UDELAY(access_delay > xfer ? access_delay - xfer : 0);
+		else
+			NS_UDELAY(access_delay);
+		NS_UDELAY(xfer);
 
 		break;
 
@@ -1692,8 +1722,16 @@ static int do_state_action(struct nandsim *ns, uint32_t action)
 			num, ns->regs.row, ns->regs.column, NS_RAW_OFFSET(ns) + ns->regs.off);
 		NS_LOG("programm page %d\n", ns->regs.row);
 
-		NS_UDELAY(programm_delay);
-		NS_UDELAY(output_cycle * ns->geom.pgsz / 1000 / busdiv);
+		xfer = output_cycle * ns->geom.pgsz / 1000 / busdiv;
+		/*
+		 * A cached program overlaps with the input of the next page,
+		 * the final program waits for the whole of it.
+		 */
+		if (ns->regs.command == NAND_CMD_CACHEDPROG)
+			NS_UDELAY(programm_delay > xfer ? programm_delay - xfer : 0);
+		else
+			NS_UDELAY(programm_delay);
+		NS_UDELAY(xfer);
 
 		if (write_error(page_no)) {
 			NS_WARN("simulating write failure in page %u\n", page_no);
@@ -1973,6 +2011,7 @@ static void ns_nand_write_byte(struct mtd_info *mtd, u_char byte)
 		if (byte == NAND_CMD_RESET) {
 			NS_LOG("reset chip\n");
 			switch_to_ready_state(ns, NS_STATUS_OK(ns));
+			ns->cachepg = -1;
 			return;
 		}
 
@@ -2010,9 +2049,35 @@ static void ns_nand_write_byte(struct mtd_info *mtd, u_char byte)
 
 		NS_DBG("command byte corresponding to %s state accepted\n",
 			get_state_name(get_state_by_command(byte)));
+
+		if (byte == NAND_CMD_READCACHESEQ || byte == NAND_CMD_READCACHEEND) {
+			if (ns->cachepg < 0 || ns->cachepg >= ns->geom.pgnum) {
+				NS_ERR("write_byte: cache read command (%#x) outside of a "
+					"cache read, ignore it\n", (uint)byte);
+				switch_to_ready_state(ns, NS_STATUS_FAILED(ns));
+				ns->cachepg = -1;
+				return;
+			}
+			/*
+			 * The cache register moves to the page register and,
+			 * unless this ends the sequence, the next page starts
+			 * loading into the cache register.
+			 */
+			ns->regs.row = ns->cachepg;
+			ns->cachepg = byte == NAND_CMD_READCACHESEQ ?
+				ns->cachepg + 1 : -1;
+		} else if (byte != NAND_CMD_STATUS && byte != NAND_CMD_RNDOUT &&
+			   byte != NAND_CMD_RNDOUTSTART) {
+			ns->cachepg = -1;
+		}
+
 		ns->regs.command = byte;
 		switch_state(ns);
 
+		/* The page just read sits in the cache register, too */
+		if (byte == NAND_CMD_READSTART)
+			ns->cachepg = ns->regs.row;
+
 	} else if (ns->lines.ale == 1) {
 		/*
 		 * The byte written is an address.
@@ -2289,6 +2354,7 @@ static int __init ns_init_module(void)
 		nand->geom.idbytes = 2;
 	nand->regs.status = NS_STATUS_OK(nand);
 	nand->nxstate = STATE_UNKNOWN;
+	nand->cachepg = -1;
 	nand->options |= OPT_PAGE256; /* temporary value */
 	nand->ids[0] = first_id_byte;
 	nand->ids[1] = second_id_byte;
@@ -2310,6 +2376,9 @@ static int __init ns_init_module(void)
 	if ((retval = parse_gravepages()) != 0)
 		goto error;
 
+	if (cache_ops)
+		chip->options |= NAND_USE_CACHE_OPS;
+
 	if ((retval = nand_scan(nsmtd, 1)) != 0) {
 		NS_ERR("can't register NAND Simulator\n");
 		if (retval > 0)
@@ -2317,6 +2386,10 @@ static int __init ns_init_module(void)
 		goto error;
 	}
 
+	/* Chip options are reset by nand_scan(), set them afterwards */
+	if (cache_ops)
+		chip->options |= NAND_CACHEPRG | NAND_CACHERD;
+
 	if (overridesize) {
 		uint64_t new_size = (uint64_t)nsmtd->erasesize << overridesize;
 		if (new_size >> overridesize != nsmtd->erasesize) {
@@ -0,0 +1,216 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published by
+ * the Free Software Foundation.
+ *
+ * Test the software BCH ECC used by NAND_ECC_SOFT_BCH: check that every
+ * number of bit errors up to the correction capability is corrected, and
+ * measure encode and decode throughput for each of them.
+ */
+
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/random.h>
+#include <linux/string.h>
+#include <linux/bitops.h>
+#include <linux/slab.h>
+#include <linux/sched.h>
+#include <linux/time.h>
+#include <linux/bch.h>
+
+#define PRINT_PREF KERN_INFO "mtd_nandbchtest: "
+
+static int eccsize = 512;
+module_param(eccsize, int, S_IRUGO);
+MODULE_PARM_DESC(eccsize, "ECC block size in bytes (default 512)");
+
+static int eccbytes = 13;
+module_param(eccbytes, int, S_IRUGO);
+MODULE_PARM_DESC(eccbytes, "ECC bytes per block, sets the number of "
+			   "correctable bits (default 13: 8 bits per 512)");
+
+static int loops = 2000;
+module_param(loops, int, S_IRUGO);
+MODULE_PARM_DESC(loops, "Blocks encoded/decoded per measurement");
+
+#if defined(CONFIG_BCH) || defined(CONFIG_BCH_MODULE)
+
+static struct bch_control *bch;
+static unsigned char *data, *error_data;
+static unsigned char *ecc, *error_ecc;
+static unsigned int *errloc;
+static unsigned int *errpos;
+static struct timeval start, finish;
+
+static inline void start_timing(void)
+{
+	do_gettimeofday(&start);
+}
+
+static inline void stop_timing(void)
+{
+	do_gettimeofday(&finish);
+}
+
+static long calc_speed(void)
+{
+	long us, k;
+
+	us = (finish.tv_sec - start.tv_sec) * 1000000 +
+	     (finish.tv_usec - start.tv_usec);
+	if (us <= 0)
+		return 0;
+	k = (long)loops * eccsize / 1024;
+	return div_s64((s64)k * 1000000, us);
+}
+
+/* flip nerr distinct random bits of the codeword (data and ecc) */
+static void inject_errors(int nerr)
+{
+	const unsigned int nbits = eccsize * 8 + bch->ecc_bits;
+	unsigned int pos;
+	int i, j;
+
+	memcpy(error_data, data, eccsize);
+	memcpy(error_ecc, ecc, bch->ecc_bytes);
+
+	for (i = 0; i < nerr; i++) {
+again:
+		pos = random32() % nbits;
+		for (j = 0; j < i; j++)
+			if (errpos[j] == pos)
+				goto again;
+		errpos[i] = pos;
+
+		/* bits are numbered from the msb of the first byte */
+		if (pos < eccsize * 8)
+			error_data[pos / 8] ^= 0x80 >> (pos % 8);
+		else {
+			pos -= eccsize * 8;
+			error_ecc[pos / 8] ^= 0x80 >> (pos % 8);
+		}
+	}
+}
+
+static int decode_and_correct(void)
+{
+	int i, count;
+
+	count = decode_bch(bch, error_data, eccsize, error_ecc, NULL, errloc);
+	for (i = 0; i < count; i++)
+		if (errloc[i] < eccsize * 8)
+			error_data[errloc[i] / 8] ^= 1 << (errloc[i] % 8);
+
+	return count;
+}
+
+static int bch_test_errors(int nerr)
+{
+	int i, count, failed = 0;
+
+	start_timing();
+	for (i = 0; i < loops; i++) {
+		inject_errors(nerr);
+		count = decode_and_correct();
+		if (count != nerr || memcmp(data, error_data, eccsize))
+			failed++;
+		cond_resched();
+	}
+	stop_timing();
+
+	if (failed) {
+		printk(KERN_ERR "mtd_nandbchtest: not ok - %d bit errors, "
+		       "%d of %d blocks miscorrected\n", nerr, failed, loops);
+		return -EINVAL;
+	}
+
+	printk(PRINT_PREF "ok - %2d bit errors, decode speed %ld KiB/s\n",
+	       nerr, calc_speed());
+	return 0;
+}
+
+static int __init bch_test_init(void)
+{
+	unsigned int m, t;
+	int i, err = -ENOMEM;
+
+	if (eccsize <= 0 || eccbytes <= 0 || loops <= 0) {
+		printk(KERN_ERR "mtd_nandbchtest: invalid parameters\n");
+		return -EINVAL;
+	}
+
+	/* same parameters as nand_bch_init() */
+	m = fls(1 + 8 * eccsize);
+	t = (eccbytes * 8) / m;
+
+	bch = init_bch(m, t, 0);
+	if (!bch) {
+		printk(KERN_ERR "mtd_nandbchtest: cannot set up BCH with "
+		       "m=%u t=%u\n", m, t);
+		return -EINVAL;
+	}
+
+	data = kmalloc(eccsize, GFP_KERNEL);
+	error_data = kmalloc(eccsize, GFP_KERNEL);
+	ecc = kmalloc(bch->ecc_bytes, GFP_KERNEL);
+	error_ecc = kmalloc(bch->ecc_bytes, GFP_KERNEL);
+	errloc = kmalloc(t * sizeof(*errloc), GFP_KERNEL);
+	errpos = kmalloc(t * sizeof(*errpos), GFP_KERNEL);
+	if (!data || !error_data || !ecc || !error_ecc || !errloc || !errpos)
+		goto out;
+
+	srandom32(jiffies);
+	printk(PRINT_PREF "%d byte blocks, m=%u t=%u, %u ecc bits\n",
+	       eccsize, m, t, bch->ecc_bits);
+
+	start_timing();
+	for (i = 0; i < loops; i++) {
+		if (!(i & 255)) {
+			get_random_bytes(data, eccsize);
+			cond_resched();
+		}
+		memset(ecc, 0, bch->ecc_bytes);
+		encode_bch(bch, data, eccsize, ecc);
+	}
+	stop_timing();
+	printk(PRINT_PREF "encode speed %ld KiB/s\n", calc_speed());
+
+	err = 0;
+	for (i = 0; i <= t; i++) {
+		err = bch_test_errors(i);
+		if (err)
+			break;
+	}
+
+out:
+	kfree(errpos);
+	kfree(errloc);
+	kfree(error_ecc);
+	kfree(ecc);
+	kfree(error_data);
+	kfree(data);
+	free_bch(bch);
+	return err;
+}
+
+#else
+
+static int __init bch_test_init(void)
+{
+	printk(PRINT_PREF "BCH library not available\n");
+	return -ENODEV;
+}
+
+#endif
+
+static void __exit bch_test_exit(void)
+{
+}
+
+module_init(bch_test_init);
+module_exit(bch_test_exit);
+
+MODULE_DESCRIPTION("NAND BCH ECC test and benchmark module");
+MODULE_LICENSE("GPL");
@@ -44,6 +44,7 @@
 #include <linux/kthread.h>
 #include <linux/kernel.h>
 #include <linux/slab.h>
+#include <linux/math64.h>
 #include "ubi.h"
 
 /* Maximum length of the 'mtd=' parameter */
@@ -107,6 +108,9 @@ static struct class_attribute ubi_version =
 
 static ssize_t dev_attribute_show(struct device *dev,
 				  struct device_attribute *attr, char *buf);
+static ssize_t dev_attribute_store(struct device *dev,
+				   struct device_attribute *attr,
+				   const char *buf, size_t count);
 
 /* UBI device attributes (correspond to files in '/<sysfs>/class/ubi/ubiX') */
 static struct device_attribute dev_eraseblock_size =
@@ -131,6 +135,19 @@ static struct device_attribute dev_bgt_enabled =
 	__ATTR(bgt_enabled, S_IRUGO, dev_attribute_show, NULL);
 static struct device_attribute dev_mtd_num =
 	__ATTR(mtd_num, S_IRUGO, dev_attribute_show, NULL);
+static struct device_attribute dev_free_eraseblocks =
+	__ATTR(free_eraseblocks, S_IRUGO, dev_attribute_show, NULL);
+static struct device_attribute dev_free_low_watermark =
+	__ATTR(free_low_watermark, S_IRUGO | S_IWUSR, dev_attribute_show,
+	       dev_attribute_store);
+static struct device_attribute dev_erase_queue_depth =
+	__ATTR(erase_queue_depth, S_IRUGO, dev_attribute_show, NULL);
+static struct device_attribute dev_write_stalls =
+	__ATTR(write_stalls, S_IRUGO, dev_attribute_show, NULL);
+static struct device_attribute dev_max_write_latency =
+	__ATTR(max_write_latency, S_IRUGO, dev_attribute_show, NULL);
+static struct device_attribute dev_mean_write_latency =
+	__ATTR(mean_write_latency, S_IRUGO, dev_attribute_show, NULL);
 
 /**
  * ubi_volume_notify - send a volume change notification.
@@ -355,13 +372,60 @@ static ssize_t dev_attribute_show(struct device *dev,
 		ret = sprintf(buf, "%d\n", ubi->thread_enabled);
 	else if (attr == &dev_mtd_num)
 		ret = sprintf(buf, "%d\n", ubi->mtd->index);
-	else
+	else if (attr == &dev_free_eraseblocks)
+		ret = sprintf(buf, "%d\n", ubi->free_count);
+	else if (attr == &dev_free_low_watermark)
+		ret = sprintf(buf, "%d\n", ubi->free_low);
+	else if (attr == &dev_erase_queue_depth)
+		ret = sprintf(buf, "%d\n", ubi_wl_erase_queue_depth(ubi));
+	else if (attr == &dev_write_stalls)
+		ret = sprintf(buf, "%u\n", ubi->write_stalls);
+	else if (attr == &dev_max_write_latency)
+		ret = sprintf(buf, "%u\n", ubi->max_write_time);
+	else if (attr == &dev_mean_write_latency) {
+		unsigned long long mean = 0;
+
+		spin_lock(&ubi->stats_lock);
+		if (ubi->write_count)
+			mean = div64_u64(ubi->write_time, ubi->write_count);
+		spin_unlock(&ubi->stats_lock);
+		ret = sprintf(buf, "%llu\n", mean);
+	} else
 		ret = -EINVAL;
 
 	ubi_put_device(ubi);
 	return ret;
 }
 
+/* "Store" method for files in '/<sysfs>/class/ubi/ubiX/' */
+static ssize_t dev_attribute_store(struct device *dev,
+				   struct device_attribute *attr,
+				   const char *buf, size_t count)
+{
+	int err;
+	unsigned long val;
+	struct ubi_device *ubi;
+
+	/* See the comment in 'dev_attribute_show()' */
+	ubi = container_of(dev, struct ubi_device, dev);
+	ubi = ubi_get_device(ubi->ubi_num);
+	if (!ubi)
+		return -ENODEV;
+
+	err = strict_strtoul(buf, 10, &val);
+	if (err || val > ubi->good_peb_count)
+		err = -EINVAL;
+	else if (attr == &dev_free_low_watermark) {
+		spin_lock(&ubi->wl_lock);
+		ubi->free_low = val;
+		spin_unlock(&ubi->wl_lock);
+	} else
+		err = -EINVAL;
+
+	ubi_put_device(ubi);
+	return err ? err : count;
+}
+
 static void dev_release(struct device *dev)
 {
 	struct ubi_device *ubi = container_of(dev, struct ubi_device, dev);
@@ -422,6 +486,24 @@ static int ubi_sysfs_init(struct ubi_device *ubi, int *ref)
 	if (err)
 		return err;
 	err = device_create_file(&ubi->dev, &dev_mtd_num);
+	if (err)
+		return err;
+	err = device_create_file(&ubi->dev, &dev_free_eraseblocks);
+	if (err)
+		return err;
+	err = device_create_file(&ubi->dev, &dev_free_low_watermark);
+	if (err)
+		return err;
+	err = device_create_file(&ubi->dev, &dev_erase_queue_depth);
+	if (err)
+		return err;
+	err = device_create_file(&ubi->dev, &dev_write_stalls);
+	if (err)
+		return err;
+	err = device_create_file(&ubi->dev, &dev_max_write_latency);
+	if (err)
+		return err;
+	err = device_create_file(&ubi->dev, &dev_mean_write_latency);
 	return err;
 }
 
@@ -431,6 +513,12 @@ static int ubi_sysfs_init(struct ubi_device *ubi, int *ref)
  */
 static void ubi_sysfs_close(struct ubi_device *ubi)
 {
+	device_remove_file(&ubi->dev, &dev_mean_write_latency);
+	device_remove_file(&ubi->dev, &dev_max_write_latency);
+	device_remove_file(&ubi->dev, &dev_write_stalls);
+	device_remove_file(&ubi->dev, &dev_erase_queue_depth);
+	device_remove_file(&ubi->dev, &dev_free_low_watermark);
+	device_remove_file(&ubi->dev, &dev_free_eraseblocks);
 	device_remove_file(&ubi->dev, &dev_mtd_num);
 	device_remove_file(&ubi->dev, &dev_bgt_enabled);
 	device_remove_file(&ubi->dev, &dev_min_io_size);
@@ -575,19 +663,22 @@ static void free_internal_volumes(struct ubi_device *ubi)
  * This function returns zero in case of success and a negative error code in
  * case of failure.
  *
- * Note, currently this is the only method to attach UBI devices. Hopefully in
- * the future we'll have more scalable attaching methods and avoid full media
- * scanning. But even in this case scanning will be needed as a fall-back
- * attaching method if there are some on-flash table corruptions.
+ * Note, if the fastmap is enabled, UBI first tries to attach using the
+ * fastmap, and scans the whole media only if there is no usable fastmap.
  */
 static int attach_by_scanning(struct ubi_device *ubi)
 {
 	int err;
+	unsigned long start = jiffies;
 	struct ubi_scan_info *si;
 
-	si = ubi_scan(ubi);
+	si = ubi_scan_fastmap(ubi);
+	if (!si)
+		si = ubi_scan(ubi);
 	if (IS_ERR(si))
 		return PTR_ERR(si);
+	ubi_msg("attached by %s in %u ms", si->fm ? "fastmap" : "scanning",
+		jiffies_to_msecs(jiffies - start));
 
 	ubi->bad_peb_count = si->bad_peb_count;
 	ubi->good_peb_count = ubi->peb_count - ubi->bad_peb_count;
@@ -921,6 +1012,7 @@ int ubi_attach_mtd_dev(struct mtd_info *mtd, int ubi_num, int vid_hdr_offset)
 	mutex_init(&ubi->ckvol_mutex);
 	mutex_init(&ubi->device_mutex);
 	spin_lock_init(&ubi->volumes_lock);
+	spin_lock_init(&ubi->stats_lock);
 
 	ubi_msg("attaching mtd%d to ubi%d", mtd->index, ubi_num);
 
@@ -960,12 +1052,22 @@ int ubi_attach_mtd_dev(struct mtd_info *mtd, int ubi_num, int vid_hdr_offset)
 	if (err)
 		goto out_detach;
 
-	ubi->bgt_thread = kthread_create(ubi_thread, ubi, ubi->bgt_name);
-	if (IS_ERR(ubi->bgt_thread)) {
-		err = PTR_ERR(ubi->bgt_thread);
-		ubi_err("cannot spawn \"%s\", error %d", ubi->bgt_name,
-			err);
-		goto out_uif;
+	for (i = 0; i < UBI_BGT_THREADS; i++) {
+		struct task_struct *tsk;
+
+		if (i == 0)
+			tsk = kthread_create(ubi_thread, ubi, "%s",
+					     ubi->bgt_name);
+		else
+			tsk = kthread_create(ubi_thread, ubi, "%s/%d",
+					     ubi->bgt_name, i);
+		if (IS_ERR(tsk)) {
+			err = PTR_ERR(tsk);
+			ubi_err("cannot spawn \"%s\" number %d, error %d",
+				ubi->bgt_name, i, err);
+			goto out_bgt;
+		}
+		ubi->bgt_thread[i] = tsk;
 	}
 
 	ubi_msg("attached mtd%d to ubi%d", mtd->index, ubi_num);
@@ -976,6 +1078,8 @@ int ubi_attach_mtd_dev(struct mtd_info *mtd, int ubi_num, int vid_hdr_offset)
 	ubi_msg("number of corrupted PEBs:   %d", ubi->corr_peb_count);
 	ubi_msg("max. allowed volumes:       %d", ubi->vtbl_slots);
 	ubi_msg("wear-leveling threshold:    %d", CONFIG_MTD_UBI_WL_THRESHOLD);
+	ubi_msg("free PEBs low watermark:    %d", ubi->free_low);
+	ubi_msg("number of background threads: %d", UBI_BGT_THREADS);
 	ubi_msg("number of internal volumes: %d", UBI_INT_VOL_COUNT);
 	ubi_msg("number of user volumes:     %d",
 		ubi->vol_count - UBI_INT_VOL_COUNT);
@@ -993,14 +1097,17 @@ int ubi_attach_mtd_dev(struct mtd_info *mtd, int ubi_num, int vid_hdr_offset)
 	spin_lock(&ubi->wl_lock);
 	if (!DBG_DISABLE_BGT)
 		ubi->thread_enabled = 1;
-	wake_up_process(ubi->bgt_thread);
+	for (i = 0; i < UBI_BGT_THREADS; i++)
+		wake_up_process(ubi->bgt_thread[i]);
 	spin_unlock(&ubi->wl_lock);
 
 	ubi_devices[ubi_num] = ubi;
 	ubi_notify_all(ubi, UBI_VOLUME_ADDED, NULL);
 	return ubi_num;
 
-out_uif:
+out_bgt:
+	while (--i >= 0)
+		kthread_stop(ubi->bgt_thread[i]);
 	uif_close(ubi);
 out_detach:
 	ubi_wl_close(ubi);
@@ -1034,6 +1141,7 @@ out_free:
  */
 int ubi_detach_mtd_dev(int ubi_num, int anyway)
 {
+	int i;
 	struct ubi_device *ubi;
 
 	if (ubi_num < 0 || ubi_num >= UBI_MAX_DEVICES)
@@ -1063,11 +1171,19 @@ int ubi_detach_mtd_dev(int ubi_num, int anyway)
 	dbg_msg("detaching mtd%d from ubi%d", ubi->mtd->index, ubi_num);
 
 	/*
-	 * Before freeing anything, we have to stop the background thread to
-	 * prevent it from doing anything on this device while we are freeing.
+	 * Before freeing anything, we have to stop the background threads to
+	 * prevent them from doing anything on this device while we are
+	 * freeing. Nobody must wake them up once they are gone.
 	 */
-	if (ubi->bgt_thread)
-		kthread_stop(ubi->bgt_thread);
+	spin_lock(&ubi->wl_lock);
+	ubi->thread_enabled = 0;
+	spin_unlock(&ubi->wl_lock);
+	for (i = 0; i < UBI_BGT_THREADS; i++)
+		if (ubi->bgt_thread[i])
+			kthread_stop(ubi->bgt_thread[i]);
+
+	/* Save the current state so that the next attach is fast */
+	ubi_update_fastmap(ubi);
 
 	/*
 	 * Get a reference to the device in order to prevent 'dev_release()'
@@ -0,0 +1,1072 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See
+ * the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+/*
+ * UBI fastmap.
+ *
+ * Attaching by scanning reads the EC and VID headers of every physical
+ * eraseblock, which takes long on large NAND chips. The fastmap is a snapshot
+ * of the WL and EBA sub-systems state stored in a few PEBs, so that attaching
+ * only has to read the fastmap and the few PEBs which might have changed since
+ * the fastmap was written.
+ *
+ * The fastmap starts in the anchor PEB, which is one of the first
+ * %UBI_FM_MAX_START PEBs so that it is found quickly, and continues in the
+ * data PEBs the anchor refers to. The anchor belongs to the internal volume
+ * %UBI_FM_SB_VOLUME_ID and the data PEBs to %UBI_FM_DATA_VOLUME_ID. Both
+ * volumes are "delete"-compatible, so UBI implementations which do not know
+ * about fastmap just erase them.
+ *
+ * Free PEBs are handed out only from the pools, and the pools are recorded in
+ * the fastmap as PEBs which have to be scanned. A new fastmap is written when
+ * a pool runs empty and when the device is detached. PEBs which were in use
+ * when the fastmap was written are not erased before the next fastmap is
+ * written, because the fastmap on the flash still refers to their contents.
+ * This means that a LEB un-map becomes persistent only when the next fastmap
+ * is written, e.g., by 'ubi_wl_flush()'.
+ *
+ * There is never more than one valid anchor on the flash: the old anchor is
+ * erased before a new fastmap is written, and the new anchor is written last.
+ * If anything about the fastmap looks wrong when attaching, UBI falls back to
+ * full scanning, which erases all fastmap PEBs it finds.
+ */
+
+#include <linux/crc32.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include "ubi.h"
+
+/* Returned by the attach helpers if the fastmap cannot be used */
+#define UBI_BAD_FASTMAP 1
+
+/* State of the PEBs while a fastmap is being written */
+enum {
+	FM_PEB_UNKNOWN = 0,
+	FM_PEB_LISTED,
+	FM_PEB_USED,
+	FM_PEB_SCRUB,
+};
+
+/**
+ * ubi_calc_fm_size - calculate the size of the fastmap.
+ * @ubi: UBI device description object
+ *
+ * This function returns the maximum size of the fastmap of @ubi rounded up to
+ * the LEB size, which is the amount of space reserved for it.
+ */
+int ubi_calc_fm_size(struct ubi_device *ubi)
+{
+	size_t size;
+
+	/*
+	 * A PEB is described either by a &struct ubi_fm_ec record or by a
+	 * larger &struct ubi_fm_leb one, but never by both.
+	 */
+	size = sizeof(struct ubi_fm_sb) + sizeof(struct ubi_fm_hdr) +
+	       (UBI_MAX_VOLUMES + UBI_INT_VOL_COUNT) *
+	       sizeof(struct ubi_fm_volhdr) +
+	       ubi->peb_count * sizeof(struct ubi_fm_leb);
+	return roundup(size, ubi->leb_size);
+}
+
+/**
+ * fm_rec - get the next record of the fastmap.
+ * @p: the current position in the fastmap buffer
+ * @end: the end of the fastmap buffer
+ * @size: size of the record
+ *
+ * This function returns a pointer to the record at @p and advances @p, or
+ * returns %NULL if the record does not fit into the buffer.
+ */
+static void *fm_rec(void **p, void *end, size_t size)
+{
+	void *rec = *p;
+
+	if (*p + size > end)
+		return NULL;
+	*p += size;
+	return rec;
+}
+
+/**
+ * add_listed - add a PEB described by the fastmap to a list.
+ * @si: scanning information
+ * @pnum: physical eraseblock number
+ * @ec: erase counter
+ * @list: the list to add to
+ *
+ * This function returns zero in case of success and %-ENOMEM in case of
+ * failure.
+ */
+static int add_listed(struct ubi_scan_info *si, int pnum, int ec,
+		      struct list_head *list)
+{
+	struct ubi_scan_leb *seb;
+
+	seb = kmalloc(sizeof(struct ubi_scan_leb), GFP_KERNEL);
+	if (!seb)
+		return -ENOMEM;
+
+	seb->pnum = pnum;
+	seb->ec = ec;
+	list_add_tail(&seb->u.list, list);
+	return 0;
+}
+
+/**
+ * account_ec - account an erase counter in the scanning information.
+ * @si: scanning information
+ * @ec: erase counter
+ */
+static void account_ec(struct ubi_scan_info *si, int ec)
+{
+	if (ec == UBI_SCAN_UNKNOWN_EC)
+		return;
+
+	si->ec_sum += ec;
+	si->ec_count += 1;
+	if (ec > si->max_ec)
+		si->max_ec = ec;
+	if (ec < si->min_ec)
+		si->min_ec = ec;
+}
+
+/**
+ * claim_peb - make sure a PEB is described by the fastmap only once.
+ * @ubi: UBI device description object
+ * @seen: bitmap of the PEBs described so far
+ * @pnum: physical eraseblock number
+ * @ec: erase counter
+ *
+ * This function returns zero if @pnum and @ec are sane and @pnum was not seen
+ * before, and %UBI_BAD_FASTMAP otherwise.
+ */
+static int claim_peb(struct ubi_device *ubi, unsigned long *seen, int pnum,
+		     int ec)
+{
+	if (pnum < 0 || pnum >= ubi->peb_count || ec < 0 ||
+	    ec > UBI_MAX_ERASECOUNTER || __test_and_set_bit(pnum, seen)) {
+		ubi_warn("bad PEB %d, EC %d in the fastmap", pnum, ec);
+		return UBI_BAD_FASTMAP;
+	}
+	return 0;
+}
+
+/**
+ * scan_peb - scan a PEB the fastmap does not know the contents of.
+ * @ubi: UBI device description object
+ * @si: scanning information
+ * @pnum: physical eraseblock number
+ * @ech: buffer for the EC header
+ * @vh: buffer for the VID header
+ *
+ * These are the PEBs of the pools and the PEBs which were not yet mapped when
+ * the fastmap was written. They were all intact at that time, so a corrupted
+ * header can only be the result of a power cut and the PEB is erased. This
+ * function returns zero in case of success, %UBI_BAD_FASTMAP if the fastmap
+ * cannot be used and a negative error code in case of failure.
+ */
+static int scan_peb(struct ubi_device *ubi, struct ubi_scan_info *si,
+		    int pnum, struct ubi_ec_hdr *ech, struct ubi_vid_hdr *vh)
+{
+	int err, ec, vol_id, bitflips = 0;
+
+	err = ubi_io_is_bad(ubi, pnum);
+	if (err < 0)
+		return err;
+	if (err) {
+		si->bad_peb_count += 1;
+		return 0;
+	}
+
+	err = ubi_io_read_ec_hdr(ubi, pnum, ech, 0);
+	if (err < 0)
+		return err;
+	if (err == UBI_IO_BITFLIPS)
+		bitflips = 1;
+	else if (err)
+		return add_listed(si, pnum, UBI_SCAN_UNKNOWN_EC, &si->erase);
+
+	ec = be64_to_cpu(ech->ec);
+	if (ec > UBI_MAX_ERASECOUNTER ||
+	    be32_to_cpu(ech->image_seq) != ubi->image_seq)
+		return UBI_BAD_FASTMAP;
+	account_ec(si, ec);
+
+	err = ubi_io_read_vid_hdr(ubi, pnum, vh, 0);
+	if (err < 0)
+		return err;
+	switch (err) {
+	case 0:
+		break;
+	case UBI_IO_BITFLIPS:
+		bitflips = 1;
+		break;
+	case UBI_IO_FF:
+		dbg_bld("free PEB %d, EC %d", pnum, ec);
+		return add_listed(si, pnum, ec,
+				  bitflips ? &si->erase : &si->free);
+	default:
+		dbg_bld("erase PEB %d, EC %d", pnum, ec);
+		return add_listed(si, pnum, ec, &si->erase);
+	}
+
+	vol_id = be32_to_cpu(vh->vol_id);
+	if (vol_id > UBI_MAX_VOLUMES && vol_id != UBI_LAYOUT_VOLUME_ID)
+		/* Leave the internal volumes to the full scan */
+		return UBI_BAD_FASTMAP;
+
+	return ubi_scan_add_used(ubi, si, pnum, ec, vh, bitflips);
+}
+
+/**
+ * read_fm - read the fastmap.
+ * @ubi: UBI device description object
+ * @anchor: the anchor PEB
+ * @sqnum: sequence number of the anchor
+ * @vh: buffer for the VID header
+ * @bufp: the fastmap is returned here
+ *
+ * This function reads the fastmap starting at @anchor, checks it and returns
+ * it in a vmalloc'ed buffer. Returns zero in case of success,
+ * %UBI_BAD_FASTMAP if the fastmap cannot be used and %-ENOMEM if there is not
+ * enough memory.
+ */
+static int read_fm(struct ubi_device *ubi, int anchor, unsigned long long sqnum,
+		   struct ubi_vid_hdr *vh, void **bufp)
+{
+	int i, err, pnum, len, size, used_blocks;
+	uint32_t crc;
+	struct ubi_fm_sb *sb;
+	void *buf;
+
+	sb = kmalloc(sizeof(struct ubi_fm_sb), GFP_KERNEL);
+	if (!sb)
+		return -ENOMEM;
+
+	err = ubi_io_read_data(ubi, sb, anchor, 0, sizeof(struct ubi_fm_sb));
+	if (err && err != UBI_IO_BITFLIPS)
+		goto out_bad;
+
+	size = be32_to_cpu(sb->size);
+	used_blocks = be32_to_cpu(sb->used_blocks);
+	if (be32_to_cpu(sb->magic) != UBI_FM_SB_MAGIC ||
+	    sb->version != UBI_FM_FMT_VERSION ||
+	    be64_to_cpu(sb->sqnum) != sqnum ||
+	    be32_to_cpu(sb->block_loc[0]) != anchor ||
+	    used_blocks < 1 || used_blocks > UBI_FM_MAX_BLOCKS ||
+	    size < sizeof(struct ubi_fm_sb) + sizeof(struct ubi_fm_hdr) ||
+	    size > used_blocks * ubi->leb_size) {
+		ubi_warn("bad fastmap super block in PEB %d", anchor);
+		goto out_bad;
+	}
+
+	buf = vmalloc(size);
+	if (!buf) {
+		kfree(sb);
+		return -ENOMEM;
+	}
+
+	for (i = 0; i < used_blocks; i++) {
+		pnum = be32_to_cpu(sb->block_loc[i]);
+		if (pnum < 0 || pnum >= ubi->peb_count)
+			goto out_bad_buf;
+
+		if (i > 0) {
+			err = ubi_io_read_vid_hdr(ubi, pnum, vh, 0);
+			if ((err && err != UBI_IO_BITFLIPS) ||
+			    be32_to_cpu(vh->vol_id) != UBI_FM_DATA_VOLUME_ID ||
+			    be32_to_cpu(vh->lnum) != i) {
+				ubi_warn("bad fastmap block %d in PEB %d",
+					 i, pnum);
+				goto out_bad_buf;
+			}
+		}
+
+		len = min(ubi->leb_size, size - i * ubi->leb_size);
+		if (len <= 0)
+			continue;
+		err = ubi_io_read_data(ubi, buf + i * ubi->leb_size, pnum, 0,
+				       len);
+		if (err && err != UBI_IO_BITFLIPS)
+			goto out_bad_buf;
+	}
+
+	kfree(sb);
+	sb = buf;
+	crc = be32_to_cpu(sb->data_crc);
+	sb->data_crc = 0;
+	if (crc32(UBI_CRC32_INIT, buf, size) != crc) {
+		ubi_warn("bad fastmap CRC");
+		vfree(buf);
+		return UBI_BAD_FASTMAP;
+	}
+
+	*bufp = buf;
+	return 0;
+
+out_bad_buf:
+	vfree(buf);
+out_bad:
+	kfree(sb);
+	return UBI_BAD_FASTMAP;
+}
+
+/**
+ * attach_fm - build the scanning information out of the fastmap.
+ * @ubi: UBI device description object
+ * @si: scanning information to fill
+ * @buf: the fastmap
+ * @ech: buffer for the EC header
+ * @vh: buffer for the VID header
+ *
+ * This function returns zero in case of success, %UBI_BAD_FASTMAP if the
+ * fastmap cannot be used and a negative error code in case of failure.
+ */
+static int attach_fm(struct ubi_device *ubi, struct ubi_scan_info *si,
+		     void *buf, struct ubi_ec_hdr *ech, struct ubi_vid_hdr *vh)
+{
+	int i, j, err, pnum, ec, vol_id, count;
+	unsigned long *seen;
+	struct ubi_fm_sb *sb = buf;
+	struct ubi_fm_hdr *hdr;
+	struct ubi_fm_ec *fec;
+	struct ubi_fm_volhdr *fvh;
+	struct ubi_fm_leb *fleb;
+	struct ubi_fastmap_layout *fm;
+	struct ubi_wl_entry *e;
+	struct ubi_scan_volume *sv;
+	struct ubi_scan_leb *seb;
+	struct rb_node *rb;
+	void *p = buf + sizeof(struct ubi_fm_sb);
+	void *end = buf + be32_to_cpu(sb->size);
+
+	seen = kzalloc(BITS_TO_LONGS(ubi->peb_count) * sizeof(long),
+		       GFP_KERNEL);
+	fm = kzalloc(sizeof(struct ubi_fastmap_layout), GFP_KERNEL);
+	if (!seen || !fm) {
+		kfree(fm);
+		err = -ENOMEM;
+		goto out;
+	}
+
+	si->fm = fm;
+	for (i = 0; i < be32_to_cpu(sb->used_blocks); i++) {
+		pnum = be32_to_cpu(sb->block_loc[i]);
+		ec = be32_to_cpu(sb->block_ec[i]);
+		err = claim_peb(ubi, seen, pnum, ec);
+		if (err)
+			goto out;
+
+		e = kmem_cache_alloc(ubi_wl_entry_slab, GFP_KERNEL);
+		if (!e) {
+			err = -ENOMEM;
+			goto out;
+		}
+		e->pnum = pnum;
+		e->ec = ec;
+		fm->e[i] = e;
+		fm->used_blocks = i + 1;
+		account_ec(si, ec);
+	}
+
+	hdr = fm_rec(&p, end, sizeof(struct ubi_fm_hdr));
+	if (!hdr || be32_to_cpu(hdr->magic) != UBI_FM_HDR_MAGIC)
+		goto out_bad;
+
+	count = be32_to_cpu(hdr->free_peb_count);
+	for (i = 0; i < count; i++) {
+		fec = fm_rec(&p, end, sizeof(struct ubi_fm_ec));
+		if (!fec)
+			goto out_bad;
+		pnum = be32_to_cpu(fec->pnum);
+		ec = be32_to_cpu(fec->ec);
+		err = claim_peb(ubi, seen, pnum, ec);
+		if (!err)
+			err = add_listed(si, pnum, ec, &si->free);
+		if (err)
+			goto out;
+		account_ec(si, ec);
+	}
+
+	/*
+	 * The erase counters of the PEBs to be erased may have changed since
+	 * the fastmap was written, read them from the flash.
+	 */
+	count = be32_to_cpu(hdr->erase_peb_count);
+	for (i = 0; i < count; i++) {
+		fec = fm_rec(&p, end, sizeof(struct ubi_fm_ec));
+		if (!fec)
+			goto out_bad;
+		pnum = be32_to_cpu(fec->pnum);
+		err = claim_peb(ubi, seen, pnum, be32_to_cpu(fec->ec));
+		if (err)
+			goto out;
+
+		err = ubi_io_is_bad(ubi, pnum);
+		if (err < 0)
+			goto out;
+		if (err) {
+			si->bad_peb_count += 1;
+			continue;
+		}
+
+		err = ubi_io_read_ec_hdr(ubi, pnum, ech, 0);
+		if (err < 0)
+			goto out;
+		ec = UBI_SCAN_UNKNOWN_EC;
+		if ((err == 0 || err == UBI_IO_BITFLIPS) &&
+		    be64_to_cpu(ech->ec) <= UBI_MAX_ERASECOUNTER)
+			ec = be64_to_cpu(ech->ec);
+		err = add_listed(si, pnum, ec, &si->erase);
+		if (err)
+			goto out;
+		account_ec(si, ec);
+	}
+
+	/*
+	 * The fastmap does not store the VID headers, build them out of the
+	 * volume description. Sequence numbers are read from the flash later,
+	 * if another copy of the LEB is found in a scanned PEB.
+	 */
+	count = be32_to_cpu(hdr->vol_count);
+	memset(vh, 0, sizeof(struct ubi_vid_hdr));
+	for (i = 0; i < count; i++) {
+		fvh = fm_rec(&p, end, sizeof(struct ubi_fm_volhdr));
+		if (!fvh || be32_to_cpu(fvh->magic) != UBI_FM_VHDR_MAGIC)
+			goto out_bad;
+
+		vol_id = be32_to_cpu(fvh->vol_id);
+		if ((vol_id < 0 || vol_id >= UBI_MAX_VOLUMES) &&
+		    vol_id != UBI_LAYOUT_VOLUME_ID)
+			goto out_bad;
+		if (fvh->vol_type == UBI_DYNAMIC_VOLUME)
+			vh->vol_type = UBI_VID_DYNAMIC;
+		else if (fvh->vol_type == UBI_STATIC_VOLUME)
+			vh->vol_type = UBI_VID_STATIC;
+		else
+			goto out_bad;
+		vh->compat = fvh->compat;
+		vh->vol_id = fvh->vol_id;
+		vh->used_ebs = fvh->used_ebs;
+		vh->data_pad = fvh->data_pad;
+		vh->data_size = fvh->last_eb_bytes;
+
+		for (j = 0; j < be32_to_cpu(fvh->leb_count); j++) {
+			fleb = fm_rec(&p, end, sizeof(struct ubi_fm_leb));
+			if (!fleb || (int)be32_to_cpu(fleb->lnum) < 0)
+				goto out_bad;
+			pnum = be32_to_cpu(fleb->pnum);
+			ec = be32_to_cpu(fleb->ec);
+			err = claim_peb(ubi, seen, pnum, ec);
+			if (err)
+				goto out;
+
+			vh->lnum = fleb->lnum;
+			err = ubi_scan_add_used(ubi, si, pnum, ec, vh,
+						fleb->scrub);
+			if (err)
+				goto out;
+			account_ec(si, ec);
+		}
+
+		sv = ubi_scan_find_sv(si, vol_id);
+		if (!sv)
+			goto out_bad;
+		ubi_rb_for_each_entry(rb, seb, &sv->root, u.rb)
+			seb->sqnum_unknown = 1;
+	}
+
+	count = be32_to_cpu(hdr->corr_peb_count);
+	for (i = 0; i < count; i++) {
+		fec = fm_rec(&p, end, sizeof(struct ubi_fm_ec));
+		if (!fec)
+			goto out_bad;
+		pnum = be32_to_cpu(fec->pnum);
+		ec = be32_to_cpu(fec->ec);
+		err = claim_peb(ubi, seen, pnum, ec);
+		if (!err)
+			err = add_listed(si, pnum, ec, &si->corr);
+		if (err)
+			goto out;
+		si->corr_peb_count += 1;
+	}
+
+	count = be32_to_cpu(hdr->scan_peb_count);
+	for (i = 0; i < count; i++) {
+		fec = fm_rec(&p, end, sizeof(struct ubi_fm_ec));
+		if (!fec)
+			goto out_bad;
+		pnum = be32_to_cpu(fec->pnum);
+		err = claim_peb(ubi, seen, pnum, be32_to_cpu(fec->ec));
+		if (err)
+			goto out;
+
+		cond_resched();
+		err = scan_peb(ubi, si, pnum, ech, vh);
+		if (err)
+			goto out;
+	}
+
+	if (p != end)
+		goto out_bad;
+
+	/* Everything the fastmap does not describe has to be bad */
+	for (pnum = 0; pnum < ubi->peb_count; pnum++) {
+		if (test_bit(pnum, seen))
+			continue;
+		err = ubi_io_is_bad(ubi, pnum);
+		if (err < 0)
+			goto out;
+		if (!err) {
+			ubi_warn("PEB %d is not described by the fastmap",
+				 pnum);
+			goto out_bad;
+		}
+		si->bad_peb_count += 1;
+	}
+
+	kfree(seen);
+	return 0;
+
+out_bad:
+	err = UBI_BAD_FASTMAP;
+out:
+	kfree(seen);
+	return err;
+}
+
+/**
+ * ubi_scan_fastmap - attach an MTD device using the fastmap.
+ * @ubi: UBI device description object
+ *
+ * This function looks for the fastmap anchor in the first %UBI_FM_MAX_START
+ * PEBs and builds the scanning information out of the fastmap. It returns the
+ * scanning information in case of success, %NULL if there is no usable
+ * fastmap and the device has to be scanned, or an error code if there is not
+ * enough memory.
+ */
+struct ubi_scan_info *ubi_scan_fastmap(struct ubi_device *ubi)
+{
+	int err, pnum, anchor = -1;
+	unsigned long long sqnum = 0;
+	struct ubi_ec_hdr *ech;
+	struct ubi_vid_hdr *vh;
+	struct ubi_scan_info *si = NULL;
+	struct ubi_scan_leb *seb;
+	void *buf = NULL;
+
+	err = -ENOMEM;
+	ech = kzalloc(ubi->ec_hdr_alsize, GFP_KERNEL);
+	if (!ech)
+		return ERR_PTR(err);
+
+	vh = ubi_zalloc_vid_hdr(ubi, GFP_KERNEL);
+	if (!vh)
+		goto out_vh;
+
+	for (pnum = 0; pnum < UBI_FM_MAX_START && pnum < ubi->peb_count;
+	     pnum++) {
+		err = ubi_io_is_bad(ubi, pnum);
+		if (err < 0)
+			goto out_vh;
+		if (err)
+			continue;
+
+		err = ubi_io_read_vid_hdr(ubi, pnum, vh, 0);
+		if ((err && err != UBI_IO_BITFLIPS) ||
+		    be32_to_cpu(vh->vol_id) != UBI_FM_SB_VOLUME_ID)
+			continue;
+
+		if (anchor >= 0) {
+			ubi_warn("fastmap anchors in PEBs %d and %d",
+				 anchor, pnum);
+			goto out_vh;
+		}
+		anchor = pnum;
+		sqnum = be64_to_cpu(vh->sqnum);
+	}
+
+	if (anchor < 0) {
+		dbg_bld("no fastmap found");
+		goto out_vh;
+	}
+
+	err = ubi_io_read_ec_hdr(ubi, anchor, ech, 0);
+	if ((err && err != UBI_IO_BITFLIPS) || ech->version != UBI_VERSION)
+		goto out_vh;
+	ubi->image_seq = be32_to_cpu(ech->image_seq);
+
+	err = read_fm(ubi, anchor, sqnum, vh, &buf);
+	if (err)
+		goto out_vh;
+
+	err = -ENOMEM;
+	si = kzalloc(sizeof(struct ubi_scan_info), GFP_KERNEL);
+	if (!si)
+		goto out_buf;
+
+	INIT_LIST_HEAD(&si->corr);
+	INIT_LIST_HEAD(&si->free);
+	INIT_LIST_HEAD(&si->erase);
+	INIT_LIST_HEAD(&si->alien);
+	si->volumes = RB_ROOT;
+
+	err = attach_fm(ubi, si, buf, ech, vh);
+	if (err)
+		goto out_si;
+
+	if (si->max_sqnum < sqnum)
+		si->max_sqnum = sqnum;
+	if (si->ec_count)
+		si->mean_ec = div_u64(si->ec_sum, si->ec_count);
+
+	/* In case of unknown erase counter use the mean erase counter value */
+	list_for_each_entry(seb, &si->erase, u.list)
+		if (seb->ec == UBI_SCAN_UNKNOWN_EC)
+			seb->ec = si->mean_ec;
+
+	vfree(buf);
+	ubi_free_vid_hdr(ubi, vh);
+	kfree(ech);
+	return si;
+
+out_si:
+	ubi_scan_destroy_si(si);
+	if (err < 0 && err != -ENOMEM)
+		ubi_warn("error %d while attaching by fastmap", err);
+out_buf:
+	vfree(buf);
+out_vh:
+	ubi_free_vid_hdr(ubi, vh);
+	kfree(ech);
+	if (err == -ENOMEM)
+		return ERR_PTR(err);
+	ubi->image_seq = 0;
+	return NULL;
+}
+
+/**
+ * fm_add_ec - add a &struct ubi_fm_ec record to the fastmap.
+ * @p: the current position in the fastmap buffer
+ * @end: the end of the fastmap buffer
+ * @pnum: physical eraseblock number
+ * @ec: erase counter
+ *
+ * This function returns zero in case of success and %-EINVAL if the fastmap
+ * buffer is full, which can only be a bug.
+ */
+static int fm_add_ec(void **p, void *end, int pnum, int ec)
+{
+	struct ubi_fm_ec *fec;
+
+	fec = fm_rec(p, end, sizeof(struct ubi_fm_ec));
+	if (!fec)
+		return -EINVAL;
+
+	fec->pnum = cpu_to_be32(pnum);
+	fec->ec = cpu_to_be32(ec);
+	return 0;
+}
+
+/**
+ * write_fm_block - write one PEB of the fastmap.
+ * @ubi: UBI device description object
+ * @vh: VID header to use
+ * @pnum: physical eraseblock to write to
+ * @vol_id: fastmap volume ID
+ * @lnum: block number within the fastmap
+ * @buf: the fastmap buffer
+ * @size: size of the fastmap
+ *
+ * This function returns zero in case of success and a negative error code in
+ * case of failure.
+ */
+static int write_fm_block(struct ubi_device *ubi, struct ubi_vid_hdr *vh,
+			  int pnum, int vol_id, int lnum, const void *buf,
+			  int size)
+{
+	int err, len;
+
+	vh->vol_id = cpu_to_be32(vol_id);
+	vh->lnum = cpu_to_be32(lnum);
+	vh->sqnum = cpu_to_be64(ubi_next_sqnum(ubi));
+	err = ubi_io_write_vid_hdr(ubi, pnum, vh);
+	if (err)
+		return err;
+
+	len = min(ubi->leb_size, size - lnum * ubi->leb_size);
+	if (len <= 0)
+		return 0;
+	return ubi_io_write_data(ubi, buf + lnum * ubi->leb_size, pnum, 0,
+				 ALIGN(len, ubi->min_io_size));
+}
+
+/**
+ * write_fm - take a snapshot of the UBI state and write it to the flash.
+ * @ubi: UBI device description object
+ * @fm: the PEBs to write the fastmap to, all erased
+ * @old: PEBs of the previous fastmap which are going to be erased
+ * @nold: number of elements in @old
+ *
+ * The caller holds @ubi->work_sem for writing, so no PEB is being erased or
+ * moved. PEBs are classified by the WL sub-system lists first, then the EBA
+ * tables tell which of the used PEBs are mapped. PEBs which are in use but
+ * not mapped yet, and the pools, are recorded as PEBs to be scanned. This
+ * function returns zero in case of success and a negative error code in case
+ * of failure.
+ */
+static int write_fm(struct ubi_device *ubi, struct ubi_fastmap_layout *fm,
+		    struct ubi_wl_entry **old, int nold)
+{
+	int i, j, err, pnum, size, count;
+	int free_count = 0, erase_count = 0, corr_count = 0, scan_count = 0;
+	int bad_count = 0, vol_count = 0;
+	unsigned char *state;
+	void *buf, *p, *end;
+	struct ubi_fm_sb *sb;
+	struct ubi_fm_hdr *hdr;
+	struct ubi_fm_volhdr *fvh;
+	struct ubi_fm_leb *fleb;
+	struct ubi_vid_hdr *vh;
+	struct ubi_wl_entry *e;
+	struct ubi_work *wrk;
+	struct rb_node *rb;
+
+	err = -ENOMEM;
+	buf = vzalloc(ubi->fm_size);
+	if (!buf)
+		return err;
+
+	state = vzalloc(ubi->peb_count);
+	if (!state)
+		goto out_buf;
+
+	vh = ubi_zalloc_vid_hdr(ubi, GFP_KERNEL);
+	if (!vh)
+		goto out_state;
+
+	sb = buf;
+	hdr = buf + sizeof(struct ubi_fm_sb);
+	p = hdr + 1;
+	end = buf + ubi->fm_size;
+	for (i = 0; i < fm->used_blocks; i++)
+		state[fm->e[i]->pnum] = FM_PEB_LISTED;
+
+	err = -EINVAL;
+	spin_lock(&ubi->wl_lock);
+	ubi_rb_for_each_entry(rb, e, &ubi->free, u.rb) {
+		if (fm_add_ec(&p, end, e->pnum, e->ec))
+			goto out_unlock_wl;
+		state[e->pnum] = FM_PEB_LISTED;
+		free_count += 1;
+	}
+
+	list_for_each_entry(wrk, &ubi->works, list) {
+		if (!ubi_is_erase_work(wrk))
+			continue;
+		if (fm_add_ec(&p, end, wrk->e->pnum, wrk->e->ec))
+			goto out_unlock_wl;
+		state[wrk->e->pnum] = FM_PEB_LISTED;
+		erase_count += 1;
+	}
+	list_for_each_entry(wrk, &ubi->fm_deferred, list) {
+		if (fm_add_ec(&p, end, wrk->e->pnum, wrk->e->ec))
+			goto out_unlock_wl;
+		state[wrk->e->pnum] = FM_PEB_LISTED;
+		erase_count += 1;
+	}
+	for (i = 0; i < nold; i++) {
+		if (fm_add_ec(&p, end, old[i]->pnum, old[i]->ec))
+			goto out_unlock_wl;
+		state[old[i]->pnum] = FM_PEB_LISTED;
+		erase_count += 1;
+	}
+
+	ubi_rb_for_each_entry(rb, e, &ubi->used, u.rb)
+		state[e->pnum] = FM_PEB_USED;
+	ubi_rb_for_each_entry(rb, e, &ubi->erroneous, u.rb)
+		state[e->pnum] = FM_PEB_USED;
+	ubi_rb_for_each_entry(rb, e, &ubi->scrub, u.rb)
+		state[e->pnum] = FM_PEB_SCRUB;
+	for (i = 0; i < UBI_PROT_QUEUE_LEN; i++)
+		list_for_each_entry(e, &ubi->pq[i], u.list)
+			state[e->pnum] = FM_PEB_USED;
+	spin_unlock(&ubi->wl_lock);
+
+	/*
+	 * The PEBs are neither erased nor freed while we hold @ubi->work_sem,
+	 * so their WL entries may be looked at without @ubi->wl_lock.
+	 */
+	spin_lock(&ubi->volumes_lock);
+	for (i = 0; i < ubi->vtbl_slots + UBI_INT_VOL_COUNT; i++) {
+		struct ubi_volume *vol = ubi->volumes[i];
+
+		if (!vol)
+			continue;
+
+		fvh = fm_rec(&p, end, sizeof(struct ubi_fm_volhdr));
+		if (!fvh)
+			goto out_unlock_vol;
+
+		count = 0;
+		for (j = 0; j < vol->reserved_pebs; j++) {
+			pnum = vol->eba_tbl[j];
+			if (pnum < 0 || (state[pnum] != FM_PEB_USED &&
+					 state[pnum] != FM_PEB_SCRUB))
+				continue;
+
+			fleb = fm_rec(&p, end, sizeof(struct ubi_fm_leb));
+			if (!fleb)
+				goto out_unlock_vol;
+			fleb->lnum = cpu_to_be32(j);
+			fleb->pnum = cpu_to_be32(pnum);
+			fleb->ec = cpu_to_be32(ubi->lookuptbl[pnum]->ec);
+			fleb->scrub = state[pnum] == FM_PEB_SCRUB;
+			state[pnum] = FM_PEB_LISTED;
+			count += 1;
+		}
+
+		if (!count) {
+			p = fvh;
+			continue;
+		}
+
+		fvh->magic = cpu_to_be32(UBI_FM_VHDR_MAGIC);
+		fvh->vol_id = cpu_to_be32(vol->vol_id);
+		fvh->vol_type = vol->vol_type;
+		if (vol->vol_id >= UBI_INTERNAL_VOL_START)
+			fvh->compat = UBI_LAYOUT_VOLUME_COMPAT;
+		fvh->data_pad = cpu_to_be32(vol->data_pad);
+		if (vol->vol_type == UBI_STATIC_VOLUME) {
+			fvh->used_ebs = cpu_to_be32(vol->updating ?
+						    vol->upd_ebs :
+						    vol->used_ebs);
+			fvh->last_eb_bytes = cpu_to_be32(vol->last_eb_bytes);
+		}
+		fvh->leb_count = cpu_to_be32(count);
+		vol_count += 1;
+	}
+	spin_unlock(&ubi->volumes_lock);
+
+	/* PEBs without a WL entry are bad, corrupted or belong to aliens */
+	for (pnum = 0; pnum < ubi->peb_count; pnum++) {
+		if (ubi->lookuptbl[pnum])
+			continue;
+
+		err = ubi_io_is_bad(ubi, pnum);
+		if (err < 0)
+			goto out_vh;
+		if (err) {
+			bad_count += 1;
+			continue;
+		}
+
+		err = fm_add_ec(&p, end, pnum, ubi->mean_ec);
+		if (err)
+			goto out_vh;
+		corr_count += 1;
+	}
+
+	for (pnum = 0; pnum < ubi->peb_count; pnum++) {
+		if (!ubi->lookuptbl[pnum] || state[pnum] == FM_PEB_LISTED)
+			continue;
+
+		err = fm_add_ec(&p, end, pnum, ubi->lookuptbl[pnum]->ec);
+		if (err)
+			goto out_vh;
+		scan_count += 1;
+	}
+
+	hdr->magic = cpu_to_be32(UBI_FM_HDR_MAGIC);
+	hdr->free_peb_count = cpu_to_be32(free_count);
+	hdr->erase_peb_count = cpu_to_be32(erase_count);
+	hdr->corr_peb_count = cpu_to_be32(corr_count);
+	hdr->scan_peb_count = cpu_to_be32(scan_count);
+	hdr->bad_peb_count = cpu_to_be32(bad_count);
+	hdr->vol_count = cpu_to_be32(vol_count);
+
+	size = p - buf;
+	sb->magic = cpu_to_be32(UBI_FM_SB_MAGIC);
+	sb->version = UBI_FM_FMT_VERSION;
+	sb->size = cpu_to_be32(size);
+	sb->used_blocks = cpu_to_be32(fm->used_blocks);
+	for (i = 0; i < fm->used_blocks; i++) {
+		sb->block_loc[i] = cpu_to_be32(fm->e[i]->pnum);
+		sb->block_ec[i] = cpu_to_be32(fm->e[i]->ec);
+	}
+
+	vh->vol_type = UBI_VID_DYNAMIC;
+	vh->compat = UBI_FM_VOLUME_COMPAT;
+	for (i = 1; i < fm->used_blocks; i++) {
+		err = write_fm_block(ubi, vh, fm->e[i]->pnum,
+				     UBI_FM_DATA_VOLUME_ID, i, buf, size);
+		if (err)
+			goto out_write;
+	}
+
+	/*
+	 * The anchor goes last and its sequence number is the highest one
+	 * referred to by the fastmap.
+	 */
+	vh->vol_id = cpu_to_be32(UBI_FM_SB_VOLUME_ID);
+	vh->lnum = 0;
+	vh->sqnum = cpu_to_be64(ubi_next_sqnum(ubi));
+	sb->sqnum = vh->sqnum;
+	sb->data_crc = cpu_to_be32(crc32(UBI_CRC32_INIT, buf, size));
+
+	err = ubi_io_write_vid_hdr(ubi, fm->e[0]->pnum, vh);
+	if (!err)
+		err = ubi_io_write_data(ubi, buf, fm->e[0]->pnum, 0,
+					ALIGN(min(size, ubi->leb_size),
+					      ubi->min_io_size));
+	if (err)
+		goto out_write;
+
+	dbg_bld("fastmap written: %d bytes, %d free, %d erase, %d corrupted, "
+		"%d scan, %d bad PEBs, %d volumes", size, free_count,
+		erase_count, corr_count, scan_count, bad_count, vol_count);
+	goto out_vh;
+
+out_write:
+	ubi_err("cannot write fastmap, error %d", err);
+	goto out_vh;
+
+out_unlock_vol:
+	spin_unlock(&ubi->volumes_lock);
+	ubi_err("fastmap does not fit into %d bytes", ubi->fm_size);
+	goto out_vh;
+
+out_unlock_wl:
+	spin_unlock(&ubi->wl_lock);
+	ubi_err("fastmap does not fit into %d bytes", ubi->fm_size);
+out_vh:
+	ubi_free_vid_hdr(ubi, vh);
+out_state:
+	vfree(state);
+out_buf:
+	vfree(buf);
+	return err;
+}
+
+/**
+ * ubi_update_fastmap - write a new fastmap.
+ * @ubi: UBI device description object
+ *
+ * This function refills the pools, writes a new fastmap and then lets the
+ * postponed erasures go. If the fastmap cannot be written, UBI goes on
+ * without it and the next attach will scan the device. This function
+ * returns zero in case of success and a negative error code if the old
+ * fastmap could not be invalidated, in which case UBI switches to R/O mode.
+ */
+int ubi_update_fastmap(struct ubi_device *ubi)
+{
+	int i, err = 0, fm_blocks, nold = 0;
+	struct ubi_fastmap_layout *new_fm, *old_fm;
+	struct ubi_wl_entry *old[2 * UBI_FM_MAX_BLOCKS];
+	struct ubi_wl_entry *e, *prev;
+
+	mutex_lock(&ubi->fm_mutex);
+	down_write(&ubi->work_sem);
+
+	if (ubi->ro_mode) {
+		err = -EROFS;
+		goto out_unlock;
+	}
+
+	if (ubi->fm_disabled) {
+		ubi_refill_pools(ubi);
+		goto out_release;
+	}
+
+	new_fm = kzalloc(sizeof(struct ubi_fastmap_layout), GFP_KERNEL);
+	if (!new_fm) {
+		err = -ENOMEM;
+		goto out_unlock;
+	}
+
+	/* First of all invalidate the old fastmap */
+	old_fm = ubi->fm;
+	if (old_fm) {
+		err = ubi_wl_erase_fm_peb(ubi, old_fm->e[0]);
+		if (err) {
+			ubi_err("cannot erase fastmap anchor PEB %d, error %d",
+				old_fm->e[0]->pnum, err);
+			kfree(new_fm);
+			ubi_ro_mode(ubi);
+			goto out_unlock;
+		}
+	}
+	ubi->fm = NULL;
+
+	/*
+	 * Keep the PEBs of the old fastmap unless they are worn out much more
+	 * than the free ones.
+	 */
+	fm_blocks = ubi->fm_size / ubi->leb_size;
+	for (i = 0; i < fm_blocks; i++) {
+		prev = old_fm && i < old_fm->used_blocks ? old_fm->e[i] : NULL;
+		e = ubi_wl_get_fm_peb(ubi, i == 0, prev);
+		if (e) {
+			if (prev)
+				old[nold++] = prev;
+		} else if (prev) {
+			e = prev;
+			if (i > 0)
+				err = ubi_wl_erase_fm_peb(ubi, e);
+		} else {
+			ubi_warn("no free PEB for the fastmap%s",
+				 i ? "" : " anchor");
+			err = -ENOSPC;
+		}
+		if (!e)
+			break;
+		new_fm->e[i] = e;
+		new_fm->used_blocks = i + 1;
+		if (err)
+			break;
+	}
+	for (; old_fm && i < old_fm->used_blocks; i++)
+		if (old_fm->e[i] != new_fm->e[i])
+			old[nold++] = old_fm->e[i];
+	kfree(old_fm);
+
+	ubi_refill_pools(ubi);
+	if (!err)
+		err = write_fm(ubi, new_fm, old, nold);
+	if (err) {
+		ubi_warn("fastmap not written, error %d", err);
+		for (i = 0; i < new_fm->used_blocks; i++)
+			old[nold++] = new_fm->e[i];
+		kfree(new_fm);
+		new_fm = NULL;
+		err = 0;
+	}
+	ubi->fm = new_fm;
+
+	for (i = 0; i < nold; i++)
+		if (ubi_wl_put_fm_peb(ubi, old[i], 0)) {
+			err = -ENOMEM;
+			ubi_ro_mode(ubi);
+		}
+
+out_release:
+	ubi_wl_release_deferred(ubi);
+out_unlock:
+	up_write(&ubi->work_sem);
+	mutex_unlock(&ubi->fm_mutex);
+	return err;
+}
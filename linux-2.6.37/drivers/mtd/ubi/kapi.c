@@ -25,6 +25,7 @@
 #include <linux/slab.h>
 #include <linux/namei.h>
 #include <linux/fs.h>
+#include <linux/ktime.h>
 #include <asm/div64.h>
 #include "ubi.h"
 
@@ -417,6 +418,23 @@ int ubi_leb_read(struct ubi_volume_desc *desc, int lnum, char *buf, int offset,
 }
 EXPORT_SYMBOL_GPL(ubi_leb_read);
 
+/**
+ * account_write - account a LEB write in the UBI device statistics.
+ * @ubi: UBI device description object
+ * @start: time the write started at
+ */
+static void account_write(struct ubi_device *ubi, ktime_t start)
+{
+	unsigned int us = ktime_us_delta(ktime_get(), start);
+
+	spin_lock(&ubi->stats_lock);
+	ubi->write_count += 1;
+	ubi->write_time += us;
+	if (us > ubi->max_write_time)
+		ubi->max_write_time = us;
+	spin_unlock(&ubi->stats_lock);
+}
+
 /**
  * ubi_leb_write - write data.
  * @desc: volume descriptor
@@ -449,7 +467,8 @@ int ubi_leb_write(struct ubi_volume_desc *desc, int lnum, const void *buf,
 {
 	struct ubi_volume *vol = desc->vol;
 	struct ubi_device *ubi = vol->ubi;
-	int vol_id = vol->vol_id;
+	int err, vol_id = vol->vol_id;
+	ktime_t start;
 
 	dbg_gen("write %d bytes to LEB %d:%d:%d", len, vol_id, lnum, offset);
 
@@ -474,7 +493,11 @@ int ubi_leb_write(struct ubi_volume_desc *desc, int lnum, const void *buf,
 	if (len == 0)
 		return 0;
 
-	return ubi_eba_write_leb(ubi, vol, lnum, buf, offset, len, dtype);
+	start = ktime_get();
+	err = ubi_eba_write_leb(ubi, vol, lnum, buf, offset, len, dtype);
+	if (!err)
+		account_write(ubi, start);
+	return err;
 }
 EXPORT_SYMBOL_GPL(ubi_leb_write);
 
@@ -499,7 +522,8 @@ int ubi_leb_change(struct ubi_volume_desc *desc, int lnum, const void *buf,
 {
 	struct ubi_volume *vol = desc->vol;
 	struct ubi_device *ubi = vol->ubi;
-	int vol_id = vol->vol_id;
+	int err, vol_id = vol->vol_id;
+	ktime_t start;
 
 	dbg_gen("atomically write %d bytes to LEB %d:%d", len, vol_id, lnum);
 
@@ -523,7 +547,11 @@ int ubi_leb_change(struct ubi_volume_desc *desc, int lnum, const void *buf,
 	if (len == 0)
 		return 0;
 
-	return ubi_eba_atomic_leb_change(ubi, vol, lnum, buf, len, dtype);
+	start = ktime_get();
+	err = ubi_eba_atomic_leb_change(ubi, vol, lnum, buf, len, dtype);
+	if (!err)
+		account_write(ubi, start);
+	return err;
 }
 EXPORT_SYMBOL_GPL(ubi_leb_change);
 
@@ -639,8 +667,10 @@ EXPORT_SYMBOL_GPL(ubi_leb_unmap);
  */
 int ubi_leb_map(struct ubi_volume_desc *desc, int lnum, int dtype)
 {
+	int err;
 	struct ubi_volume *vol = desc->vol;
 	struct ubi_device *ubi = vol->ubi;
+	ktime_t start;
 
 	dbg_gen("unmap LEB %d:%d", vol->vol_id, lnum);
 
@@ -660,7 +690,11 @@ int ubi_leb_map(struct ubi_volume_desc *desc, int lnum, int dtype)
 	if (vol->eba_tbl[lnum] >= 0)
 		return -EBADMSG;
 
-	return ubi_eba_write_leb(ubi, vol, lnum, NULL, 0, 0, dtype);
+	start = ktime_get();
+	err = ubi_eba_write_leb(ubi, vol, lnum, NULL, 0, 0, dtype);
+	if (!err)
+		account_write(ubi, start);
+	return err;
 }
 EXPORT_SYMBOL_GPL(ubi_leb_map);
 
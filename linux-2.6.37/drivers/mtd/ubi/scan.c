@@ -414,6 +414,44 @@ out_free_vidh:
 	return err;
 }
 
+/**
+ * read_sqnum - read the sequence number of a LEB which came from the fastmap.
+ * @ubi: UBI device description object
+ * @seb: the logical eraseblock
+ *
+ * The fastmap does not store sequence numbers. If another copy of a LEB taken
+ * from the fastmap is found, this function reads the VID header of @seb to
+ * find out which copy is newer. Returns zero in case of success and a negative
+ * error code in case of failure.
+ */
+static int read_sqnum(struct ubi_device *ubi, struct ubi_scan_leb *seb)
+{
+	int err;
+	struct ubi_vid_hdr *vh;
+
+	vh = ubi_zalloc_vid_hdr(ubi, GFP_KERNEL);
+	if (!vh)
+		return -ENOMEM;
+
+	err = ubi_io_read_vid_hdr(ubi, seb->pnum, vh, 0);
+	if (err && err != UBI_IO_BITFLIPS) {
+		ubi_err("cannot read VID header of PEB %d, error %d",
+			seb->pnum, err);
+		if (err > 0)
+			err = -EINVAL;
+		goto out_free;
+	}
+
+	seb->sqnum = be64_to_cpu(vh->sqnum);
+	seb->copy_flag = vh->copy_flag;
+	seb->sqnum_unknown = 0;
+	err = 0;
+
+out_free:
+	ubi_free_vid_hdr(ubi, vh);
+	return err;
+}
+
 /**
  * ubi_scan_add_used - add physical eraseblock to the scanning information.
  * @ubi: UBI device description object
@@ -477,6 +515,12 @@ int ubi_scan_add_used(struct ubi_device *ubi, struct ubi_scan_info *si,
 		 * logical eraseblock present.
 		 */
 
+		if (seb->sqnum_unknown) {
+			err = read_sqnum(ubi, seb);
+			if (err)
+				return err;
+		}
+
 		dbg_bld("this LEB already exists: PEB %d, sqnum %llu, "
 			"EC %d", seb->pnum, seb->sqnum, seb->ec);
 
@@ -562,6 +606,7 @@ int ubi_scan_add_used(struct ubi_device *ubi, struct ubi_scan_info *si,
 	seb->lnum = lnum;
 	seb->scrub = bitflips;
 	seb->copy_flag = vid_hdr->copy_flag;
+	seb->sqnum_unknown = 0;
 	seb->sqnum = sqnum;
 
 	if (sv->highest_lnum <= lnum) {
@@ -997,6 +1042,23 @@ static int process_eb(struct ubi_device *ubi, struct ubi_scan_info *si,
 	}
 
 	vol_id = be32_to_cpu(vidh->vol_id);
+#ifdef CONFIG_MTD_UBI_FASTMAP
+	if (vol_id == UBI_FM_SB_VOLUME_ID && !ec_err) {
+		/*
+		 * We are scanning, so this fastmap was not usable. Erase its
+		 * anchor right away: the fastmap is going to become stale as
+		 * soon as the flash is changed, and it must not be found when
+		 * attaching next time.
+		 */
+		ubi_msg("erase unused fastmap anchor PEB %d", pnum);
+		err = ubi_scan_erase_peb(ubi, si, pnum, ec + 1);
+		if (!err)
+			return add_to_list(si, pnum, ec + 1, 0, &si->free);
+		if (err != -EIO)
+			return err;
+		return add_to_list(si, pnum, ec, 1, &si->erase);
+	}
+#endif
 	if (vol_id > UBI_MAX_VOLUMES && vol_id != UBI_LAYOUT_VOLUME_ID) {
 		int lnum = be32_to_cpu(vidh->lnum);
 
@@ -1280,6 +1342,14 @@ void ubi_scan_destroy_si(struct ubi_scan_info *si)
 		kfree(seb);
 	}
 
+	if (si->fm) {
+		int i;
+
+		for (i = 0; i < si->fm->used_blocks; i++)
+			kmem_cache_free(ubi_wl_entry_slab, si->fm->e[i]);
+		kfree(si->fm);
+	}
+
 	/* Destroy the volume RB-tree */
 	rb = si->volumes.rb_node;
 	while (rb) {
@@ -31,6 +31,8 @@
  * @lnum: logical eraseblock number
  * @scrub: if this physical eraseblock needs scrubbing
  * @copy_flag: this LEB is a copy (@copy_flag is set in VID header of this LEB)
+ * @sqnum_unknown: @sqnum and @copy_flag were not read yet, because the LEB
+ *                 comes from the fastmap
  * @sqnum: sequence number
  * @u: unions RB-tree or @list links
  * @u.rb: link in the per-volume RB-tree of &struct ubi_scan_leb objects
@@ -45,6 +47,7 @@ struct ubi_scan_leb {
 	int lnum;
 	unsigned int scrub:1;
 	unsigned int copy_flag:1;
+	unsigned int sqnum_unknown:1;
 	unsigned long long sqnum;
 	union {
 		struct rb_node rb;
@@ -109,6 +112,8 @@ struct ubi_scan_volume {
  * @mean_ec: mean erase counter value
  * @ec_sum: a temporary variable used when calculating @mean_ec
  * @ec_count: a temporary variable used when calculating @mean_ec
+ * @fm: the fastmap this information was read from, %NULL if it was obtained
+ *      by scanning
  *
  * This data structure contains the result of scanning and may be used by other
  * UBI sub-systems to build final UBI data structures, further error-recovery
@@ -134,6 +139,7 @@ struct ubi_scan_info {
 	int mean_ec;
 	uint64_t ec_sum;
 	int ec_count;
+	struct ubi_fastmap_layout *fm;
 };
 
 struct ubi_device;
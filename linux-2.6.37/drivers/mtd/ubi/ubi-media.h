@@ -375,4 +375,156 @@ struct ubi_vtbl_record {
 	__be32  crc;
 } __attribute__ ((packed));
 
+/* UBI fastmap on-flash data structures */
+
+/*
+ * The fastmap is stored in two internal volumes: the fastmap super block
+ * volume, whose only LEB (the "anchor") has to be within the first
+ * %UBI_FM_MAX_START PEBs, and the fastmap data volume. Both are "delete"
+ * compatible, so UBI implementations without fastmap support just erase
+ * them.
+ */
+#define UBI_FM_SB_VOLUME_ID	(UBI_LAYOUT_VOLUME_ID + 1)
+#define UBI_FM_DATA_VOLUME_ID	(UBI_LAYOUT_VOLUME_ID + 2)
+#define UBI_FM_VOLUME_COMPAT	UBI_COMPAT_DELETE
+
+/* fastmap on-flash data structure format version */
+#define UBI_FM_FMT_VERSION	1
+
+#define UBI_FM_SB_MAGIC		0x7B11D69F
+#define UBI_FM_HDR_MAGIC	0xD4B82EF7
+#define UBI_FM_VHDR_MAGIC	0xFA370ED1
+
+/* The fastmap anchor PEB has to be one of the first %UBI_FM_MAX_START PEBs */
+#define UBI_FM_MAX_START	64
+
+/* A fastmap may occupy up to %UBI_FM_MAX_BLOCKS PEBs */
+#define UBI_FM_MAX_BLOCKS	32
+
+/*
+ * Size limits of the pool of free PEBs which are handed out between fastmap
+ * updates. All PEBs of the pool have to be scanned when attaching, so by
+ * default the pool is 5% of the PEB count, but within these limits.
+ */
+#define UBI_FM_MIN_POOL_SIZE	8
+#define UBI_FM_MAX_POOL_SIZE	256
+
+/* Size of the pool of free PEBs the wear-leveling worker moves data to */
+#define UBI_FM_WL_POOL_SIZE	25
+
+/**
+ * struct ubi_fm_sb - UBI fastmap super block.
+ * @magic: fastmap super block magic number (%UBI_FM_SB_MAGIC)
+ * @version: format version of this fastmap
+ * @padding1: reserved for future, zeroes
+ * @data_crc: CRC of the whole fastmap, computed with this field set to zero
+ * @size: size of the fastmap in bytes, including this super block
+ * @used_blocks: number of PEBs used by this fastmap
+ * @block_loc: an array containing the location of all PEBs of the fastmap
+ * @block_ec: the erase counter of each used PEB
+ * @sqnum: highest sequence number value at the time the fastmap was written
+ * @padding2: reserved for future, zeroes
+ *
+ * The super block is stored at the beginning of the anchor LEB. The fastmap
+ * data is a contiguous byte stream of @size bytes which starts with this
+ * super block and is split over @used_blocks LEBs: block 0 is the anchor
+ * LEB, block N is LEB N of the fastmap data volume.
+ */
+struct ubi_fm_sb {
+	__be32 magic;
+	__u8   version;
+	__u8   padding1[3];
+	__be32 data_crc;
+	__be32 size;
+	__be32 used_blocks;
+	__be32 block_loc[UBI_FM_MAX_BLOCKS];
+	__be32 block_ec[UBI_FM_MAX_BLOCKS];
+	__be64 sqnum;
+	__u8   padding2[32];
+} __attribute__ ((packed));
+
+/**
+ * struct ubi_fm_hdr - header of the fastmap data set.
+ * @magic: fastmap header magic number (%UBI_FM_HDR_MAGIC)
+ * @free_peb_count: number of free PEBs known by this fastmap
+ * @erase_peb_count: number of PEBs which have to be erased
+ * @corr_peb_count: number of corrupted PEBs, preserved and not used
+ * @scan_peb_count: number of PEBs which have to be scanned when attaching
+ * @bad_peb_count: number of bad PEBs known by this fastmap
+ * @vol_count: number of volumes with mapped LEBs
+ * @padding: reserved for future, zeroes
+ *
+ * The header is followed by @free_peb_count and @erase_peb_count &struct
+ * ubi_fm_ec records, then by @vol_count volume descriptions, each a &struct
+ * ubi_fm_volhdr followed by its &struct ubi_fm_leb records, and finally by
+ * @corr_peb_count and @scan_peb_count &struct ubi_fm_ec records.
+ *
+ * The scanned PEBs are the pools of free PEBs handed out after this fastmap
+ * was written, and PEBs which were in use but not yet mapped to a LEB at that
+ * time. Attaching reads their EC and VID headers, everything else is taken
+ * from the fastmap.
+ */
+struct ubi_fm_hdr {
+	__be32 magic;
+	__be32 free_peb_count;
+	__be32 erase_peb_count;
+	__be32 corr_peb_count;
+	__be32 scan_peb_count;
+	__be32 bad_peb_count;
+	__be32 vol_count;
+	__u8   padding[4];
+} __attribute__ ((packed));
+
+/**
+ * struct ubi_fm_ec - a PEB and its erase counter.
+ * @pnum: PEB number
+ * @ec: erase counter
+ */
+struct ubi_fm_ec {
+	__be32 pnum;
+	__be32 ec;
+} __attribute__ ((packed));
+
+/**
+ * struct ubi_fm_volhdr - fastmap volume header.
+ * @magic: fastmap volume header magic number (%UBI_FM_VHDR_MAGIC)
+ * @vol_id: volume ID
+ * @vol_type: type of the volume (%UBI_DYNAMIC_VOLUME or %UBI_STATIC_VOLUME)
+ * @compat: compatibility flags of the volume (internal volumes only)
+ * @padding1: reserved for future, zeroes
+ * @used_ebs: number of used LEBs (static volumes only)
+ * @data_pad: how many bytes at the end of LEBs are not used
+ * @last_eb_bytes: number of bytes in the last LEB (static volumes only)
+ * @leb_count: number of &struct ubi_fm_leb records which follow
+ * @padding2: reserved for future, zeroes
+ */
+struct ubi_fm_volhdr {
+	__be32 magic;
+	__be32 vol_id;
+	__u8   vol_type;
+	__u8   compat;
+	__u8   padding1[2];
+	__be32 used_ebs;
+	__be32 data_pad;
+	__be32 last_eb_bytes;
+	__be32 leb_count;
+	__u8   padding2[8];
+} __attribute__ ((packed));
+
+/**
+ * struct ubi_fm_leb - a mapped LEB.
+ * @lnum: logical eraseblock number
+ * @pnum: physical eraseblock the LEB is mapped to
+ * @ec: erase counter of the physical eraseblock
+ * @scrub: non-zero if the physical eraseblock has to be scrubbed
+ * @padding: reserved for future, zeroes
+ */
+struct ubi_fm_leb {
+	__be32 lnum;
+	__be32 pnum;
+	__be32 ec;
+	__u8   scrub;
+	__u8   padding[3];
+} __attribute__ ((packed));
+
 #endif /* !__UBI_MEDIA_H__ */
@@ -66,6 +66,9 @@
 /* Background thread name pattern */
 #define UBI_BGT_NAME_PATTERN "ubi_bgt%dd"
 
+/* Number of background threads per UBI device */
+#define UBI_BGT_THREADS CONFIG_MTD_UBI_BGT_THREADS
+
 /* This marker in the EBA table means that the LEB is um-mapped */
 #define UBI_LEB_UNMAPPED -1
 
@@ -294,6 +297,30 @@ struct ubi_volume_desc {
 
 struct ubi_wl_entry;
 
+/**
+ * struct ubi_fastmap_layout - in-memory description of the on-flash fastmap.
+ * @e: PEBs used by the fastmap, the anchor PEB is @e[0]
+ * @used_blocks: number of PEBs used by the fastmap
+ */
+struct ubi_fastmap_layout {
+	struct ubi_wl_entry *e[UBI_FM_MAX_BLOCKS];
+	int used_blocks;
+};
+
+/**
+ * struct ubi_fm_pool - pool of free PEBs handed out between fastmap updates.
+ * @pebs: PEBs of the pool
+ * @used: number of PEBs already handed out, they are at the start of @pebs
+ * @size: number of PEBs in the pool
+ * @max_size: how many PEBs the pool is refilled with
+ */
+struct ubi_fm_pool {
+	int pebs[UBI_FM_MAX_POOL_SIZE];
+	int used;
+	int size;
+	int max_size;
+};
+
 /**
  * struct ubi_device - UBI device description structure
  * @dev: UBI device object to use the the Linux device model
@@ -339,9 +366,12 @@ struct ubi_wl_entry;
  * @pq: protection queue (contain physical eraseblocks which are temporarily
  *      protected from the wear-leveling worker)
  * @pq_head: protection queue head
- * @wl_lock: protects the @used, @free, @pq, @pq_head, @lookuptbl, @move_from,
- * 	     @move_to, @move_to_put @erase_pending, @wl_scheduled, @works,
- * 	     @erroneous, and @erroneous_peb_count fields
+ * @free_count: count of physical eraseblocks in @free
+ * @free_low: low watermark of @free_count, below which pending erasures are
+ *            done before any other work
+ * @wl_lock: protects the @used, @free, @free_count, @pq, @pq_head, @lookuptbl,
+ * 	     @move_from, @move_to, @move_to_put, @wl_scheduled, @works,
+ * 	     @erroneous, @erroneous_peb_count and @write_stalls fields
  * @move_mutex: serializes eraseblock moves
  * @work_sem: synchronizes the WL worker with use tasks
  * @wl_scheduled: non-zero if the wear-leveling was scheduled
@@ -352,9 +382,26 @@ struct ubi_wl_entry;
  * @move_to_put: if the "to" PEB was put
  * @works: list of pending works
  * @works_count: count of pending works
- * @bgt_thread: background thread description object
- * @thread_enabled: if the background thread is enabled
- * @bgt_name: background thread name
+ * @bgt_thread: background thread description objects
+ * @thread_enabled: if the background threads are enabled
+ * @bgt_name: name of the first background thread, the other ones are
+ *            suffixed with their index
+ *
+ * @write_stalls: how many times a writer had to do pending works itself
+ *                because there were no free physical eraseblocks
+ * @stats_lock: protects the @write_count, @write_time and @max_write_time
+ *              fields
+ * @write_count: count of LEB writes done through the kernel API
+ * @write_time: total time spent in these writes (in microseconds)
+ * @max_write_time: longest of these writes (in microseconds)
+ *
+ * @fm: the fastmap currently on the flash, %NULL if there is none
+ * @fm_pool: pool of free PEBs handed out by 'ubi_wl_get_peb()'
+ * @fm_wl_pool: pool of free PEBs the wear-leveling worker moves data to
+ * @fm_deferred: erase works which have to wait for the next fastmap update
+ * @fm_mutex: serializes fastmap updates
+ * @fm_size: maximum size of the fastmap in bytes
+ * @fm_disabled: non-zero if this UBI device does not use fastmap
  *
  * @flash_size: underlying MTD device size (in bytes)
  * @peb_count: count of physical eraseblocks on the MTD device
@@ -426,6 +473,8 @@ struct ubi_device {
 	struct rb_root used;
 	struct rb_root erroneous;
 	struct rb_root free;
+	int free_count;
+	int free_low;
 	struct rb_root scrub;
 	struct list_head pq[UBI_PROT_QUEUE_LEN];
 	int pq_head;
@@ -439,10 +488,28 @@ struct ubi_device {
 	int move_to_put;
 	struct list_head works;
 	int works_count;
-	struct task_struct *bgt_thread;
+	struct task_struct *bgt_thread[UBI_BGT_THREADS];
 	int thread_enabled;
 	char bgt_name[sizeof(UBI_BGT_NAME_PATTERN)+2];
 
+	/* Statistics */
+	unsigned int write_stalls;
+	spinlock_t stats_lock;
+	unsigned long long write_count;
+	unsigned long long write_time;
+	unsigned int max_write_time;
+
+#ifdef CONFIG_MTD_UBI_FASTMAP
+	/* Fastmap stuff */
+	struct ubi_fastmap_layout *fm;
+	struct ubi_fm_pool fm_pool;
+	struct ubi_fm_pool fm_wl_pool;
+	struct list_head fm_deferred;
+	struct mutex fm_mutex;
+	int fm_size;
+	int fm_disabled;
+#endif
+
 	/* I/O sub-system's stuff */
 	long long flash_size;
 	int peb_count;
@@ -476,6 +543,26 @@ struct ubi_device {
 #endif
 };
 
+/**
+ * struct ubi_work - UBI work description data structure.
+ * @list: a link in the list of pending works
+ * @func: worker function
+ * @e: physical eraseblock to erase
+ * @torture: if the physical eraseblock has to be tortured
+ *
+ * The @func pointer points to the worker function. If the @cancel argument is
+ * not zero, the worker has to free the resources and exit immediately. The
+ * worker has to return zero in case of success and a negative error code in
+ * case of failure.
+ */
+struct ubi_work {
+	struct list_head list;
+	int (*func)(struct ubi_device *ubi, struct ubi_work *wrk, int cancel);
+	/* The below fields are only relevant to erasure works */
+	struct ubi_wl_entry *e;
+	int torture;
+};
+
 extern struct kmem_cache *ubi_wl_entry_slab;
 extern const struct file_operations ubi_ctrl_cdev_operations;
 extern const struct file_operations ubi_cdev_operations;
@@ -517,6 +604,7 @@ void ubi_calculate_reserved(struct ubi_device *ubi);
 int ubi_check_pattern(const void *buf, uint8_t patt, int size);
 
 /* eba.c */
+unsigned long long ubi_next_sqnum(struct ubi_device *ubi);
 int ubi_eba_unmap_leb(struct ubi_device *ubi, struct ubi_volume *vol,
 		      int lnum);
 int ubi_eba_read_leb(struct ubi_device *ubi, struct ubi_volume *vol, int lnum,
@@ -540,6 +628,34 @@ int ubi_wl_scrub_peb(struct ubi_device *ubi, int pnum);
 int ubi_wl_init_scan(struct ubi_device *ubi, struct ubi_scan_info *si);
 void ubi_wl_close(struct ubi_device *ubi);
 int ubi_thread(void *u);
+void ubi_wake_bgt(struct ubi_device *ubi);
+int ubi_wl_erase_queue_depth(struct ubi_device *ubi);
+#ifdef CONFIG_MTD_UBI_FASTMAP
+int ubi_is_erase_work(struct ubi_work *wrk);
+void ubi_refill_pools(struct ubi_device *ubi);
+struct ubi_wl_entry *ubi_wl_get_fm_peb(struct ubi_device *ubi, int anchor,
+				       struct ubi_wl_entry *old);
+int ubi_wl_put_fm_peb(struct ubi_device *ubi, struct ubi_wl_entry *e,
+		      int torture);
+int ubi_wl_erase_fm_peb(struct ubi_device *ubi, struct ubi_wl_entry *e);
+void ubi_wl_release_deferred(struct ubi_device *ubi);
+#endif
+
+/* fastmap.c */
+#ifdef CONFIG_MTD_UBI_FASTMAP
+int ubi_calc_fm_size(struct ubi_device *ubi);
+struct ubi_scan_info *ubi_scan_fastmap(struct ubi_device *ubi);
+int ubi_update_fastmap(struct ubi_device *ubi);
+#else
+static inline struct ubi_scan_info *ubi_scan_fastmap(struct ubi_device *ubi)
+{
+	return NULL;
+}
+static inline int ubi_update_fastmap(struct ubi_device *ubi)
+{
+	return 0;
+}
+#endif
 
 /* io.c */
 int ubi_io_read(const struct ubi_device *ubi, void *buf, int pnum, int offset,
@@ -141,25 +141,8 @@
  */
 #define WL_MAX_FAILURES 32
 
-/**
- * struct ubi_work - UBI work description data structure.
- * @list: a link in the list of pending works
- * @func: worker function
- * @e: physical eraseblock to erase
- * @torture: if the physical eraseblock has to be tortured
- *
- * The @func pointer points to the worker function. If the @cancel argument is
- * not zero, the worker has to free the resources and exit immediately. The
- * worker has to return zero in case of success and a negative error code in
- * case of failure.
- */
-struct ubi_work {
-	struct list_head list;
-	int (*func)(struct ubi_device *ubi, struct ubi_work *wrk, int cancel);
-	/* The below fields are only relevant to erasure works */
-	struct ubi_wl_entry *e;
-	int torture;
-};
+static int erase_worker(struct ubi_device *ubi, struct ubi_work *wl_wrk,
+			int cancel);
 
 #ifdef CONFIG_MTD_UBI_DEBUG_PARANOID
 static int paranoid_check_ec(struct ubi_device *ubi, int pnum, int ec);
@@ -237,6 +220,20 @@ static int do_work(struct ubi_device *ubi)
 	}
 
 	wrk = list_entry(ubi->works.next, struct ubi_work, list);
+	if (ubi->free_count < ubi->free_low && wrk->func != erase_worker) {
+		struct ubi_work *w;
+
+		/*
+		 * Free PEBs are running out and writers would soon have to wait
+		 * for erasures. Do the pending erasures before anything else,
+		 * because e.g. the WL worker consumes a free PEB instead.
+		 */
+		list_for_each_entry(w, &ubi->works, list)
+			if (w->func == erase_worker) {
+				wrk = w;
+				break;
+			}
+	}
 	list_del(&wrk->list);
 	ubi->works_count -= 1;
 	ubi_assert(ubi->works_count >= 0);
@@ -377,38 +374,18 @@ static struct ubi_wl_entry *find_wl_entry(struct rb_root *root, int max)
 }
 
 /**
- * ubi_wl_get_peb - get a physical eraseblock.
+ * pick_free_peb - pick a free physical eraseblock for a type of data.
  * @ubi: UBI device description object
  * @dtype: type of data which will be stored in this physical eraseblock
  *
- * This function returns a physical eraseblock in case of success and a
- * negative error code in case of failure. Might sleep.
+ * This function returns the free physical eraseblock which suits @dtype best.
+ * The free tree must not be empty. Note, @ubi->wl_lock has to be locked.
  */
-int ubi_wl_get_peb(struct ubi_device *ubi, int dtype)
+static struct ubi_wl_entry *pick_free_peb(struct ubi_device *ubi, int dtype)
 {
-	int err, medium_ec;
+	int medium_ec;
 	struct ubi_wl_entry *e, *first, *last;
 
-	ubi_assert(dtype == UBI_LONGTERM || dtype == UBI_SHORTTERM ||
-		   dtype == UBI_UNKNOWN);
-
-retry:
-	spin_lock(&ubi->wl_lock);
-	if (!ubi->free.rb_node) {
-		if (ubi->works_count == 0) {
-			ubi_assert(list_empty(&ubi->works));
-			ubi_err("no free eraseblocks");
-			spin_unlock(&ubi->wl_lock);
-			return -ENOSPC;
-		}
-		spin_unlock(&ubi->wl_lock);
-
-		err = produce_free_peb(ubi);
-		if (err < 0)
-			return err;
-		goto retry;
-	}
-
 	switch (dtype) {
 	case UBI_LONGTERM:
 		/*
@@ -449,6 +426,135 @@ retry:
 		BUG();
 	}
 
+	return e;
+}
+
+#ifdef CONFIG_MTD_UBI_FASTMAP
+/**
+ * pool_get - take a physical eraseblock from a fastmap pool.
+ * @ubi: UBI device description object
+ * @pool: the pool to take from, must not be empty
+ * @dtype: type of data which will be stored in this physical eraseblock
+ *
+ * The pool was filled from the free tree with the %UBI_UNKNOWN policy, this
+ * function honours the long and short term hints by picking the PEB with the
+ * highest or the lowest erase counter of the pool. Note, @ubi->wl_lock has to
+ * be locked.
+ */
+static struct ubi_wl_entry *pool_get(struct ubi_device *ubi,
+				     struct ubi_fm_pool *pool, int dtype)
+{
+	int i, best = pool->used;
+	struct ubi_wl_entry *e, *eb = ubi->lookuptbl[pool->pebs[best]];
+
+	for (i = pool->used + 1; i < pool->size && dtype != UBI_UNKNOWN; i++) {
+		e = ubi->lookuptbl[pool->pebs[i]];
+		if ((dtype == UBI_LONGTERM && e->ec > eb->ec) ||
+		    (dtype == UBI_SHORTTERM && e->ec < eb->ec)) {
+			best = i;
+			eb = e;
+		}
+	}
+
+	pool->pebs[best] = pool->pebs[pool->used];
+	pool->pebs[pool->used++] = eb->pnum;
+	return eb;
+}
+
+/**
+ * ubi_wl_get_peb - get a physical eraseblock.
+ * @ubi: UBI device description object
+ * @dtype: type of data which will be stored in this physical eraseblock
+ *
+ * PEBs are handed out from @ubi->fm_pool only, because the fastmap on the
+ * flash tells that all other free PEBs contain nothing. When the pool is
+ * empty, a new fastmap is written and the pool is refilled.
+ *
+ * This function returns a physical eraseblock in case of success and a
+ * negative error code in case of failure. Might sleep.
+ */
+int ubi_wl_get_peb(struct ubi_device *ubi, int dtype)
+{
+	int err, produce;
+	struct ubi_wl_entry *e;
+	struct ubi_fm_pool *pool = &ubi->fm_pool;
+
+	ubi_assert(dtype == UBI_LONGTERM || dtype == UBI_SHORTTERM ||
+		   dtype == UBI_UNKNOWN);
+
+retry:
+	spin_lock(&ubi->wl_lock);
+	if (pool->used == pool->size) {
+		produce = !ubi->free.rb_node && list_empty(&ubi->fm_deferred);
+		if (produce && ubi->works_count == 0) {
+			ubi_assert(list_empty(&ubi->works));
+			ubi_err("no free eraseblocks");
+			spin_unlock(&ubi->wl_lock);
+			return -ENOSPC;
+		}
+		if (produce)
+			ubi->write_stalls += 1;
+		spin_unlock(&ubi->wl_lock);
+
+		if (produce)
+			err = produce_free_peb(ubi);
+		else
+			err = ubi_update_fastmap(ubi);
+		if (err < 0)
+			return err;
+		goto retry;
+	}
+
+	e = pool_get(ubi, pool, dtype);
+	dbg_wl("PEB %d EC %d", e->pnum, e->ec);
+	prot_queue_add(ubi, e);
+	spin_unlock(&ubi->wl_lock);
+
+	err = ubi_dbg_check_all_ff(ubi, e->pnum, ubi->vid_hdr_aloffset,
+				   ubi->peb_size - ubi->vid_hdr_aloffset);
+	if (err) {
+		ubi_err("new PEB %d does not contain all 0xFF bytes", e->pnum);
+		return err;
+	}
+
+	return e->pnum;
+}
+#else
+/**
+ * ubi_wl_get_peb - get a physical eraseblock.
+ * @ubi: UBI device description object
+ * @dtype: type of data which will be stored in this physical eraseblock
+ *
+ * This function returns a physical eraseblock in case of success and a
+ * negative error code in case of failure. Might sleep.
+ */
+int ubi_wl_get_peb(struct ubi_device *ubi, int dtype)
+{
+	int err;
+	struct ubi_wl_entry *e;
+
+	ubi_assert(dtype == UBI_LONGTERM || dtype == UBI_SHORTTERM ||
+		   dtype == UBI_UNKNOWN);
+
+retry:
+	spin_lock(&ubi->wl_lock);
+	if (!ubi->free.rb_node) {
+		if (ubi->works_count == 0) {
+			ubi_assert(list_empty(&ubi->works));
+			ubi_err("no free eraseblocks");
+			spin_unlock(&ubi->wl_lock);
+			return -ENOSPC;
+		}
+		ubi->write_stalls += 1;
+		spin_unlock(&ubi->wl_lock);
+
+		err = produce_free_peb(ubi);
+		if (err < 0)
+			return err;
+		goto retry;
+	}
+
+	e = pick_free_peb(ubi, dtype);
 	paranoid_check_in_wl_tree(e, &ubi->free);
 
 	/*
@@ -456,6 +562,7 @@ retry:
 	 * be protected from being moved for some time.
 	 */
 	rb_erase(&e->u.rb, &ubi->free);
+	ubi->free_count -= 1;
 	dbg_wl("PEB %d EC %d", e->pnum, e->ec);
 	prot_queue_add(ubi, e);
 	spin_unlock(&ubi->wl_lock);
@@ -469,6 +576,7 @@ retry:
 
 	return e->pnum;
 }
+#endif
 
 /**
  * prot_queue_del - remove a physical eraseblock from the protection queue.
@@ -613,25 +721,27 @@ static void schedule_ubi_work(struct ubi_device *ubi, struct ubi_work *wrk)
 	list_add_tail(&wrk->list, &ubi->works);
 	ubi_assert(ubi->works_count >= 0);
 	ubi->works_count += 1;
-	if (ubi->thread_enabled)
-		wake_up_process(ubi->bgt_thread);
+	ubi_wake_bgt(ubi);
 	spin_unlock(&ubi->wl_lock);
 }
 
-static int erase_worker(struct ubi_device *ubi, struct ubi_work *wl_wrk,
-			int cancel);
-
 /**
  * schedule_erase - schedule an erase work.
  * @ubi: UBI device description object
  * @e: the WL entry of the physical eraseblock to erase
  * @torture: if the physical eraseblock has to be tortured
+ * @lazy: the erasure may be postponed until the next fastmap update
+ *
+ * A PEB which was in use when the fastmap was written must not be erased
+ * before a new fastmap is written, because the old one still refers to its
+ * contents. Such erasures are requested with @lazy set and are kept in
+ * @ubi->fm_deferred until then.
  *
  * This function returns zero in case of success and a %-ENOMEM in case of
  * failure.
  */
 static int schedule_erase(struct ubi_device *ubi, struct ubi_wl_entry *e,
-			  int torture)
+			  int torture, int lazy)
 {
 	struct ubi_work *wl_wrk;
 
@@ -646,10 +756,63 @@ static int schedule_erase(struct ubi_device *ubi, struct ubi_wl_entry *e,
 	wl_wrk->e = e;
 	wl_wrk->torture = torture;
 
+#ifdef CONFIG_MTD_UBI_FASTMAP
+	if (lazy && !ubi->fm_disabled) {
+		spin_lock(&ubi->wl_lock);
+		list_add_tail(&wl_wrk->list, &ubi->fm_deferred);
+		spin_unlock(&ubi->wl_lock);
+		return 0;
+	}
+#endif
+
 	schedule_ubi_work(ubi, wl_wrk);
 	return 0;
 }
 
+#ifdef CONFIG_MTD_UBI_FASTMAP
+/**
+ * peek_wl_target - find the free PEB the WL worker would move data to.
+ * @ubi: UBI device description object
+ *
+ * With fastmap the WL worker takes its target PEBs from @ubi->fm_wl_pool, so
+ * that they are scanned at attach time. Returns %NULL if the pool is empty.
+ * Note, @ubi->wl_lock has to be locked.
+ */
+static struct ubi_wl_entry *peek_wl_target(struct ubi_device *ubi)
+{
+	struct ubi_fm_pool *pool = &ubi->fm_wl_pool;
+
+	if (pool->used == pool->size)
+		return NULL;
+	return ubi->lookuptbl[pool->pebs[pool->used]];
+}
+
+/**
+ * take_wl_target - take the PEB returned by 'peek_wl_target()'.
+ * @ubi: UBI device description object
+ * @e: the PEB to take
+ */
+static void take_wl_target(struct ubi_device *ubi, struct ubi_wl_entry *e)
+{
+	ubi_assert(ubi->fm_wl_pool.pebs[ubi->fm_wl_pool.used] == e->pnum);
+	ubi->fm_wl_pool.used += 1;
+}
+#else
+static struct ubi_wl_entry *peek_wl_target(struct ubi_device *ubi)
+{
+	if (!ubi->free.rb_node)
+		return NULL;
+	return find_wl_entry(&ubi->free, WL_FREE_MAX_DIFF);
+}
+
+static void take_wl_target(struct ubi_device *ubi, struct ubi_wl_entry *e)
+{
+	paranoid_check_in_wl_tree(e, &ubi->free);
+	rb_erase(&e->u.rb, &ubi->free);
+	ubi->free_count -= 1;
+}
+#endif
+
 /**
  * wear_leveling_worker - wear-leveling worker function.
  * @ubi: UBI device description object
@@ -681,12 +844,14 @@ static int wear_leveling_worker(struct ubi_device *ubi, struct ubi_work *wrk,
 	ubi_assert(!ubi->move_from && !ubi->move_to);
 	ubi_assert(!ubi->move_to_put);
 
-	if (!ubi->free.rb_node ||
-	    (!ubi->used.rb_node && !ubi->scrub.rb_node)) {
+	e2 = peek_wl_target(ubi);
+	if (!e2 || (!ubi->used.rb_node && !ubi->scrub.rb_node)) {
 		/*
 		 * No free physical eraseblocks? Well, they must be waiting in
 		 * the queue to be erased. Cancel movement - it will be
 		 * triggered again when a free physical eraseblock appears.
+		 * With fastmap, the WL pool may also be empty until the next
+		 * fastmap update refills it.
 		 *
 		 * No used physical eraseblocks? They must be temporarily
 		 * protected from being moved. They will be moved to the
@@ -694,7 +859,7 @@ static int wear_leveling_worker(struct ubi_device *ubi, struct ubi_work *wrk,
 		 * triggered again.
 		 */
 		dbg_wl("cancel WL, a list is empty: free %d, used %d",
-		       !ubi->free.rb_node, !ubi->used.rb_node);
+		       !e2, !ubi->used.rb_node);
 		goto out_cancel;
 	}
 
@@ -705,7 +870,6 @@ static int wear_leveling_worker(struct ubi_device *ubi, struct ubi_work *wrk,
 		 * counters differ much enough, start wear-leveling.
 		 */
 		e1 = rb_entry(rb_first(&ubi->used), struct ubi_wl_entry, u.rb);
-		e2 = find_wl_entry(&ubi->free, WL_FREE_MAX_DIFF);
 
 		if (!(e2->ec - e1->ec >= UBI_WL_THRESHOLD)) {
 			dbg_wl("no WL needed: min used EC %d, max free EC %d",
@@ -720,14 +884,12 @@ static int wear_leveling_worker(struct ubi_device *ubi, struct ubi_work *wrk,
 		/* Perform scrubbing */
 		scrubbing = 1;
 		e1 = rb_entry(rb_first(&ubi->scrub), struct ubi_wl_entry, u.rb);
-		e2 = find_wl_entry(&ubi->free, WL_FREE_MAX_DIFF);
 		paranoid_check_in_wl_tree(e1, &ubi->scrub);
 		rb_erase(&e1->u.rb, &ubi->scrub);
 		dbg_wl("scrub PEB %d to PEB %d", e1->pnum, e2->pnum);
 	}
 
-	paranoid_check_in_wl_tree(e2, &ubi->free);
-	rb_erase(&e2->u.rb, &ubi->free);
+	take_wl_target(ubi, e2);
 	ubi->move_from = e1;
 	ubi->move_to = e2;
 	spin_unlock(&ubi->wl_lock);
@@ -841,7 +1003,7 @@ static int wear_leveling_worker(struct ubi_device *ubi, struct ubi_work *wrk,
 	ubi->move_to_put = ubi->wl_scheduled = 0;
 	spin_unlock(&ubi->wl_lock);
 
-	err = schedule_erase(ubi, e1, 0);
+	err = schedule_erase(ubi, e1, 0, 1);
 	if (err) {
 		kmem_cache_free(ubi_wl_entry_slab, e1);
 		if (e2)
@@ -856,7 +1018,7 @@ static int wear_leveling_worker(struct ubi_device *ubi, struct ubi_work *wrk,
 		 */
 		dbg_wl("PEB %d (LEB %d:%d) was put meanwhile, erase",
 		       e2->pnum, vol_id, lnum);
-		err = schedule_erase(ubi, e2, 0);
+		err = schedule_erase(ubi, e2, 0, 1);
 		if (err) {
 			kmem_cache_free(ubi_wl_entry_slab, e2);
 			goto out_ro;
@@ -895,7 +1057,7 @@ out_not_moved:
 	spin_unlock(&ubi->wl_lock);
 
 	ubi_free_vid_hdr(ubi, vid_hdr);
-	err = schedule_erase(ubi, e2, torture);
+	err = schedule_erase(ubi, e2, torture, 1);
 	if (err) {
 		kmem_cache_free(ubi_wl_entry_slab, e2);
 		goto out_ro;
@@ -958,7 +1120,8 @@ static int ensure_wear_leveling(struct ubi_device *ubi)
 	 * the WL worker has to be scheduled anyway.
 	 */
 	if (!ubi->scrub.rb_node) {
-		if (!ubi->used.rb_node || !ubi->free.rb_node)
+		e2 = peek_wl_target(ubi);
+		if (!ubi->used.rb_node || !e2)
 			/* No physical eraseblocks - no deal */
 			goto out_unlock;
 
@@ -969,7 +1132,6 @@ static int ensure_wear_leveling(struct ubi_device *ubi)
 		 * %UBI_WL_THRESHOLD.
 		 */
 		e1 = rb_entry(rb_first(&ubi->used), struct ubi_wl_entry, u.rb);
-		e2 = find_wl_entry(&ubi->free, WL_FREE_MAX_DIFF);
 
 		if (!(e2->ec - e1->ec >= UBI_WL_THRESHOLD))
 			goto out_unlock;
@@ -1031,6 +1193,7 @@ static int erase_worker(struct ubi_device *ubi, struct ubi_work *wl_wrk,
 
 		spin_lock(&ubi->wl_lock);
 		wl_tree_add(e, &ubi->free);
+		ubi->free_count += 1;
 		spin_unlock(&ubi->wl_lock);
 
 		/*
@@ -1046,20 +1209,25 @@ static int erase_worker(struct ubi_device *ubi, struct ubi_work *wl_wrk,
 
 	ubi_err("failed to erase PEB %d, error %d", pnum, err);
 	kfree(wl_wrk);
-	kmem_cache_free(ubi_wl_entry_slab, e);
 
 	if (err == -EINTR || err == -ENOMEM || err == -EAGAIN ||
 	    err == -EBUSY) {
 		int err1;
 
 		/* Re-schedule the LEB for erasure */
-		err1 = schedule_erase(ubi, e, 0);
-		if (err1) {
-			err = err1;
-			goto out_ro;
-		}
-		return err;
-	} else if (err != -EIO) {
+		err1 = schedule_erase(ubi, e, 0, 0);
+		if (!err1)
+			return err;
+		err = err1;
+	}
+
+	/* The PEB is not in any of the WL sub-system's lists any longer */
+	spin_lock(&ubi->wl_lock);
+	ubi->lookuptbl[pnum] = NULL;
+	spin_unlock(&ubi->wl_lock);
+	kmem_cache_free(ubi_wl_entry_slab, e);
+
+	if (err != -EIO) {
 		/*
 		 * If this is not %-EIO, we have no idea what to do. Scheduling
 		 * this physical eraseblock for erasure again would cause
@@ -1193,7 +1361,7 @@ retry:
 	}
 	spin_unlock(&ubi->wl_lock);
 
-	err = schedule_erase(ubi, e, torture);
+	err = schedule_erase(ubi, e, torture, 1);
 	if (err) {
 		spin_lock(&ubi->wl_lock);
 		wl_tree_add(e, &ubi->used);
@@ -1259,6 +1427,17 @@ retry:
 	wl_tree_add(e, &ubi->scrub);
 	spin_unlock(&ubi->wl_lock);
 
+#ifdef CONFIG_MTD_UBI_FASTMAP
+	/* The WL worker needs a target PEB from the WL pool */
+	if (ubi->fm_wl_pool.used == ubi->fm_wl_pool.size) {
+		int err;
+
+		err = ubi_update_fastmap(ubi);
+		if (err)
+			return err;
+	}
+#endif
+
 	/*
 	 * Technically scrubbing is the same as wear-leveling, so it is done
 	 * by the WL worker.
@@ -1277,6 +1456,15 @@ int ubi_wl_flush(struct ubi_device *ubi)
 {
 	int err;
 
+#ifdef CONFIG_MTD_UBI_FASTMAP
+	/* Postponed erasures are released by writing a new fastmap */
+	if (!list_empty(&ubi->fm_deferred)) {
+		err = ubi_update_fastmap(ubi);
+		if (err)
+			return err;
+	}
+
+#endif
 	/*
 	 * Erase while the pending works queue is not empty, but not more than
 	 * the number of currently pending works.
@@ -1350,7 +1538,7 @@ int ubi_thread(void *u)
 	struct ubi_device *ubi = u;
 
 	ubi_msg("background thread \"%s\" started, PID %d",
-		ubi->bgt_name, task_pid_nr(current));
+		current->comm, task_pid_nr(current));
 
 	set_freezable();
 	for (;;) {
@@ -1375,14 +1563,14 @@ int ubi_thread(void *u)
 		err = do_work(ubi);
 		if (err) {
 			ubi_err("%s: work failed with error code %d",
-				ubi->bgt_name, err);
+				current->comm, err);
 			if (failures++ > WL_MAX_FAILURES) {
 				/*
 				 * Too many failures, disable the thread and
 				 * switch to read-only mode.
 				 */
 				ubi_msg("%s: %d consecutive failures",
-					ubi->bgt_name, WL_MAX_FAILURES);
+					current->comm, WL_MAX_FAILURES);
 				ubi_ro_mode(ubi);
 				ubi->thread_enabled = 0;
 				continue;
@@ -1393,10 +1581,54 @@ int ubi_thread(void *u)
 		cond_resched();
 	}
 
-	dbg_wl("background thread \"%s\" is killed", ubi->bgt_name);
+	dbg_wl("background thread \"%s\" is killed", current->comm);
 	return 0;
 }
 
+/**
+ * ubi_wake_bgt - wake up the background threads.
+ * @ubi: UBI device description object
+ *
+ * This function wakes up one sleeping background thread per pending work, so
+ * that the works may go in parallel, e.g. erasures on different flash chips.
+ * Note, @ubi->wl_lock has to be locked.
+ */
+void ubi_wake_bgt(struct ubi_device *ubi)
+{
+	int i, woken = 0;
+
+	if (!ubi->thread_enabled)
+		return;
+
+	for (i = 0; i < UBI_BGT_THREADS && woken < ubi->works_count; i++)
+		woken += wake_up_process(ubi->bgt_thread[i]);
+}
+
+/**
+ * ubi_wl_erase_queue_depth - count pending erasures.
+ * @ubi: UBI device description object
+ *
+ * This function returns the number of physical eraseblocks which are waiting
+ * to be erased, including the ones postponed until the next fastmap update.
+ */
+int ubi_wl_erase_queue_depth(struct ubi_device *ubi)
+{
+	int count = 0;
+	struct ubi_work *wrk;
+
+	spin_lock(&ubi->wl_lock);
+	list_for_each_entry(wrk, &ubi->works, list)
+		if (wrk->func == erase_worker)
+			count += 1;
+#ifdef CONFIG_MTD_UBI_FASTMAP
+	list_for_each_entry(wrk, &ubi->fm_deferred, list)
+		count += 1;
+#endif
+	spin_unlock(&ubi->wl_lock);
+
+	return count;
+}
+
 /**
  * cancel_pending - cancel all pending works.
  * @ubi: UBI device description object
@@ -1414,6 +1646,273 @@ static void cancel_pending(struct ubi_device *ubi)
 	}
 }
 
+#ifdef CONFIG_MTD_UBI_FASTMAP
+/**
+ * ubi_is_erase_work - check if a work is an erase work.
+ * @wrk: the work to check
+ */
+int ubi_is_erase_work(struct ubi_work *wrk)
+{
+	return wrk->func == erase_worker;
+}
+
+/**
+ * return_unused_pool_pebs - put the PEBs of a pool back to the free tree.
+ * @ubi: UBI device description object
+ * @pool: the pool
+ *
+ * Note, @ubi->wl_lock has to be locked.
+ */
+static void return_unused_pool_pebs(struct ubi_device *ubi,
+				    struct ubi_fm_pool *pool)
+{
+	int i;
+
+	for (i = pool->used; i < pool->size; i++)
+		wl_tree_add(ubi->lookuptbl[pool->pebs[i]], &ubi->free);
+	ubi->free_count += pool->size - pool->used;
+	pool->used = pool->size = 0;
+}
+
+/**
+ * ubi_refill_pools - refill the fastmap pools from the free tree.
+ * @ubi: UBI device description object
+ *
+ * PEBs left over in the pools go back to the free tree first, so the pools are
+ * always filled with the PEBs the usual allocation policy would pick. This
+ * function is called by the fastmap code just before it takes its snapshot.
+ */
+void ubi_refill_pools(struct ubi_device *ubi)
+{
+	int added;
+	struct ubi_wl_entry *e;
+	struct ubi_fm_pool *pool = &ubi->fm_pool;
+	struct ubi_fm_pool *wl_pool = &ubi->fm_wl_pool;
+
+	spin_lock(&ubi->wl_lock);
+	return_unused_pool_pebs(ubi, pool);
+	return_unused_pool_pebs(ubi, wl_pool);
+
+	do {
+		added = 0;
+		if (pool->size < pool->max_size && ubi->free.rb_node) {
+			e = pick_free_peb(ubi, UBI_UNKNOWN);
+			paranoid_check_in_wl_tree(e, &ubi->free);
+			rb_erase(&e->u.rb, &ubi->free);
+			ubi->free_count -= 1;
+			pool->pebs[pool->size++] = e->pnum;
+			added = 1;
+		}
+		if (wl_pool->size < wl_pool->max_size && ubi->free.rb_node) {
+			e = find_wl_entry(&ubi->free, WL_FREE_MAX_DIFF);
+			paranoid_check_in_wl_tree(e, &ubi->free);
+			rb_erase(&e->u.rb, &ubi->free);
+			ubi->free_count -= 1;
+			wl_pool->pebs[wl_pool->size++] = e->pnum;
+			added = 1;
+		}
+	} while (added);
+	spin_unlock(&ubi->wl_lock);
+}
+
+/**
+ * ubi_wl_get_fm_peb - get a free PEB for a fastmap block.
+ * @ubi: UBI device description object
+ * @anchor: the PEB is going to be the fastmap anchor
+ * @old: the PEB the fastmap block was stored in so far, or %NULL
+ *
+ * This function returns the free PEB with the lowest erase counter, which for
+ * the anchor has to be one of the first %UBI_FM_MAX_START PEBs, and removes it
+ * from the free tree. If @old is not %NULL, the free PEB is only returned if
+ * @old is worn out more by at least %UBI_WL_THRESHOLD, so that fastmap blocks
+ * take part in wear-leveling. Returns %NULL if there is no suitable PEB.
+ */
+struct ubi_wl_entry *ubi_wl_get_fm_peb(struct ubi_device *ubi, int anchor,
+				       struct ubi_wl_entry *old)
+{
+	int pnum;
+	struct ubi_wl_entry *e = NULL, *e1;
+
+	spin_lock(&ubi->wl_lock);
+	if (!anchor) {
+		if (ubi->free.rb_node)
+			e = rb_entry(rb_first(&ubi->free), struct ubi_wl_entry,
+				     u.rb);
+	} else {
+		for (pnum = 0; pnum < UBI_FM_MAX_START &&
+			       pnum < ubi->peb_count; pnum++) {
+			e1 = ubi->lookuptbl[pnum];
+			if (!e1 || (e && e1->ec >= e->ec) ||
+			    !in_wl_tree(e1, &ubi->free))
+				continue;
+			e = e1;
+		}
+	}
+
+	if (e && old && old->ec - e->ec < UBI_WL_THRESHOLD)
+		e = NULL;
+	if (e) {
+		paranoid_check_in_wl_tree(e, &ubi->free);
+		rb_erase(&e->u.rb, &ubi->free);
+		ubi->free_count -= 1;
+	}
+	spin_unlock(&ubi->wl_lock);
+
+	return e;
+}
+
+/**
+ * ubi_wl_put_fm_peb - return a PEB which is not a fastmap block any longer.
+ * @ubi: UBI device description object
+ * @e: the PEB
+ * @torture: if this physical eraseblock has to be tortured
+ *
+ * The PEB is scheduled for erasure. Returns zero in case of success and a
+ * negative error code in case of failure.
+ */
+int ubi_wl_put_fm_peb(struct ubi_device *ubi, struct ubi_wl_entry *e,
+		      int torture)
+{
+	dbg_wl("PEB %d", e->pnum);
+	return schedule_erase(ubi, e, torture, 0);
+}
+
+/**
+ * ubi_wl_erase_fm_peb - synchronously erase a fastmap block.
+ * @ubi: UBI device description object
+ * @e: the PEB to erase
+ *
+ * This function returns zero in case of success and a negative error code in
+ * case of failure.
+ */
+int ubi_wl_erase_fm_peb(struct ubi_device *ubi, struct ubi_wl_entry *e)
+{
+	return sync_erase(ubi, e, 0);
+}
+
+/**
+ * ubi_wl_release_deferred - start the postponed erasures.
+ * @ubi: UBI device description object
+ *
+ * This function is called once a new fastmap has been written, the erasures
+ * postponed by 'schedule_erase()' may be done now.
+ */
+void ubi_wl_release_deferred(struct ubi_device *ubi)
+{
+	struct ubi_work *wrk, *tmp;
+
+	spin_lock(&ubi->wl_lock);
+	list_for_each_entry_safe(wrk, tmp, &ubi->fm_deferred, list) {
+		list_move_tail(&wrk->list, &ubi->works);
+		ubi->works_count += 1;
+	}
+	ubi_wake_bgt(ubi);
+	spin_unlock(&ubi->wl_lock);
+}
+
+/**
+ * fastmap_init - initialize the fastmap part of the WL sub-system.
+ * @ubi: UBI device description object
+ * @si: scanning information
+ *
+ * This function sizes the pools, reserves the PEBs for the fastmap and takes
+ * over the fastmap found at attach time, if any. Returns zero in case of
+ * success and a negative error code in case of failure.
+ */
+static int fastmap_init(struct ubi_device *ubi, struct ubi_scan_info *si)
+{
+	int i, err, fm_blocks;
+	struct ubi_fastmap_layout *fm = si->fm;
+
+	ubi->fm_pool.max_size = clamp_t(int, ubi->peb_count / 20,
+					UBI_FM_MIN_POOL_SIZE,
+					UBI_FM_MAX_POOL_SIZE);
+	ubi->fm_wl_pool.max_size = min_t(int, ubi->fm_pool.max_size / 2,
+					 UBI_FM_WL_POOL_SIZE);
+
+	ubi->fm_size = ubi_calc_fm_size(ubi);
+	fm_blocks = ubi->fm_size / ubi->leb_size;
+	if (fm_blocks > UBI_FM_MAX_BLOCKS || ubi->avail_pebs < fm_blocks) {
+		ubi_warn("fastmap disabled, it needs %d PEBs", fm_blocks);
+		ubi->fm_disabled = 1;
+	} else {
+		ubi->avail_pebs -= fm_blocks;
+		ubi->rsvd_pebs += fm_blocks;
+	}
+
+	if (!fm)
+		return 0;
+
+	si->fm = NULL;
+	ubi->fm = fm;
+	for (i = 0; i < fm->used_blocks; i++)
+		ubi->lookuptbl[fm->e[i]->pnum] = fm->e[i];
+	if (!ubi->fm_disabled)
+		return 0;
+
+	/*
+	 * Nobody is going to keep the fastmap found on the flash up to date,
+	 * so it has to be invalidated before anything changes.
+	 */
+	err = sync_erase(ubi, fm->e[0], 0);
+	if (err)
+		return err;
+
+	ubi->fm = NULL;
+	wl_tree_add(fm->e[0], &ubi->free);
+	ubi->free_count += 1;
+	for (i = 1; i < fm->used_blocks; i++)
+		if (schedule_erase(ubi, fm->e[i], 0, 0)) {
+			ubi->lookuptbl[fm->e[i]->pnum] = NULL;
+			kmem_cache_free(ubi_wl_entry_slab, fm->e[i]);
+			err = -ENOMEM;
+		}
+	kfree(fm);
+	return err;
+}
+
+/**
+ * fastmap_close - free the fastmap part of the WL sub-system.
+ * @ubi: UBI device description object
+ */
+static void fastmap_close(struct ubi_device *ubi)
+{
+	int i;
+	struct ubi_work *wrk, *tmp;
+	struct ubi_fm_pool *pool = &ubi->fm_pool;
+	struct ubi_fm_pool *wl_pool = &ubi->fm_wl_pool;
+
+	list_for_each_entry_safe(wrk, tmp, &ubi->fm_deferred, list) {
+		list_del(&wrk->list);
+		wrk->func(ubi, wrk, 1);
+	}
+
+	for (i = pool->used; i < pool->size; i++)
+		kmem_cache_free(ubi_wl_entry_slab,
+				ubi->lookuptbl[pool->pebs[i]]);
+	for (i = wl_pool->used; i < wl_pool->size; i++)
+		kmem_cache_free(ubi_wl_entry_slab,
+				ubi->lookuptbl[wl_pool->pebs[i]]);
+	pool->used = pool->size = wl_pool->used = wl_pool->size = 0;
+
+	if (ubi->fm) {
+		for (i = 0; i < ubi->fm->used_blocks; i++)
+			kmem_cache_free(ubi_wl_entry_slab, ubi->fm->e[i]);
+		kfree(ubi->fm);
+		ubi->fm = NULL;
+	}
+}
+#else
+static int fastmap_init(struct ubi_device *ubi, struct ubi_scan_info *si)
+{
+	return 0;
+}
+
+static void fastmap_close(struct ubi_device *ubi)
+{
+}
+#endif
+
 /**
  * ubi_wl_init_scan - initialize the WL sub-system using scanning information.
  * @ubi: UBI device description object
@@ -1431,11 +1930,17 @@ int ubi_wl_init_scan(struct ubi_device *ubi, struct ubi_scan_info *si)
 	struct ubi_wl_entry *e;
 
 	ubi->used = ubi->erroneous = ubi->free = ubi->scrub = RB_ROOT;
+	ubi->free_count = 0;
+	ubi->free_low = CONFIG_MTD_UBI_FREE_LOW_WATERMARK;
 	spin_lock_init(&ubi->wl_lock);
 	mutex_init(&ubi->move_mutex);
 	init_rwsem(&ubi->work_sem);
 	ubi->max_ec = si->max_ec;
 	INIT_LIST_HEAD(&ubi->works);
+#ifdef CONFIG_MTD_UBI_FASTMAP
+	INIT_LIST_HEAD(&ubi->fm_deferred);
+	mutex_init(&ubi->fm_mutex);
+#endif
 
 	sprintf(ubi->bgt_name, UBI_BGT_NAME_PATTERN, ubi->ubi_num);
 
@@ -1458,7 +1963,7 @@ int ubi_wl_init_scan(struct ubi_device *ubi, struct ubi_scan_info *si)
 		e->pnum = seb->pnum;
 		e->ec = seb->ec;
 		ubi->lookuptbl[e->pnum] = e;
-		if (schedule_erase(ubi, e, 0)) {
+		if (schedule_erase(ubi, e, 0, 0)) {
 			kmem_cache_free(ubi_wl_entry_slab, e);
 			goto out_free;
 		}
@@ -1475,6 +1980,7 @@ int ubi_wl_init_scan(struct ubi_device *ubi, struct ubi_scan_info *si)
 		e->ec = seb->ec;
 		ubi_assert(e->ec >= 0);
 		wl_tree_add(e, &ubi->free);
+		ubi->free_count += 1;
 		ubi->lookuptbl[e->pnum] = e;
 	}
 
@@ -1512,6 +2018,10 @@ int ubi_wl_init_scan(struct ubi_device *ubi, struct ubi_scan_info *si)
 	ubi->avail_pebs -= WL_RESERVED_PEBS;
 	ubi->rsvd_pebs += WL_RESERVED_PEBS;
 
+	err = fastmap_init(ubi, si);
+	if (err)
+		goto out_free;
+
 	/* Schedule wear-leveling if needed */
 	err = ensure_wear_leveling(ubi);
 	if (err)
@@ -1520,6 +2030,7 @@ int ubi_wl_init_scan(struct ubi_device *ubi, struct ubi_scan_info *si)
 	return 0;
 
 out_free:
+	fastmap_close(ubi);
 	cancel_pending(ubi);
 	tree_destroy(&ubi->used);
 	tree_destroy(&ubi->free);
@@ -1552,6 +2063,7 @@ static void protection_queue_destroy(struct ubi_device *ubi)
 void ubi_wl_close(struct ubi_device *ubi)
 {
 	dbg_wl("close the WL sub-system");
+	fastmap_close(ubi);
 	cancel_pending(ubi);
 	protection_queue_destroy(ubi);
 	tree_destroy(&ubi->used);
@@ -26,6 +26,7 @@
 #include <linux/highmem.h>
 #include <linux/slab.h>
 #include <linux/lzo.h>
+#include <linux/lz4.h>
 #include <linux/string.h>
 #include <linux/vmalloc.h>
 
@@ -38,6 +39,11 @@ struct zram *devices;
 /* Module params (documentation at end) */
 unsigned int num_devices;
 
+const char *zram_compressor_names[__NR_ZRAM_COMPRESSORS] = {
+	[ZRAM_COMPR_LZO]	= "lzo",
+	[ZRAM_COMPR_LZ4]	= "lz4",
+};
+
 static void zram_stat_inc(u32 *v)
 {
 	*v = *v + 1;
@@ -200,6 +206,30 @@ static void handle_uncompressed_page(struct zram *zram,
 	flush_dcache_page(page);
 }
 
+/*
+ * Both backends return 0 on success and take the capacity of @dst in
+ * *@dst_len, so callers need not care which one the device was set up with.
+ */
+static int zram_compress(struct zram *zram, const unsigned char *src,
+		unsigned char *dst, size_t *dst_len)
+{
+	if (zram->compressor == ZRAM_COMPR_LZ4)
+		return lz4_compress(src, PAGE_SIZE, dst, dst_len,
+				zram->compress_workmem);
+
+	return lzo1x_1_compress(src, PAGE_SIZE, dst, dst_len,
+				zram->compress_workmem);
+}
+
+static int zram_decompress(struct zram *zram, const unsigned char *src,
+		size_t src_len, unsigned char *dst, size_t *dst_len)
+{
+	if (zram->compressor == ZRAM_COMPR_LZ4)
+		return lz4_decompress_safe(src, src_len, dst, dst_len);
+
+	return lzo1x_decompress_safe(src, src_len, dst, dst_len);
+}
+
 static int zram_read(struct zram *zram, struct bio *bio)
 {
 
@@ -253,8 +283,7 @@ static int zram_read(struct zram *zram, struct bio *bio)
 		cmem = kmap_atomic(zram->table[index].page, KM_USER1) +
 				zram->table[index].offset;
 
-		ret = lzo1x_decompress_safe(
-			cmem + sizeof(*zheader),
+		ret = zram_decompress(zram, cmem + sizeof(*zheader),
 			xv_get_object_size(cmem) - sizeof(*zheader),
 			user_mem, &clen);
 
@@ -262,7 +291,7 @@ static int zram_read(struct zram *zram, struct bio *bio)
 		kunmap_atomic(cmem, KM_USER1);
 
 		/* Should NEVER happen. Return bio error if it does. */
-		if (unlikely(ret != LZO_E_OK)) {
+		if (unlikely(ret)) {
 			pr_err("Decompression failed! err=%d, page=%u\n",
 				ret, index);
 			zram_stat64_inc(zram, &zram->stats.failed_reads);
@@ -327,12 +356,12 @@ static int zram_write(struct zram *zram, struct bio *bio)
 			continue;
 		}
 
-		ret = lzo1x_1_compress(user_mem, PAGE_SIZE, src, &clen,
-					zram->compress_workmem);
+		clen = 2 * PAGE_SIZE;
+		ret = zram_compress(zram, user_mem, src, &clen);
 
 		kunmap_atomic(user_mem, KM_USER0);
 
-		if (unlikely(ret != LZO_E_OK)) {
+		if (unlikely(ret)) {
 			mutex_unlock(&zram->lock);
 			pr_err("Compression failed! err=%d\n", ret);
 			zram_stat64_inc(zram, &zram->stats.failed_writes);
@@ -516,7 +545,8 @@ int zram_init_device(struct zram *zram)
 
 	zram_set_disksize(zram, totalram_pages << PAGE_SHIFT);
 
-	zram->compress_workmem = kzalloc(LZO1X_MEM_COMPRESS, GFP_KERNEL);
+	zram->compress_workmem = kzalloc(max_t(size_t, LZO1X_MEM_COMPRESS,
+					LZ4_MEM_COMPRESS), GFP_KERNEL);
 	if (!zram->compress_workmem) {
 		pr_err("Error allocating compressor working memory!\n");
 		ret = -ENOMEM;
@@ -73,6 +73,14 @@ enum zram_pageflags {
 	__NR_ZRAM_PAGEFLAGS,
 };
 
+/* Compression backends, selected through sysfs before device init */
+enum zram_compressor {
+	ZRAM_COMPR_LZO,
+	ZRAM_COMPR_LZ4,
+
+	__NR_ZRAM_COMPRESSORS,
+};
+
 /*-- Data structures */
 
 /* Allocated for each disk page */
@@ -108,6 +116,7 @@ struct zram {
 	struct request_queue *queue;
 	struct gendisk *disk;
 	int init_done;
+	enum zram_compressor compressor;
 	/* Prevent concurrent execution of device init and reset */
 	struct mutex init_lock;
 	/*
@@ -125,6 +134,8 @@ extern unsigned int num_devices;
 extern struct attribute_group zram_disk_attr_group;
 #endif
 
+extern const char *zram_compressor_names[__NR_ZRAM_COMPRESSORS];
+
 extern int zram_init_device(struct zram *zram);
 extern void zram_reset_device(struct zram *zram);
 
@@ -461,6 +461,8 @@ static struct kiocb *__aio_get_req(struct kioctx *ctx)
 	req->ki_iovec = NULL;
 	INIT_LIST_HEAD(&req->ki_run_list);
 	req->ki_eventfd = NULL;
+	req->ki_complete = NULL;
+	req->ki_pages = NULL;
 
 	/* Check if the completion queue has enough free space to
 	 * accept an event from this io.
@@ -934,6 +936,12 @@ int aio_complete(struct kiocb *iocb, long res, long res2)
 		return 1;
 	}
 
+	/* iocbs submitted through io_uring complete to their own ring */
+	if (iocb->ki_complete) {
+		iocb->ki_complete(iocb, res, res2);
+		return 1;
+	}
+
 	info = &ctx->ring_info;
 
 	/* add a completion event to the ring buffer.
@@ -7107,6 +7107,9 @@ static long btrfs_fallocate(struct inode *inode, int mode,
 	struct extent_map *em;
 	int ret;
 
+	if (mode & ~FALLOC_FL_KEEP_SIZE)
+		return -EOPNOTSUPP;
+
 	alloc_start = offset & ~mask;
 	alloc_end =  (offset + len + mask) & ~mask;
 
@@ -105,6 +105,8 @@ struct dio {
 	unsigned long refcount;		/* direct_io_worker() and bios */
 	struct bio *bio_list;		/* singly linked via bi_private */
 	struct task_struct *waiter;	/* waiting task (NULL if none) */
+	struct block_device *bio_bdev;	/* device of the last bio, */
+	blk_qc_t bio_cookie;		/* and its cookie for polling */
 
 	/* AIO related stuff */
 	struct kiocb *iocb;		/* kiocb */
@@ -143,6 +145,29 @@ static inline unsigned dio_pages_present(struct dio *dio)
 	return dio->tail - dio->head;
 }
 
+/*
+ * The user buffer was pinned when it was registered (io_uring fixed
+ * buffers), just take references on the pages instead of walking the
+ * page tables again.
+ */
+static int dio_refill_fixed_pages(struct dio *dio, int nr_pages)
+{
+	struct kiocb *iocb = dio->iocb;
+	unsigned long index;
+	int i;
+
+	index = (dio->curr_user_address - iocb->ki_pages_addr) >> PAGE_SHIFT;
+	for (i = 0; i < nr_pages; i++) {
+		dio->pages[i] = iocb->ki_pages[index + i];
+		page_cache_get(dio->pages[i]);
+	}
+	dio->curr_user_address += nr_pages * PAGE_SIZE;
+	dio->curr_page += nr_pages;
+	dio->head = 0;
+	dio->tail = nr_pages;
+	return 0;
+}
+
 /*
  * Go grab and pin some userspace pages.   Typically we'll get 64 at a time.
  */
@@ -152,6 +177,9 @@ static int dio_refill_pages(struct dio *dio)
 	int nr_pages;
 
 	nr_pages = min(dio->total_pages - dio->curr_page, DIO_PAGES);
+	if (dio->iocb->ki_pages)
+		return dio_refill_fixed_pages(dio, nr_pages);
+
 	ret = get_user_pages_fast(
 		dio->curr_user_address,		/* Where from? */
 		nr_pages,			/* How many pages? */
@@ -369,12 +397,21 @@ static void dio_bio_submit(struct dio *dio)
 	if (dio->is_async && dio->rw == READ)
 		bio_set_pages_dirty(bio);
 
+	dio->bio_bdev = bio->bi_bdev;
+
 	if (dio->submit_io)
 		dio->submit_io(dio->rw, bio, dio->inode,
 			       dio->logical_offset_in_bio);
 	else
 		submit_bio(dio->rw, bio);
 
+	/*
+	 * A sync dio only frees its bios once it has waited for them, so
+	 * the cookie can still be read here.
+	 */
+	if (!dio->is_async)
+		dio->bio_cookie = bio->bi_cookie;
+
 	dio->bio = NULL;
 	dio->boundary = 0;
 	dio->logical_offset_in_bio = 0;
@@ -412,7 +449,9 @@ static struct bio *dio_await_one(struct dio *dio)
 		__set_current_state(TASK_UNINTERRUPTIBLE);
 		dio->waiter = current;
 		spin_unlock_irqrestore(&dio->bio_lock, flags);
-		io_schedule();
+		if (!blk_qc_t_valid(dio->bio_cookie) ||
+		    !blk_poll(bdev_get_queue(dio->bio_bdev), dio->bio_cookie))
+			io_schedule();
 		/* wake up sets us TASK_RUNNING */
 		spin_lock_irqsave(&dio->bio_lock, flags);
 		dio->waiter = NULL;
@@ -995,6 +1034,7 @@ direct_io_worker(int rw, struct kiocb *iocb, struct inode *inode,
 	ssize_t ret = 0;
 	ssize_t ret2;
 	size_t bytes;
+	struct blk_plug plug;
 
 	dio->inode = inode;
 	dio->rw = rw;
@@ -1028,6 +1068,8 @@ direct_io_worker(int rw, struct kiocb *iocb, struct inode *inode,
 				- user_addr/PAGE_SIZE);
 	}
 
+	blk_start_plug(&plug);
+
 	for (seg = 0; seg < nr_segs; seg++) {
 		user_addr = (unsigned long)iov[seg].iov_base;
 		dio->size += bytes = iov[seg].iov_len;
@@ -1084,6 +1126,8 @@ direct_io_worker(int rw, struct kiocb *iocb, struct inode *inode,
 	if (dio->bio)
 		dio_bio_submit(dio);
 
+	blk_finish_plug(&plug);
+
 	/*
 	 * It is possible that, we return short IO due to end of file.
 	 * In that case, we need to release all the pages we got hold on.
@@ -1213,6 +1257,7 @@ __blockdev_direct_IO(int rw, struct kiocb *iocb, struct inode *inode,
 	 * care to only zero out what's needed.
 	 */
 	memset(dio, 0, offsetof(struct dio, pages));
+	dio->bio_cookie = BLK_QC_T_NONE;
 
 	dio->flags = flags;
 	if (dio->flags & DIO_LOCKING) {
@@ -2034,6 +2034,14 @@ static int ext4_ext_rm_idx(handle_t *handle, struct inode *inode,
 	err = ext4_ext_get_access(handle, inode, path);
 	if (err)
 		return err;
+
+	/* hole punching can empty a leaf in the middle of the index */
+	if (path->p_idx != EXT_LAST_INDEX(path->p_hdr)) {
+		int len = EXT_LAST_INDEX(path->p_hdr) - path->p_idx;
+		len *= sizeof(struct ext4_extent_idx);
+		memmove(path->p_idx, path->p_idx + 1, len);
+	}
+
 	le16_add_cpu(&path->p_hdr->eh_entries, -1);
 	err = ext4_ext_dirty(handle, inode, path);
 	if (err)
@@ -2149,9 +2157,15 @@ static int ext4_remove_blocks(handle_t *handle, struct inode *inode,
 	return 0;
 }
 
+/*
+ * ext4_ext_rm_leaf() removes the extents in [start, end] from the leaf.
+ * For truncate end is EXT_MAX_BLOCK; for hole punching the extents have
+ * been split at start and end + 1 already, so only whole extents go.
+ */
 static int
 ext4_ext_rm_leaf(handle_t *handle, struct inode *inode,
-		struct ext4_ext_path *path, ext4_lblk_t start)
+		struct ext4_ext_path *path, ext4_lblk_t start,
+		ext4_lblk_t end)
 {
 	int err = 0, correct_index = 0;
 	int depth = ext_depth(inode), credits;
@@ -2178,6 +2192,13 @@ ext4_ext_rm_leaf(handle_t *handle, struct inode *inode,
 	ex_ee_block = le32_to_cpu(ex->ee_block);
 	ex_ee_len = ext4_ext_get_actual_len(ex);
 
+	/* skip the extents beyond the hole */
+	while (ex >= EXT_FIRST_EXTENT(eh) && ex_ee_block > end) {
+		ex--;
+		ex_ee_block = le32_to_cpu(ex->ee_block);
+		ex_ee_len = ext4_ext_get_actual_len(ex);
+	}
+
 	while (ex >= EXT_FIRST_EXTENT(eh) &&
 			ex_ee_block + ex_ee_len > start) {
 
@@ -2191,8 +2212,8 @@ ext4_ext_rm_leaf(handle_t *handle, struct inode *inode,
 		path[depth].p_ext = ex;
 
 		a = ex_ee_block > start ? ex_ee_block : start;
-		b = ex_ee_block + ex_ee_len - 1 < EXT_MAX_BLOCK ?
-			ex_ee_block + ex_ee_len - 1 : EXT_MAX_BLOCK;
+		b = ex_ee_block + ex_ee_len - 1 < end ?
+			ex_ee_block + ex_ee_len - 1 : end;
 
 		ext_debug("  border %u:%u\n", a, b);
 
@@ -2258,6 +2279,17 @@ ext4_ext_rm_leaf(handle_t *handle, struct inode *inode,
 		if (uninitialized && num)
 			ext4_ext_mark_uninitialized(ex);
 
+		/*
+		 * A hole punched in the middle of the leaf: move the
+		 * extents behind it down, so there is no unused slot.
+		 */
+		if (num == 0 && end != EXT_MAX_BLOCK) {
+			memmove(ex, ex + 1, (EXT_LAST_EXTENT(eh) - ex + 1) *
+					sizeof(struct ext4_extent));
+			memset(EXT_LAST_EXTENT(eh) + 1, 0,
+			       sizeof(struct ext4_extent));
+		}
+
 		err = ext4_ext_dirty(handle, inode, path + depth);
 		if (err)
 			goto out;
@@ -2286,13 +2318,21 @@ out:
  * returns 1 if current index has to be freed (even partial)
  */
 static int
-ext4_ext_more_to_rm(struct ext4_ext_path *path)
+ext4_ext_more_to_rm(struct ext4_ext_path *path, ext4_lblk_t start,
+		    ext4_lblk_t end)
 {
 	BUG_ON(path->p_idx == NULL);
 
 	if (path->p_idx < EXT_FIRST_INDEX(path->p_hdr))
 		return 0;
 
+	/*
+	 * when punching a hole, p_block is the first block covered by
+	 * the index visited last: go on while the hole reaches below it
+	 */
+	if (end != EXT_MAX_BLOCK)
+		return path->p_block > start;
+
 	/*
 	 * if truncate on deeper level happened, it wasn't partial,
 	 * so we have to consider current index for truncation
@@ -2302,7 +2342,8 @@ ext4_ext_more_to_rm(struct ext4_ext_path *path)
 	return 1;
 }
 
-static int ext4_ext_remove_space(struct inode *inode, ext4_lblk_t start)
+static int ext4_ext_remove_space(struct inode *inode, ext4_lblk_t start,
+				 ext4_lblk_t end)
 {
 	struct super_block *sb = inode->i_sb;
 	int depth = ext_depth(inode);
@@ -2310,7 +2351,7 @@ static int ext4_ext_remove_space(struct inode *inode, ext4_lblk_t start)
 	handle_t *handle;
 	int i, err;
 
-	ext_debug("truncate since %u\n", start);
+	ext_debug("truncate since %u to %u\n", start, end);
 
 	/* probably first extent we're gonna free will be last in block */
 	handle = ext4_journal_start(inode, depth + 1);
@@ -2341,7 +2382,8 @@ again:
 	while (i >= 0 && err == 0) {
 		if (i == depth) {
 			/* this is leaf block */
-			err = ext4_ext_rm_leaf(handle, inode, path, start);
+			err = ext4_ext_rm_leaf(handle, inode, path,
+					       start, end);
 			/* root level has p_bh == NULL, brelse() eats this */
 			brelse(path[i].p_bh);
 			path[i].p_bh = NULL;
@@ -2359,6 +2401,14 @@ again:
 			/* this level hasn't been touched yet */
 			path[i].p_idx = EXT_LAST_INDEX(path[i].p_hdr);
 			path[i].p_block = le16_to_cpu(path[i].p_hdr->eh_entries)+1;
+			if (end != EXT_MAX_BLOCK) {
+				/* start with the subtree holding @end */
+				while (path[i].p_idx >
+				       EXT_FIRST_INDEX(path[i].p_hdr) &&
+				       le32_to_cpu(path[i].p_idx->ei_block) > end)
+					path[i].p_idx--;
+				path[i].p_block = (ext4_fsblk_t)EXT_MAX_BLOCK + 1;
+			}
 			ext_debug("init index ptr: hdr 0x%p, num %d\n",
 				  path[i].p_hdr,
 				  le16_to_cpu(path[i].p_hdr->eh_entries));
@@ -2370,7 +2420,7 @@ again:
 		ext_debug("level %d - index, first 0x%p, cur 0x%p\n",
 				i, EXT_FIRST_INDEX(path[i].p_hdr),
 				path[i].p_idx);
-		if (ext4_ext_more_to_rm(path + i)) {
+		if (ext4_ext_more_to_rm(path + i, start, end)) {
 			struct buffer_head *bh;
 			/* go to the next level */
 			ext_debug("move to level %d (block %llu)\n",
@@ -2396,6 +2446,9 @@ again:
 			/* save actual number of indexes since this
 			 * number is changed at the next iteration */
 			path[i].p_block = le16_to_cpu(path[i].p_hdr->eh_entries);
+			if (end != EXT_MAX_BLOCK)
+				path[i].p_block =
+					le32_to_cpu(path[i].p_idx->ei_block);
 			i++;
 		} else {
 			/* we finished processing this index, go up */
@@ -3549,7 +3602,7 @@ void ext4_ext_truncate(struct inode *inode)
 
 	last_block = (inode->i_size + sb->s_blocksize - 1)
 			>> EXT4_BLOCK_SIZE_BITS(sb);
-	err = ext4_ext_remove_space(inode, last_block);
+	err = ext4_ext_remove_space(inode, last_block, EXT_MAX_BLOCK);
 
 	/* In a multi-transaction truncate, we only make the final
 	 * transaction synchronous.
@@ -3604,6 +3657,168 @@ static void ext4_falloc_update_inode(struct inode *inode,
 
 }
 
+/*
+ * ext4_ext_split_at() cuts the extent covering @split, if any, in two so
+ * that @split becomes the first block of an extent of its own.  Used to
+ * line up the extents with a hole before punching it.
+ */
+static int ext4_ext_split_at(handle_t *handle, struct inode *inode,
+			     ext4_lblk_t split)
+{
+	struct ext4_ext_path *path;
+	struct ext4_extent *ex, newex;
+	ext4_lblk_t ee_block;
+	unsigned int ee_len;
+	int uninitialized;
+	int depth, err = 0;
+
+	path = ext4_ext_find_extent(inode, split, NULL);
+	if (IS_ERR(path))
+		return PTR_ERR(path);
+
+	depth = ext_depth(inode);
+	ex = path[depth].p_ext;
+	if (!ex)
+		goto out;
+
+	ee_block = le32_to_cpu(ex->ee_block);
+	ee_len = ext4_ext_get_actual_len(ex);
+	if (split <= ee_block || split >= ee_block + ee_len)
+		goto out;
+
+	uninitialized = ext4_ext_is_uninitialized(ex);
+
+	err = ext4_ext_get_access(handle, inode, path + depth);
+	if (err)
+		goto out;
+	ex->ee_len = cpu_to_le16(split - ee_block);
+	if (uninitialized)
+		ext4_ext_mark_uninitialized(ex);
+	err = ext4_ext_dirty(handle, inode, path + depth);
+	if (err)
+		goto out;
+
+	newex.ee_block = cpu_to_le32(split);
+	newex.ee_len = cpu_to_le16(ee_block + ee_len - split);
+	ext4_ext_store_pblock(&newex, ext4_ext_pblock(ex) + split - ee_block);
+	if (uninitialized)
+		ext4_ext_mark_uninitialized(&newex);
+
+	/* EXT4_GET_BLOCKS_PRE_IO keeps it from merging the halves again */
+	err = ext4_ext_insert_extent(handle, inode, path, &newex,
+				     EXT4_GET_BLOCKS_PRE_IO);
+	if (err) {
+		/* put the original extent back */
+		ex->ee_len = cpu_to_le16(ee_len);
+		if (uninitialized)
+			ext4_ext_mark_uninitialized(ex);
+		ext4_ext_dirty(handle, inode, path + depth);
+	}
+out:
+	ext4_ext_drop_refs(path);
+	kfree(path);
+	return err;
+}
+
+/*
+ * ext4_ext_punch_hole() releases the blocks backing [offset, offset+len).
+ * The partial blocks at either end are zeroed, the ones in between are
+ * removed from the extent tree and freed.  i_size does not change.
+ */
+static long ext4_ext_punch_hole(struct inode *inode, loff_t offset,
+				loff_t len)
+{
+	struct address_space *mapping = inode->i_mapping;
+	unsigned int blkbits = inode->i_blkbits;
+	loff_t blocksize = 1 << blkbits;
+	loff_t end, first_page, last_page;
+	ext4_lblk_t first_block, stop_block;
+	handle_t *handle;
+	int err = 0, err2;
+
+	mutex_lock(&inode->i_mutex);
+	if (offset >= inode->i_size)
+		goto out_mutex;
+
+	/* a hole reaching EOF takes the whole last block */
+	end = offset + len;
+	if (end >= inode->i_size)
+		end = EXT4_BLOCK_ALIGN(inode->i_size, blkbits);
+
+	first_block = (offset + blocksize - 1) >> blkbits;
+	stop_block = end >> blkbits;
+
+	/* zero the partial blocks at either end */
+	handle = ext4_journal_start(inode, ext4_writepage_trans_blocks(inode));
+	if (IS_ERR(handle)) {
+		err = PTR_ERR(handle);
+		goto out_mutex;
+	}
+	if (offset & (blocksize - 1))
+		err = ext4_block_zero_page_range(handle, mapping, offset,
+						 end - offset);
+	if (!err && (end & (blocksize - 1)) &&
+	    (end >> blkbits) != (offset >> blkbits))
+		err = ext4_block_zero_page_range(handle, mapping,
+						 end & ~(blocksize - 1),
+						 end & (blocksize - 1));
+	err2 = ext4_journal_stop(handle);
+	if (!err)
+		err = err2;
+	if (err)
+		goto out_mutex;
+
+	/*
+	 * Get the range out of the page cache.  Whatever is dirty there,
+	 * delayed allocations and the zeroed partial blocks included, is
+	 * written first: pages straddling the hole are dropped whole and
+	 * their buffers must not be left mapped to blocks we free.
+	 */
+	first_page = offset & PAGE_CACHE_MASK;
+	last_page = PAGE_CACHE_ALIGN(end);
+	unmap_mapping_range(mapping, first_page, last_page - first_page, 1);
+	err = filemap_write_and_wait_range(mapping, first_page, last_page - 1);
+	if (err)
+		goto out_mutex;
+	truncate_inode_pages_range(mapping, first_page, last_page - 1);
+
+	if (first_block >= stop_block)
+		goto out_mutex;
+
+	handle = ext4_journal_start(inode,
+			2 * ext4_ext_calc_credits_for_single_extent(inode, 1,
+								    NULL));
+	if (IS_ERR(handle)) {
+		err = PTR_ERR(handle);
+		goto out_mutex;
+	}
+
+	down_write(&EXT4_I(inode)->i_data_sem);
+	ext4_ext_invalidate_cache(inode);
+	ext4_discard_preallocations(inode);
+
+	err = ext4_ext_split_at(handle, inode, first_block);
+	if (!err)
+		err = ext4_ext_split_at(handle, inode, stop_block);
+	if (!err)
+		err = ext4_ext_remove_space(inode, first_block,
+					    stop_block - 1);
+
+	ext4_ext_invalidate_cache(inode);
+	up_write(&EXT4_I(inode)->i_data_sem);
+
+	inode->i_mtime = inode->i_ctime = ext4_current_time(inode);
+	ext4_mark_inode_dirty(handle, inode);
+	if (IS_SYNC(inode))
+		ext4_handle_sync(handle);
+	err2 = ext4_journal_stop(handle);
+	if (!err)
+		err = err2;
+out_mutex:
+	mutex_unlock(&inode->i_mutex);
+	return err;
+}
+
 /*
  * preallocate space for a file. This implements ext4's fallocate inode
  * operation, which gets called from sys_fallocate system call.
@@ -3633,6 +3848,12 @@ long ext4_fallocate(struct inode *inode, int mode, loff_t offset, loff_t len)
 	if (S_ISDIR(inode->i_mode))
 		return -ENODEV;
 
+	if (mode & ~(FALLOC_FL_KEEP_SIZE | FALLOC_FL_PUNCH_HOLE))
+		return -EOPNOTSUPP;
+
+	if (mode & FALLOC_FL_PUNCH_HOLE)
+		return ext4_ext_punch_hole(inode, offset, len);
+
 	map.m_lblk = offset >> blkbits;
 	/*
 	 * We can't just convert len to max_blocks because
@@ -3695,6 +3916,112 @@ retry:
 	return ret > 0 ? ret2 : ret;
 }
 
+/*
+ * Find the extent covering @lblk, or the first one after it.  Returns 1
+ * and the extent in [*start, *end) if there is one, 0 if there is no
+ * data at or beyond @lblk, or an error.
+ */
+static int ext4_ext_next_data(struct inode *inode, ext4_lblk_t lblk,
+			      ext4_lblk_t *start, ext4_lblk_t *end)
+{
+	struct ext4_ext_path *path;
+	struct ext4_extent *ex;
+	ext4_lblk_t next;
+	int ret;
+
+	down_read(&EXT4_I(inode)->i_data_sem);
+	for (;;) {
+		path = ext4_ext_find_extent(inode, lblk, NULL);
+		if (IS_ERR(path)) {
+			ret = PTR_ERR(path);
+			break;
+		}
+
+		ret = 0;
+		next = EXT_MAX_BLOCK;
+		ex = path[ext_depth(inode)].p_ext;
+		if (ex && le32_to_cpu(ex->ee_block) +
+			  ext4_ext_get_actual_len(ex) > lblk) {
+			*start = le32_to_cpu(ex->ee_block);
+			*end = *start + ext4_ext_get_actual_len(ex);
+			ret = 1;
+		} else {
+			next = ext4_ext_next_allocated_block(path);
+		}
+		ext4_ext_drop_refs(path);
+		kfree(path);
+
+		if (ret || next == EXT_MAX_BLOCK || next <= lblk)
+			break;
+		lblk = next;
+	}
+	up_read(&EXT4_I(inode)->i_data_sem);
+
+	return ret;
+}
+
+/*
+ * ext4_ext_seek_data_hole() implements SEEK_DATA and SEEK_HOLE for
+ * extent mapped files.  Data is what the extent tree maps, unwritten
+ * extents included, plus whatever is in the page cache, which covers
+ * delayed allocations.  Called with i_mutex held.
+ */
+loff_t ext4_ext_seek_data_hole(struct inode *inode, loff_t offset,
+			       int origin)
+{
+	struct address_space *mapping = inode->i_mapping;
+	unsigned int blkbits = inode->i_blkbits;
+	loff_t isize = i_size_read(inode);
+	ext4_lblk_t start = 0, end = 0;
+	pgoff_t index, next;
+	struct page *page;
+	loff_t data;
+	int ret;
+
+	if (offset < 0 || offset >= isize)
+		return -ENXIO;
+
+	for (;;) {
+		/* the first extent at or after offset */
+		ret = ext4_ext_next_data(inode, offset >> blkbits,
+					 &start, &end);
+		if (ret < 0)
+			return ret;
+		data = ret ? max_t(loff_t, offset, (loff_t)start << blkbits)
+			   : isize;
+
+		/* the first cached page at or after offset */
+		index = offset >> PAGE_CACHE_SHIFT;
+		if (find_get_pages(mapping, index, 1, &page)) {
+			index = page->index;
+			page_cache_release(page);
+			data = min_t(loff_t, data, max_t(loff_t, offset,
+				     (loff_t)index << PAGE_CACHE_SHIFT));
+		}
+
+		if (origin == SEEK_DATA)
+			return data < isize ? data : -ENXIO;
+
+		/* SEEK_HOLE: done unless offset is in data */
+		if (data > offset)
+			return offset;
+
+		/* skip to the end of the data at offset */
+		if (ret && ((loff_t)start << blkbits) <= offset)
+			offset = (loff_t)end << blkbits;
+		rcu_read_lock();
+		next = radix_tree_next_hole(&mapping->page_tree,
+					    offset >> PAGE_CACHE_SHIFT,
+					    ULONG_MAX);
+		rcu_read_unlock();
+		if (next > (offset >> PAGE_CACHE_SHIFT))
+			offset = (loff_t)next << PAGE_CACHE_SHIFT;
+
+		if (offset >= isize)
+			return isize;
+	}
+}
+
 /*
  * This function convert a range of blocks to written extents
  * The caller of this function will pass the start offset and the size.
@@ -133,7 +133,8 @@ static int ext4_file_open(struct inode * inode, struct file * filp)
 /*
  * ext4_llseek() copied from generic_file_llseek() to handle both
  * block-mapped and extent-mapped maxbytes values. This should
- * otherwise be identical with generic_file_llseek().
+ * otherwise be identical with generic_file_llseek(), except that
+ * SEEK_DATA and SEEK_HOLE look at the extent tree.
  */
 loff_t ext4_llseek(struct file *file, loff_t offset, int origin)
 {
@@ -156,6 +157,22 @@ loff_t ext4_llseek(struct file *file, loff_t offset, int origin)
 		}
 		offset += file->f_pos;
 		break;
+	case SEEK_DATA:
+	case SEEK_HOLE:
+		if (ext4_test_inode_flag(inode, EXT4_INODE_EXTENTS)) {
+			offset = ext4_ext_seek_data_hole(inode, offset,
+							 origin);
+		} else if (offset < 0 || offset >= inode->i_size) {
+			/* block-mapped files are all data, see generic */
+			offset = -ENXIO;
+		} else if (origin == SEEK_HOLE) {
+			offset = inode->i_size;
+		}
+		if (offset < 0) {
+			mutex_unlock(&inode->i_mutex);
+			return offset;
+		}
+		break;
 	}
 
 	if (offset < 0 || offset > maxbytes) {
@@ -3970,10 +3970,24 @@ void ext4_set_aops(struct inode *inode)
  */
 int ext4_block_truncate_page(handle_t *handle,
 		struct address_space *mapping, loff_t from)
+{
+	unsigned blocksize = mapping->host->i_sb->s_blocksize;
+
+	return ext4_block_zero_page_range(handle, mapping, from,
+					  blocksize - (from & (blocksize - 1)));
+}
+
+/*
+ * ext4_block_zero_page_range() zeroes out a mapping of `length' bytes
+ * from file offset `from', clamped to the end of the block containing
+ * `from'.  Used by truncate and hole punching for partial blocks.
+ */
+int ext4_block_zero_page_range(handle_t *handle,
+		struct address_space *mapping, loff_t from, loff_t length)
 {
 	ext4_fsblk_t index = from >> PAGE_CACHE_SHIFT;
 	unsigned offset = from & (PAGE_CACHE_SIZE-1);
-	unsigned blocksize, length, pos;
+	unsigned blocksize, max, pos;
 	ext4_lblk_t iblock;
 	struct inode *inode = mapping->host;
 	struct buffer_head *bh;
@@ -3986,7 +4000,9 @@ int ext4_block_truncate_page(handle_t *handle,
 		return -EINVAL;
 
 	blocksize = inode->i_sb->s_blocksize;
-	length = blocksize - (offset & (blocksize - 1));
+	max = blocksize - (offset & (blocksize - 1));
+	if (length > max)
+		length = max;
 	iblock = index << (PAGE_CACHE_SHIFT - inode->i_sb->s_blocksize_bits);
 
 	if (!page_has_buffers(page))
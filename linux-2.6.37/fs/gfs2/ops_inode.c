@@ -1437,6 +1437,10 @@ static long gfs2_fallocate(struct inode *inode, int mode, loff_t offset,
 	struct gfs2_alloc *al;
 	int error;
 	loff_t next = (offset + len - 1) >> sdp->sd_sb.sb_bsize_shift;
+
+	if (mode & ~FALLOC_FL_KEEP_SIZE)
+		return -EOPNOTSUPP;
+
 	next = (next + 1) << sdp->sd_sb.sb_bsize_shift;
 
 	offset = (offset >> sdp->sd_sb.sb_bsize_shift) <<
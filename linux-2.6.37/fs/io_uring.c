@@ -0,0 +1,1224 @@
+/*
+ * Shared application/kernel submission and completion ring pairs, for
+ * supporting fast/efficient IO.
+ *
+ * An io_uring instance consists of a submission queue (SQ) ring and a
+ * completion queue (CQ) ring, both mapped into the application with mmap()
+ * on the io_uring file descriptor. The application fills in sqes and
+ * moves the SQ tail, the kernel consumes them on io_uring_enter() and
+ * moves the SQ head. Completions are posted to the CQ ring, where the
+ * application can reap them without entering the kernel at all; the
+ * kernel updates the CQ tail, the application the CQ head.
+ *
+ * Ordering: when the application reads the CQ ring tail, it must use an
+ * appropriate smp_rmb() to pair with the smp_wmb() the kernel uses before
+ * writing the tail, and it must do a full barrier before updating the CQ
+ * head. On the SQ side, the application fills in the sqe and the array
+ * entry, then does an smp_wmb() before updating the SQ tail.
+ *
+ * Files and buffers can be registered with io_uring_register(), which
+ * saves the fget()/fput() of every request on fixed files and the page
+ * table walk and page pinning of every direct I/O on fixed buffers.
+ *
+ * Direct I/O is issued inline and completes asynchronously through the
+ * usual ->aio_read()/->aio_write() methods. Everything that could block
+ * (buffered reads that miss the page cache, buffered writes, fsync) is
+ * handed off to a per-ring pool of worker threads, which run on behalf of
+ * the mm of the task that set up the ring.
+ */
+#include <linux/kernel.h>
+#include <linux/init.h>
+#include <linux/errno.h>
+#include <linux/syscalls.h>
+#include <linux/compat.h>
+#include <linux/fs.h>
+#include <linux/file.h>
+#include <linux/aio.h>
+#include <linux/mm.h>
+#include <linux/mman.h>
+#include <linux/mmu_context.h>
+#include <linux/pagemap.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/poll.h>
+#include <linux/sched.h>
+#include <linux/workqueue.h>
+#include <linux/anon_inodes.h>
+#include <linux/log2.h>
+#include <linux/uio.h>
+#include <linux/io_uring.h>
+
+#include <asm/uaccess.h>
+
+#include "read_write.h"
+
+#define IORING_MAX_ENTRIES	4096
+#define IORING_MAX_FIXED_FILES	1024
+
+struct io_uring {
+	u32 head ____cacheline_aligned_in_smp;
+	u32 tail ____cacheline_aligned_in_smp;
+};
+
+struct io_sq_ring {
+	struct io_uring		r;
+	u32			ring_mask;
+	u32			ring_entries;
+	u32			dropped;
+	u32			flags;
+	u32			array[0];
+};
+
+struct io_cq_ring {
+	struct io_uring		r;
+	u32			ring_mask;
+	u32			ring_entries;
+	u32			overflow;
+	struct io_uring_cqe	cqes[0] ____cacheline_aligned_in_smp;
+};
+
+/* a registered buffer, pinned for the lifetime of the registration */
+struct io_mapped_ubuf {
+	u64		ubuf;
+	size_t		len;
+	struct page	**pages;
+	unsigned int	nr_pages;
+};
+
+struct io_ring_ctx {
+	struct {
+		/* consumed by the submission side, under uring_lock */
+		struct io_sq_ring	*sq_ring;
+		unsigned		cached_sq_head;
+		unsigned		sq_entries;
+		unsigned		sq_mask;
+		struct io_uring_sqe	*sq_sqes;
+	} ____cacheline_aligned_in_smp;
+
+	struct {
+		/* filled by completions, under completion_lock */
+		struct io_cq_ring	*cq_ring;
+		unsigned		cached_cq_tail;
+		unsigned		cq_entries;
+		unsigned		cq_mask;
+		spinlock_t		completion_lock;
+		wait_queue_head_t	cq_wait;
+	} ____cacheline_aligned_in_smp;
+
+	/* requests that have not been completed and freed yet */
+	atomic_t		inflight;
+	wait_queue_head_t	inflight_wait;
+
+	/* serializes submission and (un)registration */
+	struct mutex		uring_lock;
+
+	struct mm_struct	*sqo_mm;
+	struct workqueue_struct	*sqo_wq;
+
+	struct file		**user_files;
+	unsigned		nr_user_files;
+
+	struct io_mapped_ubuf	*user_bufs;
+	unsigned		nr_user_bufs;
+
+	int			compat;
+};
+
+#define REQ_F_FIXED_FILE	1	/* ctx owns file */
+#define REQ_F_IOVEC		2	/* iov was allocated */
+
+struct io_kiocb {
+	struct kiocb		rw;
+	struct io_ring_ctx	*ctx;
+	struct file		*file;
+	unsigned		flags;
+	struct work_struct	work;
+
+	/* private copy of the sqe, the application may reuse the slot */
+	struct io_uring_sqe	sqe;
+
+	struct iovec		*iov;
+	unsigned long		nr_segs;
+	size_t			len;
+	struct iovec		fast_iov[UIO_FASTIOV];
+};
+
+static struct kmem_cache *req_cachep;
+
+static const struct file_operations io_uring_fops;
+
+static void io_cqring_add_event(struct io_ring_ctx *ctx, u64 user_data,
+				long res)
+{
+	struct io_cq_ring *ring = ctx->cq_ring;
+	struct io_uring_cqe *cqe;
+	unsigned long flags;
+	unsigned tail;
+
+	spin_lock_irqsave(&ctx->completion_lock, flags);
+	tail = ctx->cached_cq_tail;
+	/* pairs with the application's barrier before it moves the head */
+	smp_rmb();
+	if (tail - ACCESS_ONCE(ring->r.head) == ring->ring_entries) {
+		/*
+		 * The application is not reaping completions fast enough,
+		 * the event is lost. Let it know how many.
+		 */
+		ring->overflow++;
+	} else {
+		cqe = &ring->cqes[tail & ctx->cq_mask];
+		cqe->user_data = user_data;
+		cqe->res = res;
+		cqe->flags = 0;
+		ctx->cached_cq_tail++;
+		/* order the cqe store before the tail update */
+		smp_wmb();
+		ring->r.tail = ctx->cached_cq_tail;
+	}
+	spin_unlock_irqrestore(&ctx->completion_lock, flags);
+
+	smp_mb();
+	if (waitqueue_active(&ctx->cq_wait))
+		wake_up(&ctx->cq_wait);
+}
+
+static struct io_kiocb *io_get_req(struct io_ring_ctx *ctx)
+{
+	struct io_kiocb *req;
+
+	req = kmem_cache_alloc(req_cachep, GFP_KERNEL);
+	if (!req)
+		return NULL;
+	req->ctx = ctx;
+	req->file = NULL;
+	req->flags = 0;
+	req->iov = NULL;
+	return req;
+}
+
+static void io_free_req(struct io_kiocb *req)
+{
+	struct io_ring_ctx *ctx = req->ctx;
+	unsigned long flags;
+
+	if (req->flags & REQ_F_IOVEC)
+		kfree(req->iov);
+	kmem_cache_free(req_cachep, req);
+
+	/*
+	 * Teardown frees the ctx as soon as it sees inflight drop to zero
+	 * and can take completion_lock, so the wakeup must be done under
+	 * the lock.
+	 */
+	spin_lock_irqsave(&ctx->completion_lock, flags);
+	if (atomic_dec_and_test(&ctx->inflight))
+		wake_up(&ctx->inflight_wait);
+	spin_unlock_irqrestore(&ctx->completion_lock, flags);
+}
+
+static void io_fput_work(struct work_struct *work)
+{
+	struct io_kiocb *req = container_of(work, struct io_kiocb, work);
+
+	fput(req->file);
+	io_free_req(req);
+}
+
+/*
+ * Drop the request and its file reference. Completions of direct I/O
+ * come in from interrupt context, where the final fput() can't be done;
+ * that is left to a workqueue the same way fs/aio.c does it.
+ */
+static void io_put_req(struct io_kiocb *req)
+{
+	if (req->file && !(req->flags & REQ_F_FIXED_FILE)) {
+		if (unlikely(!fput_atomic(req->file))) {
+			INIT_WORK(&req->work, io_fput_work);
+			schedule_work(&req->work);
+			return;
+		}
+	}
+	io_free_req(req);
+}
+
+static void io_complete_rw(struct kiocb *kiocb, long res, long res2)
+{
+	struct io_kiocb *req = container_of(kiocb, struct io_kiocb, rw);
+
+	io_cqring_add_event(req->ctx, req->sqe.user_data, res);
+	io_put_req(req);
+}
+
+static int io_import_fixed(struct io_ring_ctx *ctx, struct io_kiocb *req)
+{
+	const struct io_uring_sqe *sqe = &req->sqe;
+	struct io_mapped_ubuf *imu;
+	u64 buf_addr;
+	size_t len = sqe->len;
+	unsigned index;
+
+	if (unlikely(!ctx->user_bufs))
+		return -EFAULT;
+	index = sqe->buf_index;
+	if (unlikely(index >= ctx->nr_user_bufs))
+		return -EFAULT;
+
+	imu = &ctx->user_bufs[index];
+	buf_addr = sqe->addr;
+
+	/* overflow and range checks: the whole I/O must be in the buffer */
+	if (buf_addr + len < buf_addr)
+		return -EFAULT;
+	if (buf_addr < imu->ubuf || buf_addr + len > imu->ubuf + imu->len)
+		return -EFAULT;
+
+	req->fast_iov[0].iov_base = (void __user *)(unsigned long)buf_addr;
+	req->fast_iov[0].iov_len = len;
+	req->iov = req->fast_iov;
+	req->nr_segs = 1;
+	req->len = len;
+
+	req->rw.ki_pages = imu->pages;
+	req->rw.ki_pages_addr = imu->ubuf & PAGE_MASK;
+	return 0;
+}
+
+static int io_import_iovec(struct io_ring_ctx *ctx, int rw,
+			   struct io_kiocb *req)
+{
+	const struct io_uring_sqe *sqe = &req->sqe;
+	ssize_t ret;
+
+#ifdef CONFIG_COMPAT
+	if (ctx->compat)
+		ret = compat_rw_copy_check_uvector(rw,
+				(struct compat_iovec __user *)(unsigned long)sqe->addr,
+				sqe->len, UIO_FASTIOV, req->fast_iov, &req->iov);
+	else
+#endif
+		ret = rw_copy_check_uvector(rw,
+				(struct iovec __user *)(unsigned long)sqe->addr,
+				sqe->len, UIO_FASTIOV, req->fast_iov, &req->iov);
+	if (ret < 0) {
+		if (req->iov != req->fast_iov)
+			kfree(req->iov);
+		req->iov = NULL;
+		return ret;
+	}
+	if (req->iov != req->fast_iov)
+		req->flags |= REQ_F_IOVEC;
+	req->nr_segs = sqe->len;
+	req->len = ret;
+	return 0;
+}
+
+static int io_prep_rw(struct io_ring_ctx *ctx, struct io_kiocb *req, int rw)
+{
+	const struct io_uring_sqe *sqe = &req->sqe;
+	struct file *file = req->file;
+	struct kiocb *kiocb = &req->rw;
+	umode_t mode = file->f_mapping->host->i_mode;
+	loff_t pos = sqe->off;
+	int ret;
+
+	if (!(file->f_mode & (rw == READ ? FMODE_READ : FMODE_WRITE)))
+		return -EBADF;
+	/*
+	 * Only regular files and block devices: I/O on anything else may
+	 * block indefinitely, and a ring can't be torn down while requests
+	 * are still in flight.
+	 */
+	if (!S_ISREG(mode) && !S_ISBLK(mode))
+		return -EOPNOTSUPP;
+	if (rw == READ ? !file->f_op->aio_read : !file->f_op->aio_write)
+		return -EINVAL;
+
+	kiocb->ki_flags = 0;
+	kiocb->ki_users = 1;
+	kiocb->ki_key = 0;
+	kiocb->ki_filp = file;
+	kiocb->ki_ctx = NULL;
+	kiocb->ki_cancel = NULL;
+	kiocb->ki_retry = NULL;
+	kiocb->ki_dtor = NULL;
+	kiocb->ki_obj.user = NULL;
+	kiocb->ki_user_data = sqe->user_data;
+	kiocb->ki_pos = pos;
+	kiocb->private = NULL;
+	kiocb->ki_iovec = NULL;
+	INIT_LIST_HEAD(&kiocb->ki_run_list);
+	kiocb->ki_eventfd = NULL;
+	kiocb->ki_complete = io_complete_rw;
+	kiocb->ki_pages = NULL;
+
+	if (sqe->opcode == IORING_OP_READ_FIXED ||
+	    sqe->opcode == IORING_OP_WRITE_FIXED)
+		ret = io_import_fixed(ctx, req);
+	else
+		ret = io_import_iovec(ctx, rw, req);
+	if (ret)
+		return ret;
+
+	ret = rw_verify_area(rw, file, &pos, req->len);
+	if (ret < 0)
+		return ret;
+
+	kiocb->ki_nbytes = req->len;
+	kiocb->ki_left = req->len;
+	kiocb->ki_iovec = req->iov;
+	kiocb->ki_nr_segs = req->nr_segs;
+	kiocb->ki_cur_seg = 0;
+	return 0;
+}
+
+/*
+ * Would a buffered read of this range be satisfied from the page cache
+ * without waiting for I/O?
+ */
+static bool io_range_cached(struct file *file, loff_t pos, size_t len)
+{
+	struct address_space *mapping = file->f_mapping;
+	pgoff_t index, end;
+	struct page *page;
+	bool uptodate;
+
+	if (!len)
+		return true;
+
+	index = pos >> PAGE_CACHE_SHIFT;
+	end = (pos + len - 1) >> PAGE_CACHE_SHIFT;
+	for (; index <= end; index++) {
+		page = find_get_page(mapping, index);
+		if (!page)
+			return false;
+		uptodate = PageUptodate(page);
+		page_cache_release(page);
+		if (!uptodate)
+			return false;
+	}
+	return true;
+}
+
+static ssize_t io_do_sync_rw(struct io_kiocb *req, int rw)
+{
+	struct file *file = req->file;
+	loff_t pos = req->sqe.off;
+	ssize_t ret;
+
+	if (rw == READ)
+		ret = do_sync_readv_writev(file, req->iov, req->nr_segs,
+					   req->len, &pos, file->f_op->aio_read);
+	else
+		ret = do_sync_readv_writev(file, req->iov, req->nr_segs,
+					   req->len, &pos, file->f_op->aio_write);
+	if (ret == -ERESTARTSYS || ret == -ERESTARTNOINTR ||
+	    ret == -ERESTARTNOHAND || ret == -ERESTART_RESTARTBLOCK)
+		ret = -EINTR;
+	return ret;
+}
+
+static int io_do_fsync(struct io_kiocb *req)
+{
+	const struct io_uring_sqe *sqe = &req->sqe;
+	loff_t end = sqe->off + sqe->len - 1;
+
+	if (!sqe->len || end < sqe->off)
+		end = LLONG_MAX;
+	return vfs_fsync_range(req->file, sqe->off, end,
+			       sqe->op_flags & IORING_FSYNC_DATASYNC);
+}
+
+/*
+ * Worker side of a punted request. Reads and writes touch the user
+ * buffers of the task that set up the ring, so borrow its mm as long as
+ * it is still alive.
+ */
+static void io_sq_wq_submit_work(struct work_struct *work)
+{
+	struct io_kiocb *req = container_of(work, struct io_kiocb, work);
+	struct io_ring_ctx *ctx = req->ctx;
+	struct mm_struct *mm = ctx->sqo_mm;
+	long ret;
+
+	switch (req->sqe.opcode) {
+	case IORING_OP_FSYNC:
+		ret = io_do_fsync(req);
+		break;
+	default:
+		if (!atomic_inc_not_zero(&mm->mm_users)) {
+			ret = -EFAULT;
+			break;
+		}
+		use_mm(mm);
+		if (req->sqe.opcode == IORING_OP_READV ||
+		    req->sqe.opcode == IORING_OP_READ_FIXED)
+			ret = io_do_sync_rw(req, READ);
+		else
+			ret = io_do_sync_rw(req, WRITE);
+		unuse_mm(mm);
+		mmput(mm);
+		break;
+	}
+
+	io_cqring_add_event(ctx, req->sqe.user_data, ret);
+	io_put_req(req);
+}
+
+static void io_punt_req(struct io_ring_ctx *ctx, struct io_kiocb *req)
+{
+	INIT_WORK(&req->work, io_sq_wq_submit_work);
+	queue_work(ctx->sqo_wq, &req->work);
+}
+
+static int io_rw(struct io_ring_ctx *ctx, struct io_kiocb *req, int rw)
+{
+	struct file *file = req->file;
+	struct kiocb *kiocb = &req->rw;
+	ssize_t ret;
+
+	ret = io_prep_rw(ctx, req, rw);
+	if (ret)
+		return ret;
+
+	if (!(file->f_flags & O_DIRECT)) {
+		/*
+		 * Buffered I/O: a read that hits the page cache completes
+		 * right away, everything else may block and is done by the
+		 * workers.
+		 */
+		if (rw == READ && io_range_cached(file, kiocb->ki_pos,
+						  req->len)) {
+			ret = io_do_sync_rw(req, READ);
+			io_cqring_add_event(ctx, req->sqe.user_data, ret);
+			io_put_req(req);
+		} else {
+			io_punt_req(ctx, req);
+		}
+		return 0;
+	}
+
+	if (rw == READ)
+		ret = file->f_op->aio_read(kiocb, req->iov, req->nr_segs,
+					   kiocb->ki_pos);
+	else
+		ret = file->f_op->aio_write(kiocb, req->iov, req->nr_segs,
+					    kiocb->ki_pos);
+	if (ret != -EIOCBQUEUED) {
+		if (ret == -ERESTARTSYS || ret == -ERESTARTNOINTR ||
+		    ret == -ERESTARTNOHAND || ret == -ERESTART_RESTARTBLOCK)
+			ret = -EINTR;
+		io_complete_rw(kiocb, ret, 0);
+	}
+	return 0;
+}
+
+/*
+ * Start one request. On error the request has not been issued and the
+ * caller posts the error to the CQ ring; once issued, the request owns
+ * itself and posts its own completion.
+ */
+static int io_submit_sqe(struct io_ring_ctx *ctx, struct io_kiocb *req)
+{
+	const struct io_uring_sqe *sqe = &req->sqe;
+	int fd = sqe->fd;
+
+	if (unlikely(sqe->flags & ~IOSQE_FIXED_FILE))
+		return -EINVAL;
+
+	if (sqe->opcode == IORING_OP_NOP) {
+		io_cqring_add_event(ctx, sqe->user_data, 0);
+		io_put_req(req);
+		return 0;
+	}
+
+	if (sqe->flags & IOSQE_FIXED_FILE) {
+		if (unlikely(!ctx->user_files || fd < 0 ||
+			     fd >= ctx->nr_user_files))
+			return -EBADF;
+		req->file = ctx->user_files[fd];
+		req->flags |= REQ_F_FIXED_FILE;
+	} else {
+		req->file = fget(fd);
+		if (unlikely(!req->file))
+			return -EBADF;
+	}
+
+	switch (sqe->opcode) {
+	case IORING_OP_READV:
+	case IORING_OP_READ_FIXED:
+		return io_rw(ctx, req, READ);
+	case IORING_OP_WRITEV:
+	case IORING_OP_WRITE_FIXED:
+		return io_rw(ctx, req, WRITE);
+	case IORING_OP_FSYNC:
+		if (unlikely(sqe->op_flags & ~IORING_FSYNC_DATASYNC))
+			return -EINVAL;
+		io_punt_req(ctx, req);
+		return 0;
+	}
+	return -EINVAL;
+}
+
+static const struct io_uring_sqe *io_get_sqring(struct io_ring_ctx *ctx)
+{
+	struct io_sq_ring *ring = ctx->sq_ring;
+	unsigned head;
+
+	/*
+	 * The cached sq head (or cq tail) serves two purposes:
+	 *
+	 * 1) allows us to batch the cost of updating the user visible
+	 *    head updates.
+	 * 2) allows the kernel side to track the head on its own, even
+	 *    though the application is the one updating it.
+	 */
+	head = ctx->cached_sq_head;
+	while (head != ACCESS_ONCE(ring->r.tail)) {
+		unsigned index;
+
+		/* pairs with the application's smp_wmb() before the tail */
+		smp_rmb();
+		index = ACCESS_ONCE(ring->array[head & ctx->sq_mask]);
+		ctx->cached_sq_head = ++head;
+		if (likely(index < ctx->sq_entries))
+			return &ctx->sq_sqes[index];
+
+		/* drop invalid entries */
+		ring->dropped++;
+	}
+	return NULL;
+}
+
+static void io_commit_sqring(struct io_ring_ctx *ctx)
+{
+	struct io_sq_ring *ring = ctx->sq_ring;
+
+	if (ring->r.head != ctx->cached_sq_head) {
+		/*
+		 * The sqes have been copied, make sure we're done with
+		 * them before the application can reuse the slots.
+		 */
+		smp_mb();
+		ring->r.head = ctx->cached_sq_head;
+	}
+}
+
+static int io_submit_sqes(struct io_ring_ctx *ctx, unsigned to_submit)
+{
+	const struct io_uring_sqe *sqe;
+	struct io_kiocb *req;
+	int submitted = 0;
+	int ret;
+
+	while (submitted < to_submit) {
+		/*
+		 * Don't let more requests in flight than there is room
+		 * for completions in the CQ ring.
+		 */
+		if (atomic_read(&ctx->inflight) >= ctx->cq_entries) {
+			if (!submitted)
+				submitted = -EBUSY;
+			break;
+		}
+
+		req = io_get_req(ctx);
+		if (unlikely(!req)) {
+			if (!submitted)
+				submitted = -EAGAIN;
+			break;
+		}
+
+		sqe = io_get_sqring(ctx);
+		if (!sqe) {
+			kmem_cache_free(req_cachep, req);
+			break;
+		}
+		memcpy(&req->sqe, sqe, sizeof(req->sqe));
+
+		atomic_inc(&ctx->inflight);
+		ret = io_submit_sqe(ctx, req);
+		if (ret) {
+			io_cqring_add_event(ctx, req->sqe.user_data, ret);
+			io_put_req(req);
+		}
+		submitted++;
+	}
+	io_commit_sqring(ctx);
+
+	return submitted;
+}
+
+static unsigned io_cqring_events(struct io_ring_ctx *ctx)
+{
+	struct io_cq_ring *ring = ctx->cq_ring;
+
+	/* see the pairing comment in io_cqring_add_event() */
+	smp_rmb();
+	return ACCESS_ONCE(ring->r.tail) - ACCESS_ONCE(ring->r.head);
+}
+
+/*
+ * Wait until events become available, if we don't already have some. The
+ * application must reap them itself, as they reside on the shared cq ring.
+ */
+static int io_cqring_wait(struct io_ring_ctx *ctx, unsigned min_events)
+{
+	int ret;
+
+	if (io_cqring_events(ctx) >= min_events)
+		return 0;
+
+	ret = wait_event_interruptible(ctx->cq_wait,
+				       io_cqring_events(ctx) >= min_events);
+	return ret ? -EINTR : 0;
+}
+
+static void io_sqe_files_unregister(struct io_ring_ctx *ctx)
+{
+	unsigned i;
+
+	for (i = 0; i < ctx->nr_user_files; i++)
+		fput(ctx->user_files[i]);
+	kfree(ctx->user_files);
+	ctx->user_files = NULL;
+	ctx->nr_user_files = 0;
+}
+
+static int io_sqe_files_register(struct io_ring_ctx *ctx, void __user *arg,
+				 unsigned nr_args)
+{
+	__s32 __user *fds = arg;
+	unsigned i;
+	int ret = 0;
+
+	if (ctx->user_files)
+		return -EBUSY;
+	if (!nr_args || nr_args > IORING_MAX_FIXED_FILES)
+		return -EINVAL;
+
+	ctx->user_files = kcalloc(nr_args, sizeof(struct file *), GFP_KERNEL);
+	if (!ctx->user_files)
+		return -ENOMEM;
+
+	for (i = 0; i < nr_args; i++) {
+		__s32 fd;
+
+		ret = -EFAULT;
+		if (get_user(fd, &fds[i]))
+			break;
+		ret = -EBADF;
+		ctx->user_files[i] = fget(fd);
+		if (!ctx->user_files[i])
+			break;
+		/*
+		 * Don't allow io_uring instances to be registered, that
+		 * would be a reference cycle nothing could break.
+		 */
+		if (ctx->user_files[i]->f_op == &io_uring_fops) {
+			fput(ctx->user_files[i]);
+			break;
+		}
+		ctx->nr_user_files++;
+		ret = 0;
+	}
+
+	if (ret)
+		io_sqe_files_unregister(ctx);
+	return ret;
+}
+
+static void io_pages_free(struct page **pages)
+{
+	if (is_vmalloc_addr(pages))
+		vfree(pages);
+	else
+		kfree(pages);
+}
+
+static void io_sqe_buffer_unregister(struct io_ring_ctx *ctx)
+{
+	struct mm_struct *mm = ctx->sqo_mm;
+	unsigned long unpinned = 0;
+	unsigned i, j;
+
+	if (!ctx->user_bufs)
+		return;
+
+	for (i = 0; i < ctx->nr_user_bufs; i++) {
+		struct io_mapped_ubuf *imu = &ctx->user_bufs[i];
+
+		for (j = 0; j < imu->nr_pages; j++)
+			put_page(imu->pages[j]);
+		io_pages_free(imu->pages);
+		unpinned += imu->nr_pages;
+	}
+
+	down_write(&mm->mmap_sem);
+	mm->locked_vm -= unpinned;
+	up_write(&mm->mmap_sem);
+
+	kfree(ctx->user_bufs);
+	ctx->user_bufs = NULL;
+	ctx->nr_user_bufs = 0;
+}
+
+static int io_copy_iov(struct io_ring_ctx *ctx, struct iovec *dst,
+		       void __user *arg, unsigned index)
+{
+	struct iovec __user *src;
+
+#ifdef CONFIG_COMPAT
+	if (ctx->compat) {
+		struct compat_iovec __user *ciovs = arg;
+		struct compat_iovec ciov;
+
+		if (copy_from_user(&ciov, &ciovs[index], sizeof(ciov)))
+			return -EFAULT;
+		dst->iov_base = compat_ptr(ciov.iov_base);
+		dst->iov_len = ciov.iov_len;
+		return 0;
+	}
+#endif
+	src = (struct iovec __user *)arg;
+	if (copy_from_user(dst, &src[index], sizeof(*dst)))
+		return -EFAULT;
+	return 0;
+}
+
+/*
+ * Pin the buffers for the lifetime of the registration. The pages are
+ * charged to RLIMIT_MEMLOCK like any other long term pin.
+ */
+static int io_sqe_buffer_register(struct io_ring_ctx *ctx, void __user *arg,
+				  unsigned nr_args)
+{
+	struct mm_struct *mm = current->mm;
+	unsigned long lock_limit;
+	unsigned i;
+	int ret;
+
+	if (ctx->user_bufs)
+		return -EBUSY;
+	if (!nr_args || nr_args > UIO_MAXIOV)
+		return -EINVAL;
+	if (mm != ctx->sqo_mm)
+		return -EPERM;
+
+	ctx->user_bufs = kcalloc(nr_args, sizeof(struct io_mapped_ubuf),
+				 GFP_KERNEL);
+	if (!ctx->user_bufs)
+		return -ENOMEM;
+
+	lock_limit = rlimit(RLIMIT_MEMLOCK) >> PAGE_SHIFT;
+
+	for (i = 0; i < nr_args; i++) {
+		struct io_mapped_ubuf *imu = &ctx->user_bufs[i];
+		unsigned long start, end, ubuf, nr_pages;
+		struct page **pages;
+		struct iovec iov;
+		size_t size;
+		int pret;
+
+		ret = io_copy_iov(ctx, &iov, arg, i);
+		if (ret)
+			break;
+
+		/* don't allow zero sized or huge buffers, 1G is plenty */
+		ret = -EFAULT;
+		if (!iov.iov_base || !iov.iov_len || iov.iov_len > (1UL << 30))
+			break;
+
+		ubuf = (unsigned long)iov.iov_base;
+		end = (ubuf + iov.iov_len + PAGE_SIZE - 1) >> PAGE_SHIFT;
+		start = ubuf >> PAGE_SHIFT;
+		nr_pages = end - start;
+
+		ret = -ENOMEM;
+		size = nr_pages * sizeof(struct page *);
+		if (size > PAGE_SIZE)
+			pages = vmalloc(size);
+		else
+			pages = kmalloc(size, GFP_KERNEL);
+		if (!pages)
+			break;
+
+		down_write(&mm->mmap_sem);
+		if (mm->locked_vm + nr_pages > lock_limit &&
+		    !capable(CAP_IPC_LOCK)) {
+			up_write(&mm->mmap_sem);
+			io_pages_free(pages);
+			break;
+		}
+		pret = get_user_pages(current, mm, ubuf & PAGE_MASK, nr_pages,
+				      1, 0, pages, NULL);
+		if (pret == nr_pages)
+			mm->locked_vm += nr_pages;
+		up_write(&mm->mmap_sem);
+
+		if (pret != nr_pages) {
+			int j;
+
+			for (j = 0; j < pret; j++)
+				put_page(pages[j]);
+			io_pages_free(pages);
+			ret = pret < 0 ? pret : -EFAULT;
+			break;
+		}
+
+		imu->ubuf = ubuf;
+		imu->len = iov.iov_len;
+		imu->pages = pages;
+		imu->nr_pages = nr_pages;
+		ctx->nr_user_bufs++;
+		ret = 0;
+	}
+
+	if (ret)
+		io_sqe_buffer_unregister(ctx);
+	return ret;
+}
+
+static void *io_mem_alloc(size_t size)
+{
+	gfp_t gfp = GFP_KERNEL | __GFP_ZERO | __GFP_NOWARN | __GFP_COMP;
+
+	return (void *)__get_free_pages(gfp, get_order(size));
+}
+
+static void io_mem_free(void *ptr)
+{
+	if (ptr)
+		put_page(virt_to_head_page(ptr));
+}
+
+static size_t io_sq_ring_size(unsigned entries)
+{
+	return sizeof(struct io_sq_ring) + entries * sizeof(u32);
+}
+
+static size_t io_cq_ring_size(unsigned entries)
+{
+	return sizeof(struct io_cq_ring) + entries * sizeof(struct io_uring_cqe);
+}
+
+static void io_ring_ctx_free(struct io_ring_ctx *ctx)
+{
+	if (ctx->sqo_wq)
+		destroy_workqueue(ctx->sqo_wq);
+	io_sqe_buffer_unregister(ctx);
+	io_sqe_files_unregister(ctx);
+	if (ctx->sqo_mm)
+		mmdrop(ctx->sqo_mm);
+	io_mem_free(ctx->sq_ring);
+	io_mem_free(ctx->sq_sqes);
+	io_mem_free(ctx->cq_ring);
+	kfree(ctx);
+}
+
+/*
+ * Wait for all issued requests to complete and to be freed. Called with
+ * uring_lock held, so nothing new can be submitted meanwhile.
+ */
+static void io_ring_ctx_quiesce(struct io_ring_ctx *ctx)
+{
+	wait_event(ctx->inflight_wait, !atomic_read(&ctx->inflight));
+
+	/* the last io_free_req() may still be inside the lock */
+	spin_lock_irq(&ctx->completion_lock);
+	spin_unlock_irq(&ctx->completion_lock);
+}
+
+static int io_uring_release(struct inode *inode, struct file *file)
+{
+	struct io_ring_ctx *ctx = file->private_data;
+
+	file->private_data = NULL;
+	mutex_lock(&ctx->uring_lock);
+	io_ring_ctx_quiesce(ctx);
+	mutex_unlock(&ctx->uring_lock);
+	io_ring_ctx_free(ctx);
+	return 0;
+}
+
+static unsigned int io_uring_poll(struct file *file, poll_table *wait)
+{
+	struct io_ring_ctx *ctx = file->private_data;
+	unsigned int mask = 0;
+
+	poll_wait(file, &ctx->cq_wait, wait);
+	smp_rmb();
+	if (ACCESS_ONCE(ctx->sq_ring->r.tail) - ctx->cached_sq_head !=
+	    ctx->sq_entries)
+		mask |= POLLOUT | POLLWRNORM;
+	if (ACCESS_ONCE(ctx->cq_ring->r.head) != ctx->cached_cq_tail)
+		mask |= POLLIN | POLLRDNORM;
+
+	return mask;
+}
+
+static int io_uring_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	loff_t offset = (loff_t) vma->vm_pgoff << PAGE_SHIFT;
+	unsigned long sz = vma->vm_end - vma->vm_start;
+	struct io_ring_ctx *ctx = file->private_data;
+	unsigned long pfn;
+	struct page *page;
+	void *ptr;
+
+	switch (offset) {
+	case IORING_OFF_SQ_RING:
+		ptr = ctx->sq_ring;
+		break;
+	case IORING_OFF_SQES:
+		ptr = ctx->sq_sqes;
+		break;
+	case IORING_OFF_CQ_RING:
+		ptr = ctx->cq_ring;
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	page = virt_to_head_page(ptr);
+	if (sz > (PAGE_SIZE << compound_order(page)))
+		return -EINVAL;
+
+	pfn = page_to_pfn(virt_to_page(ptr));
+	return remap_pfn_range(vma, vma->vm_start, pfn, sz, vma->vm_page_prot);
+}
+
+static const struct file_operations io_uring_fops = {
+	.release	= io_uring_release,
+	.mmap		= io_uring_mmap,
+	.poll		= io_uring_poll,
+	.llseek		= noop_llseek,
+};
+
+static struct io_ring_ctx *io_get_ctx(struct file *file)
+{
+	if (file->f_op != &io_uring_fops)
+		return NULL;
+	return file->private_data;
+}
+
+SYSCALL_DEFINE4(io_uring_enter, unsigned int, fd, u32, to_submit,
+		u32, min_complete, u32, flags)
+{
+	struct io_ring_ctx *ctx;
+	struct file *file;
+	long ret = -EBADF;
+	int submitted = 0;
+
+	if (flags & ~IORING_ENTER_GETEVENTS)
+		return -EINVAL;
+
+	file = fget(fd);
+	if (!file)
+		return -EBADF;
+
+	ret = -EOPNOTSUPP;
+	ctx = io_get_ctx(file);
+	if (!ctx)
+		goto out_fput;
+
+	ret = 0;
+	if (to_submit) {
+		to_submit = min(to_submit, ctx->sq_entries);
+
+		mutex_lock(&ctx->uring_lock);
+		submitted = io_submit_sqes(ctx, to_submit);
+		mutex_unlock(&ctx->uring_lock);
+
+		if (submitted < 0) {
+			ret = submitted;
+			goto out_fput;
+		}
+	}
+	if (flags & IORING_ENTER_GETEVENTS) {
+		min_complete = min(min_complete, ctx->cq_entries);
+		ret = io_cqring_wait(ctx, min_complete);
+	}
+
+out_fput:
+	fput(file);
+	return submitted ? submitted : ret;
+}
+
+static int io_allocate_rings(struct io_ring_ctx *ctx,
+			     struct io_uring_params *p)
+{
+	struct io_sq_ring *sq_ring;
+	struct io_cq_ring *cq_ring;
+
+	sq_ring = io_mem_alloc(io_sq_ring_size(p->sq_entries));
+	if (!sq_ring)
+		return -ENOMEM;
+	ctx->sq_ring = sq_ring;
+	sq_ring->ring_mask = p->sq_entries - 1;
+	sq_ring->ring_entries = p->sq_entries;
+	ctx->sq_mask = sq_ring->ring_mask;
+	ctx->sq_entries = sq_ring->ring_entries;
+
+	ctx->sq_sqes = io_mem_alloc(p->sq_entries *
+				    sizeof(struct io_uring_sqe));
+	if (!ctx->sq_sqes)
+		return -ENOMEM;
+
+	cq_ring = io_mem_alloc(io_cq_ring_size(p->cq_entries));
+	if (!cq_ring)
+		return -ENOMEM;
+	ctx->cq_ring = cq_ring;
+	cq_ring->ring_mask = p->cq_entries - 1;
+	cq_ring->ring_entries = p->cq_entries;
+	ctx->cq_mask = cq_ring->ring_mask;
+	ctx->cq_entries = cq_ring->ring_entries;
+	return 0;
+}
+
+SYSCALL_DEFINE2(io_uring_setup, u32, entries,
+		struct io_uring_params __user *, params)
+{
+	struct io_uring_params p;
+	struct io_ring_ctx *ctx;
+	int i, ret;
+
+	if (copy_from_user(&p, params, sizeof(p)))
+		return -EFAULT;
+	for (i = 0; i < ARRAY_SIZE(p.resv); i++)
+		if (p.resv[i])
+			return -EINVAL;
+	if (p.flags)
+		return -EINVAL;
+
+	/*
+	 * Use twice as many entries for the CQ ring. It's possible for the
+	 * application to drive a higher depth than the size of the SQ ring,
+	 * since the sqes are only used at submission time.
+	 */
+	if (!entries || entries > IORING_MAX_ENTRIES)
+		return -EINVAL;
+	entries = roundup_pow_of_two(entries);
+	p.sq_entries = entries;
+	p.cq_entries = 2 * entries;
+
+	ctx = kzalloc(sizeof(*ctx), GFP_KERNEL);
+	if (!ctx)
+		return -ENOMEM;
+	spin_lock_init(&ctx->completion_lock);
+	init_waitqueue_head(&ctx->cq_wait);
+	init_waitqueue_head(&ctx->inflight_wait);
+	atomic_set(&ctx->inflight, 0);
+	mutex_init(&ctx->uring_lock);
+#ifdef CONFIG_COMPAT
+	ctx->compat = is_compat_task();
+#endif
+
+	ctx->sqo_mm = current->mm;
+	atomic_inc(&ctx->sqo_mm->mm_count);
+
+	/* do at most this many buffered requests concurrently */
+	ret = -ENOMEM;
+	ctx->sqo_wq = alloc_workqueue("io_ring-wq", WQ_UNBOUND,
+				      min(entries - 1, 2 * num_online_cpus()));
+	if (!ctx->sqo_wq)
+		goto err;
+
+	ret = io_allocate_rings(ctx, &p);
+	if (ret)
+		goto err;
+
+	memset(&p.sq_off, 0, sizeof(p.sq_off));
+	p.sq_off.head = offsetof(struct io_sq_ring, r.head);
+	p.sq_off.tail = offsetof(struct io_sq_ring, r.tail);
+	p.sq_off.ring_mask = offsetof(struct io_sq_ring, ring_mask);
+	p.sq_off.ring_entries = offsetof(struct io_sq_ring, ring_entries);
+	p.sq_off.flags = offsetof(struct io_sq_ring, flags);
+	p.sq_off.dropped = offsetof(struct io_sq_ring, dropped);
+	p.sq_off.array = offsetof(struct io_sq_ring, array);
+
+	memset(&p.cq_off, 0, sizeof(p.cq_off));
+	p.cq_off.head = offsetof(struct io_cq_ring, r.head);
+	p.cq_off.tail = offsetof(struct io_cq_ring, r.tail);
+	p.cq_off.ring_mask = offsetof(struct io_cq_ring, ring_mask);
+	p.cq_off.ring_entries = offsetof(struct io_cq_ring, ring_entries);
+	p.cq_off.overflow = offsetof(struct io_cq_ring, overflow);
+	p.cq_off.cqes = offsetof(struct io_cq_ring, cqes);
+
+	ret = -EFAULT;
+	if (copy_to_user(params, &p, sizeof(p)))
+		goto err;
+
+	ret = anon_inode_getfd("[io_uring]", &io_uring_fops, ctx,
+			       O_RDWR | O_CLOEXEC);
+	if (ret < 0)
+		goto err;
+	return ret;
+err:
+	io_ring_ctx_free(ctx);
+	return ret;
+}
+
+SYSCALL_DEFINE4(io_uring_register, unsigned int, fd, unsigned int, opcode,
+		void __user *, arg, unsigned int, nr_args)
+{
+	struct io_ring_ctx *ctx;
+	struct file *file;
+	long ret;
+
+	file = fget(fd);
+	if (!file)
+		return -EBADF;
+
+	ret = -EOPNOTSUPP;
+	ctx = io_get_ctx(file);
+	if (!ctx)
+		goto out_fput;
+
+	mutex_lock(&ctx->uring_lock);
+	/* registered resources can't change under issued requests */
+	io_ring_ctx_quiesce(ctx);
+
+	switch (opcode) {
+	case IORING_REGISTER_BUFFERS:
+		ret = io_sqe_buffer_register(ctx, arg, nr_args);
+		break;
+	case IORING_UNREGISTER_BUFFERS:
+		ret = -EINVAL;
+		if (arg || nr_args)
+			break;
+		ret = -ENXIO;
+		if (!ctx->user_bufs)
+			break;
+		io_sqe_buffer_unregister(ctx);
+		ret = 0;
+		break;
+	case IORING_REGISTER_FILES:
+		ret = io_sqe_files_register(ctx, arg, nr_args);
+		break;
+	case IORING_UNREGISTER_FILES:
+		ret = -EINVAL;
+		if (arg || nr_args)
+			break;
+		ret = -ENXIO;
+		if (!ctx->user_files)
+			break;
+		io_sqe_files_unregister(ctx);
+		ret = 0;
+		break;
+	default:
+		ret = -EINVAL;
+		break;
+	}
+	mutex_unlock(&ctx->uring_lock);
+
+out_fput:
+	fput(file);
+	return ret;
+}
+
+static int __init io_uring_init(void)
+{
+	req_cachep = KMEM_CACHE(io_kiocb, SLAB_HWCACHE_ALIGN | SLAB_PANIC);
+	return 0;
+}
+__initcall(io_uring_init);
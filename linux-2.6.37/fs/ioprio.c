@@ -65,7 +65,7 @@ int set_task_ioprio(struct task_struct *task, int ioprio)
 
 	if (!err) {
 		ioc->ioprio = ioprio;
-		ioc->ioprio_changed = 1;
+		ioc->ioprio_changed = IOC_CHANGED_ALL;
 	}
 
 	task_unlock(task);
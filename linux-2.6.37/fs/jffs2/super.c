@@ -230,6 +230,7 @@ static struct file_system_type jffs2_fs_type = {
 	.name =		"jffs2",
 	.mount =	jffs2_mount,
 	.kill_sb =	jffs2_kill_sb,
+	.fs_flags =	FS_RCU_INODES,
 };
 
 static int __init init_jffs2_fs(void)
@@ -260,7 +261,8 @@ static int __init init_jffs2_fs(void)
 	jffs2_inode_cachep = kmem_cache_create("jffs2_i",
 					     sizeof(struct jffs2_inode_info),
 					     0, (SLAB_RECLAIM_ACCOUNT|
-						SLAB_MEM_SPREAD),
+						SLAB_MEM_SPREAD|
+						SLAB_DESTROY_BY_RCU),
 					     jffs2_i_init_once);
 	if (!jffs2_inode_cachep) {
 		printk(KERN_ERR "JFFS2 error: Failed to initialise inode cache\n");
@@ -612,7 +612,7 @@ int follow_up(struct path *path)
 	return 1;
 }
 
-/* no need for dcache_lock, as serialization is taken care in
+/* no need for any dentry locks, as serialization is taken care in
  * namespace.c
  */
 static int __follow_mount(struct path *path)
@@ -645,7 +645,7 @@ static void follow_mount(struct path *path)
 	}
 }
 
-/* no need for dcache_lock, as serialization is taken care in
+/* no need for any dentry locks, as serialization is taken care in
  * namespace.c
  */
 int follow_down(struct path *path)
@@ -1002,6 +1002,264 @@ static int path_walk(const char *name, struct nameidata *nd)
 	return result;
 }
 
+/*
+ * rcu-walk: lockless path walking
+ *
+ * Most lookups only go through dentries that are already in the dcache.
+ * rcu-walk resolves those under rcu_read_lock() and the vfsmount_lock read
+ * side, without taking d_lock or a reference on any intermediate
+ * component. Each step samples the d_seq of the child and then validates
+ * the d_seq of the parent, so a concurrent rename, unlink or mount change
+ * is noticed; dentries are freed after an RCU grace period and the inodes
+ * of FS_RCU_INODES filesystems are type-stable, so looking at a stale one
+ * is harmless until the d_seq check says it's stale. Only the final
+ * dentry and vfsmount get a reference.
+ *
+ * Anything rcu-walk cannot do without blocking or calling into the
+ * filesystem (a dcache miss, ->d_hash, ->d_revalidate, ->permission, a
+ * cached ACL, symlinks, an LSM permission hook) returns -ECHILD, and the
+ * lookup is redone from the start by ref-walk.
+ */
+static inline bool rcu_walk_inode_ok(struct dentry *dentry)
+{
+	return dentry->d_sb->s_type->fs_flags & FS_RCU_INODES;
+}
+
+/*
+ * exec_permission() for rcu-walk: the DAC check only, with the cached ACL
+ * pointer standing in for ->check_acl(). Denials and capability overrides
+ * are left to ref-walk, which gives the proper error.
+ */
+static int exec_permission_rcu(struct inode *inode)
+{
+	umode_t mode = inode->i_mode;
+
+	if (inode->i_op->permission)
+		return -ECHILD;
+
+	if (current_fsuid() == inode->i_uid)
+		mode >>= 6;
+	else {
+		if (IS_POSIXACL(inode) && (mode & S_IRWXG) &&
+		    inode->i_op->check_acl) {
+#ifdef CONFIG_FS_POSIX_ACL
+			/* only a cached "no ACL" can be trusted here */
+			if (ACCESS_ONCE(inode->i_acl) != NULL)
+				return -ECHILD;
+#else
+			return -ECHILD;
+#endif
+		}
+		if (in_group_p(inode->i_gid))
+			mode >>= 3;
+	}
+	if (!(mode & MAY_EXEC))
+		return -ECHILD;
+
+	return security_inode_exec_permission_rcu(inode);
+}
+
+/*
+ * Cross the mounts on top of @path without taking references; @seq is
+ * the d_seq of path->dentry, updated along. Called with the vfsmount_lock
+ * read side held.
+ */
+static bool follow_mount_rcu(struct path *path, unsigned *seq)
+{
+	while (d_mountpoint(path->dentry)) {
+		struct vfsmount *mounted;
+
+		mounted = __lookup_mnt(path->mnt, path->dentry, 1);
+		if (!mounted)
+			break;
+		if (read_seqcount_retry(&path->dentry->d_seq, *seq))
+			return false;
+		path->mnt = mounted;
+		path->dentry = mounted->mnt_root;
+		*seq = read_seqcount_begin(&path->dentry->d_seq);
+	}
+	return true;
+}
+
+static bool follow_dotdot_rcu(struct path *path, struct path *root,
+			      unsigned *seq)
+{
+	for (;;) {
+		if (path->dentry == root->dentry && path->mnt == root->mnt)
+			break;
+		if (path->dentry != path->mnt->mnt_root) {
+			struct dentry *parent = path->dentry->d_parent;
+			unsigned pseq = read_seqcount_begin(&parent->d_seq);
+
+			if (read_seqcount_retry(&path->dentry->d_seq, *seq))
+				return false;
+			path->dentry = parent;
+			*seq = pseq;
+			break;
+		}
+		if (path->mnt->mnt_parent == path->mnt)
+			break;
+		path->dentry = path->mnt->mnt_mountpoint;
+		path->mnt = path->mnt->mnt_parent;
+		*seq = read_seqcount_begin(&path->dentry->d_seq);
+	}
+	return follow_mount_rcu(path, seq);
+}
+
+/*
+ * Take the references on the result of rcu-walk, provided the dentry has
+ * not changed since it was sampled and is not on its way out.
+ */
+static bool path_get_rcu(struct path *path, unsigned seq)
+{
+	struct dentry *dentry = path->dentry;
+
+	spin_lock(&dentry->d_lock);
+	if (read_seqcount_retry(&dentry->d_seq, seq) ||
+	    (d_unhashed(dentry) && !atomic_read(&dentry->d_count))) {
+		spin_unlock(&dentry->d_lock);
+		return false;
+	}
+	atomic_inc(&dentry->d_count);
+	spin_unlock(&dentry->d_lock);
+	mntget(path->mnt);
+	return true;
+}
+
+/*
+ * Returns 0 with nd->path referenced, or -ECHILD if ref-walk has to do
+ * the lookup. Only plain lookups relative to the root or the current
+ * directory are attempted.
+ */
+static int path_walk_rcu(int dfd, const char *name, unsigned int flags,
+			 struct nameidata *nd)
+{
+	struct fs_struct *fs = current->fs;
+	unsigned int lookup_flags = flags;
+	struct path root, path;
+	struct inode *inode;
+	unsigned seq, fseq;
+
+	if (flags & ~(LOOKUP_FOLLOW | LOOKUP_DIRECTORY))
+		return -ECHILD;
+	if (*name != '/' && dfd != AT_FDCWD)
+		return -ECHILD;
+
+	nd->last_type = LAST_ROOT;
+	nd->flags = flags;
+	nd->depth = 0;
+	nd->root.mnt = NULL;
+
+	br_read_lock(vfsmount_lock);
+	rcu_read_lock();
+
+	do {
+		fseq = read_seqcount_begin(&fs->seq);
+		root = fs->root;
+		path = (*name == '/') ? root : fs->pwd;
+		seq = read_seqcount_begin(&path.dentry->d_seq);
+	} while (read_seqcount_retry(&fs->seq, fseq));
+
+	while (*name == '/')
+		name++;
+	if (!*name)
+		goto done;
+
+	for (;;) {
+		struct dentry *child;
+		unsigned long hash;
+		struct qstr this;
+		unsigned int c;
+		unsigned cseq;
+
+		inode = path.dentry->d_inode;
+		if (!inode || !rcu_walk_inode_ok(path.dentry))
+			goto fail;
+		if (exec_permission_rcu(inode))
+			goto fail;
+		if (read_seqcount_retry(&path.dentry->d_seq, seq))
+			goto fail;
+
+		this.name = name;
+		c = *(const unsigned char *)name;
+
+		hash = init_name_hash();
+		do {
+			name++;
+			hash = partial_name_hash(c, hash);
+			c = *(const unsigned char *)name;
+		} while (c && (c != '/'));
+		this.len = name - (const char *) this.name;
+		this.hash = end_name_hash(hash);
+
+		while (*name == '/')
+			name++;
+		if (!*name && c)
+			lookup_flags |= LOOKUP_FOLLOW | LOOKUP_DIRECTORY;
+
+		if (this.name[0] == '.') switch (this.len) {
+			default:
+				break;
+			case 2:
+				if (this.name[1] != '.')
+					break;
+				if (!follow_dotdot_rcu(&path, &root, &seq))
+					goto fail;
+				/* fallthrough */
+			case 1:
+				if (!*name)
+					goto done_dir;
+				continue;
+		}
+
+		if (path.dentry->d_op && path.dentry->d_op->d_hash)
+			goto fail;
+		child = __d_lookup_rcu(path.dentry, &this, &cseq);
+		if (!child)
+			goto fail;
+		if (read_seqcount_retry(&path.dentry->d_seq, seq))
+			goto fail;
+		path.dentry = child;
+		seq = cseq;
+
+		if (child->d_op && child->d_op->d_revalidate)
+			goto fail;
+		if (!follow_mount_rcu(&path, &seq))
+			goto fail;
+
+		inode = path.dentry->d_inode;
+		if (!inode || !rcu_walk_inode_ok(path.dentry))
+			goto fail;
+		if (!*name) {
+			if (follow_on_final(inode, lookup_flags))
+				goto fail;
+			if ((lookup_flags & LOOKUP_DIRECTORY) &&
+			    !inode->i_op->lookup)
+				goto fail;
+			goto done;
+		}
+		if (inode->i_op->follow_link || !inode->i_op->lookup)
+			goto fail;
+	}
+
+done_dir:
+	/* ".." may have crossed into a filesystem without FS_RCU_INODES */
+	if (!rcu_walk_inode_ok(path.dentry))
+		goto fail;
+done:
+	if (!path_get_rcu(&path, seq))
+		goto fail;
+	rcu_read_unlock();
+	br_read_unlock(vfsmount_lock);
+	nd->path = path;
+	return 0;
+
+fail:
+	rcu_read_unlock();
+	br_read_unlock(vfsmount_lock);
+	return -ECHILD;
+}
+
 static int path_init(int dfd, const char *name, unsigned int flags, struct nameidata *nd)
 {
 	int retval = 0;
@@ -1054,9 +1312,12 @@ out_fail:
 static int do_path_lookup(int dfd, const char *name,
 				unsigned int flags, struct nameidata *nd)
 {
-	int retval = path_init(dfd, name, flags, nd);
-	if (!retval)
-		retval = path_walk(name, nd);
+	int retval = path_walk_rcu(dfd, name, flags, nd);
+	if (retval == -ECHILD) {
+		retval = path_init(dfd, name, flags, nd);
+		if (!retval)
+			retval = path_walk(name, nd);
+	}
 	if (unlikely(!retval && !audit_dummy_context() && nd->path.dentry &&
 				nd->path.dentry->d_inode))
 		audit_inode(name, nd->path.dentry);
@@ -2130,12 +2391,10 @@ void dentry_unhash(struct dentry *dentry)
 {
 	dget(dentry);
 	shrink_dcache_parent(dentry);
-	spin_lock(&dcache_lock);
 	spin_lock(&dentry->d_lock);
 	if (atomic_read(&dentry->d_count) == 2)
 		__d_drop(dentry);
 	spin_unlock(&dentry->d_lock);
-	spin_unlock(&dcache_lock);
 }
 
 int vfs_rmdir(struct inode *dir, struct dentry *dentry)
@@ -384,21 +384,25 @@ ncp_dget_fpos(struct dentry *dentry, struct dentry *parent, unsigned long fpos)
 	}
 
 	/* If a pointer is invalid, we search the dentry. */
-	spin_lock(&dcache_lock);
+	spin_lock(&parent->d_lock);
 	next = parent->d_subdirs.next;
 	while (next != &parent->d_subdirs) {
 		dent = list_entry(next, struct dentry, d_u.d_child);
 		if ((unsigned long)dent->d_fsdata == fpos) {
-			if (dent->d_inode)
-				dget_locked(dent);
-			else
+			spin_lock_nested(&dent->d_lock, DENTRY_D_LOCK_NESTED);
+			if (dent->d_inode) {
+				dget_dlock(dent);
+				spin_unlock(&dent->d_lock);
+			} else {
+				spin_unlock(&dent->d_lock);
 				dent = NULL;
-			spin_unlock(&dcache_lock);
+			}
+			spin_unlock(&parent->d_lock);
 			goto out;
 		}
 		next = next->next;
 	}
-	spin_unlock(&dcache_lock);
+	spin_unlock(&parent->d_lock);
 	return NULL;
 
 out:
@@ -625,18 +629,18 @@ ncp_fill_cache(struct file *filp, void *dirent, filldir_t filldir,
 			 * Inside ncpfs all uses of d_name are either for debugging,
 			 * or on functions which acquire inode mutex (mknod, creat,
 			 * lookup).  So grab i_mutex here, to be sure.  d_path
-			 * uses dcache_lock when generating path, so we should too.
+			 * uses rename_lock when generating path, so we should too.
 			 * And finally d_compare is protected by dentry's d_lock, so
 			 * here we go.
 			 */
 			if (inode)
 				mutex_lock(&inode->i_mutex);
-			spin_lock(&dcache_lock);
+			write_seqlock(&rename_lock);
 			spin_lock(&newdent->d_lock);
 			memcpy((char *) newdent->d_name.name, qname.name,
 								newdent->d_name.len);
 			spin_unlock(&newdent->d_lock);
-			spin_unlock(&dcache_lock);
+			write_sequnlock(&rename_lock);
 			if (inode)
 				mutex_unlock(&inode->i_mutex);
 		}
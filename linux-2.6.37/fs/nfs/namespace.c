@@ -49,23 +49,34 @@ char *nfs_path(const char *base,
 	       const struct dentry *dentry,
 	       char *buffer, ssize_t buflen)
 {
-	char *end = buffer+buflen;
+	const struct dentry *d;
+	ssize_t len;
+	char *end;
 	int namelen;
+	unsigned seq;
 
+rename_retry:
+	d = dentry;
+	len = buflen;
+	end = buffer+len;
 	*--end = '\0';
-	buflen--;
-	spin_lock(&dcache_lock);
-	while (!IS_ROOT(dentry) && dentry != droot) {
-		namelen = dentry->d_name.len;
-		buflen -= namelen + 1;
-		if (buflen < 0)
+	len--;
+	seq = read_seqbegin(&rename_lock);
+	rcu_read_lock();
+	while (!IS_ROOT(d) && d != droot) {
+		namelen = d->d_name.len;
+		len -= namelen + 1;
+		if (len < 0)
 			goto Elong_unlock;
 		end -= namelen;
-		memcpy(end, dentry->d_name.name, namelen);
+		memcpy(end, d->d_name.name, namelen);
 		*--end = '/';
-		dentry = dentry->d_parent;
+		d = d->d_parent;
 	}
-	spin_unlock(&dcache_lock);
+	rcu_read_unlock();
+	if (read_seqretry(&rename_lock, seq))
+		goto rename_retry;
+	buflen = len;
 	if (*end != '/') {
 		if (--buflen < 0)
 			goto Elong;
@@ -82,7 +93,9 @@ char *nfs_path(const char *base,
 	memcpy(end, base, namelen);
 	return end;
 Elong_unlock:
-	spin_unlock(&dcache_lock);
+	rcu_read_unlock();
+	if (read_seqretry(&rename_lock, seq))
+		goto rename_retry;
 Elong:
 	return ERR_PTR(-ENAMETOOLONG);
 }
@@ -1993,6 +1993,9 @@ static long ocfs2_fallocate(struct inode *inode, int mode, loff_t offset,
 	struct ocfs2_space_resv sr;
 	int change_size = 1;
 
+	if (mode & ~FALLOC_FL_KEEP_SIZE)
+		return -EOPNOTSUPP;
+
 	if (!ocfs2_writes_unwritten_extents(osb))
 		return -EOPNOTSUPP;
 
@@ -73,6 +73,24 @@ generic_file_llseek_unlocked(struct file *file, loff_t offset, int origin)
 			return file->f_pos;
 		offset += file->f_pos;
 		break;
+	case SEEK_DATA:
+		/*
+		 * In the generic case the entire file is data, so as long as
+		 * offset isn't at the end of the file then the offset is data.
+		 * Filesystems that know about holes hook in with ->llseek.
+		 */
+		if (offset < 0 || offset >= inode->i_size)
+			return -ENXIO;
+		break;
+	case SEEK_HOLE:
+		/*
+		 * There is a virtual hole at the end of the file, so as long as
+		 * offset isn't i_size or larger, return i_size.
+		 */
+		if (offset < 0 || offset >= inode->i_size)
+			return -ENXIO;
+		offset = inode->i_size;
+		break;
 	}
 
 	if (offset < 0 && __negative_fpos_check(file, offset, 0))
@@ -150,6 +168,32 @@ loff_t default_llseek(struct file *file, loff_t offset, int origin)
 				goto out;
 			}
 			offset += file->f_pos;
+			break;
+		case SEEK_DATA:
+			/*
+			 * In the generic case the entire file is data, so as
+			 * long as offset isn't at the end of the file then the
+			 * offset is data.
+			 */
+			if (offset < 0 ||
+			    offset >= i_size_read(file->f_path.dentry->d_inode)) {
+				retval = -ENXIO;
+				goto out;
+			}
+			break;
+		case SEEK_HOLE:
+			/*
+			 * There is a virtual hole at the end of the file, so
+			 * as long as offset isn't i_size or larger, return
+			 * i_size.
+			 */
+			if (offset < 0 ||
+			    offset >= i_size_read(file->f_path.dentry->d_inode)) {
+				retval = -ENXIO;
+				goto out;
+			}
+			offset = i_size_read(file->f_path.dentry->d_inode);
+			break;
 	}
 	retval = -EINVAL;
 	if (offset >= 0 || !__negative_fpos_check(file, offset, 0)) {
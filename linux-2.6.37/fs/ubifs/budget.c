@@ -440,6 +440,7 @@ int ubifs_budget_space(struct ubifs_info *c, struct ubifs_budget_req *req)
 {
 	int uninitialized_var(cmt_retries), uninitialized_var(wb_retries);
 	int err, idx_growth, data_growth, dd_growth, retried = 0;
+	ktime_t start;
 
 	ubifs_assert(req->new_page <= 1);
 	ubifs_assert(req->dirtied_page <= 1);
@@ -457,6 +458,7 @@ int ubifs_budget_space(struct ubifs_info *c, struct ubifs_budget_req *req)
 	if (!data_growth && !dd_growth)
 		return 0;
 	idx_growth = calc_idx_growth(c, req);
+	start = dbg_lat_start();
 
 again:
 	spin_lock(&c->space_lock);
@@ -480,6 +482,7 @@ again:
 		req->data_growth = data_growth;
 		req->dd_growth = dd_growth;
 		spin_unlock(&c->space_lock);
+		dbg_lat_account(c, UBIFS_LAT_BUDGET, start);
 		return 0;
 	}
 
@@ -512,6 +515,7 @@ again:
 		smp_wmb();
 	} else
 		ubifs_err("cannot budget space, error %d", err);
+	dbg_lat_account(c, UBIFS_LAT_BUDGET, start);
 	return err;
 }
 
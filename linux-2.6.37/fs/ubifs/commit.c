@@ -61,6 +61,7 @@ static int do_commit(struct ubifs_info *c)
 	int err, new_ltail_lnum, old_ltail_lnum, i;
 	struct ubifs_zbranch zroot;
 	struct ubifs_lp_stats lst;
+	ktime_t start = dbg_lat_start();
 
 	dbg_cmt("start");
 	ubifs_assert(!c->ro_media && !c->ro_mount);
@@ -100,6 +101,7 @@ static int do_commit(struct ubifs_info *c)
 	ubifs_get_lp_stats(c, &lst);
 
 	up_write(&c->commit_sem);
+	dbg_lat_account(c, UBIFS_LAT_CMT_START, start);
 
 	err = ubifs_tnc_end_commit(c);
 	if (err)
@@ -191,6 +193,8 @@ out:
  */
 static int run_bg_commit(struct ubifs_info *c)
 {
+	int err, i;
+
 	spin_lock(&c->cs_lock);
 	/*
 	 * Run background commit only if background commit was requested or if
@@ -201,6 +205,17 @@ static int run_bg_commit(struct ubifs_info *c)
 		goto out;
 	spin_unlock(&c->cs_lock);
 
+	/*
+	 * Synchronize the write-buffers before locking the writers out, so
+	 * that 'do_commit()' finds little or nothing to write while it holds
+	 * the commit semaphore.
+	 */
+	for (i = 0; i < c->jhead_cnt; i++) {
+		err = ubifs_wbuf_sync(&c->jheads[i].wbuf);
+		if (err)
+			return err;
+	}
+
 	down_write(&c->commit_sem);
 	spin_lock(&c->cs_lock);
 	if (c->cmt_state == COMMIT_REQUIRED)
@@ -229,8 +244,8 @@ out:
  *   write-buffer;
  * o when the journal is about to be full, it starts in-advance commit.
  *
- * Note, other stuff like background garbage collection may be added here in
- * future.
+ * Background garbage collection runs in a thread of its own, see
+ * 'ubifs_gc_thread()'.
  */
 int ubifs_bg_thread(void *info)
 {
@@ -2784,6 +2784,91 @@ static const struct file_operations dfs_fops = {
 	.llseek = default_llseek,
 };
 
+/**
+ * dbg_lat_account - account an operation in a latency histogram.
+ * @c: UBIFS file-system description object
+ * @type: histogram to account in (%UBIFS_LAT_BUDGET, etc)
+ * @start: time the operation started, as returned by 'dbg_lat_start()'
+ */
+void dbg_lat_account(struct ubifs_info *c, int type, ktime_t start)
+{
+	s64 us = ktime_us_delta(ktime_get(), start);
+	int bucket = 0;
+
+	if (us > 0)
+		bucket = min_t(int, fls64(us), UBIFS_LAT_BUCKETS - 1);
+	atomic_inc(&c->dbg->lat_hist[type][bucket]);
+}
+
+static const char * const lat_hist_names[UBIFS_LAT_CNT] = {
+	[UBIFS_LAT_BUDGET]	= "budget",
+	[UBIFS_LAT_JNL_RESERVE]	= "jnl_reserve",
+	[UBIFS_LAT_GC_LEB]	= "gc_leb",
+	[UBIFS_LAT_CMT_START]	= "cmt_start",
+};
+
+/*
+ * The histogram file prints one line per bucket with the bucket's upper bound
+ * in microseconds followed by a count for every histogram type. Writing
+ * anything to the file resets the histograms.
+ */
+static ssize_t read_lat_hist(struct file *file, char __user *u, size_t count,
+			     loff_t *ppos)
+{
+	struct ubifs_info *c = file->private_data;
+	struct ubifs_debug_info *d = c->dbg;
+	size_t sz = (UBIFS_LAT_BUCKETS + 1) * (UBIFS_LAT_CNT + 1) * 12;
+	ssize_t ret;
+	char *buf;
+	int i, j, n;
+
+	buf = kmalloc(sz, GFP_KERNEL);
+	if (!buf)
+		return -ENOMEM;
+
+	n = snprintf(buf, sz, "%-11s", "usecs");
+	for (j = 0; j < UBIFS_LAT_CNT; j++)
+		n += snprintf(buf + n, sz - n, " %11s", lat_hist_names[j]);
+	n += snprintf(buf + n, sz - n, "\n");
+
+	for (i = 0; i < UBIFS_LAT_BUCKETS; i++) {
+		if (i == UBIFS_LAT_BUCKETS - 1)
+			n += snprintf(buf + n, sz - n, "%-11s", "max");
+		else
+			n += snprintf(buf + n, sz - n, "%-11lu", 1UL << i);
+		for (j = 0; j < UBIFS_LAT_CNT; j++)
+			n += snprintf(buf + n, sz - n, " %11d",
+				      atomic_read(&d->lat_hist[j][i]));
+		n += snprintf(buf + n, sz - n, "\n");
+	}
+
+	ret = simple_read_from_buffer(u, count, ppos, buf, n);
+	kfree(buf);
+	return ret;
+}
+
+static ssize_t write_lat_hist(struct file *file, const char __user *buf,
+			      size_t count, loff_t *ppos)
+{
+	struct ubifs_info *c = file->private_data;
+	int i, j;
+
+	for (j = 0; j < UBIFS_LAT_CNT; j++)
+		for (i = 0; i < UBIFS_LAT_BUCKETS; i++)
+			atomic_set(&c->dbg->lat_hist[j][i], 0);
+
+	*ppos += count;
+	return count;
+}
+
+static const struct file_operations dfs_lat_fops = {
+	.open = open_debugfs_file,
+	.read = read_lat_hist,
+	.write = write_lat_hist,
+	.owner = THIS_MODULE,
+	.llseek = default_llseek,
+};
+
 /**
  * dbg_debugfs_init_fs - initialize debugfs for UBIFS instance.
  * @c: UBIFS file-system description object
@@ -2830,6 +2915,13 @@ int dbg_debugfs_init_fs(struct ubifs_info *c)
 		goto out_remove;
 	d->dfs_dump_tnc = dent;
 
+	fname = "lat_hist";
+	dent = debugfs_create_file(fname, S_IRUSR | S_IWUSR, d->dfs_dir, c,
+				   &dfs_lat_fops);
+	if (IS_ERR(dent))
+		goto out_remove;
+	d->dfs_lat_hist = dent;
+
 	return 0;
 
 out_remove:
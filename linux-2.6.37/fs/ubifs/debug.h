@@ -23,6 +23,30 @@
 #ifndef __UBIFS_DEBUG_H__
 #define __UBIFS_DEBUG_H__
 
+/*
+ * Latency histogram types.
+ *
+ * UBIFS_LAT_BUDGET: budgeting, including the write-back, GC and commit it may
+ *                   have to run synchronously to make space
+ * UBIFS_LAT_JNL_RESERVE: reserving space in a journal head, including GC
+ *                        when the head runs out of space
+ * UBIFS_LAT_GC_LEB: garbage collection of one LEB by the GC thread
+ * UBIFS_LAT_CMT_START: commit start, while writers are locked out
+ */
+enum {
+	UBIFS_LAT_BUDGET,
+	UBIFS_LAT_JNL_RESERVE,
+	UBIFS_LAT_GC_LEB,
+	UBIFS_LAT_CMT_START,
+	UBIFS_LAT_CNT,
+};
+
+/*
+ * Latency histograms have power of 2 microsecond buckets, the last bucket
+ * collects everything from about 4 seconds up.
+ */
+#define UBIFS_LAT_BUCKETS 23
+
 #ifdef CONFIG_UBIFS_FS_DEBUG
 
 /**
@@ -47,11 +71,14 @@
  * @saved_lst: saved lprops statistics (used by 'dbg_save_space_info()')
  * @saved_free: saved free space (used by 'dbg_save_space_info()')
  *
+ * @lat_hist: latency histograms, indexed by %UBIFS_LAT_BUDGET, etc
+ *
  * dfs_dir_name: name of debugfs directory containing this file-system's files
  * dfs_dir: direntry object of the file-system debugfs directory
  * dfs_dump_lprops: "dump lprops" debugfs knob
  * dfs_dump_budg: "dump budgeting information" debugfs knob
  * dfs_dump_tnc: "dump TNC" debugfs knob
+ * dfs_lat_hist: latency histograms debugfs file
  */
 struct ubifs_debug_info {
 	void *buf;
@@ -74,11 +101,14 @@ struct ubifs_debug_info {
 	struct ubifs_lp_stats saved_lst;
 	long long saved_free;
 
+	atomic_t lat_hist[UBIFS_LAT_CNT][UBIFS_LAT_BUCKETS];
+
 	char dfs_dir_name[100];
 	struct dentry *dfs_dir;
 	struct dentry *dfs_dump_lprops;
 	struct dentry *dfs_dump_budg;
 	struct dentry *dfs_dump_tnc;
+	struct dentry *dfs_lat_hist;
 };
 
 #define ubifs_assert(expr) do {                                                \
@@ -379,6 +409,10 @@ static inline int dbg_change(struct ubi_volume_desc *desc, int lnum,
 	return dbg_leb_change(desc, lnum, buf, len, UBI_UNKNOWN);
 }
 
+/* Latency accounting */
+#define dbg_lat_start() ktime_get()
+void dbg_lat_account(struct ubifs_info *c, int type, ktime_t start);
+
 /* Debugfs-related stuff */
 int dbg_debugfs_init(void);
 void dbg_debugfs_exit(void);
@@ -473,6 +507,13 @@ void dbg_debugfs_exit_fs(struct ubifs_info *c);
 #define dbg_force_in_the_gaps()                    0
 #define dbg_failure_mode                           0
 
+#define dbg_lat_start()                            ktime_set(0, 0)
+
+static inline void dbg_lat_account(struct ubifs_info *c, int type,
+				   ktime_t start)
+{
+}
+
 #define dbg_debugfs_init()                         0
 #define dbg_debugfs_exit()
 #define dbg_debugfs_init_fs(c)                     0
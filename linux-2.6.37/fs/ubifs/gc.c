@@ -56,6 +56,8 @@
 #include <linux/slab.h>
 #include <linux/pagemap.h>
 #include <linux/list_sort.h>
+#include <linux/freezer.h>
+#include <linux/kthread.h>
 #include "ubifs.h"
 
 /*
@@ -66,6 +68,18 @@
 #define SOFT_LEBS_LIMIT 4
 #define HARD_LEBS_LIMIT 32
 
+/*
+ * The GC thread wakes up every %BG_GC_INTERVAL jiffies and, if the journal
+ * has not been written to for at least %BG_GC_IDLE_TIME jiffies, collects up
+ * to %BG_GC_MAX_LEBS LEBs or until there are %BG_GC_FREE_LEBS LEBs available
+ * for writing. It only picks LEBs which are at least half free + dirty, so
+ * that idle-time GC never moves more data than it reclaims.
+ */
+#define BG_GC_INTERVAL  HZ
+#define BG_GC_IDLE_TIME (HZ / 2)
+#define BG_GC_MAX_LEBS  16
+#define BG_GC_FREE_LEBS 8
+
 /**
  * switch_gc_head - switch the garbage collection journal head.
  * @c: UBIFS file-system description object
@@ -453,17 +467,18 @@ static int gc_sync_wbufs(struct ubifs_info *c)
 }
 
 /**
- * ubifs_garbage_collect_leb - garbage-collect a logical eraseblock.
+ * gc_scanned_leb - garbage-collect a scanned logical eraseblock.
  * @c: UBIFS file-system description object
  * @lp: describes the LEB to garbage collect
+ * @sleb: the scanned contents of the LEB, destroyed by this function
  *
- * This function garbage-collects an LEB and returns one of the @LEB_FREED,
- * @LEB_RETAINED, etc positive codes in case of success, %-EAGAIN if commit is
- * required, and other negative error codes in case of failures.
+ * This is the body of 'ubifs_garbage_collect_leb()' for callers which have
+ * already read the LEB. The caller has to hold the GC head and the LEB has to
+ * have been taken since it was scanned.
  */
-int ubifs_garbage_collect_leb(struct ubifs_info *c, struct ubifs_lprops *lp)
+static int gc_scanned_leb(struct ubifs_info *c, struct ubifs_lprops *lp,
+			  struct ubifs_scan_leb *sleb)
 {
-	struct ubifs_scan_leb *sleb;
 	struct ubifs_scan_node *snod;
 	struct ubifs_wbuf *wbuf = &c->jheads[GCHD].wbuf;
 	int err = 0, lnum = lp->lnum;
@@ -472,15 +487,7 @@ int ubifs_garbage_collect_leb(struct ubifs_info *c, struct ubifs_lprops *lp)
 		     c->need_recovery);
 	ubifs_assert(c->gc_lnum != lnum);
 	ubifs_assert(wbuf->lnum != lnum);
-
-	/*
-	 * We scan the entire LEB even though we only really need to scan up to
-	 * (c->leb_size - lp->free).
-	 */
-	sleb = ubifs_scan(c, lnum, 0, c->sbuf, 0);
-	if (IS_ERR(sleb))
-		return PTR_ERR(sleb);
-
+	ubifs_assert(sleb->lnum == lnum);
 	ubifs_assert(!list_empty(&sleb->nodes));
 	snod = list_entry(sleb->nodes.next, struct ubifs_scan_node, list);
 
@@ -573,6 +580,63 @@ out_inc_seq:
 	goto out;
 }
 
+/**
+ * ubifs_garbage_collect_leb - garbage-collect a logical eraseblock.
+ * @c: UBIFS file-system description object
+ * @lp: describes the LEB to garbage collect
+ *
+ * This function garbage-collects an LEB and returns one of the @LEB_FREED,
+ * @LEB_RETAINED, etc positive codes in case of success, %-EAGAIN if commit is
+ * required, and other negative error codes in case of failures.
+ */
+int ubifs_garbage_collect_leb(struct ubifs_info *c, struct ubifs_lprops *lp)
+{
+	struct ubifs_scan_leb *sleb;
+
+	/*
+	 * We scan the entire LEB even though we only really need to scan up to
+	 * (c->leb_size - lp->free).
+	 */
+	sleb = ubifs_scan(c, lp->lnum, 0, c->sbuf, 0);
+	if (IS_ERR(sleb))
+		return PTR_ERR(sleb);
+
+	return gc_scanned_leb(c, lp, sleb);
+}
+
+/**
+ * gc_freeable_leb - reclaim a LEB which has only free and dirty space.
+ * @c: UBIFS file-system description object
+ * @lp: describes the LEB, which has to be taken
+ *
+ * There is nothing to move out of such an LEB, it just has to be unmapped.
+ * Returns zero in case of success and a negative error code in case of
+ * failure.
+ */
+static int gc_freeable_leb(struct ubifs_info *c, struct ubifs_lprops *lp)
+{
+	int err;
+
+	/*
+	 * ubifs_find_dirty_leb() doesn't return freeable index LEBs.
+	 */
+	ubifs_assert(!(lp->flags & LPROPS_INDEX));
+	if (lp->free != c->leb_size) {
+		/*
+		 * Write buffers must be sync'd before unmapping freeable LEBs,
+		 * because one of them may contain data which obsoletes
+		 * something in 'lp->pnum'.
+		 */
+		err = gc_sync_wbufs(c);
+		if (err)
+			return err;
+		err = ubifs_change_one_lp(c, lp->lnum, c->leb_size, 0, 0, 0, 0);
+		if (err)
+			return err;
+	}
+	return ubifs_leb_unmap(c, lp->lnum);
+}
+
 /**
  * ubifs_garbage_collect - UBIFS garbage collector.
  * @c: UBIFS file-system description object
@@ -685,28 +749,7 @@ int ubifs_garbage_collect(struct ubifs_info *c, int anyway)
 		if (lp.free + lp.dirty == c->leb_size) {
 			/* An empty LEB was returned */
 			dbg_gc("LEB %d is free, return it", lp.lnum);
-			/*
-			 * ubifs_find_dirty_leb() doesn't return freeable index
-			 * LEBs.
-			 */
-			ubifs_assert(!(lp.flags & LPROPS_INDEX));
-			if (lp.free != c->leb_size) {
-				/*
-				 * Write buffers must be sync'd before
-				 * unmapping freeable LEBs, because one of them
-				 * may contain data which obsoletes something
-				 * in 'lp.pnum'.
-				 */
-				ret = gc_sync_wbufs(c);
-				if (ret)
-					goto out;
-				ret = ubifs_change_one_lp(c, lp.lnum,
-							  c->leb_size, 0, 0, 0,
-							  0);
-				if (ret)
-					goto out;
-			}
-			ret = ubifs_leb_unmap(c, lp.lnum);
+			ret = gc_freeable_leb(c, &lp);
 			if (ret)
 				goto out;
 			ret = lp.lnum;
@@ -978,3 +1021,238 @@ int ubifs_get_idx_gc_leb(struct ubifs_info *c)
 	kfree(idx_gc);
 	return lnum;
 }
+
+/**
+ * bg_gc_idle - check whether the journal is idle.
+ * @c: UBIFS file-system description object
+ *
+ * Returns %1 if the file-system is writable and nothing has been written to
+ * the journal for %BG_GC_IDLE_TIME, and %0 otherwise.
+ */
+static int bg_gc_idle(struct ubifs_info *c)
+{
+	if (c->ro_mount || c->ro_error || c->remounting_rw || c->need_recovery)
+		return 0;
+	return time_after_eq(jiffies, c->jnl_last_write + BG_GC_IDLE_TIME);
+}
+
+/**
+ * bg_gc_needed - check whether idle-time garbage collection is worthwhile.
+ * @c: UBIFS file-system description object
+ *
+ * Returns %1 if the journal is idle and fewer than %BG_GC_FREE_LEBS LEBs are
+ * available for writing, and %0 otherwise. The calculation is the one
+ * 'ubifs_find_free_space()' uses to decide whether it may hand out an empty
+ * LEB.
+ */
+static int bg_gc_needed(struct ubifs_info *c)
+{
+	int lebs, rsvd_idx_lebs = 0;
+
+	if (!bg_gc_idle(c))
+		return 0;
+
+	spin_lock(&c->space_lock);
+	if (c->min_idx_lebs > c->lst.idx_lebs)
+		rsvd_idx_lebs = c->min_idx_lebs - c->lst.idx_lebs;
+	lebs = c->lst.empty_lebs + c->freeable_cnt + c->idx_gc_cnt -
+	       c->lst.taken_empty_lebs - rsvd_idx_lebs;
+	spin_unlock(&c->space_lock);
+
+	return lebs < BG_GC_FREE_LEBS;
+}
+
+/**
+ * bg_gc_leb - garbage-collect one LEB from the GC thread.
+ * @c: UBIFS file-system description object
+ *
+ * Unlike 'ubifs_garbage_collect()', this function reads and CRC-checks the
+ * victim LEB before it takes the commit semaphore and the GC head, so the
+ * read, which is the slow half of moving an LEB, goes on in parallel with
+ * journal writes instead of holding them up. Only the writing half is done
+ * with the GC head locked.
+ *
+ * Returns zero if an LEB was collected, %-ENOSPC if there is no LEB worth
+ * collecting, %-EAGAIN if commit is required, and other negative error codes
+ * in case of failure.
+ */
+static int bg_gc_leb(struct ubifs_info *c)
+{
+	struct ubifs_wbuf *wbuf = &c->jheads[GCHD].wbuf;
+	struct ubifs_scan_leb *sleb = NULL;
+	struct ubifs_lprops lp;
+	ktime_t start = dbg_lat_start();
+	int err, ret, lnum = -1;
+
+	ret = ubifs_find_dirty_leb(c, &lp, c->half_leb_size, 0);
+	if (ret)
+		return ret;
+
+	/*
+	 * The LEB is taken now, so nothing is written to it until we return
+	 * it. Nodes in it may still become obsolete meanwhile, but GC checks
+	 * every node against the TNC with the GC head locked anyway.
+	 */
+	if (lp.free + lp.dirty != c->leb_size) {
+		sleb = ubifs_scan(c, lp.lnum, 0, c->gc_pbuf, 0);
+		if (IS_ERR(sleb)) {
+			ret = PTR_ERR(sleb);
+			ubifs_ro_mode(c, ret);
+			ubifs_return_leb(c, lp.lnum);
+			return ret;
+		}
+	}
+
+	down_read(&c->commit_sem);
+	mutex_lock_nested(&wbuf->io_mutex, wbuf->jhead);
+
+	if (c->ro_error) {
+		ret = -EROFS;
+		goto out_return;
+	}
+
+	if (ubifs_gc_should_commit(c)) {
+		ret = -EAGAIN;
+		goto out_return;
+	}
+
+	/* We expect the write-buffer to be empty on entry */
+	ubifs_assert(!wbuf->used);
+
+	if (!sleb) {
+		dbg_gc("LEB %d is freeable", lp.lnum);
+		ret = gc_freeable_leb(c, &lp);
+		if (ret)
+			goto out_ro;
+		lnum = lp.lnum;
+	} else {
+		dbg_gc("LEB %d: free %d, dirty %d", lp.lnum, lp.free, lp.dirty);
+		ret = gc_scanned_leb(c, &lp, sleb);
+		sleb = NULL;
+		if (ret == -EAGAIN)
+			goto out_return;
+		if (ret < 0)
+			goto out_ro;
+		if (ret == LEB_FREED)
+			lnum = lp.lnum;
+	}
+
+	ret = ubifs_wbuf_sync_nolock(wbuf);
+	if (!ret)
+		ret = ubifs_leb_unmap(c, c->gc_lnum);
+	if (ret)
+		goto out_ro;
+
+	mutex_unlock(&wbuf->io_mutex);
+	up_read(&c->commit_sem);
+
+	/* Make the freed LEB available for writing */
+	if (lnum != -1) {
+		err = ubifs_return_leb(c, lnum);
+		if (err)
+			return err;
+	}
+
+	dbg_lat_account(c, UBIFS_LAT_GC_LEB, start);
+	return 0;
+
+out_ro:
+	ubifs_assert(ret < 0);
+	ubifs_wbuf_sync_nolock(wbuf);
+	ubifs_ro_mode(c, ret);
+out_return:
+	mutex_unlock(&wbuf->io_mutex);
+	up_read(&c->commit_sem);
+	if (sleb)
+		ubifs_scan_destroy(sleb);
+	err = ubifs_return_leb(c, lp.lnum);
+	if (err && ret == -EAGAIN)
+		ret = err;
+	return ret;
+}
+
+/**
+ * bg_commit_idle - start an early background commit while the journal is idle.
+ * @c: UBIFS file-system description object
+ * @last_write: journal write time this was last done for
+ *
+ * If the journal is idle and already half way to the point where background
+ * commit is started, start it now. This keeps the amount of work the commit
+ * has to do with the writers locked out small, and moves it to a time when
+ * nobody is waiting to write.
+ */
+static void bg_commit_idle(struct ubifs_info *c, unsigned long *last_write)
+{
+	long long bud_bytes;
+
+	if (!bg_gc_idle(c) || *last_write == c->jnl_last_write)
+		return;
+
+	spin_lock(&c->buds_lock);
+	bud_bytes = c->bud_bytes;
+	spin_unlock(&c->buds_lock);
+
+	if (bud_bytes >= c->bg_bud_bytes / 2) {
+		dbg_gc("idle, start commit (bud bytes %lld)", bud_bytes);
+		*last_write = c->jnl_last_write;
+		ubifs_request_bg_commit(c);
+	}
+}
+
+/**
+ * ubifs_gc_thread - UBIFS garbage collection thread function.
+ * @info: points to the file-system description object
+ *
+ * This thread does garbage collection and commit while the file-system is
+ * idle, so that writers find free LEBs and a short journal when they come back
+ * instead of having to run GC and commit themselves. Writers still run GC
+ * synchronously if the thread did not keep up.
+ */
+int ubifs_gc_thread(void *info)
+{
+	int err, i;
+	struct ubifs_info *c = info;
+	unsigned long last_write = c->jnl_last_write;
+
+	dbg_msg("garbage collection thread \"%s\" started, PID %d",
+		c->gct_name, current->pid);
+	set_freezable();
+
+	while (1) {
+		if (kthread_should_stop())
+			break;
+
+		if (try_to_freeze())
+			continue;
+
+		set_current_state(TASK_INTERRUPTIBLE);
+		if (kthread_should_stop()) {
+			__set_current_state(TASK_RUNNING);
+			break;
+		}
+		schedule_timeout(BG_GC_INTERVAL);
+
+		for (i = 0; i < BG_GC_MAX_LEBS; i++) {
+			if (kthread_should_stop() || !bg_gc_needed(c))
+				break;
+
+			err = bg_gc_leb(c);
+			if (err == -EAGAIN) {
+				/* Commit was flagged as required, kick it */
+				ubifs_wake_up_bgt(c);
+				break;
+			}
+			if (err) {
+				if (err != -ENOSPC)
+					ubifs_err("GC thread error %d", err);
+				break;
+			}
+			cond_resched();
+		}
+
+		bg_commit_idle(c, &last_write);
+	}
+
+	dbg_msg("garbage collection thread \"%s\" stops", c->gct_name);
+	return 0;
+}
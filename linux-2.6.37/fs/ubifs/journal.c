@@ -318,12 +318,17 @@ static int write_head(struct ubifs_info *c, int jhead, void *buf, int len,
 static int make_reservation(struct ubifs_info *c, int jhead, int len)
 {
 	int err, cmt_retries = 0, nospc_retries = 0;
+	ktime_t start = dbg_lat_start();
 
 again:
 	down_read(&c->commit_sem);
 	err = reserve_space(c, jhead, len);
-	if (!err)
+	if (!err) {
+		/* The GC thread only works while the journal is idle */
+		c->jnl_last_write = jiffies;
+		dbg_lat_account(c, UBIFS_LAT_JNL_RESERVE, start);
 		return 0;
+	}
 	up_read(&c->commit_sem);
 
 	if (err == -ENOSPC) {
@@ -1018,6 +1018,8 @@ static int ubifs_parse_options(struct ubifs_info *c, char *options,
 				c->mount_opts.compr_type = UBIFS_COMPR_LZO;
 			else if (!strcmp(name, "zlib"))
 				c->mount_opts.compr_type = UBIFS_COMPR_ZLIB;
+			else if (!strcmp(name, "lz4"))
+				c->mount_opts.compr_type = UBIFS_COMPR_LZ4;
 			else {
 				ubifs_err("unknown compressor \"%s\"", name);
 				kfree(name);
@@ -1125,6 +1127,30 @@ static int check_free_space(struct ubifs_info *c)
 	return 0;
 }
 
+/**
+ * start_gc_thread - create the garbage collection thread.
+ * @c: UBIFS file-system description object
+ *
+ * Returns zero in case of success and a negative error code in case of
+ * failure.
+ */
+static int start_gc_thread(struct ubifs_info *c)
+{
+	int err;
+
+	/* Do not consider the journal idle until it had a chance to be used */
+	c->jnl_last_write = jiffies;
+	c->gct = kthread_create(ubifs_gc_thread, c, "%s", c->gct_name);
+	if (IS_ERR(c->gct)) {
+		err = PTR_ERR(c->gct);
+		c->gct = NULL;
+		ubifs_err("cannot spawn \"%s\", error %d", c->gct_name, err);
+		return err;
+	}
+	wake_up_process(c->gct);
+	return 0;
+}
+
 /**
  * mount_ubifs - mount UBIFS file-system.
  * @c: UBIFS file-system description object
@@ -1189,6 +1215,9 @@ static int mount_ubifs(struct ubifs_info *c)
 		c->ileb_buf = vmalloc(c->leb_size);
 		if (!c->ileb_buf)
 			goto out_free;
+		c->gc_pbuf = vmalloc(c->leb_size);
+		if (!c->gc_pbuf)
+			goto out_free;
 	}
 
 	if (c->bulk_read == 1)
@@ -1228,6 +1257,7 @@ static int mount_ubifs(struct ubifs_info *c)
 	}
 
 	sprintf(c->bgt_name, BGT_NAME_PATTERN, c->vi.ubi_num, c->vi.vol_id);
+	sprintf(c->gct_name, GCT_NAME_PATTERN, c->vi.ubi_num, c->vi.vol_id);
 	if (!c->ro_mount) {
 		err = alloc_wbufs(c);
 		if (err)
@@ -1374,6 +1404,14 @@ static int mount_ubifs(struct ubifs_info *c)
 	if (err)
 		goto out_infos;
 
+	if (!c->ro_mount) {
+		err = start_gc_thread(c);
+		if (err) {
+			dbg_debugfs_exit_fs(c);
+			goto out_infos;
+		}
+	}
+
 	c->always_chk_crc = 0;
 
 	ubifs_msg("mounted UBI device %d, volume %d, name \"%s\"",
@@ -1467,6 +1505,7 @@ out_cbuf:
 	kfree(c->cbuf);
 out_free:
 	kfree(c->bu.buf);
+	vfree(c->gc_pbuf);
 	vfree(c->ileb_buf);
 	vfree(c->sbuf);
 	kfree(c->bottom_up_buf);
@@ -1493,6 +1532,8 @@ static void ubifs_umount(struct ubifs_info *c)
 	list_del(&c->infos_list);
 	spin_unlock(&ubifs_infos_lock);
 
+	if (c->gct)
+		kthread_stop(c->gct);
 	if (c->bgt)
 		kthread_stop(c->bgt);
 
@@ -1505,6 +1546,7 @@ static void ubifs_umount(struct ubifs_info *c)
 	kfree(c->rcvrd_mst_node);
 	kfree(c->mst_node);
 	kfree(c->bu.buf);
+	vfree(c->gc_pbuf);
 	vfree(c->ileb_buf);
 	vfree(c->sbuf);
 	kfree(c->bottom_up_buf);
@@ -1590,6 +1632,12 @@ static int ubifs_remount_rw(struct ubifs_info *c)
 		goto out;
 	}
 
+	c->gc_pbuf = vmalloc(c->leb_size);
+	if (!c->gc_pbuf) {
+		err = -ENOMEM;
+		goto out;
+	}
+
 	err = ubifs_lpt_init(c, 0, 1);
 	if (err)
 		goto out;
@@ -1639,6 +1687,10 @@ static int ubifs_remount_rw(struct ubifs_info *c)
 		ubifs_msg("deferred recovery completed");
 	}
 
+	err = start_gc_thread(c);
+	if (err)
+		goto out;
+
 	dbg_gen("re-mounted read-write");
 	c->ro_mount = 0;
 	c->remounting_rw = 0;
@@ -1650,11 +1702,17 @@ static int ubifs_remount_rw(struct ubifs_info *c)
 out:
 	vfree(c->orph_buf);
 	c->orph_buf = NULL;
+	if (c->gct) {
+		kthread_stop(c->gct);
+		c->gct = NULL;
+	}
 	if (c->bgt) {
 		kthread_stop(c->bgt);
 		c->bgt = NULL;
 	}
 	free_wbufs(c);
+	vfree(c->gc_pbuf);
+	c->gc_pbuf = NULL;
 	vfree(c->ileb_buf);
 	c->ileb_buf = NULL;
 	ubifs_lpt_free(c, 1);
@@ -1679,6 +1737,10 @@ static void ubifs_remount_ro(struct ubifs_info *c)
 	ubifs_assert(!c->ro_mount);
 
 	mutex_lock(&c->umount_mutex);
+	if (c->gct) {
+		kthread_stop(c->gct);
+		c->gct = NULL;
+	}
 	if (c->bgt) {
 		kthread_stop(c->bgt);
 		c->bgt = NULL;
@@ -1699,6 +1761,8 @@ static void ubifs_remount_ro(struct ubifs_info *c)
 	free_wbufs(c);
 	vfree(c->orph_buf);
 	c->orph_buf = NULL;
+	vfree(c->gc_pbuf);
+	c->gc_pbuf = NULL;
 	vfree(c->ileb_buf);
 	c->ileb_buf = NULL;
 	ubifs_lpt_free(c, 1);
@@ -1736,9 +1800,13 @@ static void ubifs_put_super(struct super_block *sb)
 	mutex_lock(&c->umount_mutex);
 	if (!c->ro_mount) {
 		/*
-		 * First of all kill the background thread to make sure it does
-		 * not interfere with un-mounting and freeing resources.
+		 * First of all kill the background threads to make sure they
+		 * do not interfere with un-mounting and freeing resources.
 		 */
+		if (c->gct) {
+			kthread_stop(c->gct);
+			c->gct = NULL;
+		}
 		if (c->bgt) {
 			kthread_stop(c->bgt);
 			c->bgt = NULL;
@@ -2109,6 +2177,7 @@ static struct file_system_type ubifs_fs_type = {
 	.owner   = THIS_MODULE,
 	.mount   = ubifs_mount,
 	.kill_sb = kill_anon_super,
+	.fs_flags = FS_RCU_INODES,
 };
 
 /*
@@ -2191,8 +2260,8 @@ static int __init ubifs_init(void)
 	err = -ENOMEM;
 	ubifs_inode_slab = kmem_cache_create("ubifs_inode_slab",
 				sizeof(struct ubifs_inode), 0,
-				SLAB_MEM_SPREAD | SLAB_RECLAIM_ACCOUNT,
-				&inode_slab_ctor);
+				SLAB_MEM_SPREAD | SLAB_RECLAIM_ACCOUNT |
+				SLAB_DESTROY_BY_RCU, &inode_slab_ctor);
 	if (!ubifs_inode_slab)
 		goto out_reg;
 
@@ -28,6 +28,7 @@
 #include <linux/fs.h>
 #include <linux/err.h>
 #include <linux/sched.h>
+#include <linux/ktime.h>
 #include <linux/slab.h>
 #include <linux/vmalloc.h>
 #include <linux/spinlock.h>
@@ -96,6 +97,12 @@
  */
 #define BGT_NAME_PATTERN "ubifs_bgt%d_%d"
 
+/*
+ * Garbage collection thread name pattern. The numbers are UBI device and
+ * volume numbers.
+ */
+#define GCT_NAME_PATTERN "ubifs_gct%d_%d"
+
 /* Write-buffer synchronization timeout interval in seconds */
 #define WBUF_TIMEOUT_SOFTLIMIT 3
 #define WBUF_TIMEOUT_HARDLIMIT 5
@@ -1102,8 +1109,15 @@ struct ubifs_debug_info;
  * @need_bgt: if background thread should run
  * @need_wbuf_sync: if write-buffers have to be synchronized
  *
+ * @gct: UBIFS garbage collection thread
+ * @gct_name: garbage collection thread name
+ * @jnl_last_write: time (jiffies) of the last journal space reservation, used
+ *                  by the garbage collection thread to detect idle periods
+ *
  * @gc_lnum: LEB number used for garbage collection
  * @sbuf: a buffer of LEB size used by GC and replay for scanning
+ * @gc_pbuf: a buffer of LEB size the GC thread reads victim LEBs into before
+ *           it locks the GC head
  * @idx_gc: list of index LEBs that have been garbage collected
  * @idx_gc_cnt: number of elements on the idx_gc list
  * @gc_seq: incremented for every non-index LEB garbage collected
@@ -1338,8 +1352,13 @@ struct ubifs_info {
 	int need_bgt;
 	int need_wbuf_sync;
 
+	struct task_struct *gct;
+	char gct_name[sizeof(GCT_NAME_PATTERN) + 9];
+	unsigned long jnl_last_write;
+
 	int gc_lnum;
 	void *sbuf;
+	void *gc_pbuf;
 	struct list_head idx_gc;
 	int idx_gc_cnt;
 	int gc_seq;
@@ -1618,6 +1637,7 @@ int ubifs_gc_end_commit(struct ubifs_info *c);
 void ubifs_destroy_idx_gc(struct ubifs_info *c);
 int ubifs_get_idx_gc_leb(struct ubifs_info *c);
 int ubifs_garbage_collect_leb(struct ubifs_info *c, struct ubifs_lprops *lp);
+int ubifs_gc_thread(void *info);
 
 /* orphan.c */
 int ubifs_add_orphan(struct ubifs_info *c, ino_t inum);
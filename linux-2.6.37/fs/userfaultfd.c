@@ -0,0 +1,616 @@
+/*
+ *  fs/userfaultfd.c
+ *
+ *  Missing page faults on anonymous memory registered with a userfaultfd
+ *  are not resolved by the kernel. The faulting thread is put to sleep and
+ *  the fault is reported through the file descriptor instead; a user-space
+ *  handler thread reads it, provides the page contents with UFFDIO_COPY and
+ *  so wakes the faulting thread up again. This allows post-copy live
+ *  migration and lazy restore of checkpointed processes.
+ */
+
+#include <linux/file.h>
+#include <linux/poll.h>
+#include <linux/init.h>
+#include <linux/fs.h>
+#include <linux/mm.h>
+#include <linux/mempolicy.h>
+#include <linux/sched.h>
+#include <linux/kernel.h>
+#include <linux/slab.h>
+#include <linux/list.h>
+#include <linux/spinlock.h>
+#include <linux/anon_inodes.h>
+#include <linux/syscalls.h>
+#include <linux/userfaultfd.h>
+
+#include <asm/uaccess.h>
+
+struct userfaultfd_ctx {
+	atomic_t refcount;
+	/* protects pending */
+	spinlock_t lock;
+	/* faulting threads waiting for their page */
+	struct list_head pending;
+	/* readers and pollers of the file descriptor */
+	wait_queue_head_t fd_wqh;
+	unsigned int flags;
+	/* set when the file descriptor is released */
+	bool released;
+	/* the mm the ranges are registered in, pinned by mm_count */
+	struct mm_struct *mm;
+};
+
+/*
+ * One per faulting thread, lives on its stack while it sleeps in
+ * handle_userfault().
+ */
+struct userfaultfd_wait {
+	struct list_head list;
+	unsigned long address;
+	unsigned int flags;
+	struct task_struct *task;
+	/* already returned by read() */
+	bool reported;
+	/* the range was resolved, the fault can be retried */
+	bool woken;
+};
+
+static const struct file_operations userfaultfd_fops;
+
+static void userfaultfd_ctx_get(struct userfaultfd_ctx *ctx)
+{
+	atomic_inc(&ctx->refcount);
+}
+
+static void userfaultfd_ctx_put(struct userfaultfd_ctx *ctx)
+{
+	if (atomic_dec_and_test(&ctx->refcount)) {
+		mmdrop(ctx->mm);
+		kfree(ctx);
+	}
+}
+
+/*
+ * Wake up the threads waiting on faults in [start, start + len).
+ * Called with ctx->lock held.
+ */
+static void __wake_userfault(struct userfaultfd_ctx *ctx,
+			     unsigned long start, unsigned long len)
+{
+	struct userfaultfd_wait *uwq;
+
+	list_for_each_entry(uwq, &ctx->pending, list) {
+		if (uwq->address < start || uwq->address >= start + len)
+			continue;
+		uwq->woken = true;
+		wake_up_process(uwq->task);
+	}
+}
+
+static void wake_userfault(struct userfaultfd_ctx *ctx,
+			   unsigned long start, unsigned long len)
+{
+	spin_lock(&ctx->lock);
+	__wake_userfault(ctx, start, len);
+	spin_unlock(&ctx->lock);
+}
+
+/*
+ * Check whether the page at @address is still missing, that is whether the
+ * faulting thread still has to wait for the handler. The fault is queued
+ * before this runs, so an UFFDIO_COPY racing with it either installed the
+ * pte already or will find the fault on ctx->pending and wake it up.
+ * Called with mmap_sem held for reading.
+ */
+static bool userfaultfd_must_wait(struct mm_struct *mm, unsigned long address)
+{
+	pgd_t *pgd;
+	pud_t *pud;
+	pmd_t *pmd;
+	pte_t *pte;
+	bool ret = true;
+
+	pgd = pgd_offset(mm, address);
+	if (!pgd_present(*pgd))
+		goto out;
+	pud = pud_offset(pgd, address);
+	if (!pud_present(*pud))
+		goto out;
+	pmd = pmd_offset(pud, address);
+	if (!pmd_present(*pmd))
+		goto out;
+	pte = pte_offset_map(pmd, address);
+	if (!pte_none(*pte))
+		ret = false;
+	pte_unmap(pte);
+out:
+	return ret;
+}
+
+/**
+ * handle_userfault - Hands a missing page fault over to user space.
+ * @vma: [in] The faulting vma, registered with a userfaultfd.
+ * @address: [in] The faulting address.
+ * @flags: [in] FAULT_FLAG_* of the fault.
+ *
+ * Called with mmap_sem held for reading. The fault is queued on the
+ * userfaultfd and mmap_sem is released while the thread sleeps, so the
+ * handler can resolve it. Returns VM_FAULT_RETRY after that, or
+ * VM_FAULT_SIGBUS if the fault cannot wait (get_user_pages(), a fault
+ * that was already retried) or the userfaultfd has been closed.
+ */
+int handle_userfault(struct vm_area_struct *vma, unsigned long address,
+		     unsigned int flags)
+{
+	struct mm_struct *mm = vma->vm_mm;
+	struct userfaultfd_ctx *ctx = vma->vm_userfaultfd_ctx;
+	struct userfaultfd_wait uwq;
+	bool must_wait;
+
+	BUG_ON(ctx->mm != mm);
+
+	if (!(flags & FAULT_FLAG_ALLOW_RETRY))
+		return VM_FAULT_SIGBUS;
+
+	uwq.address = address & PAGE_MASK;
+	uwq.flags = flags;
+	uwq.task = current;
+	uwq.reported = false;
+	uwq.woken = false;
+
+	userfaultfd_ctx_get(ctx);
+	spin_lock(&ctx->lock);
+	if (ctx->released) {
+		spin_unlock(&ctx->lock);
+		userfaultfd_ctx_put(ctx);
+		return VM_FAULT_SIGBUS;
+	}
+	list_add_tail(&uwq.list, &ctx->pending);
+	spin_unlock(&ctx->lock);
+	wake_up_poll(&ctx->fd_wqh, POLLIN);
+
+	must_wait = userfaultfd_must_wait(mm, uwq.address);
+	up_read(&mm->mmap_sem);
+
+	while (must_wait) {
+		set_current_state(TASK_KILLABLE);
+		if (ACCESS_ONCE(uwq.woken) || fatal_signal_pending(current))
+			break;
+		schedule();
+	}
+	__set_current_state(TASK_RUNNING);
+
+	spin_lock(&ctx->lock);
+	list_del(&uwq.list);
+	spin_unlock(&ctx->lock);
+	userfaultfd_ctx_put(ctx);
+
+	return VM_FAULT_RETRY;
+}
+
+static int userfaultfd_release(struct inode *inode, struct file *file)
+{
+	struct userfaultfd_ctx *ctx = file->private_data;
+	struct mm_struct *mm = ctx->mm;
+	struct vm_area_struct *vma;
+
+	/*
+	 * Unregister all the ranges, so the faults after this point are
+	 * handled by the kernel again. The mm may be exiting already, in
+	 * which case there are no vmas left to look at.
+	 */
+	if (atomic_inc_not_zero(&mm->mm_users)) {
+		down_write(&mm->mmap_sem);
+		for (vma = mm->mmap; vma; vma = vma->vm_next)
+			if (vma->vm_userfaultfd_ctx == ctx)
+				vma->vm_userfaultfd_ctx = NULL;
+		up_write(&mm->mmap_sem);
+		mmput(mm);
+	}
+
+	spin_lock(&ctx->lock);
+	ctx->released = true;
+	/* wake everybody, the retried faults are handled normally */
+	__wake_userfault(ctx, 0, ULONG_MAX);
+	spin_unlock(&ctx->lock);
+	wake_up_poll(&ctx->fd_wqh, POLLHUP);
+
+	userfaultfd_ctx_put(ctx);
+	return 0;
+}
+
+/* Called with ctx->lock held */
+static struct userfaultfd_wait *find_userfault(struct userfaultfd_ctx *ctx)
+{
+	struct userfaultfd_wait *uwq;
+
+	list_for_each_entry(uwq, &ctx->pending, list)
+		if (!uwq->reported && !uwq->woken)
+			return uwq;
+	return NULL;
+}
+
+static unsigned int userfaultfd_poll(struct file *file, poll_table *wait)
+{
+	struct userfaultfd_ctx *ctx = file->private_data;
+	unsigned int events = 0;
+
+	poll_wait(file, &ctx->fd_wqh, wait);
+
+	spin_lock(&ctx->lock);
+	if (find_userfault(ctx))
+		events |= POLLIN;
+	spin_unlock(&ctx->lock);
+
+	return events;
+}
+
+static ssize_t userfaultfd_ctx_read(struct userfaultfd_ctx *ctx, int no_wait,
+				    struct uffd_msg *msg)
+{
+	struct userfaultfd_wait *uwq;
+	ssize_t res;
+	DECLARE_WAITQUEUE(wait, current);
+
+	spin_lock(&ctx->lock);
+	uwq = find_userfault(ctx);
+	if (!uwq && !no_wait) {
+		__add_wait_queue(&ctx->fd_wqh, &wait);
+		for (;;) {
+			set_current_state(TASK_INTERRUPTIBLE);
+			uwq = find_userfault(ctx);
+			if (uwq)
+				break;
+			if (signal_pending(current))
+				break;
+			spin_unlock(&ctx->lock);
+			schedule();
+			spin_lock(&ctx->lock);
+		}
+		__remove_wait_queue(&ctx->fd_wqh, &wait);
+		__set_current_state(TASK_RUNNING);
+	}
+	if (uwq) {
+		memset(msg, 0, sizeof(*msg));
+		msg->event = UFFD_EVENT_PAGEFAULT;
+		msg->arg.pagefault.address = uwq->address;
+		if (uwq->flags & FAULT_FLAG_WRITE)
+			msg->arg.pagefault.flags |= UFFD_PAGEFAULT_FLAG_WRITE;
+		uwq->reported = true;
+		res = sizeof(*msg);
+	} else
+		res = no_wait ? -EAGAIN : -ERESTARTSYS;
+	spin_unlock(&ctx->lock);
+
+	return res;
+}
+
+static ssize_t userfaultfd_read(struct file *file, char __user *buf,
+				size_t count, loff_t *ppos)
+{
+	struct userfaultfd_ctx *ctx = file->private_data;
+	int no_wait = file->f_flags & O_NONBLOCK;
+	struct uffd_msg msg;
+	ssize_t res, copied = 0;
+
+	if (count < sizeof(msg))
+		return -EINVAL;
+
+	while (count >= sizeof(msg)) {
+		res = userfaultfd_ctx_read(ctx, no_wait, &msg);
+		if (res < 0)
+			return copied ? copied : res;
+		if (copy_to_user(buf, &msg, sizeof(msg)))
+			return copied ? copied : -EFAULT;
+		buf += sizeof(msg);
+		count -= sizeof(msg);
+		copied += sizeof(msg);
+		/* only block for the first message */
+		no_wait = O_NONBLOCK;
+	}
+	return copied;
+}
+
+static int validate_range(struct mm_struct *mm, __u64 start, __u64 len)
+{
+	if (start & ~PAGE_MASK)
+		return -EINVAL;
+	if (len & ~PAGE_MASK)
+		return -EINVAL;
+	if (!len)
+		return -EINVAL;
+	if (start >= TASK_SIZE || len > TASK_SIZE - start)
+		return -EINVAL;
+	return 0;
+}
+
+/*
+ * Only private anonymous memory can be registered: shared and file backed
+ * mappings have a page cache the handler cannot fill atomically.
+ */
+static bool vma_can_userfault(struct vm_area_struct *vma)
+{
+	return !vma->vm_ops && !vma->vm_file &&
+		!(vma->vm_flags & (VM_SHARED | VM_HUGETLB | VM_SPECIAL));
+}
+
+/*
+ * Set the context of every vma in [start, end) to @new_ctx. The vmas are
+ * merged with their neighbours where the contexts now match, and split at
+ * the boundaries of the range where they do not. Called with mmap_sem held
+ * for writing.
+ */
+static int userfaultfd_set_range(struct mm_struct *mm, unsigned long start,
+				 unsigned long end,
+				 struct userfaultfd_ctx *old_ctx,
+				 struct userfaultfd_ctx *new_ctx)
+{
+	struct vm_area_struct *vma, *prev, *cur;
+	unsigned long vma_end;
+	pgoff_t pgoff;
+	int ret;
+
+	vma = find_vma_prev(mm, start, &prev);
+	if (!vma || vma->vm_start > start)
+		return -EINVAL;
+
+	/* check first, so a failure leaves the address space untouched */
+	for (cur = vma; cur && cur->vm_start < end; cur = cur->vm_next) {
+		if (cur->vm_next && cur->vm_end < end &&
+		    cur->vm_end != cur->vm_next->vm_start)
+			return -EINVAL;
+		if (!vma_can_userfault(cur))
+			return -EINVAL;
+		if (new_ctx && cur->vm_userfaultfd_ctx &&
+		    cur->vm_userfaultfd_ctx != new_ctx)
+			return -EBUSY;
+	}
+	for (cur = vma; cur && cur->vm_end < end; cur = cur->vm_next)
+		;
+	if (!cur)
+		return -EINVAL;
+
+	if (vma->vm_start < start)
+		prev = vma;
+
+	do {
+		if (vma->vm_userfaultfd_ctx == new_ctx)
+			goto next;
+		if (old_ctx && vma->vm_userfaultfd_ctx != old_ctx)
+			goto next;
+
+		vma_end = min(end, vma->vm_end);
+		pgoff = vma->vm_pgoff + ((start - vma->vm_start) >> PAGE_SHIFT);
+		prev = vma_merge(mm, prev, start, vma_end, vma->vm_flags,
+				 vma->anon_vma, vma->vm_file, pgoff,
+				 vma_policy(vma), new_ctx);
+		if (prev) {
+			vma = prev;
+			goto set;
+		}
+		if (vma->vm_start < start) {
+			ret = split_vma(mm, vma, start, 1);
+			if (ret)
+				return ret;
+		}
+		if (vma->vm_end > end) {
+			ret = split_vma(mm, vma, end, 0);
+			if (ret)
+				return ret;
+		}
+set:
+		vma->vm_userfaultfd_ctx = new_ctx;
+next:
+		prev = vma;
+		start = vma->vm_end;
+		vma = vma->vm_next;
+	} while (vma && vma->vm_start < end);
+	return 0;
+}
+
+static int userfaultfd_register(struct userfaultfd_ctx *ctx,
+				unsigned long arg)
+{
+	struct mm_struct *mm = ctx->mm;
+	struct uffdio_register uffdio_register;
+	struct uffdio_register __user *user_uffdio_register;
+	int ret;
+
+	user_uffdio_register = (struct uffdio_register __user *) arg;
+	if (copy_from_user(&uffdio_register, user_uffdio_register,
+			   sizeof(uffdio_register) - sizeof(__u64)))
+		return -EFAULT;
+
+	if (uffdio_register.mode != UFFDIO_REGISTER_MODE_MISSING)
+		return -EINVAL;
+	ret = validate_range(mm, uffdio_register.range.start,
+			     uffdio_register.range.len);
+	if (ret)
+		return ret;
+
+	if (!atomic_inc_not_zero(&mm->mm_users))
+		return -ESRCH;
+	down_write(&mm->mmap_sem);
+	ret = userfaultfd_set_range(mm, uffdio_register.range.start,
+				    uffdio_register.range.start +
+				    uffdio_register.range.len, NULL, ctx);
+	up_write(&mm->mmap_sem);
+	mmput(mm);
+	if (ret)
+		return ret;
+
+	if (put_user(UFFD_API_RANGE_IOCTLS, &user_uffdio_register->ioctls))
+		return -EFAULT;
+	return 0;
+}
+
+static int userfaultfd_unregister(struct userfaultfd_ctx *ctx,
+				  unsigned long arg)
+{
+	struct mm_struct *mm = ctx->mm;
+	struct uffdio_range range;
+	int ret;
+
+	if (copy_from_user(&range, (void __user *) arg, sizeof(range)))
+		return -EFAULT;
+	ret = validate_range(mm, range.start, range.len);
+	if (ret)
+		return ret;
+
+	if (!atomic_inc_not_zero(&mm->mm_users))
+		return -ESRCH;
+	down_write(&mm->mmap_sem);
+	ret = userfaultfd_set_range(mm, range.start, range.start + range.len,
+				    ctx, NULL);
+	up_write(&mm->mmap_sem);
+	mmput(mm);
+
+	/* the faults still waiting in the range are handled by the kernel */
+	if (!ret)
+		wake_userfault(ctx, range.start, range.len);
+	return ret;
+}
+
+static int userfaultfd_wake(struct userfaultfd_ctx *ctx, unsigned long arg)
+{
+	struct uffdio_range range;
+	int ret;
+
+	if (copy_from_user(&range, (void __user *) arg, sizeof(range)))
+		return -EFAULT;
+	ret = validate_range(ctx->mm, range.start, range.len);
+	if (ret)
+		return ret;
+
+	wake_userfault(ctx, range.start, range.len);
+	return 0;
+}
+
+static int userfaultfd_copy(struct userfaultfd_ctx *ctx, unsigned long arg)
+{
+	struct uffdio_copy uffdio_copy;
+	struct uffdio_copy __user *user_uffdio_copy;
+	ssize_t ret;
+
+	user_uffdio_copy = (struct uffdio_copy __user *) arg;
+	if (copy_from_user(&uffdio_copy, user_uffdio_copy,
+			   sizeof(uffdio_copy) - sizeof(__s64)))
+		return -EFAULT;
+
+	ret = validate_range(ctx->mm, uffdio_copy.dst, uffdio_copy.len);
+	if (ret)
+		return ret;
+	/* the source is in the address space of the caller */
+	if (uffdio_copy.src & ~PAGE_MASK)
+		return -EINVAL;
+	if (uffdio_copy.src + uffdio_copy.len <= uffdio_copy.src)
+		return -EINVAL;
+	if (uffdio_copy.mode & ~UFFDIO_COPY_MODE_DONTWAKE)
+		return -EINVAL;
+
+	if (atomic_inc_not_zero(&ctx->mm->mm_users)) {
+		ret = mcopy_atomic(ctx->mm, ctx, uffdio_copy.dst,
+				   uffdio_copy.src, uffdio_copy.len);
+		mmput(ctx->mm);
+	} else
+		ret = -ESRCH;
+
+	if (put_user(ret, &user_uffdio_copy->copy))
+		return -EFAULT;
+	/*
+	 * The first page was installed by somebody else, maybe after the
+	 * fault on it was queued: wake the range anyway, a spurious wakeup
+	 * only retries the fault.
+	 */
+	if (ret == -EEXIST && !(uffdio_copy.mode & UFFDIO_COPY_MODE_DONTWAKE))
+		wake_userfault(ctx, uffdio_copy.dst, uffdio_copy.len);
+	if (ret < 0)
+		return ret;
+	BUG_ON(!ret);
+
+	if (!(uffdio_copy.mode & UFFDIO_COPY_MODE_DONTWAKE))
+		wake_userfault(ctx, uffdio_copy.dst, ret);
+	return ret == uffdio_copy.len ? 0 : -EAGAIN;
+}
+
+static int userfaultfd_api(struct userfaultfd_ctx *ctx, unsigned long arg)
+{
+	struct uffdio_api uffdio_api;
+	void __user *buf = (void __user *) arg;
+
+	if (copy_from_user(&uffdio_api, buf, sizeof(uffdio_api)))
+		return -EFAULT;
+	if (uffdio_api.api != UFFD_API || uffdio_api.features) {
+		memset(&uffdio_api, 0, sizeof(uffdio_api));
+		if (copy_to_user(buf, &uffdio_api, sizeof(uffdio_api)))
+			return -EFAULT;
+		return -EINVAL;
+	}
+	uffdio_api.ioctls = UFFD_API_IOCTLS;
+	if (copy_to_user(buf, &uffdio_api, sizeof(uffdio_api)))
+		return -EFAULT;
+	return 0;
+}
+
+static long userfaultfd_ioctl(struct file *file, unsigned cmd,
+			      unsigned long arg)
+{
+	struct userfaultfd_ctx *ctx = file->private_data;
+
+	switch (cmd) {
+	case UFFDIO_API:
+		return userfaultfd_api(ctx, arg);
+	case UFFDIO_REGISTER:
+		return userfaultfd_register(ctx, arg);
+	case UFFDIO_UNREGISTER:
+		return userfaultfd_unregister(ctx, arg);
+	case UFFDIO_WAKE:
+		return userfaultfd_wake(ctx, arg);
+	case UFFDIO_COPY:
+		return userfaultfd_copy(ctx, arg);
+	}
+	return -ENOTTY;
+}
+
+static const struct file_operations userfaultfd_fops = {
+	.release	= userfaultfd_release,
+	.poll		= userfaultfd_poll,
+	.read		= userfaultfd_read,
+	.unlocked_ioctl	= userfaultfd_ioctl,
+	.compat_ioctl	= userfaultfd_ioctl,
+	.llseek		= noop_llseek,
+};
+
+SYSCALL_DEFINE1(userfaultfd, int, flags)
+{
+	struct userfaultfd_ctx *ctx;
+	int fd;
+
+	/* Check the UFFD_* constants for consistency.  */
+	BUILD_BUG_ON(UFFD_CLOEXEC != O_CLOEXEC);
+	BUILD_BUG_ON(UFFD_NONBLOCK != O_NONBLOCK);
+
+	if (flags & ~UFFD_FLAGS_SET)
+		return -EINVAL;
+
+	ctx = kmalloc(sizeof(*ctx), GFP_KERNEL);
+	if (!ctx)
+		return -ENOMEM;
+
+	atomic_set(&ctx->refcount, 1);
+	spin_lock_init(&ctx->lock);
+	INIT_LIST_HEAD(&ctx->pending);
+	init_waitqueue_head(&ctx->fd_wqh);
+	ctx->flags = flags;
+	ctx->released = false;
+	ctx->mm = current->mm;
+	/* prevent the mm struct to be freed */
+	atomic_inc(&ctx->mm->mm_count);
+
+	fd = anon_inode_getfd("[userfaultfd]", &userfaultfd_fops, ctx,
+			      O_RDWR | (flags & UFFD_SHARED_FCNTL_FLAGS));
+	if (fd < 0)
+		userfaultfd_ctx_put(ctx);
+	return fd;
+}
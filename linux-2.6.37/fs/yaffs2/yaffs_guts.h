@@ -576,6 +576,18 @@ struct yaffs_param {
 	/*  Callback to control garbage collection. */
 	unsigned (*gc_control_fn) (struct yaffs_dev *dev);
 
+	/* Optional callbacks used by the yaffs2 scan to read the flash on
+	 * several threads. scan_par_start_fn starts calling fn(dev, arg, i)
+	 * for i = 0 .. n - 1, in any order and possibly concurrently, and
+	 * returns a handle for scan_par_wait_fn, which waits until all the
+	 * calls have returned. If they are not supplied, or start returns
+	 * NULL, the scan does the calls itself.
+	 */
+	void *(*scan_par_start_fn) (struct yaffs_dev *dev,
+			void (*fn) (struct yaffs_dev *dev, void *arg, int i),
+			void *arg, int n);
+	void (*scan_par_wait_fn) (struct yaffs_dev *dev, void *handle);
+
 	/* Debug control flags. Don't use unless you know what you're doing */
 	int use_header_file_size;	/* Flag to determine if we should use
 					 * file sizes from the header */
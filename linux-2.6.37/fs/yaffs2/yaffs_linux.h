@@ -32,6 +32,9 @@ struct yaffs_linux_context {
 	struct task_struct *readdir_process;
 	unsigned mount_id;
 	int dirty;
+	unsigned long last_dirty;	/* jiffies when last marked dirty */
+	unsigned scan_threads;	/* Threads reading the flash while scanning */
+	unsigned mount_ms;	/* Time yaffs_guts_initialise() took */
 };
 
 #define yaffs_dev_to_lc(dev) ((struct yaffs_linux_context *)((dev)->os_context))
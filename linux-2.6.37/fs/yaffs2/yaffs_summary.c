@@ -98,9 +98,10 @@ int yaffs_summary_init(struct yaffs_dev *dev)
 	return YAFFS_OK;
 }
 
-static unsigned yaffs_summary_sum(struct yaffs_dev *dev)
+static unsigned yaffs_summary_sum(struct yaffs_dev *dev,
+				  struct yaffs_summary_tags *st)
 {
-	u8 *sum_buffer = (u8 *)dev->sum_tags;
+	u8 *sum_buffer = (u8 *)st;
 	int i;
 	unsigned sum = 0;
 
@@ -141,7 +142,7 @@ static int yaffs_summary_write(struct yaffs_dev *dev, int blk)
 	hdr.version = YAFFS_SUMMARY_VERSION;
 	hdr.block = blk;
 	hdr.seq = bi->seq_number;
-	hdr.sum = yaffs_summary_sum(dev);
+	hdr.sum = yaffs_summary_sum(dev, dev->sum_tags);
 
 	do {
 		this_tx = n_bytes;
@@ -175,29 +176,26 @@ static int yaffs_summary_write(struct yaffs_dev *dev, int blk)
 	return result;
 }
 
-int yaffs_summary_read(struct yaffs_dev *dev,
+/* Read and check the summary of a block into st, using buffer for the reads.
+ * This does not touch the block info, so it can be used on several blocks
+ * concurrently.
+ */
+static int yaffs_summary_load(struct yaffs_dev *dev,
 			struct yaffs_summary_tags *st,
-			int blk)
+			int blk, u8 *buffer)
 {
 	struct yaffs_ext_tags tags;
-	u8 *buffer;
 	u8 *sum_buffer = (u8 *)st;
 	int n_bytes;
 	int chunk_id;
 	int chunk_in_nand;
-	int chunk_in_block;
 	int result;
 	int this_tx;
 	struct yaffs_summary_header hdr;
 	struct yaffs_block_info *bi = yaffs_get_block_info(dev, blk);
 	int sum_bytes_per_chunk = dev->data_bytes_per_chunk - sizeof(hdr);
-	int sum_tags_bytes;
 
-	sum_tags_bytes = sizeof(struct yaffs_summary_tags) *
-				dev->chunks_per_summary;
-	buffer = yaffs_get_temp_buffer(dev);
 	n_bytes = sizeof(struct yaffs_summary_tags) * dev->chunks_per_summary;
-	chunk_in_block = dev->chunks_per_summary;
 	chunk_in_nand = blk * dev->param.chunks_per_block +
 							dev->chunks_per_summary;
 	chunk_id = 1;
@@ -217,32 +215,61 @@ int yaffs_summary_read(struct yaffs_dev *dev,
 		if (result != YAFFS_OK)
 			break;
 
-		if (st == dev->sum_tags) {
-			/* If we're scanning then update the block info */
-			yaffs_set_chunk_bit(dev, blk, chunk_in_block);
-			bi->pages_in_use++;
-		}
 		memcpy(&hdr, buffer, sizeof(hdr));
 		memcpy(sum_buffer, buffer + sizeof(hdr), this_tx);
 		n_bytes -= this_tx;
 		sum_buffer += this_tx;
 		chunk_in_nand++;
-		chunk_in_block++;
 		chunk_id++;
 	} while (result == YAFFS_OK && n_bytes > 0);
-	yaffs_release_temp_buffer(dev, buffer);
 
 	if (result == YAFFS_OK) {
 		/* Verify header */
 		if (hdr.version != YAFFS_SUMMARY_VERSION ||
 		    hdr.block != blk ||
 		    hdr.seq != bi->seq_number ||
-		    hdr.sum != yaffs_summary_sum(dev))
+		    hdr.sum != yaffs_summary_sum(dev, st))
 			result = YAFFS_FAIL;
 	}
 
+	return result;
+}
+
+/* Account the chunks holding the summary of a scanned block as in use. */
+void yaffs_summary_set_used(struct yaffs_dev *dev, int blk)
+{
+	struct yaffs_block_info *bi = yaffs_get_block_info(dev, blk);
+	int sum_bytes_per_chunk = dev->data_bytes_per_chunk -
+				sizeof(struct yaffs_summary_header);
+	int n_bytes;
+	int chunk_in_block;
+
+	n_bytes = sizeof(struct yaffs_summary_tags) * dev->chunks_per_summary;
+	chunk_in_block = dev->chunks_per_summary;
+	do {
+		yaffs_set_chunk_bit(dev, blk, chunk_in_block);
+		bi->pages_in_use++;
+		n_bytes -= sum_bytes_per_chunk;
+		chunk_in_block++;
+	} while (n_bytes > 0);
+
+	bi->has_summary = 1;
+}
+
+int yaffs_summary_read(struct yaffs_dev *dev,
+			struct yaffs_summary_tags *st,
+			int blk)
+{
+	u8 *buffer;
+	int result;
+
+	buffer = yaffs_get_temp_buffer(dev);
+	result = yaffs_summary_load(dev, st, blk, buffer);
+	yaffs_release_temp_buffer(dev, buffer);
+
+	/* If we're scanning then update the block info */
 	if (st == dev->sum_tags && result == YAFFS_OK)
-		bi->has_summary = 1;
+		yaffs_summary_set_used(dev, blk);
 
 	return result;
 }
@@ -276,14 +303,15 @@ int yaffs_summary_add(struct yaffs_dev *dev,
 	return YAFFS_OK;
 }
 
-int yaffs_summary_fetch(struct yaffs_dev *dev,
+static int yaffs_summary_unpack(struct yaffs_dev *dev,
+			struct yaffs_summary_tags *st,
 			struct yaffs_ext_tags *tags,
 			int chunk_in_block)
 {
 	struct yaffs_packed_tags2_tags_only tags_only;
 	struct yaffs_summary_tags *sum_tags;
 	if (chunk_in_block >= 0 && chunk_in_block < dev->chunks_per_summary) {
-		sum_tags = &dev->sum_tags[chunk_in_block];
+		sum_tags = &st[chunk_in_block];
 		tags_only.chunk_id = sum_tags->chunk_id;
 		tags_only.n_bytes = sum_tags->n_bytes;
 		tags_only.obj_id = sum_tags->obj_id;
@@ -293,6 +321,37 @@ int yaffs_summary_fetch(struct yaffs_dev *dev,
 	return YAFFS_FAIL;
 }
 
+int yaffs_summary_fetch(struct yaffs_dev *dev,
+			struct yaffs_ext_tags *tags,
+			int chunk_in_block)
+{
+	return yaffs_summary_unpack(dev, dev->sum_tags, tags, chunk_in_block);
+}
+
+/* Read the summary of a block and unpack it into tags[0 ..
+ * chunks_per_summary - 1], using buffer for the reads. Like
+ * yaffs_summary_load() this can run on several blocks concurrently.
+ */
+int yaffs_summary_read_tags(struct yaffs_dev *dev, int blk,
+			struct yaffs_ext_tags *tags, u8 *buffer)
+{
+	struct yaffs_summary_tags *st;
+	int result;
+	int i;
+
+	st = kmalloc(sizeof(struct yaffs_summary_tags) *
+			dev->chunks_per_summary, GFP_NOFS);
+	if (!st)
+		return YAFFS_FAIL;
+
+	result = yaffs_summary_load(dev, st, blk, buffer);
+	for (i = 0; result == YAFFS_OK && i < dev->chunks_per_summary; i++)
+		yaffs_summary_unpack(dev, st, &tags[i], i);
+
+	kfree(st);
+	return result;
+}
+
 void yaffs_summary_gc(struct yaffs_dev *dev, int blk)
 {
 	struct yaffs_block_info *bi = yaffs_get_block_info(dev, blk);
@@ -31,6 +31,9 @@ int yaffs_summary_fetch(struct yaffs_dev *dev,
 int yaffs_summary_read(struct yaffs_dev *dev,
 			struct yaffs_summary_tags *st,
 			int blk);
+int yaffs_summary_read_tags(struct yaffs_dev *dev, int blk,
+			struct yaffs_ext_tags *tags, u8 *buffer);
+void yaffs_summary_set_used(struct yaffs_dev *dev, int blk);
 void yaffs_summary_gc(struct yaffs_dev *dev, int blk);
 
 
@@ -48,6 +48,10 @@
 #define YAFFS_COMPILE_EXPORTFS
 #endif
 
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(2, 6, 36))
+#define YAFFS_COMPILE_PARALLEL_SCAN
+#endif
+
 #if (LINUX_VERSION_CODE > KERNEL_VERSION(2, 6, 35))
 #define YAFFS_USE_SETATTR_COPY
 #define YAFFS_USE_TRUNCATE_SETSIZE
@@ -101,6 +105,10 @@
 #ifdef YAFFS_COMPILE_FREEZER
 #include <linux/freezer.h>
 #endif
+#ifdef YAFFS_COMPILE_PARALLEL_SCAN
+#include <linux/workqueue.h>
+#include <linux/completion.h>
+#endif
 
 #include <asm/div64.h>
 
@@ -184,6 +192,7 @@ unsigned int yaffs_auto_checkpoint = 1;
 unsigned int yaffs_gc_control = 1;
 unsigned int yaffs_bg_enable = 1;
 unsigned int yaffs_auto_select = 1;
+unsigned int yaffs_idle_checkpoint = 30;
 /* Module Parameters */
 #if (LINUX_VERSION_CODE > KERNEL_VERSION(2, 5, 0))
 module_param(yaffs_trace_mask, uint, 0644);
@@ -191,6 +200,7 @@ module_param(yaffs_wr_attempts, uint, 0644);
 module_param(yaffs_auto_checkpoint, uint, 0644);
 module_param(yaffs_gc_control, uint, 0644);
 module_param(yaffs_bg_enable, uint, 0644);
+module_param(yaffs_idle_checkpoint, uint, 0644);
 #else
 MODULE_PARM(yaffs_trace_mask, "i");
 MODULE_PARM(yaffs_wr_attempts, "i");
@@ -329,8 +339,11 @@ static void yaffs_set_super_dirty_val(struct yaffs_dev *dev, int val)
 {
 	struct yaffs_linux_context *lc = yaffs_dev_to_lc(dev);
 
-	if (lc)
+	if (lc) {
 		lc->dirty = val;
+		if (val)
+			lc->last_dirty = jiffies;
+	}
 
 # ifdef YAFFS_SUPER_HAS_DIRTY
 	{
@@ -1928,6 +1941,8 @@ static unsigned yaffs_bg_gc_urgency(struct yaffs_dev *dev)
 
 #ifdef YAFFS_COMPILE_BACKGROUND
 
+static int yaffs_do_sync_fs(struct super_block *sb, int request_checkpoint);
+
 void yaffs_background_waker(unsigned long data)
 {
 	wake_up_process((struct task_struct *)data);
@@ -1990,6 +2005,23 @@ static int yaffs_bg_thread_fn(void *data)
                         }
 		}
 		yaffs_gross_unlock(dev);
+
+		/*
+		 * Once the file system has been idle for a while save a
+		 * checkpoint, so that the next mount does not have to scan
+		 * even if this one does not end cleanly.
+		 */
+		if (yaffs_idle_checkpoint && yaffs_bg_enable &&
+		    !dev->is_checkpointed &&
+		    time_after(now, context->last_dirty +
+				    yaffs_idle_checkpoint * HZ)) {
+			yaffs_trace(YAFFS_TRACE_BACKGROUND |
+				    YAFFS_TRACE_CHECKPOINT,
+				"yaffs_background: idle checkpoint");
+			yaffs_do_sync_fs(context->super, 1);
+			/* Don't retry before the next idle period */
+			context->last_dirty = jiffies;
+		}
 #if 1
 		expires = next_dir_update;
 		if (time_before(next_gc, expires))
@@ -2063,6 +2095,106 @@ static void yaffs_bg_stop(struct yaffs_dev *dev)
 }
 #endif
 
+/*
+ * Parallel scanning.
+ * The scan hands us batches of tag reads, which are spread over
+ * scan_threads work items on the unbound system workqueue. Each work item
+ * keeps taking the next index of the batch until there are none left.
+ */
+
+#ifdef YAFFS_COMPILE_PARALLEL_SCAN
+
+struct yaffs_scan_job;
+
+struct yaffs_scan_worker {
+	struct work_struct work;
+	struct yaffs_scan_job *job;
+};
+
+struct yaffs_scan_job {
+	struct yaffs_dev *dev;
+	void (*fn) (struct yaffs_dev *dev, void *arg, int i);
+	void *arg;
+	int n;
+	atomic_t next;
+	atomic_t running;
+	struct completion done;
+	struct yaffs_scan_worker workers[0];
+};
+
+static void yaffs_scan_work_fn(struct work_struct *work)
+{
+	struct yaffs_scan_worker *worker =
+		container_of(work, struct yaffs_scan_worker, work);
+	struct yaffs_scan_job *job = worker->job;
+	int i;
+
+	while ((i = atomic_inc_return(&job->next) - 1) < job->n) {
+		job->fn(job->dev, job->arg, i);
+		cond_resched();
+	}
+
+	if (atomic_dec_and_test(&job->running))
+		complete(&job->done);
+}
+
+static void *yaffs_scan_par_start(struct yaffs_dev *dev,
+			void (*fn) (struct yaffs_dev *dev, void *arg, int i),
+			void *arg, int n)
+{
+	struct yaffs_scan_job *job;
+	int n_workers = min_t(int, yaffs_dev_to_lc(dev)->scan_threads, n);
+	int i;
+
+	if (n_workers < 1)
+		return NULL;
+
+	job = kmalloc(sizeof(*job) + n_workers * sizeof(job->workers[0]),
+			GFP_NOFS);
+	if (!job)
+		return NULL;
+
+	job->dev = dev;
+	job->fn = fn;
+	job->arg = arg;
+	job->n = n;
+	atomic_set(&job->next, 0);
+	atomic_set(&job->running, n_workers);
+	init_completion(&job->done);
+
+	for (i = 0; i < n_workers; i++) {
+		job->workers[i].job = job;
+		INIT_WORK(&job->workers[i].work, yaffs_scan_work_fn);
+		queue_work(system_unbound_wq, &job->workers[i].work);
+	}
+
+	return job;
+}
+
+static void yaffs_scan_par_wait(struct yaffs_dev *dev, void *handle)
+{
+	struct yaffs_scan_job *job = handle;
+
+	wait_for_completion(&job->done);
+	kfree(job);
+}
+
+static void yaffs_scan_par_install(struct yaffs_dev *dev)
+{
+	struct yaffs_param *param = &dev->param;
+
+	if (yaffs_dev_to_lc(dev)->scan_threads < 1 || param->inband_tags)
+		return;
+
+	param->scan_par_start_fn = yaffs_scan_par_start;
+	param->scan_par_wait_fn = yaffs_scan_par_wait;
+}
+#else
+static void yaffs_scan_par_install(struct yaffs_dev *dev)
+{
+}
+#endif
+
 
 static void yaffs_flush_inodes(struct super_block *sb)
 {
@@ -2503,6 +2635,8 @@ struct yaffs_options {
 	int empty_lost_and_found;
 	int empty_lost_and_found_overridden;
 	int disable_summary;
+	int scan_threads;
+	int scan_threads_overridden;
 };
 
 #define MAX_OPT_LEN 30
@@ -2561,6 +2695,10 @@ static int yaffs_parse_options(struct yaffs_options *options,
 		} else if (!strcmp(cur_opt, "no-checkpoint")) {
 			options->skip_checkpoint_read = 1;
 			options->skip_checkpoint_write = 1;
+		} else if (!strncmp(cur_opt, "scan-threads=", 13)) {
+			options->scan_threads =
+				simple_strtoul(cur_opt + 13, NULL, 10);
+			options->scan_threads_overridden = 1;
 		} else {
 			printk(KERN_INFO "yaffs: Bad mount option \"%s\"\n",
 			       cur_opt);
@@ -2610,6 +2748,7 @@ static struct super_block *yaffs_internal_read_super(int yaffs_version,
 	struct yaffs_options options;
 
 	unsigned mount_id;
+	unsigned long mount_start;
 	int found;
 	struct yaffs_linux_context *context_iterator;
 	struct list_head *l;
@@ -2809,6 +2948,10 @@ static struct super_block *yaffs_internal_read_super(int yaffs_version,
 	param->skip_checkpt_rd = options.skip_checkpoint_read;
 	param->skip_checkpt_wr = options.skip_checkpoint_write;
 
+	context->scan_threads = (options.scan_threads_overridden) ?
+				options.scan_threads : num_online_cpus();
+	yaffs_scan_par_install(dev);
+
 	mutex_lock(&yaffs_context_lock);
 	/* Get a mount id */
 	found = 0;
@@ -2836,12 +2979,23 @@ static struct super_block *yaffs_internal_read_super(int yaffs_version,
 
 	yaffs_gross_lock(dev);
 
+	mount_start = jiffies;
 	err = yaffs_guts_initialise(dev);
+	context->mount_ms = jiffies_to_msecs(jiffies - mount_start);
+	context->last_dirty = jiffies;
 
 	yaffs_trace(YAFFS_TRACE_OS,
 		"yaffs_read_super: guts initialised %s",
 		(err == YAFFS_OK) ? "OK" : "FAILED");
 
+	if (err == YAFFS_OK)
+		yaffs_trace(YAFFS_TRACE_ALWAYS,
+			"yaffs: mounted in %u ms (%s, %u scan threads)",
+			context->mount_ms,
+			dev->is_checkpointed ? "checkpoint" : "scan",
+			(param->is_yaffs2 && param->scan_par_start_fn) ?
+				context->scan_threads : 0);
+
 	if (err == YAFFS_OK)
 		yaffs_bg_start(dev);
 
@@ -3070,6 +3224,8 @@ static char *yaffs_dump_dev_part1(char *buf, struct yaffs_dev *dev)
 	buf += sprintf(buf, "n_bg_deletions....... %u\n", dev->n_bg_deletions);
 	buf += sprintf(buf, "tags_used............ %u\n", dev->tags_used);
 	buf += sprintf(buf, "summary_used......... %u\n", dev->summary_used);
+	buf += sprintf(buf, "mount_ms............. %u\n",
+				yaffs_dev_to_lc(dev)->mount_ms);
 
 	return buf;
 }
@@ -31,6 +31,12 @@
 #define YAFFS_CHECKPOINT_MIN_BLOCKS 60
 #define YAFFS_SMALL_HOLE_THRESHOLD 4
 
+/*
+ * Number of blocks the scan reads ahead in one go when the OS supplies
+ * scan_par_start_fn. Two such windows are in flight.
+ */
+#define YAFFS_SCAN_RA_BLOCKS 16
+
 /*
  * Oldest Dirty Sequence Number handling.
  */
@@ -930,13 +936,204 @@ static int yaffs2_ybicmp(const void *a, const void *b)
 	return aseq - bseq;
 }
 
+/*
+ * Parallel scanning.
+ *
+ * Reading the tags is what makes scanning slow. It does not depend on
+ * anything found in other blocks, so it can be done on several threads and
+ * ahead of the scan proper, which has to look at the blocks one at a time
+ * and newest first to build the objects. The reads only touch the block
+ * info of their own block, and the scan never looks at a block that is
+ * still being read.
+ */
+
+struct yaffs_scan_ra_block {
+	int blk;
+	int summary_ok;		/* tags up to chunks_per_summary from summary */
+	int n_tags_read;	/* tags read from the chunks themselves */
+	struct yaffs_ext_tags *tags;
+	u8 *buffer;
+};
+
+struct yaffs_scan_ra {
+	struct yaffs_scan_ra_block *blocks;	/* two windows */
+	int n_blocks[2];
+	int cur;		/* window being scanned */
+	int pos;		/* next block in it */
+	void *handle;		/* the other window being read */
+};
+
+static int yaffs2_scan_par_ok(struct yaffs_dev *dev)
+{
+	/* Inband tags need the shared temporary buffers to read tags */
+	return dev->param.scan_par_start_fn && !dev->param.inband_tags;
+}
+
+static void *yaffs2_scan_par_start(struct yaffs_dev *dev,
+		void (*fn) (struct yaffs_dev *dev, void *arg, int i),
+		void *arg, int n)
+{
+	void *handle = NULL;
+	int i;
+
+	if (yaffs2_scan_par_ok(dev))
+		handle = dev->param.scan_par_start_fn(dev, fn, arg, n);
+
+	if (!handle)
+		for (i = 0; i < n; i++)
+			fn(dev, arg, i);
+
+	return handle;
+}
+
+static void yaffs2_scan_par_wait(struct yaffs_dev *dev, void *handle)
+{
+	if (handle)
+		dev->param.scan_par_wait_fn(dev, handle);
+}
+
+static void yaffs2_query_block_fn(struct yaffs_dev *dev, void *arg, int i)
+{
+	int blk = dev->internal_start_block + i;
+	struct yaffs_block_info *bi = yaffs_get_block_info(dev, blk);
+	enum yaffs_block_state state;
+	u32 seq_number;
+
+	yaffs_query_init_block_state(dev, blk, &state, &seq_number);
+
+	bi->block_state = state;
+	bi->seq_number = seq_number;
+}
+
+static void yaffs2_scan_ra_fn(struct yaffs_dev *dev, void *arg, int i)
+{
+	struct yaffs_scan_ra_block *rab = (struct yaffs_scan_ra_block *)arg + i;
+	struct yaffs_block_info *bi = yaffs_get_block_info(dev, rab->blk);
+	int n_chunks = dev->param.chunks_per_block;
+	int c;
+
+	rab->n_tags_read = 0;
+	rab->summary_ok = dev->sum_tags &&
+		yaffs_summary_read_tags(dev, rab->blk, rab->tags,
+					rab->buffer) == YAFFS_OK;
+	if (rab->summary_ok)
+		n_chunks = dev->chunks_per_summary;
+
+	for (c = 0; c < n_chunks; c++) {
+		if (rab->summary_ok) {
+			rab->tags[c].seq_number = bi->seq_number;
+			if (rab->tags[c].obj_id)
+				continue;
+		}
+		yaffs_rd_chunk_tags_nand(dev,
+				rab->blk * dev->param.chunks_per_block + c,
+				NULL, &rab->tags[c]);
+		rab->n_tags_read++;
+	}
+}
+
+static void yaffs2_scan_ra_free(struct yaffs_scan_ra *ra)
+{
+	int i;
+
+	if (!ra)
+		return;
+
+	for (i = 0; ra->blocks && i < 2 * YAFFS_SCAN_RA_BLOCKS; i++) {
+		kfree(ra->blocks[i].tags);
+		kfree(ra->blocks[i].buffer);
+	}
+	kfree(ra->blocks);
+	kfree(ra);
+}
+
+static struct yaffs_scan_ra *yaffs2_scan_ra_alloc(struct yaffs_dev *dev)
+{
+	struct yaffs_scan_ra *ra;
+	struct yaffs_scan_ra_block *rab;
+	int i;
+
+	if (!yaffs2_scan_par_ok(dev))
+		return NULL;
+
+	ra = kmalloc(sizeof(struct yaffs_scan_ra), GFP_NOFS);
+	if (!ra)
+		return NULL;
+	memset(ra, 0, sizeof(struct yaffs_scan_ra));
+	ra->cur = 1;
+
+	/* Two windows, one being scanned and one being read */
+	rab = kmalloc(2 * YAFFS_SCAN_RA_BLOCKS *
+			sizeof(struct yaffs_scan_ra_block), GFP_NOFS);
+	ra->blocks = rab;
+	if (!rab)
+		goto fail;
+	memset(rab, 0, 2 * YAFFS_SCAN_RA_BLOCKS *
+			sizeof(struct yaffs_scan_ra_block));
+
+	for (i = 0; i < 2 * YAFFS_SCAN_RA_BLOCKS; i++) {
+		rab[i].tags = kmalloc(dev->param.chunks_per_block *
+				sizeof(struct yaffs_ext_tags), GFP_NOFS);
+		rab[i].buffer = kmalloc(dev->param.total_bytes_per_chunk,
+				GFP_NOFS);
+		if (!rab[i].tags || !rab[i].buffer)
+			goto fail;
+	}
+	return ra;
+
+fail:
+	yaffs2_scan_ra_free(ra);
+	return NULL;
+}
+
+/* Start reading block_index[last], block_index[last - 1], ... down to
+ * block_index[first] into the window that is not being scanned.
+ */
+static void yaffs2_scan_ra_start(struct yaffs_dev *dev,
+				struct yaffs_scan_ra *ra,
+				struct yaffs_block_index *block_index,
+				int last, int first)
+{
+	int w = !ra->cur;
+	struct yaffs_scan_ra_block *rab = ra->blocks + w * YAFFS_SCAN_RA_BLOCKS;
+	int i;
+
+	for (i = 0; i < YAFFS_SCAN_RA_BLOCKS && last - i >= first; i++)
+		rab[i].blk = block_index[last - i].block;
+
+	ra->n_blocks[w] = i;
+	ra->handle = NULL;
+	if (i)
+		ra->handle = yaffs2_scan_par_start(dev, yaffs2_scan_ra_fn,
+						rab, i);
+}
+
+/* Get the read ahead block for block_index[block_iter]. When the scan moves
+ * on to the window that has been read ahead, start reading the next one.
+ */
+static struct yaffs_scan_ra_block *
+yaffs2_scan_ra_next(struct yaffs_dev *dev, struct yaffs_scan_ra *ra,
+		struct yaffs_block_index *block_index, int block_iter, int first)
+{
+	if (ra->pos == ra->n_blocks[ra->cur]) {
+		yaffs2_scan_par_wait(dev, ra->handle);
+		ra->cur = !ra->cur;
+		ra->pos = 0;
+		yaffs2_scan_ra_start(dev, ra, block_index,
+				block_iter - ra->n_blocks[ra->cur], first);
+	}
+
+	return ra->blocks + ra->cur * YAFFS_SCAN_RA_BLOCKS + ra->pos++;
+}
+
 static inline int yaffs2_scan_chunk(struct yaffs_dev *dev,
 		struct yaffs_block_info *bi,
 		int blk, int chunk_in_block,
 		int *found_chunks,
 		u8 *chunk_data,
 		struct list_head *hard_list,
-		int summary_available)
+		int summary_available,
+		struct yaffs_ext_tags *ra_tags)
 {
 	struct yaffs_obj_hdr *oh;
 	struct yaffs_obj *in;
@@ -953,16 +1150,23 @@ static inline int yaffs2_scan_chunk(struct yaffs_dev *dev,
 	struct yaffs_hardlink_var *hl_var;
 	struct yaffs_symlink_var *sl_var;
 
-	if (summary_available) {
-		result = yaffs_summary_fetch(dev, &tags, chunk_in_block);
-		tags.seq_number = bi->seq_number;
-	}
-
-	if (!summary_available || tags.obj_id == 0) {
-		result = yaffs_rd_chunk_tags_nand(dev, chunk, NULL, &tags);
-		dev->tags_used++;
+	if (ra_tags) {
+		/* Already read ahead */
+		tags = *ra_tags;
 	} else {
-		dev->summary_used++;
+		if (summary_available) {
+			result = yaffs_summary_fetch(dev, &tags,
+						chunk_in_block);
+			tags.seq_number = bi->seq_number;
+		}
+
+		if (!summary_available || tags.obj_id == 0) {
+			result = yaffs_rd_chunk_tags_nand(dev, chunk, NULL,
+							&tags);
+			dev->tags_used++;
+		} else {
+			dev->summary_used++;
+		}
 	}
 
 	/* Let's have a good look at this chunk... */
@@ -1347,7 +1551,6 @@ int yaffs2_scan_backwards(struct yaffs_dev *dev)
 	int start_iter;
 	int end_iter;
 	int n_to_scan = 0;
-	enum yaffs_block_state state;
 	int c;
 	int deleted;
 	LIST_HEAD(hard_list);
@@ -1360,6 +1563,8 @@ int yaffs2_scan_backwards(struct yaffs_dev *dev)
 	struct yaffs_block_index *block_index = NULL;
 	int alt_block_index = 0;
 	int summary_available;
+	struct yaffs_scan_ra *ra;
+	struct yaffs_scan_ra_block *rab = NULL;
 
 	yaffs_trace(YAFFS_TRACE_SCAN,
 		"yaffs2_scan_backwards starts  intstartblk %d intendblk %d...",
@@ -1388,6 +1593,9 @@ int yaffs2_scan_backwards(struct yaffs_dev *dev)
 	chunk_data = yaffs_get_temp_buffer(dev);
 
 	/* Scan all the blocks to determine their state */
+	yaffs2_scan_par_wait(dev, yaffs2_scan_par_start(dev,
+				yaffs2_query_block_fn, NULL, n_blocks));
+
 	bi = dev->block_info;
 	for (blk = dev->internal_start_block; blk <= dev->internal_end_block;
 	     blk++) {
@@ -1395,10 +1603,7 @@ int yaffs2_scan_backwards(struct yaffs_dev *dev)
 		bi->pages_in_use = 0;
 		bi->soft_del_pages = 0;
 
-		yaffs_query_init_block_state(dev, blk, &state, &seq_number);
-
-		bi->block_state = state;
-		bi->seq_number = seq_number;
+		seq_number = bi->seq_number;
 
 		if (bi->seq_number == YAFFS_SEQUENCE_CHECKPOINT_DATA)
 			bi->block_state = YAFFS_BLOCK_STATE_CHECKPOINT;
@@ -1456,6 +1661,11 @@ int yaffs2_scan_backwards(struct yaffs_dev *dev)
 	end_iter = n_to_scan - 1;
 	yaffs_trace(YAFFS_TRACE_SCAN_DEBUG, "%d blocks to scan", n_to_scan);
 
+	ra = yaffs2_scan_ra_alloc(dev);
+	if (ra)
+		yaffs2_scan_ra_start(dev, ra, block_index, end_iter,
+				start_iter);
+
 	/* For each block.... backwards */
 	for (block_iter = end_iter;
 	     !alloc_failed && block_iter >= start_iter;
@@ -1469,7 +1679,20 @@ int yaffs2_scan_backwards(struct yaffs_dev *dev)
 		bi = yaffs_get_block_info(dev, blk);
 		deleted = 0;
 
-		summary_available = yaffs_summary_read(dev, dev->sum_tags, blk);
+		if (ra) {
+			rab = yaffs2_scan_ra_next(dev, ra, block_index,
+						block_iter, start_iter);
+			summary_available = rab->summary_ok;
+			if (summary_available) {
+				yaffs_summary_set_used(dev, blk);
+				dev->summary_used += dev->chunks_per_summary -
+							rab->n_tags_read;
+			}
+			dev->tags_used += rab->n_tags_read;
+		} else {
+			summary_available =
+				yaffs_summary_read(dev, dev->sum_tags, blk);
+		}
 
 		/* For each chunk in each block that needs scanning.... */
 		found_chunks = 0;
@@ -1488,7 +1711,8 @@ int yaffs2_scan_backwards(struct yaffs_dev *dev)
 			 */
 			if (yaffs2_scan_chunk(dev, bi, blk, c,
 					&found_chunks, chunk_data,
-					&hard_list, summary_available) ==
+					&hard_list, summary_available,
+					rab ? &rab->tags[c] : NULL) ==
 					YAFFS_FAIL)
 				alloc_failed = 1;
 		}
@@ -1509,6 +1733,12 @@ int yaffs2_scan_backwards(struct yaffs_dev *dev)
 
 	yaffs_skip_rest_of_block(dev);
 
+	if (ra) {
+		/* We may have stopped early */
+		yaffs2_scan_par_wait(dev, ra->handle);
+		yaffs2_scan_ra_free(ra);
+	}
+
 	if (alt_block_index)
 		vfree(block_index);
 	else
@@ -647,8 +647,19 @@ __SYSCALL(__NR_fanotify_init, sys_fanotify_init)
 #define __NR_fanotify_mark 263
 __SYSCALL(__NR_fanotify_mark, sys_fanotify_mark)
 
+#define __NR_userfaultfd 264
+__SYSCALL(__NR_userfaultfd, sys_userfaultfd)
+
+/* fs/io_uring.c */
+#define __NR_io_uring_setup 265
+__SYSCALL(__NR_io_uring_setup, sys_io_uring_setup)
+#define __NR_io_uring_enter 266
+__SYSCALL(__NR_io_uring_enter, sys_io_uring_enter)
+#define __NR_io_uring_register 267
+__SYSCALL(__NR_io_uring_register, sys_io_uring_register)
+
 #undef __NR_syscalls
-#define __NR_syscalls 264
+#define __NR_syscalls 268
 
 /*
  * All syscalls below here should go away really,
@@ -123,6 +123,22 @@ struct kiocb {
 	 * this is the underlying eventfd context to deliver events to.
 	 */
 	struct eventfd_ctx	*ki_eventfd;
+
+	/*
+	 * Completion callback for iocbs that are not owned by an aio
+	 * context (io_uring), called by aio_complete() instead of filling
+	 * in an io_event. May be called from interrupt context.
+	 */
+	void			(*ki_complete)(struct kiocb *, long, long);
+
+	/*
+	 * If not NULL, the user buffers of this iocb lie within a region
+	 * whose pages were pinned in advance: ki_pages[0] backs the page
+	 * at user address ki_pages_addr, which is page aligned. Direct I/O
+	 * takes the pages from here instead of calling get_user_pages().
+	 */
+	struct page		**ki_pages;
+	unsigned long		ki_pages_addr;
 };
 
 #define is_sync_kiocb(iocb)	((iocb)->ki_key == KIOCB_SYNC_KEY)
@@ -139,6 +155,8 @@ struct kiocb {
 		(x)->ki_dtor = NULL;			\
 		(x)->ki_obj.tsk = tsk;			\
 		(x)->ki_user_data = 0;                  \
+		(x)->ki_complete = NULL;		\
+		(x)->ki_pages = NULL;			\
 	} while (0)
 
 #define AIO_RING_MAGIC			0xa10a10a1
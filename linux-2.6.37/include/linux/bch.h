@@ -0,0 +1,62 @@
+/*
+ * Generic binary BCH encoding/decoding library
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published by
+ * the Free Software Foundation.
+ */
+#ifndef _BCH_H
+#define _BCH_H
+
+#include <linux/types.h>
+
+/**
+ * struct bch_control - BCH control structure
+ * @m:		Galois field order, codewords are at most 2^m-1 bits long
+ * @n:		maximum codeword length in bits (= 2^m-1)
+ * @t:		number of correctable bit errors per codeword
+ * @ecc_bits:	number of ecc bits, i.e. degree of the generator polynomial
+ * @ecc_bytes:	number of ecc bytes, enough for m*t bits
+ * @ecc_words:	number of 32-bit words the encoder works with
+ * @a_pow_tab:	Galois field power table, alpha^i
+ * @a_log_tab:	Galois field log table
+ * @mod8_tab:	remainder tables of the encoder, for each byte of a word
+ * @ecc_buf:	encoder and decoder scratch buffers
+ * @ecc_buf2:
+ * @syn:	syndromes S_1 to S_2t
+ * @elp:	error locator polynomial and Berlekamp-Massey scratch
+ * @elp_prev:
+ * @elp_tmp:
+ *
+ * A control structure is used by one thread at a time.
+ */
+struct bch_control {
+	unsigned int	m;
+	unsigned int	n;
+	unsigned int	t;
+	unsigned int	ecc_bits;
+	unsigned int	ecc_bytes;
+	unsigned int	ecc_words;
+	uint16_t	*a_pow_tab;
+	uint16_t	*a_log_tab;
+	uint32_t	*mod8_tab;
+	uint32_t	*ecc_buf;
+	uint32_t	*ecc_buf2;
+	unsigned int	*syn;
+	unsigned int	*elp;
+	unsigned int	*elp_prev;
+	unsigned int	*elp_tmp;
+};
+
+struct bch_control *init_bch(int m, int t, unsigned int prim_poly);
+
+void free_bch(struct bch_control *bch);
+
+void encode_bch(struct bch_control *bch, const uint8_t *data,
+		unsigned int len, uint8_t *ecc);
+
+int decode_bch(struct bch_control *bch, const uint8_t *data, unsigned int len,
+	       const uint8_t *recv_ecc, const uint8_t *calc_ecc,
+	       unsigned int *errloc);
+
+#endif /* _BCH_H */
@@ -17,6 +17,34 @@ struct block_device;
 typedef void (bio_end_io_t) (struct bio *, int);
 typedef void (bio_destructor_t) (struct bio *);
 
+/*
+ * Poll cookie of a bio: which hardware queue and tag of a blk-mq device
+ * it was queued as, see blk_poll().
+ */
+typedef unsigned int blk_qc_t;
+#define BLK_QC_T_NONE		-1U
+#define BLK_QC_T_SHIFT		16
+
+static inline bool blk_qc_t_valid(blk_qc_t cookie)
+{
+	return cookie != BLK_QC_T_NONE;
+}
+
+static inline blk_qc_t blk_tag_to_qc_t(unsigned int tag, unsigned int queue_num)
+{
+	return tag | (queue_num << BLK_QC_T_SHIFT);
+}
+
+static inline unsigned int blk_qc_t_to_queue_num(blk_qc_t cookie)
+{
+	return cookie >> BLK_QC_T_SHIFT;
+}
+
+static inline unsigned int blk_qc_t_to_tag(blk_qc_t cookie)
+{
+	return cookie & ((1u << BLK_QC_T_SHIFT) - 1);
+}
+
 /*
  * was unsigned short, but we might as well be ready for > 64kB I/O pages
  */
@@ -61,6 +89,8 @@ struct bio {
 
 	unsigned int		bi_comp_cpu;	/* completion CPU */
 
+	blk_qc_t		bi_cookie;	/* set by blk-mq on submission */
+
 	atomic_t		bi_cnt;		/* pin count */
 
 	struct bio_vec		*bi_io_vec;	/* the actual vec list */
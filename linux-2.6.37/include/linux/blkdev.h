@@ -28,8 +28,12 @@ struct request_queue;
 struct elevator_queue;
 struct request_pm_state;
 struct blk_trace;
+struct rq_wb;
 struct request;
 struct sg_io_hdr;
+struct blk_mq_ops;
+struct blk_mq_ctx;
+struct blk_mq_hw_ctx;
 
 #define BLKDEV_MIN_RQ	4
 #define BLKDEV_MAX_RQ	128	/* Default maximum */
@@ -81,6 +85,7 @@ struct request {
 	struct call_single_data csd;
 
 	struct request_queue *q;
+	struct blk_mq_ctx *mq_ctx;
 
 	unsigned int cmd_flags;
 	enum rq_cmd_type_bits cmd_type;
@@ -120,6 +125,10 @@ struct request {
 #ifdef CONFIG_BLK_CGROUP
 	unsigned long long start_time_ns;
 	unsigned long long io_start_time_ns;    /* when passed to hardware */
+#endif
+	u64 issue_time_ns;	/* blk-mq and wbt, when passed to the driver */
+#ifdef CONFIG_BLK_WBT
+	unsigned char wbt_flags;	/* WBT_* flags, see blk-wbt.h */
 #endif
 	/* Number of scatter-gather DMA addr+len pairs after
 	 * physical address coalescing is performed.
@@ -271,6 +280,17 @@ struct request_queue
 
 	request_fn_proc		*request_fn;
 	make_request_fn		*make_request_fn;
+
+	/*
+	 * multi-queue: per-cpu software queues mapped to hardware queues
+	 */
+	struct blk_mq_ops	*mq_ops;
+	unsigned int		*mq_map;
+	struct blk_mq_ctx __percpu	*queue_ctx;
+	struct blk_mq_hw_ctx	**queue_hw_ctx;
+	unsigned int		nr_hw_queues;
+	int			poll_nsec;	/* see blk_poll() */
+
 	prep_rq_fn		*prep_rq_fn;
 	unprep_rq_fn		*unprep_rq_fn;
 	unplug_fn		*unplug_fn;
@@ -379,6 +399,11 @@ struct request_queue
 	/* Throttle data */
 	struct throtl_data *td;
 #endif
+
+#ifdef CONFIG_BLK_WBT
+	/* Writeback throttling */
+	struct rq_wb *rq_wb;
+#endif
 };
 
 #define QUEUE_FLAG_QUEUED	1	/* uses generic tag queueing */
@@ -401,12 +426,16 @@ struct request_queue
 #define QUEUE_FLAG_NOXMERGES   17	/* No extended merges */
 #define QUEUE_FLAG_ADD_RANDOM  18	/* Contributes to random pool */
 #define QUEUE_FLAG_SECDISCARD  19	/* supports SECDISCARD */
+#define QUEUE_FLAG_POLL        20	/* polled completions enabled */
 
 #define QUEUE_FLAG_DEFAULT	((1 << QUEUE_FLAG_IO_STAT) |		\
 				 (1 << QUEUE_FLAG_STACKABLE)	|	\
 				 (1 << QUEUE_FLAG_SAME_COMP)	|	\
 				 (1 << QUEUE_FLAG_ADD_RANDOM))
 
+#define QUEUE_FLAG_MQ_DEFAULT	((1 << QUEUE_FLAG_STACKABLE)	|	\
+				 (1 << QUEUE_FLAG_SAME_COMP))
+
 static inline int queue_is_locked(struct request_queue *q)
 {
 #ifdef CONFIG_SMP
@@ -702,6 +731,7 @@ extern void blk_sync_queue(struct request_queue *q);
 extern void __blk_stop_queue(struct request_queue *q);
 extern void __blk_run_queue(struct request_queue *q, bool force_kblockd);
 extern void blk_run_queue(struct request_queue *);
+extern bool blk_poll(struct request_queue *q, blk_qc_t cookie);
 extern int blk_rq_map_user(struct request_queue *, struct request *,
 			   struct rq_map_data *, void __user *, unsigned long,
 			   gfp_t);
@@ -716,6 +746,61 @@ extern void blk_execute_rq_nowait(struct request_queue *, struct gendisk *,
 				  struct request *, int, rq_end_io_fn *);
 extern void blk_unplug(struct request_queue *q);
 
+/*
+ * blk_plug allows for build up of queue of related requests by holding the
+ * I/O fragments for a short period. This allows merging of sequential
+ * requests into single larger request. As the requests are moved from
+ * a per-task list to the device's request_queue in a batch, this results
+ * in improved scalability as the lock contention for request_queue lock
+ * is reduced.
+ *
+ * It is ok not to disable preemption when adding the request to the plug
+ * list or when attempting a merge, because blk_schedule_flush_plug() will
+ * only flush the plug list when the task sleeps by itself. For details,
+ * please see schedule() where blk_schedule_flush_plug() is called.
+ */
+struct blk_plug {
+	unsigned long magic;
+	struct list_head list;
+	struct list_head mq_list;	/* blk-mq requests */
+	unsigned int count;
+	unsigned int should_sort;
+};
+#define BLK_MAX_REQUEST_COUNT 16
+
+extern void blk_start_plug(struct blk_plug *);
+extern void blk_finish_plug(struct blk_plug *);
+extern void blk_flush_plug_list(struct blk_plug *, bool);
+
+static inline void blk_flush_plug(struct task_struct *tsk)
+{
+	struct blk_plug *plug = tsk->plug;
+
+	if (plug)
+		blk_flush_plug_list(plug, false);
+}
+
+/*
+ * Flush on behalf of a task that is about to sleep: its state is already
+ * set, so queues that may block in their dispatch path are run from
+ * kblockd instead of in this context.
+ */
+static inline void blk_schedule_flush_plug(struct task_struct *tsk)
+{
+	struct blk_plug *plug = tsk->plug;
+
+	if (plug)
+		blk_flush_plug_list(plug, true);
+}
+
+static inline bool blk_needs_flush_plug(struct task_struct *tsk)
+{
+	struct blk_plug *plug = tsk->plug;
+
+	return plug && (!list_empty(&plug->list) ||
+			!list_empty(&plug->mq_list));
+}
+
 static inline struct request_queue *bdev_get_queue(struct block_device *bdev)
 {
 	return bdev->bd_disk->queue;
@@ -1271,11 +1356,37 @@ extern int __blkdev_driver_ioctl(struct block_device *, fmode_t, unsigned int,
  */
 #define buffer_heads_over_limit 0
 
+struct task_struct;
+
 static inline long nr_blockdev_pages(void)
 {
 	return 0;
 }
 
+struct blk_plug {
+};
+
+static inline void blk_start_plug(struct blk_plug *plug)
+{
+}
+
+static inline void blk_finish_plug(struct blk_plug *plug)
+{
+}
+
+static inline void blk_flush_plug(struct task_struct *tsk)
+{
+}
+
+static inline void blk_schedule_flush_plug(struct task_struct *tsk)
+{
+}
+
+static inline bool blk_needs_flush_plug(struct task_struct *tsk)
+{
+	return false;
+}
+
 #endif /* CONFIG_BLOCK */
 
 #endif
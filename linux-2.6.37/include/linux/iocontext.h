@@ -27,6 +27,39 @@ struct cfq_io_context {
 	struct rcu_head rcu_head;
 };
 
+struct bfq_queue;
+struct bfq_io_context {
+	void *key;
+
+	struct bfq_queue *bfqq[2];
+
+	struct io_context *ioc;
+
+	unsigned long last_end_request;
+
+	unsigned long ttime_total;
+	unsigned long ttime_samples;
+	unsigned long ttime_mean;
+
+	struct list_head queue_list;
+	struct hlist_node cic_list;
+
+	void (*dtor)(struct io_context *); /* destructor */
+	void (*exit)(struct io_context *); /* called on task exit */
+
+	struct rcu_head rcu_head;
+};
+
+/*
+ * Bits in io_context->ioprio_changed and ->cgroup_changed. Every I/O
+ * scheduler that keeps per-process state notices the change on its own.
+ */
+enum {
+	IOC_CFQ_CHANGED,
+	IOC_BFQ_CHANGED,
+	IOC_CHANGED_ALL = (1 << IOC_CFQ_CHANGED) | (1 << IOC_BFQ_CHANGED),
+};
+
 /*
  * I/O subsystem state of the associated processes.  It is refcounted
  * and kmalloc'ed. These could be shared between processes.
@@ -39,10 +72,10 @@ struct io_context {
 	spinlock_t lock;
 
 	unsigned short ioprio;
-	unsigned short ioprio_changed;
+	unsigned long ioprio_changed;
 
 #if defined(CONFIG_BLK_CGROUP) || defined(CONFIG_BLK_CGROUP_MODULE)
-	unsigned short cgroup_changed;
+	unsigned long cgroup_changed;
 #endif
 
 	/*
@@ -54,6 +87,10 @@ struct io_context {
 	struct radix_tree_root radix_root;
 	struct hlist_head cic_list;
 	void __rcu *ioc_data;
+
+	struct radix_tree_root bfq_radix_root;
+	struct hlist_head bfq_cic_list;
+	void __rcu *bfq_ioc_data;
 };
 
 static inline struct io_context *ioc_task_link(struct io_context *ioc)
@@ -18,6 +18,7 @@
 #include <linux/blkdev.h>
 #include <linux/spinlock.h>
 #include <linux/mutex.h>
+#include <linux/workqueue.h>
 
 /* Possible states of device */
 enum {
@@ -56,12 +57,19 @@ struct loop_device {
 	gfp_t		old_gfp_mask;
 
 	spinlock_t		lo_lock;
-	struct bio_list		lo_bio_list;
 	int			lo_state;
 	struct mutex		lo_ctl_mutex;
-	struct task_struct	*lo_thread;
 	wait_queue_head_t	lo_event;
 
+	/* commands handed to lo_wq and not yet completed */
+	struct workqueue_struct	*lo_wq;
+	atomic_t		lo_pending;
+	struct list_head	lo_write_list;
+	struct work_struct	lo_write_work;
+	/* commands held back while the backing file is switched */
+	bool			lo_switching;
+	struct list_head	lo_held_list;
+
 	struct request_queue	*lo_queue;
 	struct gendisk		*lo_disk;
 	struct list_head	lo_list;
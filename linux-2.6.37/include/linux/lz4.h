@@ -0,0 +1,62 @@
+#ifndef __LZ4_H__
+#define __LZ4_H__
+/*
+ *  LZ4 Public Kernel Interface
+ *
+ *  LZ4 is a byte-oriented LZ77 compressor with a very fast decoder. The
+ *  data format is the LZ4 block format: a series of sequences, each a
+ *  token byte, literals and a 16-bit match offset. Nothing else is
+ *  stored, so callers must keep track of the compressed and
+ *  uncompressed lengths themselves.
+ */
+
+#define LZ4_HASH_LOG		12
+#define LZ4HC_HASH_LOG		15
+#define LZ4HC_MAX_DISTANCE	65536
+
+/* Working memory needed by lz4_compress() */
+#define LZ4_MEM_COMPRESS	((1 << LZ4_HASH_LOG) * sizeof(u32))
+
+/* Working memory needed by lz4hc_compress() */
+#define LZ4HC_MEM_COMPRESS	((1 << LZ4HC_HASH_LOG) * sizeof(u32) + \
+				 LZ4HC_MAX_DISTANCE * sizeof(u16) + \
+				 2 * sizeof(void *))
+
+/* Worst case compressed size of 'x' bytes of incompressible input */
+#define lz4_compressbound(x)	((x) + ((x) / 255) + 16)
+
+/*
+ * Fast compression. On entry *dst_len is the size of the dst buffer, on
+ * success it is set to the compressed length. A dst buffer of
+ * lz4_compressbound(src_len) bytes is always big enough. Requires
+ * 'wrkmem' of size LZ4_MEM_COMPRESS.
+ */
+int lz4_compress(const unsigned char *src, size_t src_len,
+		unsigned char *dst, size_t *dst_len, void *wrkmem);
+
+/*
+ * High compression variant, same block format and the same decoder, but
+ * much slower to compress. Meant for offline packing. Requires 'wrkmem'
+ * of size LZ4HC_MEM_COMPRESS.
+ */
+int lz4hc_compress(const unsigned char *src, size_t src_len,
+		unsigned char *dst, size_t *dst_len, void *wrkmem);
+
+/*
+ * Safe decompression with overrun testing. On entry *dst_len is the size
+ * of the dst buffer, on success it is set to the decompressed length.
+ * Corrupt input never makes the decoder read or write out of bounds.
+ */
+int lz4_decompress_safe(const unsigned char *src, size_t src_len,
+		unsigned char *dst, size_t *dst_len);
+
+/*
+ * Return values (< 0 = Error)
+ */
+#define LZ4_E_OK			0
+#define LZ4_E_ERROR			(-1)
+#define LZ4_E_INPUT_OVERRUN		(-4)
+#define LZ4_E_OUTPUT_OVERRUN		(-5)
+#define LZ4_E_LOOKBEHIND_OVERRUN	(-6)
+
+#endif
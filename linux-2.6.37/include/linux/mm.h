@@ -1256,6 +1256,14 @@ static inline void vma_nonlinear_insert(struct vm_area_struct *vma,
 	list_add_tail(&vma->shared.vm_set.list, list);
 }
 
+/* userfaultfd context the missing faults of a vma are delivered to */
+struct userfaultfd_ctx;
+#ifdef CONFIG_USERFAULTFD
+#define vma_uffd_ctx(vma)	((vma)->vm_userfaultfd_ctx)
+#else
+#define vma_uffd_ctx(vma)	(NULL)
+#endif
+
 /* mmap.c */
 extern int __vm_enough_memory(struct mm_struct *mm, long pages, int cap_sys_admin);
 extern int vma_adjust(struct vm_area_struct *vma, unsigned long start,
@@ -1263,7 +1271,7 @@ extern int vma_adjust(struct vm_area_struct *vma, unsigned long start,
 extern struct vm_area_struct *vma_merge(struct mm_struct *,
 	struct vm_area_struct *prev, unsigned long addr, unsigned long end,
 	unsigned long vm_flags, struct anon_vma *, struct file *, pgoff_t,
-	struct mempolicy *);
+	struct mempolicy *, struct userfaultfd_ctx *);
 extern struct anon_vma *find_mergeable_anon_vma(struct vm_area_struct *);
 extern int split_vma(struct mm_struct *,
 	struct vm_area_struct *, unsigned long addr, int new_below);
@@ -1354,7 +1362,21 @@ void page_cache_async_readahead(struct address_space *mapping,
 				pgoff_t offset,
 				unsigned long size);
 
+/* Access patterns reported by the readahead tracepoints */
+enum readahead_pattern {
+	RA_PATTERN_INITIAL,
+	RA_PATTERN_SEQUENTIAL,
+	RA_PATTERN_INTERLEAVED,
+	RA_PATTERN_CONTEXT,
+	RA_PATTERN_OVERSIZE,
+	RA_PATTERN_RANDOM,
+	RA_PATTERN_MMAP_AROUND,
+};
+
 unsigned long max_sane_readahead(unsigned long nr);
+unsigned long ra_max_pages(struct file_ra_state *ra);
+void ra_account(struct file_ra_state *ra, unsigned long hit,
+		unsigned long miss, bool interleaved);
 unsigned long ra_submit(struct file_ra_state *ra,
 			struct address_space *mapping,
 			struct file *filp);
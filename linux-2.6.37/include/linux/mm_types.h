@@ -183,6 +183,10 @@ struct vm_area_struct {
 #ifdef CONFIG_NUMA
 	struct mempolicy *vm_policy;	/* NUMA policy for the VMA */
 #endif
+#ifdef CONFIG_USERFAULTFD
+	/* userfaultfd the missing faults are delivered to, or NULL */
+	struct userfaultfd_ctx *vm_userfaultfd_ctx;
+#endif
 };
 
 struct core_thread {
@@ -106,6 +106,9 @@ enum zone_stat_item {
 	NR_SHMEM,		/* shmem pages (included tmpfs/GEM pages) */
 	NR_DIRTIED,		/* page dirtyings since bootup */
 	NR_WRITTEN,		/* page writings since bootup */
+	ZONE_LOCK_ACQUIRED,	/* zone->lock taken by the allocator */
+	ZONE_LOCK_CONTENDED,	/* ... and found held by another cpu */
+	PCP_REMOTE_FREE,	/* pages handed over to another cpu's pcp */
 #ifdef CONFIG_NUMA
 	NUMA_HIT,		/* allocated in intended node */
 	NUMA_MISS,		/* allocated in non intended node */
@@ -175,6 +178,15 @@ struct per_cpu_pages {
 
 	/* Lists of pages, one per migrate type stored on the pcp-lists */
 	struct list_head lists[MIGRATE_PCPTYPES];
+#ifdef CONFIG_SMP
+	/*
+	 * Pages freed on other cpus and handed over to this one in batches,
+	 * so that they need not go through zone->lock twice.
+	 */
+	spinlock_t remote_lock;
+	int remote_count;
+	struct list_head remote_lists[MIGRATE_PCPTYPES];
+#endif
 };
 
 struct per_cpu_pageset {
@@ -316,6 +328,10 @@ struct zone {
 	 */
 	spinlock_t		lock;
 	int                     all_unreclaimable; /* All pages pinned */
+#ifdef CONFIG_SMP
+	/* last cpu which had to refill its pcp lists from the buddy lists */
+	int			pcp_refill_cpu;
+#endif
 #ifdef CONFIG_MEMORY_HOTPLUG
 	/* see spanned/present_pages for more description */
 	seqlock_t		span_seqlock;
@@ -188,6 +188,9 @@ enum access_mode {
  * @select_bank: callback to select a certain bank, this is
  * platform-specific. If the controller only supports one bank
  * this may be set to NULL
+ * @bch_ecc_bits: if not 0, correct this many bit errors per 512 bytes with
+ * software BCH (CONFIG_MTD_NAND_ECC_BCH) instead of the controller ECC, for
+ * large page chips that need more than the hardware provides
  */
 struct fsmc_nand_platform_data {
 	const struct fsmc_nand_timings *nand_timings;
@@ -208,6 +211,8 @@ struct fsmc_nand_platform_data {
 	/* priv structures for dma accesses */
 	void			*read_dma_priv;
 	void			*write_dma_priv;
+
+	unsigned int		bch_ecc_bits;
 };
 
 extern int __init fsmc_nor_init(struct platform_device *pdev,
@@ -38,6 +38,14 @@ struct res_counter {
 	 * the limit that usage can be exceed
 	 */
 	unsigned long long soft_limit;
+	/*
+	 * usage above which background reclaim is started
+	 */
+	unsigned long long low_wmark_limit;
+	/*
+	 * usage below which background reclaim stops
+	 */
+	unsigned long long high_wmark_limit;
 	/*
 	 * the number of unsuccessful attempts to consume the resource
 	 */
@@ -92,6 +100,8 @@ enum {
 	RES_LIMIT,
 	RES_FAILCNT,
 	RES_SOFT_LIMIT,
+	RES_LOW_WMARK_LIMIT,
+	RES_HIGH_WMARK_LIMIT,
 };
 
 /*
@@ -145,6 +155,24 @@ static inline bool res_counter_soft_limit_check_locked(struct res_counter *cnt)
 	return false;
 }
 
+static inline bool
+res_counter_low_wmark_limit_check_locked(struct res_counter *cnt)
+{
+	if (cnt->usage < cnt->low_wmark_limit)
+		return true;
+
+	return false;
+}
+
+static inline bool
+res_counter_high_wmark_limit_check_locked(struct res_counter *cnt)
+{
+	if (cnt->usage < cnt->high_wmark_limit)
+		return true;
+
+	return false;
+}
+
 /**
  * Get the difference between the usage and the soft limit
  * @cnt: The counter
@@ -193,6 +221,35 @@ static inline bool res_counter_check_under_soft_limit(struct res_counter *cnt)
 	return ret;
 }
 
+/*
+ * Watermark checks used by the background reclaim. Being under the low
+ * watermark means no background reclaim is needed, being under the high
+ * watermark means the background reclaim has done its job.
+ */
+static inline bool
+res_counter_check_under_low_wmark_limit(struct res_counter *cnt)
+{
+	bool ret;
+	unsigned long flags;
+
+	spin_lock_irqsave(&cnt->lock, flags);
+	ret = res_counter_low_wmark_limit_check_locked(cnt);
+	spin_unlock_irqrestore(&cnt->lock, flags);
+	return ret;
+}
+
+static inline bool
+res_counter_check_under_high_wmark_limit(struct res_counter *cnt)
+{
+	bool ret;
+	unsigned long flags;
+
+	spin_lock_irqsave(&cnt->lock, flags);
+	ret = res_counter_high_wmark_limit_check_locked(cnt);
+	spin_unlock_irqrestore(&cnt->lock, flags);
+	return ret;
+}
+
 static inline void res_counter_reset_max(struct res_counter *cnt)
 {
 	unsigned long flags;
@@ -238,4 +295,21 @@ res_counter_set_soft_limit(struct res_counter *cnt,
 	return 0;
 }
 
+static inline int
+res_counter_set_wmark_limits(struct res_counter *cnt,
+			     unsigned long long low_wmark_limit,
+			     unsigned long long high_wmark_limit)
+{
+	unsigned long flags;
+
+	if (high_wmark_limit > low_wmark_limit)
+		return -EINVAL;
+
+	spin_lock_irqsave(&cnt->lock, flags);
+	cnt->low_wmark_limit = low_wmark_limit;
+	cnt->high_wmark_limit = high_wmark_limit;
+	spin_unlock_irqrestore(&cnt->lock, flags);
+	return 0;
+}
+
 #endif
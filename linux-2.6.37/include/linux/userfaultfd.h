@@ -0,0 +1,147 @@
+/*
+ *  include/linux/userfaultfd.h
+ *
+ *  Missing page faults on registered anonymous ranges delivered to a
+ *  user-space handler through a file descriptor.
+ */
+
+#ifndef _LINUX_USERFAULTFD_H
+#define _LINUX_USERFAULTFD_H
+
+#include <linux/types.h>
+#include <linux/ioctl.h>
+
+#define UFFD_API ((__u64)0xAA)
+
+/* userfaultfd() flags, same values as O_CLOEXEC and O_NONBLOCK */
+#define UFFD_CLOEXEC		02000000
+#define UFFD_NONBLOCK		00004000
+
+#define UFFDIO			0xAA
+#define UFFDIO_API		_IOWR(UFFDIO, 0x3F, struct uffdio_api)
+#define UFFDIO_REGISTER		_IOWR(UFFDIO, 0x00, struct uffdio_register)
+#define UFFDIO_UNREGISTER	_IOR(UFFDIO, 0x01, struct uffdio_range)
+#define UFFDIO_WAKE		_IOR(UFFDIO, 0x02, struct uffdio_range)
+#define UFFDIO_COPY		_IOWR(UFFDIO, 0x03, struct uffdio_copy)
+
+/* bits of uffdio_api.ioctls and uffdio_register.ioctls */
+#define _UFFDIO_REGISTER	(0x00)
+#define _UFFDIO_UNREGISTER	(0x01)
+#define _UFFDIO_WAKE		(0x02)
+#define _UFFDIO_COPY		(0x03)
+#define _UFFDIO_API		(0x3F)
+
+#define UFFD_API_IOCTLS				\
+	((__u64)1 << _UFFDIO_REGISTER |		\
+	 (__u64)1 << _UFFDIO_UNREGISTER |	\
+	 (__u64)1 << _UFFDIO_API)
+#define UFFD_API_RANGE_IOCTLS			\
+	((__u64)1 << _UFFDIO_WAKE |		\
+	 (__u64)1 << _UFFDIO_COPY)
+
+/* Message read() from the userfaultfd, one per faulting thread */
+struct uffd_msg {
+	__u8	event;
+
+	__u8	reserved1;
+	__u16	reserved2;
+	__u32	reserved3;
+
+	union {
+		struct {
+			__u64	flags;
+			__u64	address;
+		} pagefault;
+
+		struct {
+			__u64	reserved1;
+			__u64	reserved2;
+			__u64	reserved3;
+		} reserved;
+	} arg;
+} __attribute__((packed));
+
+#define UFFD_EVENT_PAGEFAULT	0x12
+
+/* uffd_msg.arg.pagefault.flags */
+#define UFFD_PAGEFAULT_FLAG_WRITE	(1<<0)
+
+struct uffdio_api {
+	/* userland asks for an API number, the kernel answers */
+	__u64 api;
+	__u64 features;
+	__u64 ioctls;
+};
+
+struct uffdio_range {
+	__u64 start;
+	__u64 len;
+};
+
+struct uffdio_register {
+	struct uffdio_range range;
+#define UFFDIO_REGISTER_MODE_MISSING	((__u64)1<<0)
+	__u64 mode;
+	/* ioctls valid on the registered range, filled in by the kernel */
+	__u64 ioctls;
+};
+
+struct uffdio_copy {
+	__u64 dst;
+	__u64 src;
+	__u64 len;
+	/*
+	 * Don't wake up the faulting threads; the handler will do it
+	 * with UFFDIO_WAKE after a series of copies.
+	 */
+#define UFFDIO_COPY_MODE_DONTWAKE	((__u64)1<<0)
+	__u64 mode;
+	/* bytes copied or negative error, filled in by the kernel */
+	__s64 copy;
+};
+
+#ifdef __KERNEL__
+
+#include <linux/fcntl.h>
+#include <linux/mm.h>
+
+#define UFFD_SHARED_FCNTL_FLAGS (O_CLOEXEC | O_NONBLOCK)
+#define UFFD_FLAGS_SET (UFFD_SHARED_FCNTL_FLAGS)
+
+struct userfaultfd_ctx;
+struct vm_area_struct;
+struct mm_struct;
+
+#ifdef CONFIG_USERFAULTFD
+
+extern int handle_userfault(struct vm_area_struct *vma, unsigned long address,
+			    unsigned int flags);
+
+extern ssize_t mcopy_atomic(struct mm_struct *dst_mm,
+			    struct userfaultfd_ctx *ctx,
+			    unsigned long dst_start, unsigned long src_start,
+			    unsigned long len);
+
+static inline bool userfaultfd_missing(struct vm_area_struct *vma)
+{
+	return vma->vm_userfaultfd_ctx != NULL;
+}
+
+#else /* CONFIG_USERFAULTFD */
+
+static inline int handle_userfault(struct vm_area_struct *vma,
+				   unsigned long address, unsigned int flags)
+{
+	return VM_FAULT_SIGBUS;
+}
+
+static inline bool userfaultfd_missing(struct vm_area_struct *vma)
+{
+	return false;
+}
+
+#endif /* CONFIG_USERFAULTFD */
+
+#endif /* __KERNEL__ */
+
+#endif /* _LINUX_USERFAULTFD_H */
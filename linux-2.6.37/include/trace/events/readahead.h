@@ -0,0 +1,88 @@
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM readahead
+
+#if !defined(_TRACE_READAHEAD_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _TRACE_READAHEAD_H
+
+#include <linux/fs.h>
+#include <linux/mm.h>
+#include <linux/tracepoint.h>
+
+#define show_ra_pattern(pattern)					\
+	__print_symbolic(pattern,					\
+		{ RA_PATTERN_INITIAL,		"initial" },		\
+		{ RA_PATTERN_SEQUENTIAL,	"sequential" },		\
+		{ RA_PATTERN_INTERLEAVED,	"interleaved" },	\
+		{ RA_PATTERN_CONTEXT,		"context" },		\
+		{ RA_PATTERN_OVERSIZE,		"oversize" },		\
+		{ RA_PATTERN_RANDOM,		"random" },		\
+		{ RA_PATTERN_MMAP_AROUND,	"mmap-around" })
+
+TRACE_EVENT(readahead,
+	TP_PROTO(struct address_space *mapping, pgoff_t offset,
+		 unsigned long req_size, struct file_ra_state *ra,
+		 int pattern),
+	TP_ARGS(mapping, offset, req_size, ra, pattern),
+	TP_STRUCT__entry(
+		__field(dev_t,		dev)
+		__field(ino_t,		ino)
+		__field(int,		pattern)
+		__field(pgoff_t,	offset)
+		__field(unsigned long,	req_size)
+		__field(pgoff_t,	start)
+		__field(unsigned int,	size)
+		__field(unsigned int,	async_size)
+		__field(unsigned long,	max)
+		__field(unsigned int,	hit_pages)
+		__field(unsigned int,	miss_pages)
+	),
+	TP_fast_assign(
+		__entry->dev		= mapping->host->i_sb->s_dev;
+		__entry->ino		= mapping->host->i_ino;
+		__entry->pattern	= pattern;
+		__entry->offset		= offset;
+		__entry->req_size	= req_size;
+		__entry->start		= ra->start;
+		__entry->size		= ra->size;
+		__entry->async_size	= ra->async_size;
+		__entry->max		= ra_max_pages(ra);
+		__entry->hit_pages	= ra->hit_pages;
+		__entry->miss_pages	= ra->miss_pages;
+	),
+	TP_printk("dev %d:%d ino %lu %s: offset=%lu req=%lu "
+		  "ra=%lu+%u-%u max=%lu hit=%u miss=%u",
+		  MAJOR(__entry->dev), MINOR(__entry->dev),
+		  (unsigned long)__entry->ino,
+		  show_ra_pattern(__entry->pattern),
+		  (unsigned long)__entry->offset, __entry->req_size,
+		  (unsigned long)__entry->start, __entry->size,
+		  __entry->async_size, __entry->max,
+		  __entry->hit_pages, __entry->miss_pages)
+);
+
+TRACE_EVENT(readahead_adapt,
+	TP_PROTO(struct file_ra_state *ra, int shift),
+	TP_ARGS(ra, shift),
+	TP_STRUCT__entry(
+		__field(unsigned int,	ra_pages)
+		__field(unsigned int,	hit_pages)
+		__field(unsigned int,	miss_pages)
+		__field(int,		old_shift)
+		__field(int,		new_shift)
+	),
+	TP_fast_assign(
+		__entry->ra_pages	= ra->ra_pages;
+		__entry->hit_pages	= ra->hit_pages;
+		__entry->miss_pages	= ra->miss_pages;
+		__entry->old_shift	= ra->ra_shift;
+		__entry->new_shift	= shift;
+	),
+	TP_printk("ra_pages=%u hit=%u miss=%u shift %d -> %d",
+		  __entry->ra_pages, __entry->hit_pages, __entry->miss_pages,
+		  __entry->old_shift, __entry->new_shift)
+);
+
+#endif /* _TRACE_READAHEAD_H */
+
+/* This part must be outside protection */
+#include <trace/define_trace.h>
@@ -0,0 +1,146 @@
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM wbt
+
+#if !defined(_TRACE_WBT_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _TRACE_WBT_H
+
+#include <linux/tracepoint.h>
+#include <linux/backing-dev.h>
+#include <linux/device.h>
+
+/**
+ * wbt_stat - completions of a monitoring window
+ * @bdi:	device the window is for
+ * @rd_min_lat:	lowest read latency seen, in nsecs
+ * @rd_nr:	number of reads completed
+ * @wr_nr:	number of writes completed
+ */
+TRACE_EVENT(wbt_stat,
+
+	TP_PROTO(struct backing_dev_info *bdi, u64 rd_min_lat,
+		 unsigned int rd_nr, unsigned int wr_nr),
+
+	TP_ARGS(bdi, rd_min_lat, rd_nr, wr_nr),
+
+	TP_STRUCT__entry(
+		__array(char, name, 32)
+		__field(u64, rd_min_lat)
+		__field(unsigned int, rd_nr)
+		__field(unsigned int, wr_nr)
+	),
+
+	TP_fast_assign(
+		strncpy(__entry->name, dev_name(bdi->dev), 32);
+		__entry->rd_min_lat	= rd_min_lat;
+		__entry->rd_nr		= rd_nr;
+		__entry->wr_nr		= wr_nr;
+	),
+
+	TP_printk("%s: rmin=%llu, rsamples=%u, wsamples=%u",
+		  __entry->name, __entry->rd_min_lat,
+		  __entry->rd_nr, __entry->wr_nr)
+);
+
+/**
+ * wbt_lat - window read latency exceeded the target
+ * @bdi:	device the latency is for
+ * @lat:	minimum read latency of the window, in usecs
+ */
+TRACE_EVENT(wbt_lat,
+
+	TP_PROTO(struct backing_dev_info *bdi, unsigned long lat),
+
+	TP_ARGS(bdi, lat),
+
+	TP_STRUCT__entry(
+		__array(char, name, 32)
+		__field(unsigned long, lat)
+	),
+
+	TP_fast_assign(
+		strncpy(__entry->name, dev_name(bdi->dev), 32);
+		__entry->lat = lat;
+	),
+
+	TP_printk("%s: latency %luus", __entry->name, __entry->lat)
+);
+
+/**
+ * wbt_step - the allowed write depth was changed
+ * @bdi:	device the depths are for
+ * @msg:	why
+ * @step:	new scale step
+ * @window:	new window length, in nsecs
+ * @bg:		new background depth
+ * @normal:	new normal depth
+ * @max:	new max depth
+ */
+TRACE_EVENT(wbt_step,
+
+	TP_PROTO(struct backing_dev_info *bdi, const char *msg,
+		 int step, u64 window, unsigned int bg, unsigned int normal,
+		 unsigned int max),
+
+	TP_ARGS(bdi, msg, step, window, bg, normal, max),
+
+	TP_STRUCT__entry(
+		__array(char, name, 32)
+		__field(const char *, msg)
+		__field(int, step)
+		__field(u64, window)
+		__field(unsigned int, bg)
+		__field(unsigned int, normal)
+		__field(unsigned int, max)
+	),
+
+	TP_fast_assign(
+		strncpy(__entry->name, dev_name(bdi->dev), 32);
+		__entry->msg	= msg;
+		__entry->step	= step;
+		__entry->window	= window;
+		__entry->bg	= bg;
+		__entry->normal	= normal;
+		__entry->max	= max;
+	),
+
+	TP_printk("%s: %s: step=%d, window=%llu, background=%u, normal=%u, max=%u",
+		  __entry->name, __entry->msg, __entry->step, __entry->window,
+		  __entry->bg, __entry->normal, __entry->max)
+);
+
+/**
+ * wbt_timer - end of a monitoring window
+ * @bdi:	device the window is for
+ * @status:	outcome of the window, see enum wbt_lat_status in blk-wbt.c
+ * @step:	scale step
+ * @inflight:	tracked writes in flight
+ */
+TRACE_EVENT(wbt_timer,
+
+	TP_PROTO(struct backing_dev_info *bdi, unsigned int status,
+		 int step, unsigned int inflight),
+
+	TP_ARGS(bdi, status, step, inflight),
+
+	TP_STRUCT__entry(
+		__array(char, name, 32)
+		__field(unsigned int, status)
+		__field(int, step)
+		__field(unsigned int, inflight)
+	),
+
+	TP_fast_assign(
+		strncpy(__entry->name, dev_name(bdi->dev), 32);
+		__entry->status		= status;
+		__entry->step		= step;
+		__entry->inflight	= inflight;
+	),
+
+	TP_printk("%s: status=%u, step=%d, inflight=%u", __entry->name,
+		  __entry->status, __entry->step, __entry->inflight)
+);
+
+#endif /* _TRACE_WBT_H */
+
+/* This part must be outside protection */
+#include <trace/define_trace.h>
@@ -146,11 +146,73 @@ DEFINE_EVENT(wbc_class, name, \
 DEFINE_WBC_EVENT(wbc_writeback_start);
 DEFINE_WBC_EVENT(wbc_writeback_written);
 DEFINE_WBC_EVENT(wbc_writeback_wait);
-DEFINE_WBC_EVENT(wbc_balance_dirty_start);
-DEFINE_WBC_EVENT(wbc_balance_dirty_written);
-DEFINE_WBC_EVENT(wbc_balance_dirty_wait);
 DEFINE_WBC_EVENT(wbc_writepage);
 
+#define KBps(x)			((x) << (PAGE_SHIFT - 10))
+
+TRACE_EVENT(balance_dirty_pages,
+
+	TP_PROTO(struct backing_dev_info *bdi,
+		 unsigned long thresh,
+		 unsigned long bg_thresh,
+		 unsigned long dirty,
+		 unsigned long bdi_thresh,
+		 unsigned long bdi_dirty,
+		 unsigned long task_ratelimit,
+		 unsigned long dirtied,
+		 long pause),
+
+	TP_ARGS(bdi, thresh, bg_thresh, dirty, bdi_thresh, bdi_dirty,
+		task_ratelimit, dirtied, pause),
+
+	TP_STRUCT__entry(
+		__array(char,		name, 32)
+		__field(unsigned long,	limit)
+		__field(unsigned long,	setpoint)
+		__field(unsigned long,	dirty)
+		__field(unsigned long,	bdi_thresh)
+		__field(unsigned long,	bdi_dirty)
+		__field(unsigned long,	write_bw)
+		__field(unsigned long,	dirty_ratelimit)
+		__field(unsigned long,	task_ratelimit)
+		__field(unsigned long,	dirtied)
+		__field(unsigned int,	paused)
+	),
+
+	TP_fast_assign(
+		unsigned long freerun = (thresh + bg_thresh) / 2;
+
+		strlcpy(__entry->name, dev_name(bdi->dev), 32);
+		__entry->limit		= thresh;
+		__entry->setpoint	= (freerun + thresh) / 2;
+		__entry->dirty		= dirty;
+		__entry->bdi_thresh	= bdi_thresh;
+		__entry->bdi_dirty	= bdi_dirty;
+		__entry->write_bw	= KBps(bdi->avg_write_bandwidth);
+		__entry->dirty_ratelimit = KBps(bdi->dirty_ratelimit);
+		__entry->task_ratelimit	= KBps(task_ratelimit);
+		__entry->dirtied	= dirtied;
+		__entry->paused		= jiffies_to_msecs(pause);
+	),
+
+	TP_printk("bdi %s: limit=%lu setpoint=%lu dirty=%lu "
+		  "bdi_thresh=%lu bdi_dirty=%lu write_bw=%lu "
+		  "dirty_ratelimit=%lu task_ratelimit=%lu "
+		  "dirtied=%lu paused=%u",
+		  __entry->name,
+		  __entry->limit,
+		  __entry->setpoint,
+		  __entry->dirty,
+		  __entry->bdi_thresh,
+		  __entry->bdi_dirty,
+		  __entry->write_bw,		/* bdi write bandwidth */
+		  __entry->dirty_ratelimit,	/* base ratelimit */
+		  __entry->task_ratelimit,	/* ratelimit with position control */
+		  __entry->dirtied,
+		  __entry->paused		/* ms */
+	)
+);
+
 DECLARE_EVENT_CLASS(writeback_congest_waited_template,
 
 	TP_PROTO(unsigned int usec_timeout, unsigned int usec_delayed),
@@ -270,6 +270,8 @@ static struct task_struct *dup_task_struct(struct task_struct *orig)
 	err = prop_local_init_single(&tsk->dirties);
 	if (err)
 		goto out;
+	tsk->nr_dirtied = 0;
+	tsk->nr_dirtied_pause = 128 >> (PAGE_SHIFT - 10);
 
 	setup_thread_stack(tsk, orig);
 	clear_user_return_notifier(tsk);
@@ -362,6 +364,10 @@ static int dup_mmap(struct mm_struct *mm, struct mm_struct *oldmm)
 		if (anon_vma_fork(tmp, mpnt))
 			goto fail_nomem_anon_vma_fork;
 		tmp->vm_flags &= ~VM_LOCKED;
+#ifdef CONFIG_USERFAULTFD
+		/* the child does not inherit the userfaultfd registration */
+		tmp->vm_userfaultfd_ctx = NULL;
+#endif
 		tmp->vm_next = tmp->vm_prev = NULL;
 		file = tmp->vm_file;
 		if (file) {
@@ -1086,6 +1092,9 @@ static struct task_struct *copy_process(unsigned long clone_flags,
 	p->real_start_time = p->start_time;
 	monotonic_to_bootbased(&p->real_start_time);
 	p->io_context = NULL;
+#ifdef CONFIG_BLOCK
+	p->plug = NULL;
+#endif
 	p->audit_context = NULL;
 	cgroup_fork(p);
 #ifdef CONFIG_NUMA
@@ -0,0 +1,357 @@
+/*
+ * Module-based torture test facility for spinlocks
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * One thread per CPU hammers on a single spinlock, checking that it is
+ * never held twice and counting acquisitions.  The spread of the
+ * per-thread counts shows how fair the lock is under contention, their
+ * sum how fast it is.  See Documentation/lock-torture.txt.
+ */
+#include <linux/types.h>
+#include <linux/kernel.h>
+#include <linux/init.h>
+#include <linux/module.h>
+#include <linux/kthread.h>
+#include <linux/err.h>
+#include <linux/spinlock.h>
+#include <linux/sched.h>
+#include <linux/delay.h>
+#include <linux/moduleparam.h>
+#include <linux/cpu.h>
+#include <linux/slab.h>
+#include <linux/jiffies.h>
+
+MODULE_LICENSE("GPL");
+
+static int nwriters_stress = -1; /* # writer threads, defaults to ncpus */
+static int stat_interval;	/* Interval between stats, in seconds. */
+				/*  Defaults to "only at end of test". */
+static int hold_us;		/* Time the lock is held for, in us. */
+static int verbose;		/* Print more debug info. */
+static char *torture_type = "spin_lock"; /* What lock to torture. */
+
+module_param(nwriters_stress, int, 0444);
+MODULE_PARM_DESC(nwriters_stress, "Number of lock-taking threads");
+module_param(stat_interval, int, 0444);
+MODULE_PARM_DESC(stat_interval, "Number of seconds between stats printk()s");
+module_param(hold_us, int, 0444);
+MODULE_PARM_DESC(hold_us, "Microseconds the lock is held for each time");
+module_param(verbose, bool, 0444);
+MODULE_PARM_DESC(verbose, "Enable verbose debugging printk()s");
+module_param(torture_type, charp, 0444);
+MODULE_PARM_DESC(torture_type, "Type of lock to torture (spin_lock, spin_lock_irq)");
+
+#define TORTURE_FLAG "-torture:"
+#define PRINTK_STRING(s) \
+	do { printk(KERN_ALERT "%s" TORTURE_FLAG s "\n", torture_type); } while (0)
+#define VERBOSE_PRINTK_STRING(s) \
+	do { if (verbose) printk(KERN_ALERT "%s" TORTURE_FLAG s "\n", torture_type); } while (0)
+
+static int nrealwriters_stress;
+static struct task_struct **writer_tasks;
+static struct task_struct *stats_task;
+static unsigned long start_jiffies;
+
+/* Written under the lock only, any other value than 0 is a bug. */
+static int lock_is_write_held;
+
+struct lock_writer_stress_stats {
+	long n_write_lock_fail;
+	long n_write_lock_acquired;
+	long n_write_lock_contended;
+	u64 max_write_wait;
+};
+static struct lock_writer_stress_stats *lwsa;
+
+/*
+ * Operations vector for selecting different types of tests.
+ */
+struct lock_torture_ops {
+	void (*writelock)(void);
+	void (*writeunlock)(void);
+	int (*is_contended)(void);
+	const char *name;
+};
+
+static struct lock_torture_ops *cur_ops;
+
+static DEFINE_SPINLOCK(torture_spinlock);
+
+static void torture_spin_lock_write_lock(void)
+{
+	spin_lock(&torture_spinlock);
+}
+
+static void torture_spin_lock_write_unlock(void)
+{
+	spin_unlock(&torture_spinlock);
+}
+
+static int torture_spin_lock_is_contended(void)
+{
+	return spin_is_contended(&torture_spinlock);
+}
+
+static struct lock_torture_ops spin_lock_ops = {
+	.writelock	= torture_spin_lock_write_lock,
+	.writeunlock	= torture_spin_lock_write_unlock,
+	.is_contended	= torture_spin_lock_is_contended,
+	.name		= "spin_lock"
+};
+
+/* Only used by the lock holder */
+static unsigned long torture_spinlock_flags;
+
+static void torture_spin_lock_write_lock_irq(void)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&torture_spinlock, flags);
+	torture_spinlock_flags = flags;
+}
+
+static void torture_spin_lock_write_unlock_irq(void)
+{
+	spin_unlock_irqrestore(&torture_spinlock, torture_spinlock_flags);
+}
+
+static struct lock_torture_ops spin_lock_irq_ops = {
+	.writelock	= torture_spin_lock_write_lock_irq,
+	.writeunlock	= torture_spin_lock_write_unlock_irq,
+	.is_contended	= torture_spin_lock_is_contended,
+	.name		= "spin_lock_irq"
+};
+
+/*
+ * Lock-torture writer kthread.  Repeatedly takes and releases the lock,
+ * checking for mutual exclusion and recording how long it waited.
+ */
+static int lock_torture_writer(void *arg)
+{
+	struct lock_writer_stress_stats *lwsp = arg;
+	u64 t;
+
+	VERBOSE_PRINTK_STRING("lock_torture_writer task started");
+
+	do {
+		t = local_clock();
+		cur_ops->writelock();
+		t = local_clock() - t;
+
+		if (lock_is_write_held)
+			lwsp->n_write_lock_fail++;
+		lock_is_write_held = 1;
+		lwsp->n_write_lock_acquired++;
+		if (cur_ops->is_contended())
+			lwsp->n_write_lock_contended++;
+		if (t > lwsp->max_write_wait)
+			lwsp->max_write_wait = t;
+		if (hold_us)
+			udelay(hold_us);
+		lock_is_write_held = 0;
+
+		cur_ops->writeunlock();
+
+		if (!(lwsp->n_write_lock_acquired & 0x3ff))
+			cond_resched();
+	} while (!kthread_should_stop());
+
+	VERBOSE_PRINTK_STRING("lock_torture_writer task stopping");
+	return 0;
+}
+
+/*
+ * Print torture statistics.  The counts are read without the lock, so
+ * they may be a little off while the test runs.
+ */
+static void lock_torture_stats_print(void)
+{
+	int i;
+	long fail = 0, contended = 0;
+	long max = 0, min = lwsa[0].n_write_lock_acquired;
+	long long sum = 0;
+	u64 max_wait = 0;
+	unsigned long secs = (jiffies - start_jiffies) / HZ;
+
+	for (i = 0; i < nrealwriters_stress; i++) {
+		fail += lwsa[i].n_write_lock_fail;
+		contended += lwsa[i].n_write_lock_contended;
+		if (max < lwsa[i].n_write_lock_acquired)
+			max = lwsa[i].n_write_lock_acquired;
+		if (min > lwsa[i].n_write_lock_acquired)
+			min = lwsa[i].n_write_lock_acquired;
+		if (max_wait < lwsa[i].max_write_wait)
+			max_wait = lwsa[i].max_write_wait;
+		sum += lwsa[i].n_write_lock_acquired;
+	}
+
+	printk(KERN_ALERT "%s" TORTURE_FLAG
+	       " Writes: Total: %lld Max/Min: %ld/%ld %s Fail: %ld %s"
+	       " Contended: %ld Max wait: %llu ns Per sec: %lld\n",
+	       torture_type, sum, max, min,
+	       max / 2 > min ? "???" : "", fail, fail ? "!!!" : "",
+	       contended, (unsigned long long)max_wait,
+	       secs ? div_u64(sum, secs) : sum);
+	for (i = 0; i < nrealwriters_stress && verbose; i++)
+		printk(KERN_ALERT "%s" TORTURE_FLAG " writer %d: %ld\n",
+		       torture_type, i, lwsa[i].n_write_lock_acquired);
+}
+
+/*
+ * Periodically prints torture statistics, if periodic statistics
+ * printing was specified via the stat_interval module parameter.
+ */
+static int lock_torture_stats(void *arg)
+{
+	VERBOSE_PRINTK_STRING("lock_torture_stats task started");
+	do {
+		schedule_timeout_interruptible(stat_interval * HZ);
+		lock_torture_stats_print();
+	} while (!kthread_should_stop());
+	VERBOSE_PRINTK_STRING("lock_torture_stats task stopping");
+	return 0;
+}
+
+static void lock_torture_cleanup(void)
+{
+	int i;
+	long fail = 0;
+
+	if (writer_tasks) {
+		for (i = 0; i < nrealwriters_stress; i++) {
+			if (writer_tasks[i]) {
+				VERBOSE_PRINTK_STRING(
+					"Stopping lock_torture_writer task");
+				kthread_stop(writer_tasks[i]);
+			}
+			writer_tasks[i] = NULL;
+		}
+		kfree(writer_tasks);
+		writer_tasks = NULL;
+	}
+
+	if (stats_task) {
+		VERBOSE_PRINTK_STRING("Stopping lock_torture_stats task");
+		kthread_stop(stats_task);
+	}
+	stats_task = NULL;
+
+	lock_torture_stats_print();  /* -After- the stats thread is stopped! */
+
+	for (i = 0; i < nrealwriters_stress; i++)
+		fail += lwsa[i].n_write_lock_fail;
+	kfree(lwsa);
+	lwsa = NULL;
+
+	if (fail)
+		PRINTK_STRING("End of test: FAILURE");
+	else
+		PRINTK_STRING("End of test: SUCCESS");
+}
+
+static int __init lock_torture_init(void)
+{
+	int i, cpu;
+	int firsterr = 0;
+	static struct lock_torture_ops *torture_ops[] =
+		{ &spin_lock_ops, &spin_lock_irq_ops, };
+
+	/* Process args and tell the world that the torturer is on the job. */
+	for (i = 0; i < ARRAY_SIZE(torture_ops); i++) {
+		cur_ops = torture_ops[i];
+		if (strcmp(torture_type, cur_ops->name) == 0)
+			break;
+	}
+	if (i == ARRAY_SIZE(torture_ops)) {
+		printk(KERN_ALERT "lock-torture: invalid torture type: \"%s\"\n",
+		       torture_type);
+		printk(KERN_ALERT "lock-torture types:");
+		for (i = 0; i < ARRAY_SIZE(torture_ops); i++)
+			printk(KERN_ALERT " %s", torture_ops[i]->name);
+		printk(KERN_ALERT "\n");
+		return -EINVAL;
+	}
+
+	if (nwriters_stress >= 0)
+		nrealwriters_stress = nwriters_stress;
+	else
+		nrealwriters_stress = num_online_cpus();
+	if (nrealwriters_stress == 0)
+		return -EINVAL;
+	printk(KERN_ALERT "%s" TORTURE_FLAG
+	       "--- Start of test: nwriters_stress=%d stat_interval=%d "
+	       "hold_us=%d verbose=%d\n",
+	       torture_type, nrealwriters_stress, stat_interval, hold_us,
+	       verbose);
+
+	lwsa = kcalloc(nrealwriters_stress, sizeof(*lwsa), GFP_KERNEL);
+	writer_tasks = kcalloc(nrealwriters_stress, sizeof(writer_tasks[0]),
+			       GFP_KERNEL);
+	if (!lwsa || !writer_tasks) {
+		VERBOSE_PRINTK_STRING("out of memory");
+		firsterr = -ENOMEM;
+		goto unwind;
+	}
+
+	/*
+	 * Bind the writers to the CPUs round robin, so that the counts show
+	 * how the lock treats each CPU rather than how the scheduler does.
+	 */
+	start_jiffies = jiffies;
+	get_online_cpus();
+	cpu = cpumask_first(cpu_online_mask);
+	for (i = 0; i < nrealwriters_stress; i++) {
+		VERBOSE_PRINTK_STRING("Creating lock_torture_writer task");
+		writer_tasks[i] = kthread_create(lock_torture_writer, &lwsa[i],
+						 "lock_torture_writer");
+		if (IS_ERR(writer_tasks[i])) {
+			firsterr = PTR_ERR(writer_tasks[i]);
+			VERBOSE_PRINTK_STRING("Failed to create writer");
+			writer_tasks[i] = NULL;
+			put_online_cpus();
+			goto unwind;
+		}
+		kthread_bind(writer_tasks[i], cpu);
+		wake_up_process(writer_tasks[i]);
+		cpu = cpumask_next(cpu, cpu_online_mask);
+		if (cpu >= nr_cpu_ids)
+			cpu = cpumask_first(cpu_online_mask);
+	}
+	put_online_cpus();
+
+	if (stat_interval > 0) {
+		VERBOSE_PRINTK_STRING("Creating lock_torture_stats task");
+		stats_task = kthread_run(lock_torture_stats, NULL,
+					 "lock_torture_stats");
+		if (IS_ERR(stats_task)) {
+			firsterr = PTR_ERR(stats_task);
+			VERBOSE_PRINTK_STRING("Failed to create stats");
+			stats_task = NULL;
+			goto unwind;
+		}
+	}
+	return 0;
+
+unwind:
+	if (lwsa)
+		lock_torture_cleanup();
+	else
+		kfree(writer_tasks);
+	return firsterr;
+}
+
+module_init(lock_torture_init);
+module_exit(lock_torture_cleanup);
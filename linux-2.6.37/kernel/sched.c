@@ -4067,6 +4067,18 @@ pick_next_task(struct rq *rq)
 /*
  * schedule() is the main scheduler function.
  */
+static inline void sched_submit_work(struct task_struct *tsk)
+{
+	if (!tsk->state || (preempt_count() & PREEMPT_ACTIVE))
+		return;
+	/*
+	 * If we are going to sleep and we have plugged IO queued,
+	 * make sure to submit it to avoid deadlocks.
+	 */
+	if (blk_needs_flush_plug(tsk))
+		blk_schedule_flush_plug(tsk);
+}
+
 asmlinkage void __sched schedule(void)
 {
 	struct task_struct *prev, *next;
@@ -4074,6 +4086,7 @@ asmlinkage void __sched schedule(void)
 	struct rq *rq;
 	int cpu;
 
+	sched_submit_work(current);
 need_resched:
 	preempt_disable();
 	cpu = smp_processor_id();
@@ -5466,6 +5479,7 @@ void __sched io_schedule(void)
 {
 	struct rq *rq = raw_rq();
 
+	blk_schedule_flush_plug(current);
 	delayacct_blkio_start();
 	atomic_inc(&rq->nr_iowait);
 	current->in_iowait = 1;
@@ -5481,6 +5495,7 @@ long __sched io_schedule_timeout(long timeout)
 	struct rq *rq = raw_rq();
 	long ret;
 
+	blk_schedule_flush_plug(current);
 	delayacct_blkio_start();
 	atomic_inc(&rq->nr_iowait);
 	current->in_iowait = 1;
@@ -0,0 +1,586 @@
+/*
+ * Generic binary BCH encoding/decoding library
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published by
+ * the Free Software Foundation.
+ *
+ * A binary BCH code over GF(2^m) corrects up to t bit errors in codewords
+ * of up to 2^m-1 bits, using at most m*t ecc bits. This suits MLC NAND
+ * flash: with m = 13, 8 bit errors in 512 bytes of data are corrected
+ * with 13 bytes of ecc. Shorter codewords (the data is anything below
+ * 2^m-1-ecc_bits bits) are handled as shortened codes.
+ *
+ * Encoding divides the data by the generator polynomial of the code,
+ * 32 bits at a time, with four tables holding the remainders of each
+ * byte of the input word.
+ *
+ * Decoding:
+ * 1. the syndromes are computed from the remainder of the received
+ *    codeword, which is simply the xor of the received and recomputed
+ *    ecc; this only has ecc_bits bits, against several thousand for the
+ *    whole codeword;
+ * 2. Berlekamp-Massey finds the error locator polynomial, skipping the
+ *    odd steps that are always zero for binary codes;
+ * 3. a Chien search finds the roots of the locator, which give the
+ *    error locations. It works in the log domain, only covers the bits
+ *    of the shortened codeword and stops as soon as all roots are found.
+ *    A single error is located directly.
+ */
+#include <linux/kernel.h>
+#include <linux/errno.h>
+#include <linux/init.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+#include <linux/bitops.h>
+#include <linux/bch.h>
+#include <asm/byteorder.h>
+
+#define BCH_MIN_M	5
+#define BCH_MAX_M	15
+
+/* default primitive polynomials, for m = BCH_MIN_M..BCH_MAX_M */
+static const unsigned int prim_poly_tab[] = {
+	0x25, 0x43, 0x83, 0x11d, 0x211, 0x409, 0x805, 0x1053, 0x201b,
+	0x402b, 0x8003,
+};
+
+/* reduce an exponent below 2n modulo n */
+static inline unsigned int mod_n(struct bch_control *bch, unsigned int v)
+{
+	return v < bch->n ? v : v - bch->n;
+}
+
+static inline unsigned int gf_mul(struct bch_control *bch, unsigned int a,
+				  unsigned int b)
+{
+	if (!a || !b)
+		return 0;
+	return bch->a_pow_tab[mod_n(bch, bch->a_log_tab[a] +
+				    bch->a_log_tab[b])];
+}
+
+static inline unsigned int gf_div(struct bch_control *bch, unsigned int a,
+				  unsigned int b)
+{
+	if (!a)
+		return 0;
+	return bch->a_pow_tab[mod_n(bch, bch->a_log_tab[a] + bch->n -
+				    bch->a_log_tab[b])];
+}
+
+static inline unsigned int gf_sqr(struct bch_control *bch, unsigned int a)
+{
+	if (!a)
+		return 0;
+	return bch->a_pow_tab[mod_n(bch, 2 * bch->a_log_tab[a])];
+}
+
+/*
+ * The ecc is handled as ecc_words 32-bit words holding the ecc_bits
+ * coefficients of the remainder left aligned, x^(ecc_bits-1) in the most
+ * significant bit of the first word. In bytes, it is stored big endian.
+ */
+static void load_ecc8(struct bch_control *bch, uint32_t *dst,
+		      const uint8_t *src)
+{
+	unsigned int i;
+
+	memset(dst, 0, bch->ecc_words * sizeof(*dst));
+	for (i = 0; i < bch->ecc_bytes; i++)
+		dst[i / 4] |= (uint32_t)src[i] << (24 - 8 * (i % 4));
+}
+
+static void store_ecc8(struct bch_control *bch, uint8_t *dst,
+		       const uint32_t *src)
+{
+	unsigned int i;
+
+	for (i = 0; i < bch->ecc_bytes; i++)
+		dst[i] = src[i / 4] >> (24 - 8 * (i % 4));
+}
+
+/* clear the bits of the ecc words past ecc_bits */
+static void clear_pad(struct bch_control *bch, uint32_t *r)
+{
+	const unsigned int e = bch->ecc_bits;
+	unsigned int i;
+
+	if (e % 32)
+		r[e / 32] &= ~0U << (32 - e % 32);
+	for (i = DIV_ROUND_UP(e, 32); i < bch->ecc_words; i++)
+		r[i] = 0;
+}
+
+static inline void encode_byte(struct bch_control *bch, uint32_t *r,
+			       uint8_t b)
+{
+	const unsigned int l = bch->ecc_words;
+	const uint32_t *tab = bch->mod8_tab + ((r[0] >> 24) ^ b) * l;
+	unsigned int i;
+
+	for (i = 0; i < l - 1; i++)
+		r[i] = ((r[i] << 8) | (r[i + 1] >> 24)) ^ tab[i];
+	r[l - 1] = (r[l - 1] << 8) ^ tab[l - 1];
+}
+
+/*
+ * With the remainder r of the data so far, feeding 32 more bits u gives
+ * ((r_hi + u) * x^ecc_bits mod g) + r_lo * x^32, where r_hi are the top
+ * 32 bits of r. The first term is looked up per byte of r_hi + u, the
+ * second is r shifted by one word.
+ */
+static void __encode_bch(struct bch_control *bch, const uint8_t *data,
+			 unsigned int len, uint32_t *r)
+{
+	const unsigned int l = bch->ecc_words;
+	const uint32_t *t0, *t1, *t2, *t3;
+	unsigned int i;
+	uint32_t w;
+
+	while (len && ((unsigned long)data & 3)) {
+		encode_byte(bch, r, *data++);
+		len--;
+	}
+
+	for (; len >= 4; len -= 4, data += 4) {
+		w = r[0] ^ be32_to_cpu(*(const __be32 *)data);
+		t0 = bch->mod8_tab + (w & 0xff) * l;
+		t1 = bch->mod8_tab + (256 + ((w >> 8) & 0xff)) * l;
+		t2 = bch->mod8_tab + (512 + ((w >> 16) & 0xff)) * l;
+		t3 = bch->mod8_tab + (768 + (w >> 24)) * l;
+
+		for (i = 0; i < l - 1; i++)
+			r[i] = r[i + 1] ^ t0[i] ^ t1[i] ^ t2[i] ^ t3[i];
+		r[l - 1] = t0[l - 1] ^ t1[l - 1] ^ t2[l - 1] ^ t3[l - 1];
+	}
+
+	while (len--)
+		encode_byte(bch, r, *data++);
+}
+
+/**
+ * encode_bch - calculate the ecc of a buffer
+ * @bch:	BCH control structure
+ * @data:	data to encode
+ * @len:	length of @data in bytes
+ * @ecc:	ecc, ecc_bytes long
+ *
+ * Description:
+ *     @ecc must be zeroed before the first call. A buffer may be encoded
+ *     in several pieces by calling this again on each, with the same @ecc.
+ */
+void encode_bch(struct bch_control *bch, const uint8_t *data,
+		unsigned int len, uint8_t *ecc)
+{
+	uint32_t *r = bch->ecc_buf;
+
+	load_ecc8(bch, r, ecc);
+	clear_pad(bch, r);
+	__encode_bch(bch, data, len, r);
+	store_ecc8(bch, ecc, r);
+}
+EXPORT_SYMBOL_GPL(encode_bch);
+
+/*
+ * S_j = rem(alpha^j). Only odd syndromes are computed from the remainder,
+ * as S_2j = S_j^2 for binary codes.
+ */
+static void compute_syndromes(struct bch_control *bch, const uint32_t *rem)
+{
+	const unsigned int t = bch->t, e = bch->ecc_bits;
+	unsigned int *syn = bch->syn;
+	unsigned int i, j, deg, x, step;
+	unsigned long w;
+	int b;
+
+	memset(syn, 0, 2 * t * sizeof(*syn));
+
+	for (i = 0; i < bch->ecc_words; i++) {
+		for (w = rem[i]; w; w &= ~(1UL << b)) {
+			b = __fls(w);
+			deg = e - 1 - (i * 32 + 31 - b);
+
+			/* syn[j] = S_(j+1) += alpha^(deg * (j+1)) */
+			x = deg;
+			step = mod_n(bch, 2 * deg);
+			for (j = 0; j < 2 * t; j += 2) {
+				syn[j] ^= bch->a_pow_tab[x];
+				x = mod_n(bch, x + step);
+			}
+		}
+	}
+
+	for (j = 0; j < t; j++)
+		syn[2 * j + 1] = gf_sqr(bch, syn[j]);
+}
+
+/*
+ * Berlekamp-Massey. Leaves the error locator in bch->elp and returns its
+ * degree, the number of errors, or -EBADMSG if there are more than t.
+ */
+static int compute_error_locator(struct bch_control *bch)
+{
+	const unsigned int t = bch->t;
+	const unsigned int *syn = bch->syn;
+	unsigned int *c = bch->elp, *b = bch->elp_prev, *tmp = bch->elp_tmp;
+	const size_t size = (2 * t + 1) * sizeof(*c);
+	unsigned int i, k, d, coef, bd = 1, l = 0, shift = 1;
+
+	memset(c, 0, size);
+	memset(b, 0, size);
+	c[0] = b[0] = 1;
+
+	for (k = 0; k < 2 * t; k++) {
+		/* the discrepancy of every other step is zero */
+		if (k & 1) {
+			shift++;
+			continue;
+		}
+
+		d = syn[k];
+		for (i = 1; i <= l; i++)
+			d ^= gf_mul(bch, c[i], syn[k - i]);
+		if (!d) {
+			shift++;
+			continue;
+		}
+
+		coef = gf_div(bch, d, bd);
+		if (2 * l <= k) {
+			memcpy(tmp, c, size);
+			for (i = 0; i + shift <= 2 * t; i++)
+				c[i + shift] ^= gf_mul(bch, coef, b[i]);
+			memcpy(b, tmp, size);
+			l = k + 1 - l;
+			bd = d;
+			shift = 1;
+		} else {
+			for (i = 0; i + shift <= 2 * t; i++)
+				c[i + shift] ^= gf_mul(bch, coef, b[i]);
+			shift++;
+		}
+	}
+
+	if (l > t || !c[l])
+		return -EBADMSG;
+
+	return l;
+}
+
+/*
+ * Chien search: the locator is prod(1 + alpha^deg x) over the degrees
+ * of the bits in error, so test elp(alpha^-i) for every bit i of the
+ * codeword. Each term elp_k alpha^(-i k) is kept as its log, which goes
+ * down by k from one bit to the next.
+ */
+static int find_error_locations(struct bch_control *bch, unsigned int nerr,
+				unsigned int nbits, unsigned int *loc)
+{
+	const unsigned int n = bch->n;
+	const unsigned int *elp = bch->elp;
+	unsigned int *lt = bch->elp_tmp, *kt = bch->elp_prev;
+	unsigned int i, j, k, sum, nt = 0, nroots = 0;
+
+	if (nerr == 1) {
+		i = bch->a_log_tab[elp[1]];
+		if (i >= nbits)
+			return -EBADMSG;
+		loc[0] = i;
+		return 1;
+	}
+
+	for (k = 1; k <= nerr; k++) {
+		if (!elp[k])
+			continue;
+		lt[nt] = bch->a_log_tab[elp[k]];
+		kt[nt] = k;
+		nt++;
+	}
+
+	for (i = 0; i < nbits; i++) {
+		sum = 1;
+		for (j = 0; j < nt; j++) {
+			sum ^= bch->a_pow_tab[lt[j]];
+			lt[j] = lt[j] >= kt[j] ? lt[j] - kt[j] : lt[j] + n - kt[j];
+		}
+		if (!sum) {
+			loc[nroots++] = i;
+			if (nroots == nerr)
+				return nerr;
+		}
+	}
+
+	/* roots outside of the codeword: too many errors */
+	return -EBADMSG;
+}
+
+/**
+ * decode_bch - locate the bit errors of a codeword
+ * @bch:	BCH control structure
+ * @data:	received data, may be NULL if @calc_ecc is given
+ * @len:	length of the data in bytes
+ * @recv_ecc:	received ecc
+ * @calc_ecc:	ecc recomputed from the received data, or NULL to compute
+ *		it here from @data
+ * @errloc:	filled with the error locations, room for t entries
+ *
+ * Description:
+ *     Returns the number of bit errors, -EBADMSG if they cannot be
+ *     corrected, or -EINVAL if the codeword is too long for the code.
+ *     Error i is in bit errloc[i] % 8 (lsb is 0) of byte errloc[i] / 8;
+ *     locations past len * 8 are in the ecc. Nothing is corrected here,
+ *     the caller flips the bits that matter to it.
+ */
+int decode_bch(struct bch_control *bch, const uint8_t *data, unsigned int len,
+	       const uint8_t *recv_ecc, const uint8_t *calc_ecc,
+	       unsigned int *errloc)
+{
+	const unsigned int nbits = len * 8 + bch->ecc_bits;
+	uint32_t *rem = bch->ecc_buf, *recv = bch->ecc_buf2;
+	uint32_t sum = 0;
+	unsigned int i, q;
+	int nerr;
+
+	if (len > bch->n / 8 || nbits > bch->n)
+		return -EINVAL;
+
+	if (calc_ecc) {
+		load_ecc8(bch, rem, calc_ecc);
+	} else {
+		if (!data)
+			return -EINVAL;
+		memset(rem, 0, bch->ecc_words * sizeof(*rem));
+		__encode_bch(bch, data, len, rem);
+	}
+
+	load_ecc8(bch, recv, recv_ecc);
+	for (i = 0; i < bch->ecc_words; i++)
+		rem[i] ^= recv[i];
+	clear_pad(bch, rem);
+
+	for (i = 0; i < bch->ecc_words; i++)
+		sum |= rem[i];
+	if (!sum)
+		return 0;
+
+	compute_syndromes(bch, rem);
+
+	nerr = compute_error_locator(bch);
+	if (nerr < 0)
+		return nerr;
+
+	nerr = find_error_locations(bch, nerr, nbits, errloc);
+	if (nerr < 0)
+		return nerr;
+
+	/* polynomial degree to bit number, the first byte holds the msb */
+	for (i = 0; i < nerr; i++) {
+		q = nbits - 1 - errloc[i];
+		errloc[i] = (q & ~7) | (7 - (q & 7));
+	}
+
+	return nerr;
+}
+EXPORT_SYMBOL_GPL(decode_bch);
+
+static int build_gf_tables(struct bch_control *bch, unsigned int poly)
+{
+	const unsigned int k = 1 << bch->m;
+	unsigned int i, x = 1;
+
+	if (fls(poly) != bch->m + 1)
+		return -EINVAL;
+
+	for (i = 0; i < bch->n; i++) {
+		/* alpha must generate the whole field */
+		if (i && x == 1)
+			return -EINVAL;
+		bch->a_pow_tab[i] = x;
+		bch->a_log_tab[x] = i;
+		x <<= 1;
+		if (x & k)
+			x ^= poly;
+	}
+	bch->a_pow_tab[bch->n] = 1;
+	bch->a_log_tab[0] = 0;
+
+	return 0;
+}
+
+/*
+ * The generator is the product of the minimal polynomials of alpha^1 to
+ * alpha^2t, i.e. of (x + alpha^r) over all their conjugates r. Returns
+ * its degree, with its (binary) coefficients in g.
+ */
+static int compute_generator(struct bch_control *bch, unsigned int *g)
+{
+	const unsigned int n = bch->n;
+	unsigned long *roots;
+	unsigned int i, j, r, deg = 0;
+
+	roots = kzalloc(BITS_TO_LONGS(n) * sizeof(long), GFP_KERNEL);
+	if (!roots)
+		return -ENOMEM;
+
+	for (i = 0; i < bch->t; i++) {
+		r = 2 * i + 1;
+		for (j = 0; j < bch->m; j++) {
+			__set_bit(r, roots);
+			r = mod_n(bch, 2 * r);
+		}
+	}
+
+	g[0] = 1;
+	for (r = 0; r < n; r++) {
+		if (!test_bit(r, roots))
+			continue;
+		g[deg + 1] = 1;
+		for (j = deg; j > 0; j--)
+			g[j] = gf_mul(bch, g[j], bch->a_pow_tab[r]) ^ g[j - 1];
+		g[0] = gf_mul(bch, g[0], bch->a_pow_tab[r]);
+		deg++;
+	}
+	kfree(roots);
+
+	for (i = 0; i <= deg; i++)
+		if (g[i] > 1)
+			return -EINVAL;
+
+	return deg;
+}
+
+/*
+ * mod8_tab[(k * 256 + b) * ecc_words] holds (b << 8k) * x^ecc_bits mod g,
+ * computed bit by bit.
+ */
+static void build_mod8_tables(struct bch_control *bch, const unsigned int *g)
+{
+	const unsigned int l = bch->ecc_words, e = bch->ecc_bits;
+	uint32_t *gw = bch->ecc_buf2, *s = bch->ecc_buf;
+	unsigned int i, j, k, b, bit;
+	uint32_t v, fb;
+
+	/* g without its leading term, left aligned */
+	memset(gw, 0, l * sizeof(*gw));
+	for (i = 0; i < e; i++)
+		if (g[e - 1 - i])
+			gw[i / 32] |= 1U << (31 - i % 32);
+
+	for (k = 0; k < 4; k++) {
+		for (b = 0; b < 256; b++) {
+			v = b << (8 * k);
+			memset(s, 0, l * sizeof(*s));
+			for (bit = 32; bit-- > 0; ) {
+				fb = ((v >> bit) ^ (s[0] >> 31)) & 1;
+				for (j = 0; j < l - 1; j++)
+					s[j] = (s[j] << 1) | (s[j + 1] >> 31);
+				s[l - 1] <<= 1;
+				if (fb)
+					for (j = 0; j < l; j++)
+						s[j] ^= gw[j];
+			}
+			memcpy(bch->mod8_tab + (k * 256 + b) * l, s,
+			       l * sizeof(*s));
+		}
+	}
+}
+
+/**
+ * init_bch - set up a BCH code
+ * @m:		Galois field order, 5 to 15
+ * @t:		number of correctable bit errors
+ * @prim_poly:	primitive polynomial of GF(2^m), or 0 for the default one
+ *
+ * Description:
+ *     Codewords (data and ecc) must fit in 2^m-1 bits, and the ecc takes
+ *     at most m*t bits. Returns NULL if the parameters are invalid or
+ *     memory is short.
+ */
+struct bch_control *init_bch(int m, int t, unsigned int prim_poly)
+{
+	struct bch_control *bch;
+	unsigned int *g = NULL;
+	unsigned int n;
+	int deg;
+
+	if (m < BCH_MIN_M || m > BCH_MAX_M)
+		return NULL;
+	n = (1 << m) - 1;
+	if (t < 1 || m * t >= n)
+		return NULL;
+
+	bch = kzalloc(sizeof(*bch), GFP_KERNEL);
+	if (!bch)
+		return NULL;
+
+	bch->m = m;
+	bch->t = t;
+	bch->n = n;
+	bch->ecc_bytes = DIV_ROUND_UP(m * t, 8);
+	bch->ecc_words = DIV_ROUND_UP(m * t, 32);
+
+	bch->a_pow_tab = kmalloc((n + 1) * sizeof(uint16_t), GFP_KERNEL);
+	bch->a_log_tab = kmalloc((n + 1) * sizeof(uint16_t), GFP_KERNEL);
+	bch->mod8_tab = kmalloc(4 * 256 * bch->ecc_words * sizeof(uint32_t),
+				GFP_KERNEL);
+	bch->ecc_buf = kmalloc(bch->ecc_words * sizeof(uint32_t), GFP_KERNEL);
+	bch->ecc_buf2 = kmalloc(bch->ecc_words * sizeof(uint32_t), GFP_KERNEL);
+	bch->syn = kmalloc(2 * t * sizeof(unsigned int), GFP_KERNEL);
+	bch->elp = kmalloc((2 * t + 1) * sizeof(unsigned int), GFP_KERNEL);
+	bch->elp_prev = kmalloc((2 * t + 1) * sizeof(unsigned int), GFP_KERNEL);
+	bch->elp_tmp = kmalloc((2 * t + 1) * sizeof(unsigned int), GFP_KERNEL);
+	g = kmalloc((m * t + 1) * sizeof(unsigned int), GFP_KERNEL);
+
+	if (!bch->a_pow_tab || !bch->a_log_tab || !bch->mod8_tab ||
+	    !bch->ecc_buf || !bch->ecc_buf2 || !bch->syn || !bch->elp ||
+	    !bch->elp_prev || !bch->elp_tmp || !g)
+		goto fail;
+
+	if (!prim_poly)
+		prim_poly = prim_poly_tab[m - BCH_MIN_M];
+	if (build_gf_tables(bch, prim_poly))
+		goto fail;
+
+	deg = compute_generator(bch, g);
+	if (deg < 0)
+		goto fail;
+	bch->ecc_bits = deg;
+
+	build_mod8_tables(bch, g);
+	kfree(g);
+
+	return bch;
+
+fail:
+	kfree(g);
+	free_bch(bch);
+	return NULL;
+}
+EXPORT_SYMBOL_GPL(init_bch);
+
+/**
+ * free_bch - free a BCH control structure
+ * @bch:	BCH control structure to free, may be NULL
+ */
+void free_bch(struct bch_control *bch)
+{
+	if (!bch)
+		return;
+
+	kfree(bch->a_pow_tab);
+	kfree(bch->a_log_tab);
+	kfree(bch->mod8_tab);
+	kfree(bch->ecc_buf);
+	kfree(bch->ecc_buf2);
+	kfree(bch->syn);
+	kfree(bch->elp);
+	kfree(bch->elp_prev);
+	kfree(bch->elp_tmp);
+	kfree(bch);
+}
+EXPORT_SYMBOL_GPL(free_bch);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("Binary BCH encoder/decoder");
@@ -0,0 +1,150 @@
+/*
+ *  LZ4 Compressor
+ *
+ *  Single pass, hash table based: every position that is looked at is
+ *  hashed on its first four bytes, the table remembers the last position
+ *  with that hash and a match is taken whenever those four bytes agree.
+ *  When nothing matches for a while the search accelerates, so
+ *  incompressible data goes through quickly.
+ */
+
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/string.h>
+#include <linux/lz4.h>
+#include <asm/unaligned.h>
+#include "lz4defs.h"
+
+/*
+ * Increase the search step after (1 << SKIP_STRENGTH) failed attempts.
+ */
+#define SKIP_STRENGTH	6
+
+/*
+ * Inputs shorter than 64k can use 16-bit positions, which lets the same
+ * amount of working memory hold a table twice as big.
+ */
+#define LZ4_64K_LIMIT	(65536 + MFLIMIT - 1)
+
+static inline u32 lz4_hash(u32 seq, bool small)
+{
+	if (small)
+		return (seq * 2654435761U) >> (32 - (LZ4_HASH_LOG + 1));
+	return (seq * 2654435761U) >> (32 - LZ4_HASH_LOG);
+}
+
+static __always_inline int lz4_compress_generic(const u8 *src, size_t src_len,
+		u8 *dst, size_t *dst_len, void *wrkmem, bool small)
+{
+	u16 *table16 = wrkmem;
+	u32 *table32 = wrkmem;
+	const u8 *ip = src;
+	const u8 *anchor = src;
+	const u8 *const iend = src + src_len;
+	const u8 *const mflimit = iend - MFLIMIT;
+	const u8 *const matchlimit = iend - LASTLITERALS;
+	const u8 *ref;
+	u8 *op = dst;
+	u8 *const oend = dst + *dst_len;
+	unsigned int attempts;
+	size_t step;
+	u32 h;
+
+	memset(wrkmem, 0, LZ4_MEM_COMPRESS);
+
+	if (src_len < MINLENGTH)
+		goto last_literals;
+
+#define LZ4_GET_REF(h)	(src + (small ? table16[h] : table32[h]))
+#define LZ4_PUT_POS(h, p) do {						\
+		if (small)						\
+			table16[h] = (p) - src;				\
+		else							\
+			table32[h] = (p) - src;				\
+	} while (0)
+
+	LZ4_PUT_POS(lz4_hash(lz4_read32(ip), small), ip);
+	ip++;
+
+	for (;;) {
+		/* Find a match */
+		attempts = (1U << SKIP_STRENGTH) + 3;
+		for (;;) {
+			h = lz4_hash(lz4_read32(ip), small);
+			ref = LZ4_GET_REF(h);
+			LZ4_PUT_POS(h, ip);
+
+			if (ip - ref <= MAX_DISTANCE &&
+			    lz4_read32(ref) == lz4_read32(ip))
+				break;
+
+			step = attempts++ >> SKIP_STRENGTH;
+			ip += step;
+			if (unlikely(ip > mflimit))
+				goto last_literals;
+		}
+
+		/* Extend the match backwards over the pending literals */
+		while (ip > anchor && ref > src && ip[-1] == ref[-1]) {
+			ip--;
+			ref--;
+		}
+
+		for (;;) {
+			size_t len = MINMATCH + lz4_count(ip + MINMATCH,
+						ref + MINMATCH, matchlimit);
+
+			op = lz4_encode_sequence(op, oend, anchor, ip - anchor,
+						 ip - ref, len);
+			if (unlikely(!op))
+				return LZ4_E_OUTPUT_OVERRUN;
+
+			ip += len;
+			anchor = ip;
+			if (ip > mflimit)
+				goto last_literals;
+
+			/* Fill the table with a position inside the match */
+			LZ4_PUT_POS(lz4_hash(lz4_read32(ip - 2), small), ip - 2);
+
+			/* A match right away saves emitting an empty run */
+			h = lz4_hash(lz4_read32(ip), small);
+			ref = LZ4_GET_REF(h);
+			LZ4_PUT_POS(h, ip);
+			if (ip - ref > MAX_DISTANCE ||
+			    lz4_read32(ref) != lz4_read32(ip))
+				break;
+		}
+
+		ip++;
+		if (unlikely(ip > mflimit))
+			break;
+	}
+
+#undef LZ4_GET_REF
+#undef LZ4_PUT_POS
+
+last_literals:
+	op = lz4_encode_last_literals(op, oend, anchor, iend - anchor);
+	if (unlikely(!op))
+		return LZ4_E_OUTPUT_OVERRUN;
+
+	*dst_len = op - dst;
+	return LZ4_E_OK;
+}
+
+int lz4_compress(const unsigned char *src, size_t src_len,
+		unsigned char *dst, size_t *dst_len, void *wrkmem)
+{
+	if (src_len > LZ4_MAX_INPUT_SIZE)
+		return LZ4_E_ERROR;
+
+	if (src_len < LZ4_64K_LIMIT)
+		return lz4_compress_generic(src, src_len, dst, dst_len,
+					    wrkmem, true);
+	return lz4_compress_generic(src, src_len, dst, dst_len, wrkmem, false);
+}
+EXPORT_SYMBOL_GPL(lz4_compress);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("LZ4 Compressor");
@@ -0,0 +1,116 @@
+/*
+ *  LZ4 Decompressor
+ *
+ *  Every length and offset read from the input is checked against both
+ *  buffers before it is used, so corrupt or malicious input can make
+ *  decompression fail but never overrun src or dst.
+ */
+
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/string.h>
+#include <linux/lz4.h>
+#include <asm/unaligned.h>
+#include "lz4defs.h"
+
+/*
+ * Read the rest of a length whose token nibble was saturated. Returns
+ * false if the input ends first or the length exceeds limit.
+ */
+static inline bool lz4_read_length(const u8 **ip, const u8 *iend,
+				   size_t *len, size_t limit)
+{
+	unsigned int s;
+
+	do {
+		if (unlikely(*ip >= iend))
+			return false;
+		s = *(*ip)++;
+		*len += s;
+		if (unlikely(*len > limit))
+			return false;
+	} while (s == 255);
+
+	return true;
+}
+
+int lz4_decompress_safe(const unsigned char *src, size_t src_len,
+		unsigned char *dst, size_t *dst_len)
+{
+	const u8 *ip = src;
+	const u8 *const iend = src + src_len;
+	u8 *op = dst;
+	u8 *const oend = dst + *dst_len;
+	const u8 *ref;
+	unsigned int token;
+	size_t len, offset;
+
+	for (;;) {
+		if (unlikely(ip >= iend))
+			return LZ4_E_INPUT_OVERRUN;
+
+		token = *ip++;
+
+		/* Literals */
+		len = token >> ML_BITS;
+		if (len == RUN_MASK &&
+		    !lz4_read_length(&ip, iend, &len, oend - op))
+			return LZ4_E_ERROR;
+
+		if (unlikely(len > (size_t)(iend - ip)))
+			return LZ4_E_INPUT_OVERRUN;
+		if (unlikely(len > (size_t)(oend - op)))
+			return LZ4_E_OUTPUT_OVERRUN;
+
+		memcpy(op, ip, len);
+		op += len;
+		ip += len;
+
+		/* The last sequence of a block has literals only */
+		if (ip == iend)
+			break;
+
+		/* Match */
+		if (unlikely(iend - ip < 2))
+			return LZ4_E_INPUT_OVERRUN;
+		offset = get_unaligned_le16(ip);
+		ip += 2;
+		if (unlikely(offset == 0 || offset > (size_t)(op - dst)))
+			return LZ4_E_LOOKBEHIND_OVERRUN;
+		ref = op - offset;
+
+		len = token & ML_MASK;
+		if (len == ML_MASK &&
+		    !lz4_read_length(&ip, iend, &len, oend - op))
+			return LZ4_E_ERROR;
+		len += MINMATCH;
+
+		if (unlikely(len > (size_t)(oend - op)))
+			return LZ4_E_OUTPUT_OVERRUN;
+
+		if (offset >= COPYLENGTH) {
+			/* No overlap within a word, copy a word at a time */
+			u8 *cpy = op + len;
+
+			while (op + COPYLENGTH <= cpy) {
+				put_unaligned(get_unaligned((const u64 *)ref),
+					      (u64 *)op);
+				op += COPYLENGTH;
+				ref += COPYLENGTH;
+			}
+			while (op < cpy)
+				*op++ = *ref++;
+		} else {
+			/* Overlapping copy replicates the last offset bytes */
+			while (len--)
+				*op++ = *ref++;
+		}
+	}
+
+	*dst_len = op - dst;
+	return LZ4_E_OK;
+}
+EXPORT_SYMBOL_GPL(lz4_decompress_safe);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("LZ4 Decompressor");
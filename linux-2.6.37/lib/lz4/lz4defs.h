@@ -0,0 +1,130 @@
+/*
+ *  lz4defs.h -- LZ4 block format constants and helpers shared by the
+ *  compressors and the decompressor
+ */
+
+#define MINMATCH	4
+
+#define COPYLENGTH	8
+#define LASTLITERALS	5
+#define MFLIMIT		(COPYLENGTH + MINMATCH)
+
+/* Inputs shorter than this are stored as a single literal run */
+#define MINLENGTH	(MFLIMIT + 1)
+
+#define MAX_DISTANCE	65535
+
+#define ML_BITS		4
+#define ML_MASK		((1U << ML_BITS) - 1)
+#define RUN_BITS	(8 - ML_BITS)
+#define RUN_MASK	((1U << RUN_BITS) - 1)
+
+/* Largest input the 32-bit position tables can address */
+#define LZ4_MAX_INPUT_SIZE	0x7E000000
+
+static inline u32 lz4_read32(const u8 *p)
+{
+	return get_unaligned((const u32 *)p);
+}
+
+/*
+ * Number of bytes that match at ip and ref, not looking at or beyond
+ * limit. Compares a word at a time.
+ */
+static inline unsigned int lz4_count(const u8 *ip, const u8 *ref,
+				     const u8 *limit)
+{
+	const u8 *start = ip;
+	unsigned long diff;
+
+	while (ip + sizeof(unsigned long) <= limit) {
+		diff = get_unaligned((const unsigned long *)ref) ^
+			get_unaligned((const unsigned long *)ip);
+		if (diff) {
+#ifdef __LITTLE_ENDIAN
+			ip += __ffs(diff) >> 3;
+#else
+			ip += (BITS_PER_LONG - 1 - __fls(diff)) >> 3;
+#endif
+			return ip - start;
+		}
+		ip += sizeof(unsigned long);
+		ref += sizeof(unsigned long);
+	}
+
+	while (ip < limit && *ip == *ref) {
+		ip++;
+		ref++;
+	}
+
+	return ip - start;
+}
+
+/* Write the part of a length that did not fit in its token nibble */
+static inline u8 *lz4_write_length(u8 *op, size_t len)
+{
+	while (len >= 255) {
+		*op++ = 255;
+		len -= 255;
+	}
+	*op++ = len;
+	return op;
+}
+
+/*
+ * Emit one sequence: lit_len literals from anchor followed by a match
+ * of match_len bytes, offset bytes back. Returns the new output
+ * position, or NULL if the sequence would not fit before oend.
+ */
+static inline u8 *lz4_encode_sequence(u8 *op, u8 *oend, const u8 *anchor,
+				      size_t lit_len, unsigned int offset,
+				      size_t match_len)
+{
+	u8 *token;
+
+	match_len -= MINMATCH;
+	if ((size_t)(oend - op) < 1 + lit_len / 255 + 1 + lit_len + 2 +
+			match_len / 255 + 1)
+		return NULL;
+
+	token = op++;
+	if (lit_len >= RUN_MASK) {
+		*token = RUN_MASK << ML_BITS;
+		op = lz4_write_length(op, lit_len - RUN_MASK);
+	} else {
+		*token = lit_len << ML_BITS;
+	}
+
+	memcpy(op, anchor, lit_len);
+	op += lit_len;
+
+	put_unaligned_le16(offset, op);
+	op += 2;
+
+	if (match_len >= ML_MASK) {
+		*token |= ML_MASK;
+		op = lz4_write_length(op, match_len - ML_MASK);
+	} else {
+		*token |= match_len;
+	}
+
+	return op;
+}
+
+/* Emit the final, literal-only sequence of a block */
+static inline u8 *lz4_encode_last_literals(u8 *op, u8 *oend,
+					   const u8 *anchor, size_t lit_len)
+{
+	if ((size_t)(oend - op) < 1 + lit_len / 255 + 1 + lit_len)
+		return NULL;
+
+	if (lit_len >= RUN_MASK) {
+		*op++ = RUN_MASK << ML_BITS;
+		op = lz4_write_length(op, lit_len - RUN_MASK);
+	} else {
+		*op++ = lit_len << ML_BITS;
+	}
+
+	memcpy(op, anchor, lit_len);
+	return op + lit_len;
+}
@@ -0,0 +1,161 @@
+/*
+ *  LZ4 HC Compressor
+ *
+ *  Produces the same block format as lz4_compress(), so the output is
+ *  read by lz4_decompress_safe(), but spends far more time finding
+ *  matches: every position is linked into a hash chain covering the
+ *  whole 64k window, the longest match along the chain is taken, and
+ *  a match is deferred by one byte when the next position has a longer
+ *  one. This is meant for images that are packed once and read many
+ *  times.
+ */
+
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/string.h>
+#include <linux/lz4.h>
+#include <asm/unaligned.h>
+#include "lz4defs.h"
+
+#define LZ4HC_HASH_SIZE		(1 << LZ4HC_HASH_LOG)
+#define LZ4HC_CHAIN_MASK	(LZ4HC_MAX_DISTANCE - 1)
+
+/* How many chain links to follow for every match search */
+#define LZ4HC_MAX_ATTEMPTS	256
+
+struct lz4hc_data {
+	const u8 *base;
+	const u8 *next_to_update;
+	u32 hash_table[LZ4HC_HASH_SIZE];
+	u16 chain_table[LZ4HC_MAX_DISTANCE];
+};
+
+static inline u32 lz4hc_hash(const u8 *p)
+{
+	return (lz4_read32(p) * 2654435761U) >> (32 - LZ4HC_HASH_LOG);
+}
+
+static void lz4hc_init(struct lz4hc_data *hc, const u8 *base)
+{
+	memset(hc->hash_table, 0, sizeof(hc->hash_table));
+	/* a delta of MAX_DISTANCE ends every chain that is not filled in */
+	memset(hc->chain_table, 0xFF, sizeof(hc->chain_table));
+	hc->base = base;
+	hc->next_to_update = base;
+}
+
+/* Link every position up to, not including, ip into its chain */
+static inline void lz4hc_insert(struct lz4hc_data *hc, const u8 *ip)
+{
+	const u8 *p = hc->next_to_update;
+	const u8 *base = hc->base;
+	size_t delta;
+	u32 h;
+
+	while (p < ip) {
+		h = lz4hc_hash(p);
+		delta = p - (base + hc->hash_table[h]);
+		if (delta == 0 || delta > MAX_DISTANCE)
+			delta = MAX_DISTANCE;
+		hc->chain_table[(p - base) & LZ4HC_CHAIN_MASK] = delta;
+		hc->hash_table[h] = p - base;
+		p++;
+	}
+
+	hc->next_to_update = ip;
+}
+
+/*
+ * Find the longest match for ip that does not extend past matchlimit.
+ * Returns its length, or 0 if there is none of at least MINMATCH bytes.
+ */
+static inline size_t lz4hc_find_longest(struct lz4hc_data *hc, const u8 *ip,
+					const u8 *matchlimit, const u8 **matchpos)
+{
+	const u8 *base = hc->base;
+	const u8 *ref;
+	unsigned int attempts = LZ4HC_MAX_ATTEMPTS;
+	size_t ml = 0, len;
+
+	lz4hc_insert(hc, ip);
+	ref = base + hc->hash_table[lz4hc_hash(ip)];
+
+	while (ref < ip && ip - ref <= MAX_DISTANCE && attempts--) {
+		/* only a longer match can be better, check its last byte first */
+		if (ref[ml] == ip[ml] && lz4_read32(ref) == lz4_read32(ip)) {
+			len = MINMATCH + lz4_count(ip + MINMATCH,
+						   ref + MINMATCH, matchlimit);
+			if (len > ml) {
+				ml = len;
+				*matchpos = ref;
+			}
+		}
+		ref -= hc->chain_table[(ref - base) & LZ4HC_CHAIN_MASK];
+	}
+
+	return ml;
+}
+
+int lz4hc_compress(const unsigned char *src, size_t src_len,
+		unsigned char *dst, size_t *dst_len, void *wrkmem)
+{
+	struct lz4hc_data *hc = wrkmem;
+	const u8 *ip = src;
+	const u8 *anchor = src;
+	const u8 *const iend = src + src_len;
+	const u8 *const mflimit = iend - MFLIMIT;
+	const u8 *const matchlimit = iend - LASTLITERALS;
+	const u8 *ref = NULL, *ref2 = NULL;
+	u8 *op = dst;
+	u8 *const oend = dst + *dst_len;
+	size_t ml, ml2;
+
+	BUILD_BUG_ON(sizeof(struct lz4hc_data) > LZ4HC_MEM_COMPRESS);
+
+	if (src_len > LZ4_MAX_INPUT_SIZE)
+		return LZ4_E_ERROR;
+
+	lz4hc_init(hc, src);
+
+	if (src_len < MINLENGTH)
+		goto last_literals;
+
+	ip++;
+	while (ip <= mflimit) {
+		ml = lz4hc_find_longest(hc, ip, matchlimit, &ref);
+		if (!ml) {
+			ip++;
+			continue;
+		}
+
+		/* Lazy matching: prefer a longer match one byte later */
+		while (ip + 1 <= mflimit) {
+			ml2 = lz4hc_find_longest(hc, ip + 1, matchlimit, &ref2);
+			if (ml2 <= ml)
+				break;
+			ip++;
+			ml = ml2;
+			ref = ref2;
+		}
+
+		op = lz4_encode_sequence(op, oend, anchor, ip - anchor,
+					 ip - ref, ml);
+		if (unlikely(!op))
+			return LZ4_E_OUTPUT_OVERRUN;
+
+		ip += ml;
+		anchor = ip;
+	}
+
+last_literals:
+	op = lz4_encode_last_literals(op, oend, anchor, iend - anchor);
+	if (unlikely(!op))
+		return LZ4_E_OUTPUT_OVERRUN;
+
+	*dst_len = op - dst;
+	return LZ4_E_OK;
+}
+EXPORT_SYMBOL_GPL(lz4hc_compress);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("LZ4HC Compressor");
@@ -0,0 +1,104 @@
+/*
+ * Private includes and definitions for the XZ decompressor
+ */
+
+#ifndef XZ_PRIVATE_H
+#define XZ_PRIVATE_H
+
+#include <linux/xz.h>
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/string.h>
+#include <linux/crc32.h>
+#include <asm/unaligned.h>
+
+/* Enable the BCJ filter decoders selected in the configuration. */
+#ifdef CONFIG_XZ_DEC_X86
+#	define XZ_DEC_X86
+#endif
+#ifdef CONFIG_XZ_DEC_POWERPC
+#	define XZ_DEC_POWERPC
+#endif
+#ifdef CONFIG_XZ_DEC_IA64
+#	define XZ_DEC_IA64
+#endif
+#ifdef CONFIG_XZ_DEC_ARM
+#	define XZ_DEC_ARM
+#endif
+#ifdef CONFIG_XZ_DEC_ARMTHUMB
+#	define XZ_DEC_ARMTHUMB
+#endif
+#ifdef CONFIG_XZ_DEC_SPARC
+#	define XZ_DEC_SPARC
+#endif
+
+#if defined(XZ_DEC_X86) || defined(XZ_DEC_POWERPC) \
+		|| defined(XZ_DEC_IA64) || defined(XZ_DEC_ARM) \
+		|| defined(XZ_DEC_ARMTHUMB) || defined(XZ_DEC_SPARC)
+#	define XZ_DEC_BCJ
+#endif
+
+#define memeq(a, b, size) (memcmp(a, b, size) == 0)
+#define memzero(buf, size) memset(buf, 0, size)
+
+#define DEC_IS_SINGLE(mode) ((mode) == XZ_SINGLE)
+#define DEC_IS_PREALLOC(mode) ((mode) == XZ_PREALLOC)
+#define DEC_IS_DYNALLOC(mode) ((mode) == XZ_DYNALLOC)
+#define DEC_IS_MULTI(mode) ((mode) != XZ_SINGLE)
+
+/* The .xz format uses the same CRC32 as lib/crc32.c, with inverted ends */
+static inline uint32_t xz_crc32(const uint8_t *buf, size_t size, uint32_t crc)
+{
+	return ~crc32_le(~crc, buf, size);
+}
+
+/*
+ * Allocate memory for LZMA2 decoder. xz_dec_lzma2_reset() must be used
+ * before calling xz_dec_lzma2_run().
+ */
+struct xz_dec_lzma2 *xz_dec_lzma2_create(enum xz_mode mode, uint32_t dict_max);
+
+/*
+ * Decode the LZMA2 properties (one byte) and reset the decoder. Return
+ * XZ_OK on success, XZ_MEMLIMIT_ERROR if the preallocated dictionary is not
+ * big enough, and XZ_OPTIONS_ERROR if props indicates something that this
+ * decoder doesn't support.
+ */
+enum xz_ret xz_dec_lzma2_reset(struct xz_dec_lzma2 *s, uint8_t props);
+
+/* Decode raw LZMA2 stream from b->in to b->out. */
+enum xz_ret xz_dec_lzma2_run(struct xz_dec_lzma2 *s, struct xz_buf *b);
+
+/* Free the memory allocated for the LZMA2 decoder. */
+void xz_dec_lzma2_end(struct xz_dec_lzma2 *s);
+
+#ifdef XZ_DEC_BCJ
+/*
+ * Allocate memory for BCJ decoders. xz_dec_bcj_reset() must be used before
+ * calling xz_dec_bcj_run().
+ */
+struct xz_dec_bcj *xz_dec_bcj_create(bool single_call);
+
+/*
+ * Decode the Filter ID of a BCJ filter. This implementation doesn't
+ * support custom start offsets, so no decoding of Filter Properties
+ * is needed. Returns XZ_OK if the given Filter ID is supported.
+ * Otherwise XZ_OPTIONS_ERROR is returned.
+ */
+enum xz_ret xz_dec_bcj_reset(struct xz_dec_bcj *s, uint8_t id);
+
+/*
+ * Decode raw BCJ + LZMA2 stream. This must be used only if there actually is
+ * a BCJ filter in the chain. If the chain has only LZMA2, xz_dec_lzma2_run()
+ * must be called directly.
+ */
+enum xz_ret xz_dec_bcj_run(struct xz_dec_bcj *s, struct xz_dec_lzma2 *lzma2,
+			   struct xz_buf *b);
+
+/* Free the memory allocated for the BCJ filters. */
+#define xz_dec_bcj_end(s) kfree(s)
+#endif
+
+#endif
@@ -35,6 +35,7 @@
 #include <linux/memcontrol.h>
 #include <linux/mm_inline.h> /* for page_is_file_cache() */
 #include "internal.h"
+#include <trace/events/readahead.h>
 
 /*
  * FIXME: remove all knowledge of the buffer layer from the core VM
@@ -80,7 +81,7 @@
  *  ->i_mutex
  *    ->i_alloc_sem             (various)
  *
- *  ->inode_lock
+ *  ->inode_wb_list_lock
  *    ->sb_lock			(fs/fs-writeback.c)
  *    ->mapping->tree_lock	(__sync_single_inode)
  *
@@ -98,12 +99,12 @@
  *    ->zone.lru_lock		(check_pte_range->isolate_lru_page)
  *    ->private_lock		(page_remove_rmap->set_page_dirty)
  *    ->tree_lock		(page_remove_rmap->set_page_dirty)
- *    ->inode_lock		(page_remove_rmap->set_page_dirty)
- *    ->inode_lock		(zap_pte_range->set_page_dirty)
+ *    ->inode->i_lock		(page_remove_rmap->set_page_dirty)
+ *    ->inode->i_lock		(zap_pte_range->set_page_dirty)
  *    ->private_lock		(zap_pte_range->__set_page_dirty_buffers)
  *
  *  ->task->proc_lock
- *    ->dcache_lock		(proc_pid_lookup)
+ *    ->d_lock		(proc_pid_lookup)
  *
  *  (code doesn't rely on that order, so you could switch it around)
  *  ->tasklist_lock             (memory_failure, collect_procs_ao)
@@ -1465,8 +1466,15 @@ static void do_sync_mmap_readahead(struct vm_area_struct *vma,
 	if (VM_RandomReadHint(vma))
 		return;
 
+	/*
+	 * A fault right behind the previous window means the mapping is
+	 * walked forward, e.g. a media file being played back.  Switch to
+	 * sequential readahead, which ramps up and pipelines through
+	 * PG_readahead instead of stalling on every read-around window.
+	 */
 	if (VM_SequentialReadHint(vma) ||
-			offset - 1 == (ra->prev_pos >> PAGE_CACHE_SHIFT)) {
+			offset - 1 == (ra->prev_pos >> PAGE_CACHE_SHIFT) ||
+			(ra->size && offset == ra->start + ra->size)) {
 		page_cache_sync_readahead(mapping, ra, file, offset,
 					  ra->ra_pages);
 		return;
@@ -1484,12 +1492,23 @@ static void do_sync_mmap_readahead(struct vm_area_struct *vma,
 
 	/*
 	 * mmap read-around
+	 *
+	 * The previous read-around window gets replaced: the pages faults
+	 * found in it were used, the rest was read in vain.
 	 */
-	ra_pages = max_sane_readahead(ra->ra_pages);
+	if (ra->mmap_hit) {
+		unsigned long hit = min(ra->mmap_hit, ra->size);
+
+		ra_account(ra, hit, ra->size - hit, false);
+		ra->mmap_hit = 0;
+	}
+	ra_pages = ra_max_pages(ra);
 	if (ra_pages) {
 		ra->start = max_t(long, 0, offset - ra_pages/2);
 		ra->size = ra_pages;
-		ra->async_size = 0;
+		ra->async_size = ra_pages / 4;
+		ra->mmap_hit = 1;
+		trace_readahead(mapping, offset, 1, ra, RA_PATTERN_MMAP_AROUND);
 		ra_submit(ra, mapping, file);
 	}
 }
@@ -1511,6 +1530,8 @@ static void do_async_mmap_readahead(struct vm_area_struct *vma,
 		return;
 	if (ra->mmap_miss > 0)
 		ra->mmap_miss--;
+	if (ra->mmap_hit && ra_has_index(ra, offset))
+		ra->mmap_hit++;
 	if (PageReadahead(page))
 		page_cache_async_readahead(mapping, ra, file,
 					   page, offset, ra->ra_pages);
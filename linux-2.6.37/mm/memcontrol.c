@@ -48,6 +48,8 @@
 #include <linux/page_cgroup.h>
 #include <linux/cpu.h>
 #include <linux/oom.h>
+#include <linux/workqueue.h>
+#include <linux/ktime.h>
 #include "internal.h"
 
 #include <asm/uaccess.h>
@@ -82,6 +84,7 @@ static int really_do_swap_account __initdata = 0;
  */
 #define THRESHOLDS_EVENTS_THRESH (7) /* once in 128 */
 #define SOFTLIMIT_EVENTS_THRESH (10) /* once in 1024 */
+#define WMARK_EVENTS_THRESH (7) /* once in 128 */
 
 /*
  * Statistics for memory cgroup.
@@ -96,6 +99,10 @@ enum mem_cgroup_stat_index {
 	MEM_CGROUP_STAT_PGPGIN_COUNT,	/* # of pages paged in */
 	MEM_CGROUP_STAT_PGPGOUT_COUNT,	/* # of pages paged out */
 	MEM_CGROUP_STAT_SWAPOUT, /* # of pages, swapped out */
+	MEM_CGROUP_STAT_BGRECLAIM_RUNS,	/* # of background reclaim runs */
+	MEM_CGROUP_STAT_BGRECLAIM_SCAN,	/* # of pages scanned in bg reclaim */
+	MEM_CGROUP_STAT_BGRECLAIM_STEAL, /* # of pages reclaimed in bg reclaim */
+	MEM_CGROUP_STAT_BGRECLAIM_TIME,	/* usecs spent in bg reclaim */
 	MEM_CGROUP_STAT_DATA, /* end of data requires synchronization */
 	/* incremented at every  pagein/pageout */
 	MEM_CGROUP_EVENTS = MEM_CGROUP_STAT_DATA,
@@ -198,10 +205,10 @@ static void mem_cgroup_oom_notify(struct mem_cgroup *mem);
  * statistics based on the statistics developed by Rik Van Riel for clock-pro,
  * to help the administrator determine what knobs to tune.
  *
- * TODO: Add a water mark for the memory controller. Reclaim will begin when
- * we hit the water mark. May be even add a low water mark, such that
- * no reclaim occurs from a cgroup at it's low water mark, this is
- * a feature that will be implemented much later in the future.
+ * Each memory cgroup may have a pair of watermarks below its limit. When
+ * usage goes above the low watermark, background reclaim is kicked and
+ * runs asynchronously until usage drops below the high watermark, so that
+ * the charging tasks rarely have to enter direct reclaim.
  */
 struct mem_cgroup {
 	struct cgroup_subsys_state css;
@@ -270,6 +277,17 @@ struct mem_cgroup {
 	 */
 	struct mem_cgroup_stat_cpu nocpu_base;
 	spinlock_t pcp_counter_lock;
+
+	/*
+	 * Distances of the watermarks below res.limit, in bytes. Zero
+	 * disables background reclaim. Protected by set_limit_mutex.
+	 */
+	unsigned long long low_wmark_distance;
+	unsigned long long high_wmark_distance;
+	/* background reclaim, queued on memcg_bgreclaim_wq */
+	struct work_struct bgreclaim_work;
+	/* longest single background reclaim run, in usecs */
+	unsigned long bgreclaim_max_latency;
 };
 
 /* Stuffs for move charges at task migration. */
@@ -359,6 +377,13 @@ static void mem_cgroup_get(struct mem_cgroup *mem);
 static void mem_cgroup_put(struct mem_cgroup *mem);
 static struct mem_cgroup *parent_mem_cgroup(struct mem_cgroup *mem);
 static void drain_all_stock_async(void);
+static void wake_memcg_bgreclaim(struct mem_cgroup *mem);
+
+/*
+ * Background reclaim is done by an unbound workqueue so that several
+ * cgroups can be reclaimed concurrently, at most one worker per cpu.
+ */
+static struct workqueue_struct *memcg_bgreclaim_wq;
 
 static struct mem_cgroup_per_zone *
 mem_cgroup_zoneinfo(struct mem_cgroup *mem, int nid, int zid)
@@ -658,6 +683,8 @@ static void memcg_check_events(struct mem_cgroup *mem, struct page *page)
 		if (unlikely(__memcg_event_check(mem, SOFTLIMIT_EVENTS_THRESH)))
 			mem_cgroup_update_tree(mem, page);
 	}
+	if (unlikely(__memcg_event_check(mem, WMARK_EVENTS_THRESH)))
+		wake_memcg_bgreclaim(mem);
 }
 
 static struct mem_cgroup *mem_cgroup_from_cont(struct cgroup *cont)
@@ -1449,6 +1476,101 @@ static int mem_cgroup_hierarchical_reclaim(struct mem_cgroup *root_mem,
 	return total;
 }
 
+/*
+ * Recompute the watermarks of @mem from its limit and the configured
+ * distances. The caller must hold set_limit_mutex.
+ */
+static void setup_per_memcg_wmarks(struct mem_cgroup *mem)
+{
+	u64 limit, low_wmark, high_wmark;
+
+	limit = res_counter_read_u64(&mem->res, RES_LIMIT);
+	if (!mem->high_wmark_distance || limit == RESOURCE_MAX) {
+		low_wmark = RESOURCE_MAX;
+		high_wmark = RESOURCE_MAX;
+	} else {
+		low_wmark = limit - min(mem->low_wmark_distance, limit);
+		high_wmark = limit - min(mem->high_wmark_distance, limit);
+	}
+	res_counter_set_wmark_limits(&mem->res, low_wmark, high_wmark);
+}
+
+/*
+ * Queue background reclaim for @mem and every ancestor sharing its
+ * hierarchy whose usage went above the low watermark. The pending work
+ * item holds a css reference which is dropped when it completes.
+ */
+static void wake_memcg_bgreclaim(struct mem_cgroup *mem)
+{
+	for (; mem; mem = parent_mem_cgroup(mem)) {
+		if (res_counter_check_under_low_wmark_limit(&mem->res))
+			continue;
+		if (work_pending(&mem->bgreclaim_work))
+			continue;
+		if (!css_tryget(&mem->css))
+			continue;
+		if (!queue_work(memcg_bgreclaim_wq, &mem->bgreclaim_work))
+			css_put(&mem->css);
+	}
+}
+
+/*
+ * Background reclaim worker. Walks the hierarchy below @mem like the
+ * direct reclaim does, until usage drops below the high watermark or a
+ * whole round over the hierarchy made no progress.
+ */
+static void mem_cgroup_bgreclaim(struct work_struct *work)
+{
+	struct mem_cgroup *mem = container_of(work, struct mem_cgroup,
+					      bgreclaim_work);
+	struct mem_cgroup *victim;
+	unsigned long nr_scanned, nr_reclaimed;
+	unsigned long total_scanned = 0, total_reclaimed = 0;
+	unsigned long round_reclaimed = 0;
+	unsigned long latency;
+	bool noswap = mem->memsw_is_minimum;
+	int loop = 0;
+	ktime_t start;
+
+	start = ktime_get();
+	while (!res_counter_check_under_high_wmark_limit(&mem->res)) {
+		victim = mem_cgroup_select_victim(mem);
+		if (victim == mem) {
+			if (loop++ && !round_reclaimed) {
+				css_put(&victim->css);
+				break;
+			}
+			round_reclaimed = 0;
+		}
+		if (!mem_cgroup_local_usage(victim)) {
+			css_put(&victim->css);
+			continue;
+		}
+		nr_reclaimed = mem_cgroup_shrink_background(victim, noswap,
+					get_swappiness(victim), &nr_scanned);
+		css_put(&victim->css);
+
+		round_reclaimed += nr_reclaimed;
+		total_reclaimed += nr_reclaimed;
+		total_scanned += nr_scanned;
+		cond_resched();
+	}
+	latency = ktime_to_us(ktime_sub(ktime_get(), start));
+
+	this_cpu_inc(mem->stat->count[MEM_CGROUP_STAT_BGRECLAIM_RUNS]);
+	this_cpu_add(mem->stat->count[MEM_CGROUP_STAT_BGRECLAIM_SCAN],
+		     total_scanned);
+	this_cpu_add(mem->stat->count[MEM_CGROUP_STAT_BGRECLAIM_STEAL],
+		     total_reclaimed);
+	this_cpu_add(mem->stat->count[MEM_CGROUP_STAT_BGRECLAIM_TIME],
+		     latency);
+	/* the work item is non-reentrant, so we are the only writer */
+	if (latency > mem->bgreclaim_max_latency)
+		mem->bgreclaim_max_latency = latency;
+
+	css_put(&mem->css);
+}
+
 /*
  * Check OOM-Killer is already running under our hierarchy.
  * If someone is running, return false.
@@ -1848,6 +1970,9 @@ static int __mem_cgroup_do_charge(struct mem_cgroup *mem, gfp_t gfp_mask,
 	} else
 		mem_over_limit = mem_cgroup_from_res_counter(fail_res, res);
 
+	/* let the background reclaim catch up while we go on */
+	wake_memcg_bgreclaim(mem_over_limit);
+
 	if (csize > PAGE_SIZE) /* change csize and retry */
 		return CHARGE_RETRY;
 
@@ -2980,6 +3105,7 @@ static int mem_cgroup_resize_limit(struct mem_cgroup *memcg,
 				memcg->memsw_is_minimum = true;
 			else
 				memcg->memsw_is_minimum = false;
+			setup_per_memcg_wmarks(memcg);
 		}
 		mutex_unlock(&set_limit_mutex);
 
@@ -3550,6 +3676,10 @@ enum {
 	MCS_INACTIVE_FILE,
 	MCS_ACTIVE_FILE,
 	MCS_UNEVICTABLE,
+	MCS_BGRECLAIM_RUNS,
+	MCS_BGRECLAIM_SCAN,
+	MCS_BGRECLAIM_STEAL,
+	MCS_BGRECLAIM_TIME,
 	NR_MCS_STAT,
 };
 
@@ -3571,7 +3701,11 @@ struct {
 	{"active_anon", "total_active_anon"},
 	{"inactive_file", "total_inactive_file"},
 	{"active_file", "total_active_file"},
-	{"unevictable", "total_unevictable"}
+	{"unevictable", "total_unevictable"},
+	{"bgreclaim_runs", "total_bgreclaim_runs"},
+	{"bgreclaim_scan", "total_bgreclaim_scan"},
+	{"bgreclaim_steal", "total_bgreclaim_steal"},
+	{"bgreclaim_time_us", "total_bgreclaim_time_us"},
 };
 
 
@@ -3607,6 +3741,16 @@ mem_cgroup_get_local_stat(struct mem_cgroup *mem, struct mcs_total_stat *s)
 	s->stat[MCS_ACTIVE_FILE] += val * PAGE_SIZE;
 	val = mem_cgroup_get_local_zonestat(mem, LRU_UNEVICTABLE);
 	s->stat[MCS_UNEVICTABLE] += val * PAGE_SIZE;
+
+	/* background reclaim stat */
+	val = mem_cgroup_read_stat(mem, MEM_CGROUP_STAT_BGRECLAIM_RUNS);
+	s->stat[MCS_BGRECLAIM_RUNS] += val;
+	val = mem_cgroup_read_stat(mem, MEM_CGROUP_STAT_BGRECLAIM_SCAN);
+	s->stat[MCS_BGRECLAIM_SCAN] += val;
+	val = mem_cgroup_read_stat(mem, MEM_CGROUP_STAT_BGRECLAIM_STEAL);
+	s->stat[MCS_BGRECLAIM_STEAL] += val;
+	val = mem_cgroup_read_stat(mem, MEM_CGROUP_STAT_BGRECLAIM_TIME);
+	s->stat[MCS_BGRECLAIM_TIME] += val;
 }
 
 static void
@@ -3633,6 +3777,8 @@ static int mem_control_stat_show(struct cgroup *cont, struct cftype *cft,
 			continue;
 		cb->fill(cb, memcg_stat_strings[i].local_name, mystat.stat[i]);
 	}
+	cb->fill(cb, "bgreclaim_max_latency_us",
+		 mem_cont->bgreclaim_max_latency);
 
 	/* Hierarchical information */
 	{
@@ -3683,6 +3829,73 @@ static int mem_control_stat_show(struct cgroup *cont, struct cftype *cft,
 	return 0;
 }
 
+static u64 mem_cgroup_wmark_distance_read(struct cgroup *cgrp,
+					  struct cftype *cft)
+{
+	struct mem_cgroup *memcg = mem_cgroup_from_cont(cgrp);
+
+	if (MEMFILE_ATTR(cft->private) == RES_LOW_WMARK_LIMIT)
+		return memcg->low_wmark_distance;
+	return memcg->high_wmark_distance;
+}
+
+/*
+ * The low watermark must stay above the high one, i.e. the distance of
+ * the low watermark from the limit must not exceed the high one.
+ */
+static int mem_cgroup_wmark_distance_write(struct cgroup *cgrp,
+					   struct cftype *cft,
+					   const char *buffer)
+{
+	struct mem_cgroup *memcg = mem_cgroup_from_cont(cgrp);
+	unsigned long long val, limit;
+	int ret;
+
+	if (mem_cgroup_is_root(memcg))
+		return -EINVAL;
+
+	ret = res_counter_memparse_write_strategy(buffer, &val);
+	if (ret)
+		return ret;
+
+	mutex_lock(&set_limit_mutex);
+	limit = res_counter_read_u64(&memcg->res, RES_LIMIT);
+	if (val && val >= limit) {
+		ret = -EINVAL;
+		goto out;
+	}
+	if (MEMFILE_ATTR(cft->private) == RES_LOW_WMARK_LIMIT) {
+		if (memcg->high_wmark_distance &&
+		    val > memcg->high_wmark_distance) {
+			ret = -EINVAL;
+			goto out;
+		}
+		memcg->low_wmark_distance = val;
+	} else {
+		if (val && val < memcg->low_wmark_distance) {
+			ret = -EINVAL;
+			goto out;
+		}
+		memcg->high_wmark_distance = val;
+	}
+	setup_per_memcg_wmarks(memcg);
+out:
+	mutex_unlock(&set_limit_mutex);
+	return ret;
+}
+
+static int mem_cgroup_wmark_read(struct cgroup *cgrp, struct cftype *cft,
+				 struct cgroup_map_cb *cb)
+{
+	struct mem_cgroup *memcg = mem_cgroup_from_cont(cgrp);
+
+	cb->fill(cb, "low_wmark",
+		 res_counter_read_u64(&memcg->res, RES_LOW_WMARK_LIMIT));
+	cb->fill(cb, "high_wmark",
+		 res_counter_read_u64(&memcg->res, RES_HIGH_WMARK_LIMIT));
+	return 0;
+}
+
 static u64 mem_cgroup_swappiness_read(struct cgroup *cgrp, struct cftype *cft)
 {
 	struct mem_cgroup *memcg = mem_cgroup_from_cont(cgrp);
@@ -4085,6 +4298,22 @@ static struct cftype mem_cgroup_files[] = {
 		.trigger = mem_cgroup_reset,
 		.read_u64 = mem_cgroup_read,
 	},
+	{
+		.name = "low_wmark_distance",
+		.private = MEMFILE_PRIVATE(_MEM, RES_LOW_WMARK_LIMIT),
+		.write_string = mem_cgroup_wmark_distance_write,
+		.read_u64 = mem_cgroup_wmark_distance_read,
+	},
+	{
+		.name = "high_wmark_distance",
+		.private = MEMFILE_PRIVATE(_MEM, RES_HIGH_WMARK_LIMIT),
+		.write_string = mem_cgroup_wmark_distance_write,
+		.read_u64 = mem_cgroup_wmark_distance_read,
+	},
+	{
+		.name = "reclaim_wmarks",
+		.read_map = mem_cgroup_wmark_read,
+	},
 	{
 		.name = "stat",
 		.read_map = mem_control_stat_show,
@@ -4347,6 +4576,11 @@ mem_cgroup_create(struct cgroup_subsys *ss, struct cgroup *cont)
 		root_mem_cgroup = mem;
 		if (mem_cgroup_soft_limit_tree_init())
 			goto free_out;
+		memcg_bgreclaim_wq = alloc_workqueue("memcg_bgreclaim",
+					WQ_MEM_RECLAIM | WQ_UNBOUND,
+					num_possible_cpus());
+		if (!memcg_bgreclaim_wq)
+			goto free_out;
 		for_each_possible_cpu(cpu) {
 			struct memcg_stock_pcp *stock =
 						&per_cpu(memcg_stock, cpu);
@@ -4375,6 +4609,7 @@ mem_cgroup_create(struct cgroup_subsys *ss, struct cgroup *cont)
 	}
 	mem->last_scanned_child = 0;
 	spin_lock_init(&mem->reclaim_param_lock);
+	INIT_WORK(&mem->bgreclaim_work, mem_cgroup_bgreclaim);
 	INIT_LIST_HEAD(&mem->oom_notify);
 
 	if (parent)
@@ -578,6 +578,19 @@ static inline int free_pages_check(struct page *page)
 	return 0;
 }
 
+/*
+ * Take zone->lock on the allocator fast paths, accounting how often it
+ * was found held by another cpu. Interrupts must be disabled.
+ */
+static inline void zone_lock(struct zone *zone)
+{
+	if (!spin_trylock(&zone->lock)) {
+		spin_lock(&zone->lock);
+		__inc_zone_state(zone, ZONE_LOCK_CONTENDED);
+	}
+	__inc_zone_state(zone, ZONE_LOCK_ACQUIRED);
+}
+
 /*
  * Frees a number of pages from the PCP lists
  * Assumes all pages on list are in same zone, and of same order.
@@ -596,7 +609,7 @@ static void free_pcppages_bulk(struct zone *zone, int count,
 	int batch_free = 0;
 	int to_free = count;
 
-	spin_lock(&zone->lock);
+	zone_lock(zone);
 	zone->all_unreclaimable = 0;
 	zone->pages_scanned = 0;
 
@@ -631,10 +644,117 @@ static void free_pcppages_bulk(struct zone *zone, int count,
 	spin_unlock(&zone->lock);
 }
 
+#ifdef CONFIG_SMP
+/*
+ * Move the pages other cpus handed over to @pcp onto its own lists.
+ * Interrupts must be disabled.
+ */
+static int pcp_take_remote(struct per_cpu_pages *pcp)
+{
+	int migratetype, count;
+
+	if (!pcp->remote_count)
+		return 0;
+
+	spin_lock(&pcp->remote_lock);
+	count = pcp->remote_count;
+	for (migratetype = 0; migratetype < MIGRATE_PCPTYPES; migratetype++)
+		list_splice_tail_init(&pcp->remote_lists[migratetype],
+				      &pcp->lists[migratetype]);
+	pcp->remote_count = 0;
+	spin_unlock(&pcp->remote_lock);
+
+	pcp->count += count;
+	return count;
+}
+
+/*
+ * When one cpu keeps freeing the pages another one allocates (network
+ * receive on one core, consumer on the other), every page would go through
+ * zone->lock twice: freed to the buddy lists by the first cpu and taken
+ * off them again by the second. Instead hand the batch straight over to
+ * the cpu which last refilled its pcp lists from the buddy allocator.
+ *
+ * Returns false if there is no such cpu or it already holds enough
+ * pages, in which case the caller frees the batch to the buddy lists.
+ * Interrupts must be disabled.
+ */
+static bool free_pcppages_remote(struct zone *zone, int count,
+					struct per_cpu_pages *pcp)
+{
+	int cpu = ACCESS_ONCE(zone->pcp_refill_cpu);
+	int migratetype = 0;
+	int batch_free = 0;
+	int to_free = count;
+	struct per_cpu_pages *rpcp;
+
+	if (cpu < 0 || cpu == smp_processor_id())
+		return false;
+
+	rpcp = &per_cpu_ptr(zone->pageset, cpu)->pcp;
+	if (rpcp->remote_count + count > rpcp->high)
+		return false;
+
+	spin_lock(&rpcp->remote_lock);
+	/* page_alloc_cpu_notify() drains the lists of a dead cpu */
+	if (!cpu_online(cpu) || rpcp->remote_count + count > rpcp->high) {
+		spin_unlock(&rpcp->remote_lock);
+		return false;
+	}
+
+	/* Same round-robin over the lists as free_pcppages_bulk() */
+	while (to_free) {
+		struct page *page;
+		struct list_head *list;
+
+		do {
+			batch_free++;
+			if (++migratetype == MIGRATE_PCPTYPES)
+				migratetype = 0;
+			list = &pcp->lists[migratetype];
+		} while (list_empty(list));
+
+		do {
+			page = list_entry(list->prev, struct page, lru);
+			list_move(&page->lru, &rpcp->remote_lists[migratetype]);
+		} while (--to_free && --batch_free && !list_empty(list));
+	}
+	rpcp->remote_count += count;
+	spin_unlock(&rpcp->remote_lock);
+
+	__mod_zone_page_state(zone, PCP_REMOTE_FREE, count);
+	return true;
+}
+
+/* Note that this cpu had to go to the buddy lists for its pcp pages */
+static inline void pcp_note_refill(struct zone *zone)
+{
+	int cpu = smp_processor_id();
+
+	if (zone->pcp_refill_cpu != cpu)
+		zone->pcp_refill_cpu = cpu;
+}
+#else
+static inline int pcp_take_remote(struct per_cpu_pages *pcp)
+{
+	return 0;
+}
+
+static inline bool free_pcppages_remote(struct zone *zone, int count,
+					struct per_cpu_pages *pcp)
+{
+	return false;
+}
+
+static inline void pcp_note_refill(struct zone *zone)
+{
+}
+#endif
+
 static void free_one_page(struct zone *zone, struct page *page, int order,
 				int migratetype)
 {
-	spin_lock(&zone->lock);
+	zone_lock(zone);
 	zone->all_unreclaimable = 0;
 	zone->pages_scanned = 0;
 
@@ -1023,7 +1143,7 @@ static int rmqueue_bulk(struct zone *zone, unsigned int order,
 {
 	int i;
 	
-	spin_lock(&zone->lock);
+	zone_lock(zone);
 	for (i = 0; i < count; ++i) {
 		struct page *page = __rmqueue(zone, order, migratetype);
 		if (unlikely(page == NULL))
@@ -1095,6 +1215,7 @@ static void drain_pages(unsigned int cpu)
 		pset = per_cpu_ptr(zone->pageset, cpu);
 
 		pcp = &pset->pcp;
+		pcp_take_remote(pcp);
 		free_pcppages_bulk(zone, pcp->count, pcp);
 		pcp->count = 0;
 		local_irq_restore(flags);
@@ -1197,7 +1318,8 @@ void free_hot_cold_page(struct page *page, int cold)
 		list_add(&page->lru, &pcp->lists[migratetype]);
 	pcp->count++;
 	if (pcp->count >= pcp->high) {
-		free_pcppages_bulk(zone, pcp->batch, pcp);
+		if (!free_pcppages_remote(zone, pcp->batch, pcp))
+			free_pcppages_bulk(zone, pcp->batch, pcp);
 		pcp->count -= pcp->batch;
 	}
 
@@ -1300,12 +1422,15 @@ again:
 		local_irq_save(flags);
 		pcp = &this_cpu_ptr(zone->pageset)->pcp;
 		list = &pcp->lists[migratetype];
+		if (list_empty(list))
+			pcp_take_remote(pcp);
 		if (list_empty(list)) {
 			pcp->count += rmqueue_bulk(zone, 0,
 					pcp->batch, list,
 					migratetype, cold);
 			if (unlikely(list_empty(list)))
 				goto failed;
+			pcp_note_refill(zone);
 		}
 
 		if (cold)
@@ -1329,7 +1454,8 @@ again:
 			 */
 			WARN_ON_ONCE(order > 1);
 		}
-		spin_lock_irqsave(&zone->lock, flags);
+		local_irq_save(flags);
+		zone_lock(zone);
 		page = __rmqueue(zone, order, migratetype);
 		spin_unlock(&zone->lock);
 		if (!page)
@@ -3388,6 +3514,11 @@ static void setup_pageset(struct per_cpu_pageset *p, unsigned long batch)
 	pcp->batch = max(1UL, 1 * batch);
 	for (migratetype = 0; migratetype < MIGRATE_PCPTYPES; migratetype++)
 		INIT_LIST_HEAD(&pcp->lists[migratetype]);
+#ifdef CONFIG_SMP
+	spin_lock_init(&pcp->remote_lock);
+	for (migratetype = 0; migratetype < MIGRATE_PCPTYPES; migratetype++)
+		INIT_LIST_HEAD(&pcp->remote_lists[migratetype]);
+#endif
 }
 
 /*
@@ -3494,6 +3625,7 @@ static int __zone_pcp_update(void *data)
 		pcp = &pset->pcp;
 
 		local_irq_save(flags);
+		pcp_take_remote(pcp);
 		free_pcppages_bulk(zone, pcp->count, pcp);
 		setup_pageset(pset, batch);
 		local_irq_restore(flags);
@@ -3514,6 +3646,9 @@ static __meminit void zone_pcp_init(struct zone *zone)
 	 * offset of a (static) per cpu variable into the per cpu area.
 	 */
 	zone->pageset = &boot_pageset;
+#ifdef CONFIG_SMP
+	zone->pcp_refill_cpu = -1;
+#endif
 
 	if (zone->present_pages)
 		printk(KERN_DEBUG "  %s zone: %lu pages, LIFO batch:%u\n",
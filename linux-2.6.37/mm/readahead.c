@@ -18,6 +18,9 @@
 #include <linux/pagevec.h>
 #include <linux/pagemap.h>
 
+#define CREATE_TRACE_POINTS
+#include <trace/events/readahead.h>
+
 /*
  * Initialise a struct file's readahead state.  Assumes that the caller has
  * memset *ra to zero.
@@ -109,9 +112,12 @@ EXPORT_SYMBOL(read_cache_pages);
 static int read_pages(struct address_space *mapping, struct file *filp,
 		struct list_head *pages, unsigned nr_pages)
 {
+	struct blk_plug plug;
 	unsigned page_idx;
 	int ret;
 
+	blk_start_plug(&plug);
+
 	if (mapping->a_ops->readpages) {
 		ret = mapping->a_ops->readpages(filp, mapping, pages, nr_pages);
 		/* Clean up the remaining pages */
@@ -129,7 +135,10 @@ static int read_pages(struct address_space *mapping, struct file *filp,
 		page_cache_release(page);
 	}
 	ret = 0;
+
 out:
+	blk_finish_plug(&plug);
+
 	return ret;
 }
 
@@ -330,6 +339,84 @@ static unsigned long get_next_ra_size(struct file_ra_state *ra,
  * it approaches max_readhead.
  */
 
+/*
+ * Adaptive window scaling.
+ *
+ * Each file counts the readahead pages that were consumed (hits) and the
+ * ones that were left behind when the reader jumped elsewhere (misses).
+ * Once a window's worth of evidence is in, the per-file maximum is halved
+ * if more was wasted than used, e.g. for database files with small random
+ * accesses that look sequential now and then.  It is doubled back when
+ * nearly everything got used, and may grow beyond ra_pages for interleaved
+ * streams, which have to share one readahead state between several readers.
+ */
+#define RA_SHIFT_MIN	(-3)
+#define RA_SHIFT_MAX	1
+
+unsigned long ra_max_pages(struct file_ra_state *ra)
+{
+	unsigned long pages = ra->ra_pages;
+
+	if (ra->ra_shift < 0)
+		pages >>= -ra->ra_shift;
+	else
+		pages <<= ra->ra_shift;
+
+	if (!pages && ra->ra_pages)
+		pages = 1;
+
+	return max_sane_readahead(pages);
+}
+
+void ra_account(struct file_ra_state *ra, unsigned long hit,
+		unsigned long miss, bool interleaved)
+{
+	int shift = ra->ra_shift;
+
+	ra->hit_pages += hit;
+	ra->miss_pages += miss;
+
+	if (ra->hit_pages + ra->miss_pages < ra->ra_pages)
+		return;
+
+	if (ra->miss_pages > ra->hit_pages) {
+		if (shift > RA_SHIFT_MIN)
+			shift--;
+	} else if (ra->miss_pages * 8 < ra->hit_pages) {
+		if (shift < (interleaved ? RA_SHIFT_MAX : 0))
+			shift++;
+	}
+
+	if (shift != ra->ra_shift)
+		trace_readahead_adapt(ra, shift);
+
+	ra->ra_shift = shift;
+	ra->hit_pages = 0;
+	ra->miss_pages = 0;
+}
+
+/*
+ * The readahead window is about to be abandoned for a read at @offset:
+ * count the pages that were read ahead beyond the last read position
+ * and are not going to be used by the sequential stream.
+ */
+static unsigned long ra_skipped_pages(struct file_ra_state *ra,
+				      pgoff_t offset)
+{
+	pgoff_t end = ra->start + ra->size;
+	pgoff_t next;
+
+	if (!ra->size || ra_has_index(ra, offset))
+		return 0;
+
+	next = ra->start;
+	if (ra->prev_pos >= 0 &&
+	    (ra->prev_pos >> PAGE_CACHE_SHIFT) >= ra->start)
+		next = (ra->prev_pos >> PAGE_CACHE_SHIFT) + 1;
+
+	return end > next ? end - next : 0;
+}
+
 /*
  * Count contiguously cached pages from @offset-1 to @offset-@max,
  * this count is a conservative estimation of
@@ -392,7 +479,8 @@ ondemand_readahead(struct address_space *mapping,
 		   bool hit_readahead_marker, pgoff_t offset,
 		   unsigned long req_size)
 {
-	unsigned long max = max_sane_readahead(ra->ra_pages);
+	unsigned long max = ra_max_pages(ra);
+	int pattern = RA_PATTERN_INITIAL;
 
 	/*
 	 * start of file
@@ -406,6 +494,9 @@ ondemand_readahead(struct address_space *mapping,
 	 */
 	if ((offset == (ra->start + ra->size - ra->async_size) ||
 	     offset == (ra->start + ra->size))) {
+		ra_account(ra, ra->size, 0, false);
+		max = ra_max_pages(ra);
+		pattern = RA_PATTERN_SEQUENTIAL;
 		ra->start += ra->size;
 		ra->size = get_next_ra_size(ra, max);
 		ra->async_size = ra->size;
@@ -428,6 +519,9 @@ ondemand_readahead(struct address_space *mapping,
 		if (!start || start - offset > max)
 			return 0;
 
+		ra_account(ra, start - offset, 0, true);
+		max = ra_max_pages(ra);
+		pattern = RA_PATTERN_INTERLEAVED;
 		ra->start = start;
 		ra->size = start - offset;	/* old async_size */
 		ra->size += req_size;
@@ -439,8 +533,10 @@ ondemand_readahead(struct address_space *mapping,
 	/*
 	 * oversize read
 	 */
-	if (req_size > max)
+	if (req_size > max) {
+		pattern = RA_PATTERN_OVERSIZE;
 		goto initial_readahead;
+	}
 
 	/*
 	 * sequential cache miss
@@ -452,16 +548,25 @@ ondemand_readahead(struct address_space *mapping,
 	 * Query the page cache and look for the traces(cached history pages)
 	 * that a sequential stream would leave behind.
 	 */
-	if (try_context_readahead(mapping, ra, offset, req_size, max))
+	if (try_context_readahead(mapping, ra, offset, req_size, max)) {
+		pattern = RA_PATTERN_CONTEXT;
 		goto readit;
+	}
 
 	/*
 	 * standalone, small random read
 	 * Read as is, and do not pollute the readahead state.
 	 */
+	trace_readahead(mapping, offset, req_size, ra, RA_PATTERN_RANDOM);
 	return __do_page_cache_readahead(mapping, filp, offset, req_size, 0);
 
 initial_readahead:
+	/*
+	 * The old window gets replaced, charge what it read in vain before
+	 * sizing the new one.
+	 */
+	ra_account(ra, 0, ra_skipped_pages(ra, offset), false);
+	max = ra_max_pages(ra);
 	ra->start = offset;
 	ra->size = get_init_ra_size(req_size, max);
 	ra->async_size = ra->size > req_size ? ra->size - req_size : ra->size;
@@ -477,6 +582,9 @@ readit:
 		ra->size += ra->async_size;
 	}
 
+	/* the window is no read-around one anymore, see filemap_fault() */
+	ra->mmap_hit = 0;
+	trace_readahead(mapping, offset, req_size, ra, pattern);
 	return ra_submit(ra, mapping, filp);
 }
 
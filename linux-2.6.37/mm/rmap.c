@@ -31,11 +31,12 @@
  *             swap_lock (in swap_duplicate, swap_info_get)
  *               mmlist_lock (in mmput, drain_mmlist and others)
  *               mapping->private_lock (in __set_page_dirty_buffers)
- *               inode_lock (in set_page_dirty's __mark_inode_dirty)
- *                 sb_lock (within inode_lock in fs/fs-writeback.c)
+ *               inode->i_lock (in set_page_dirty's __mark_inode_dirty)
+ *               inode_wb_list_lock (in set_page_dirty's __mark_inode_dirty)
+ *                 sb_lock (within inode_wb_list_lock in fs/fs-writeback.c)
  *                 mapping->tree_lock (widely used, in set_page_dirty,
  *                           in arch-dependent flush_dcache_mmap_lock,
- *                           within inode_lock in __sync_single_inode)
+ *                           within inode_wb_list_lock in __sync_single_inode)
  *
  * (code doesn't rely on that order so it could be switched around)
  * ->tasklist_lock
@@ -998,10 +999,32 @@ int try_to_unmap_one(struct page *page, struct vm_area_struct *vma,
 		}
   	}
 
+	/*
+	 * A page freed with MADV_FREE can be dropped without swapping it
+	 * out, unless it has been written to since or is shared.
+	 */
+	if (TTU_ACTION(flags) == TTU_LZFREE &&
+	    (pte_dirty(*pte) || PageDirty(page) || page_mapcount(page) != 1)) {
+		ret = SWAP_DIRTY;
+		goto out_unmap;
+	}
+
 	/* Nuke the page table entry. */
 	flush_cache_page(vma, address, page_to_pfn(page));
 	pteval = ptep_clear_flush_notify(vma, address, pte);
 
+	if (TTU_ACTION(flags) == TTU_LZFREE) {
+		if (pte_dirty(pteval)) {
+			/* Raced with a write, the data must be kept */
+			set_pte_at(mm, address, pte, pteval);
+			ret = SWAP_DIRTY;
+			goto out_unmap;
+		}
+		update_hiwater_rss(mm);
+		dec_mm_counter(mm, MM_ANONPAGES);
+		goto discard;
+	}
+
 	/* Move the dirty bit to the physical page now the pte is gone. */
 	if (pte_dirty(pteval))
 		set_page_dirty(page);
@@ -1056,6 +1079,7 @@ int try_to_unmap_one(struct page *page, struct vm_area_struct *vma,
 	} else
 		dec_mm_counter(mm, MM_FILEPAGES);
 
+discard:
 	page_remove_rmap(page);
 	page_cache_release(page);
 
@@ -1394,6 +1418,7 @@ out:
  * SWAP_AGAIN	- we missed a mapping, try again later
  * SWAP_FAIL	- the page is unswappable
  * SWAP_MLOCK	- page is mlocked.
+ * SWAP_DIRTY	- TTU_LZFREE: page was written to since MADV_FREE
  */
 int try_to_unmap(struct page *page, enum ttu_flags flags)
 {
@@ -60,6 +60,7 @@ static struct vfsmount *shm_mnt;
 #include <linux/highmem.h>
 #include <linux/seq_file.h>
 #include <linux/magic.h>
+#include <linux/falloc.h>
 
 #include <asm/uaccess.h>
 #include <asm/div64.h>
@@ -819,6 +820,82 @@ static int shmem_notify_change(struct dentry *dentry, struct iattr *attr)
 	return error;
 }
 
+/*
+ * Zero part of a single page, if it is there at all: a hole in the
+ * cache and the swap reads back as zeroes anyway.
+ */
+static int shmem_zero_page_range(struct inode *inode, loff_t from, loff_t to)
+{
+	struct page *page = NULL;
+	int error;
+
+	error = shmem_getpage(inode, from >> PAGE_CACHE_SHIFT,
+					&page, SGP_READ, NULL);
+	if (error || !page)
+		return error;
+	zero_user(page, from & (PAGE_CACHE_SIZE - 1), to - from);
+	set_page_dirty(page);
+	unlock_page(page);
+	page_cache_release(page);
+	return 0;
+}
+
+/*
+ * Only hole punching is supported: tmpfs has nothing to preallocate.
+ * Partial pages at either end are zeroed, whole pages and their swap
+ * entries are freed as madvise(MADV_REMOVE) would free them.
+ */
+static long shmem_fallocate(struct inode *inode, int mode,
+			    loff_t offset, loff_t len)
+{
+	struct address_space *mapping = inode->i_mapping;
+	loff_t start, end;
+	int error = 0;
+
+	if (mode != (FALLOC_FL_KEEP_SIZE | FALLOC_FL_PUNCH_HOLE))
+		return -EOPNOTSUPP;
+
+	mutex_lock(&inode->i_mutex);
+	if (offset >= inode->i_size)
+		goto out;
+	if (len > inode->i_size - offset)
+		len = inode->i_size - offset;
+
+	start = round_up(offset, PAGE_CACHE_SIZE);
+	end = round_down(offset + len, PAGE_CACHE_SIZE);
+	if (offset + len == inode->i_size)
+		end = round_up(inode->i_size, PAGE_CACHE_SIZE);
+
+	if (start > end) {
+		/* within a single page */
+		error = shmem_zero_page_range(inode, offset, offset + len);
+		goto out_time;
+	}
+	if (offset < start) {
+		error = shmem_zero_page_range(inode, offset, start);
+		if (error)
+			goto out;
+	}
+	if (end < offset + len) {
+		error = shmem_zero_page_range(inode, end, offset + len);
+		if (error)
+			goto out;
+	}
+	if (start < end) {
+		down_write(&inode->i_alloc_sem);
+		unmap_mapping_range(mapping, start, end - start, 1);
+		truncate_inode_pages_range(mapping, start, end - 1);
+		unmap_mapping_range(mapping, start, end - start, 1);
+		shmem_truncate_range(inode, start, end - 1);
+		up_write(&inode->i_alloc_sem);
+	}
+out_time:
+	inode->i_ctime = inode->i_mtime = CURRENT_TIME;
+out:
+	mutex_unlock(&inode->i_mutex);
+	return error;
+}
+
 static void shmem_evict_inode(struct inode *inode)
 {
 	struct shmem_inode_info *info = SHMEM_I(inode);
@@ -1812,6 +1889,58 @@ static ssize_t shmem_file_aio_read(struct kiocb *iocb,
 	return retval;
 }
 
+/*
+ * SEEK_DATA and SEEK_HOLE look at the page cache.  Once part of the file
+ * has gone out to swap, the cache no longer tells the whole story, so
+ * fall back to treating the whole file as data.
+ */
+static loff_t shmem_seek_data_hole(struct inode *inode, loff_t offset,
+				   int origin)
+{
+	struct address_space *mapping = inode->i_mapping;
+	loff_t isize = i_size_read(inode);
+	struct page *page;
+	pgoff_t index;
+
+	if (offset < 0 || offset >= isize)
+		return -ENXIO;
+	if (SHMEM_I(inode)->swapped)
+		return origin == SEEK_DATA ? offset : isize;
+
+	index = offset >> PAGE_CACHE_SHIFT;
+	if (origin == SEEK_DATA) {
+		if (!find_get_pages(mapping, index, 1, &page))
+			return -ENXIO;
+		index = page->index;
+		page_cache_release(page);
+		offset = max_t(loff_t, offset, (loff_t)index << PAGE_CACHE_SHIFT);
+		return offset < isize ? offset : -ENXIO;
+	}
+
+	rcu_read_lock();
+	index = radix_tree_next_hole(&mapping->page_tree, index, ULONG_MAX);
+	rcu_read_unlock();
+	offset = max_t(loff_t, offset, (loff_t)index << PAGE_CACHE_SHIFT);
+	return min(offset, isize);
+}
+
+static loff_t shmem_file_llseek(struct file *file, loff_t offset, int origin)
+{
+	struct inode *inode = file->f_path.dentry->d_inode;
+
+	if (origin != SEEK_DATA && origin != SEEK_HOLE)
+		return generic_file_llseek(file, offset, origin);
+
+	mutex_lock(&inode->i_mutex);
+	offset = shmem_seek_data_hole(inode, offset, origin);
+	if (offset >= 0 && offset != file->f_pos) {
+		file->f_pos = offset;
+		file->f_version = 0;
+	}
+	mutex_unlock(&inode->i_mutex);
+	return offset;
+}
+
 static int shmem_statfs(struct dentry *dentry, struct kstatfs *buf)
 {
 	struct shmem_sb_info *sbinfo = SHMEM_SB(dentry->d_sb);
@@ -2435,7 +2564,7 @@ static int init_inodecache(void)
 {
 	shmem_inode_cachep = kmem_cache_create("shmem_inode_cache",
 				sizeof(struct shmem_inode_info),
-				0, SLAB_PANIC, init_once);
+				0, SLAB_PANIC | SLAB_DESTROY_BY_RCU, init_once);
 	return 0;
 }
 
@@ -2459,7 +2588,7 @@ static const struct address_space_operations shmem_aops = {
 static const struct file_operations shmem_file_operations = {
 	.mmap		= shmem_mmap,
 #ifdef CONFIG_TMPFS
-	.llseek		= generic_file_llseek,
+	.llseek		= shmem_file_llseek,
 	.read		= do_sync_read,
 	.write		= do_sync_write,
 	.aio_read	= shmem_file_aio_read,
@@ -2473,6 +2602,7 @@ static const struct file_operations shmem_file_operations = {
 static const struct inode_operations shmem_inode_operations = {
 	.setattr	= shmem_notify_change,
 	.truncate_range	= shmem_truncate_range,
+	.fallocate	= shmem_fallocate,
 #ifdef CONFIG_TMPFS_POSIX_ACL
 	.setxattr	= generic_setxattr,
 	.getxattr	= generic_getxattr,
@@ -2549,6 +2679,7 @@ static struct file_system_type tmpfs_fs_type = {
 	.name		= "tmpfs",
 	.mount		= shmem_mount,
 	.kill_sb	= kill_litter_super,
+	.fs_flags	= FS_RCU_INODES,
 };
 
 int __init init_tmpfs(void)
@@ -2645,6 +2776,7 @@ static struct file_system_type tmpfs_fs_type = {
 	.name		= "tmpfs",
 	.mount		= ramfs_mount,
 	.kill_sb	= kill_litter_super,
+	.fs_flags	= FS_RCU_INODES,
 };
 
 int __init init_tmpfs(void)
@@ -0,0 +1,161 @@
+/*
+ *  mm/userfaultfd.c
+ *
+ *  UFFDIO_COPY: install pages provided by the userfaultfd handler into the
+ *  registered ranges of the faulting mm.
+ */
+
+#include <linux/mm.h>
+#include <linux/pagemap.h>
+#include <linux/rmap.h>
+#include <linux/swap.h>
+#include <linux/highmem.h>
+#include <linux/memcontrol.h>
+#include <linux/userfaultfd.h>
+#include <asm/tlbflush.h>
+
+static int mcopy_atomic_pte(struct mm_struct *dst_mm, pmd_t *dst_pmd,
+			    struct vm_area_struct *dst_vma,
+			    unsigned long dst_addr, struct page *page)
+{
+	pte_t _dst_pte, *dst_pte;
+	spinlock_t *ptl;
+
+	if (mem_cgroup_newpage_charge(page, dst_mm, GFP_KERNEL))
+		return -ENOMEM;
+
+	_dst_pte = mk_pte(page, dst_vma->vm_page_prot);
+	if (dst_vma->vm_flags & VM_WRITE)
+		_dst_pte = pte_mkwrite(pte_mkdirty(_dst_pte));
+
+	dst_pte = pte_offset_map_lock(dst_mm, dst_pmd, dst_addr, &ptl);
+	if (!pte_none(*dst_pte)) {
+		pte_unmap_unlock(dst_pte, ptl);
+		mem_cgroup_uncharge_page(page);
+		return -EEXIST;
+	}
+
+	inc_mm_counter(dst_mm, MM_ANONPAGES);
+	page_add_new_anon_rmap(page, dst_vma, dst_addr);
+	set_pte_at(dst_mm, dst_addr, dst_pte, _dst_pte);
+
+	/* No need to invalidate - it was non-present before */
+	update_mmu_cache(dst_vma, dst_addr, dst_pte);
+	pte_unmap_unlock(dst_pte, ptl);
+	return 0;
+}
+
+static pmd_t *mm_alloc_pmd(struct mm_struct *mm, unsigned long address)
+{
+	pgd_t *pgd;
+	pud_t *pud;
+
+	pgd = pgd_offset(mm, address);
+	pud = pud_alloc(mm, pgd, address);
+	if (!pud)
+		return NULL;
+	return pmd_alloc(mm, pud, address);
+}
+
+/*
+ * Copy one page from the caller's address space to @dst_addr in @dst_mm.
+ * The source is read before taking mmap_sem of the destination, which may
+ * be the caller's own mm.
+ */
+static int mcopy_atomic_page(struct mm_struct *dst_mm,
+			     struct userfaultfd_ctx *ctx,
+			     unsigned long dst_addr, unsigned long src_addr)
+{
+	struct vm_area_struct *dst_vma;
+	struct page *page;
+	pmd_t *dst_pmd;
+	void *kaddr;
+	int err;
+
+	page = alloc_page(GFP_HIGHUSER_MOVABLE);
+	if (!page)
+		return -ENOMEM;
+
+	kaddr = kmap(page);
+	err = copy_from_user(kaddr, (const void __user *) src_addr, PAGE_SIZE);
+	kunmap(page);
+	if (err) {
+		page_cache_release(page);
+		return -EFAULT;
+	}
+	flush_dcache_page(page);
+	__SetPageUptodate(page);
+
+	down_read(&dst_mm->mmap_sem);
+
+	/*
+	 * The range must still be registered with this userfaultfd, it can
+	 * have been unmapped or unregistered while mmap_sem was dropped.
+	 */
+	err = -ENOENT;
+	dst_vma = find_vma(dst_mm, dst_addr);
+	if (!dst_vma || dst_vma->vm_start > dst_addr ||
+	    dst_vma->vm_userfaultfd_ctx != ctx)
+		goto out_unlock;
+
+	err = -ENOMEM;
+	if (unlikely(anon_vma_prepare(dst_vma)))
+		goto out_unlock;
+	dst_pmd = mm_alloc_pmd(dst_mm, dst_addr);
+	if (unlikely(!dst_pmd))
+		goto out_unlock;
+	if (unlikely(pmd_none(*dst_pmd)) &&
+	    unlikely(__pte_alloc(dst_mm, dst_pmd, dst_addr)))
+		goto out_unlock;
+
+	err = mcopy_atomic_pte(dst_mm, dst_pmd, dst_vma, dst_addr, page);
+	up_read(&dst_mm->mmap_sem);
+	if (err)
+		page_cache_release(page);
+	return err;
+
+out_unlock:
+	up_read(&dst_mm->mmap_sem);
+	page_cache_release(page);
+	return err;
+}
+
+/**
+ * mcopy_atomic - Resolves missing faults in a userfaultfd range.
+ * @dst_mm: [in] The mm the range is registered in.
+ * @ctx: [in] The userfaultfd the range must be registered with.
+ * @dst_start: [in] Page aligned start of the range in @dst_mm.
+ * @src_start: [in] Page aligned source in the caller's address space.
+ * @len: [in] Length of the range.
+ *
+ * Maps a copy of each source page at the matching destination address, if
+ * nothing is mapped there yet. Returns the number of bytes copied, or a
+ * negative error if the first page could not be installed; -EEXIST means
+ * the page was already present.
+ */
+ssize_t mcopy_atomic(struct mm_struct *dst_mm, struct userfaultfd_ctx *ctx,
+		     unsigned long dst_start, unsigned long src_start,
+		     unsigned long len)
+{
+	unsigned long copied = 0;
+	int err = 0;
+
+	BUG_ON(dst_start & ~PAGE_MASK);
+	BUG_ON(len & ~PAGE_MASK);
+
+	while (copied < len) {
+		err = mcopy_atomic_page(dst_mm, ctx, dst_start + copied,
+					src_start + copied);
+		if (err)
+			break;
+		copied += PAGE_SIZE;
+
+		if (fatal_signal_pending(current)) {
+			err = -EINTR;
+			break;
+		}
+		cond_resched();
+	}
+
+	return copied ? copied : err;
+}
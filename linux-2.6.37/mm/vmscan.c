@@ -29,6 +29,7 @@
 #include <linux/pagevec.h>
 #include <linux/backing-dev.h>
 #include <linux/rmap.h>
+#include <linux/ksm.h>
 #include <linux/topology.h>
 #include <linux/cpu.h>
 #include <linux/cpuset.h>
@@ -759,6 +760,30 @@ static unsigned long shrink_page_list(struct list_head *page_list,
 			; /* try to reclaim the page below */
 		}
 
+		/*
+		 * Anonymous memory freed with MADV_FREE and not written to
+		 * since does not need to go to swap: just drop it.
+		 */
+		if (PageLazyFree(page) && PageAnon(page) &&
+		    !PageSwapCache(page) && !PageKsm(page)) {
+			switch (try_to_unmap(page, TTU_LZFREE)) {
+			case SWAP_FAIL:
+				goto activate_locked;
+			case SWAP_MLOCK:
+				goto cull_mlocked;
+			case SWAP_SUCCESS:
+				/* Nobody can look the page up anymore */
+				if (!page_freeze_refs(page, 1))
+					goto keep_locked;
+				__clear_page_locked(page);
+				count_vm_event(PGLAZYFREED);
+				goto free_it;
+			default:
+				/* written to or shared, swap it out below */
+				ClearPageLazyFree(page);
+			}
+		}
+
 		/*
 		 * Anonymous process memory has backing store?
 		 * Try to allocate it some swap space here.
@@ -2122,6 +2147,57 @@ unsigned long try_to_free_mem_cgroup_pages(struct mem_cgroup *mem_cont,
 
 	return nr_reclaimed;
 }
+
+/*
+ * Background reclaim for a memory cgroup above its low watermark. Unlike
+ * try_to_free_mem_cgroup_pages() this runs from the memcg reclaim workers,
+ * so it does not throttle on congestion and reports the number of pages
+ * scanned for the per-cgroup statistics.
+ */
+unsigned long mem_cgroup_shrink_background(struct mem_cgroup *mem,
+					   bool noswap,
+					   unsigned int swappiness,
+					   unsigned long *nr_scanned)
+{
+	unsigned long total_scanned = 0;
+	int priority, nid, i;
+	struct scan_control sc = {
+		.gfp_mask = GFP_KERNEL,
+		.may_writepage = !laptop_mode,
+		.may_unmap = 1,
+		.may_swap = !noswap,
+		.nr_to_reclaim = SWAP_CLUSTER_MAX,
+		.swappiness = swappiness,
+		.order = 0,
+		.mem_cgroup = mem,
+	};
+
+	trace_mm_vmscan_memcg_reclaim_begin(0, sc.may_writepage,
+					    sc.gfp_mask);
+
+	for (priority = DEF_PRIORITY; priority >= 0; priority--) {
+		sc.nr_scanned = 0;
+		for_each_node_state(nid, N_HIGH_MEMORY) {
+			pg_data_t *pgdat = NODE_DATA(nid);
+
+			for (i = 0; i < pgdat->nr_zones; i++) {
+				struct zone *zone = pgdat->node_zones + i;
+
+				if (!populated_zone(zone))
+					continue;
+				shrink_zone(priority, zone, &sc);
+			}
+		}
+		total_scanned += sc.nr_scanned;
+		if (sc.nr_reclaimed >= sc.nr_to_reclaim)
+			break;
+	}
+
+	trace_mm_vmscan_memcg_reclaim_end(sc.nr_reclaimed);
+
+	*nr_scanned = total_scanned;
+	return sc.nr_reclaimed;
+}
 #endif
 
 /* is kswapd sleeping prematurely? */
@@ -794,6 +794,9 @@ static const char * const vmstat_text[] = {
 	"nr_shmem",
 	"nr_dirtied",
 	"nr_written",
+	"zone_lock_acquired",
+	"zone_lock_contended",
+	"pcp_remote_free",
 
 #ifdef CONFIG_NUMA
 	"numa_hit",
@@ -840,6 +843,7 @@ static const char * const vmstat_text[] = {
 	"allocstall",
 
 	"pgrotated",
+	"pglazyfreed",
 
 #ifdef CONFIG_COMPACTION
 	"compact_blocks_moved",
@@ -912,6 +916,8 @@ static void zoneinfo_show_print(struct seq_file *m, pg_data_t *pgdat,
 			   pageset->pcp.high,
 			   pageset->pcp.batch);
 #ifdef CONFIG_SMP
+		seq_printf(m, "\n              remote: %i",
+			   pageset->pcp.remote_count);
 		seq_printf(m, "\n  vm stats threshold: %d",
 				pageset->stat_threshold);
 #endif
@@ -512,6 +512,20 @@ int security_inode_permission(struct inode *inode, int mask)
 	return security_ops->inode_permission(inode, mask);
 }
 
+/*
+ * Lockless path walking cannot call an LSM permission hook, which may
+ * block: it only goes on when the default capability hook is in place.
+ */
+int security_inode_exec_permission_rcu(struct inode *inode)
+{
+	if (unlikely(IS_PRIVATE(inode)))
+		return 0;
+	if (security_ops->inode_permission !=
+	    default_security_ops.inode_permission)
+		return -ECHILD;
+	return 0;
+}
+
 int security_inode_setattr(struct dentry *dentry, struct iattr *attr)
 {
 	if (unlikely(IS_PRIVATE(dentry->d_inode)))
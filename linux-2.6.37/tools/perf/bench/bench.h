@@ -4,6 +4,12 @@
 extern int bench_sched_messaging(int argc, const char **argv, const char *prefix);
 extern int bench_sched_pipe(int argc, const char **argv, const char *prefix);
 extern int bench_mem_memcpy(int argc, const char **argv, const char *prefix __used);
+extern int bench_fs_stat(int argc, const char **argv, const char *prefix);
+extern int bench_fs_create(int argc, const char **argv, const char *prefix);
+extern int bench_fs_aio(int argc, const char **argv, const char *prefix);
+extern int bench_fs_mount(int argc, const char **argv, const char *prefix);
+extern int bench_fs_startup(int argc, const char **argv, const char *prefix);
+extern int bench_fs_randwrite(int argc, const char **argv, const char *prefix);
 
 #define BENCH_FORMAT_DEFAULT_STR	"default"
 #define BENCH_FORMAT_DEFAULT		0
@@ -0,0 +1,482 @@
+/*
+ *
+ * fs-aio.c
+ *
+ * aio: Benchmark for asynchronous random reads, io_uring against libaio
+ *
+ * Like a fio random read job: keep a fixed number of reads of one block
+ * size in flight at random offsets of a file and count how many complete
+ * per second. The same job is run through io_submit()/io_getevents() and
+ * through the io_uring rings, optionally with the file and the buffers
+ * registered. Both are driven with raw system calls, so no libaio is
+ * needed.
+ *
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "../builtin.h"
+#include "bench.h"
+
+#include "../../../include/linux/aio_abi.h"
+#include "../../../include/linux/io_uring.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <limits.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <fcntl.h>
+
+#ifndef O_DIRECT
+#define O_DIRECT	00040000
+#endif
+
+static const char *filename;
+static const char *engine = "all";
+static int file_mb = 256;
+static int block_size = 4096;
+static int depth = 32;
+static int nr_ios = 100000;
+static bool buffered;
+static bool fixed;
+
+static const struct option options[] = {
+	OPT_STRING('f', "file", &filename, "path",
+		   "File to read (default: create one in /tmp)"),
+	OPT_INTEGER('s', "size", &file_mb,
+		    "Size in MB of the file to create"),
+	OPT_STRING('e', "engine", &engine, "engine",
+		   "Engine to use: uring, libaio or all"),
+	OPT_INTEGER('b', "bs", &block_size,
+		    "Specify block size of each read"),
+	OPT_INTEGER('q', "depth", &depth,
+		    "Specify number of reads in flight"),
+	OPT_INTEGER('n', "ios", &nr_ios,
+		    "Specify number of reads to do"),
+	OPT_BOOLEAN('B', "buffered", &buffered,
+		    "Use buffered I/O instead of O_DIRECT"),
+	OPT_BOOLEAN('x', "fixed", &fixed,
+		    "Register the file and buffers with io_uring"),
+	OPT_END()
+};
+
+static const char * const bench_fs_aio_usage[] = {
+	"perf bench fs aio <options>",
+	NULL
+};
+
+static int fd;
+static off_t nr_blocks;
+static void **bufs;
+static unsigned long long seed;
+
+static void barf(const char *msg)
+{
+	fprintf(stderr, "%s (error: %s)\n", msg, strerror(errno));
+	exit(1);
+}
+
+/* same offset sequence for every engine */
+static off_t next_offset(void)
+{
+	seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+	return (off_t)((seed >> 33) % nr_blocks) * block_size;
+}
+
+static char *create_file(void)
+{
+	char *path, *buf;
+	int i, tmp;
+
+	if (asprintf(&path, "/tmp/perf-bench-aio.%d", getpid()) < 0)
+		barf("asprintf");
+	tmp = open(path, O_CREAT | O_EXCL | O_WRONLY, 0644);
+	if (tmp < 0)
+		barf("open");
+	buf = malloc(1024 * 1024);
+	if (!buf)
+		barf("malloc");
+	memset(buf, 0xa5, 1024 * 1024);
+	for (i = 0; i < file_mb; i++)
+		if (write(tmp, buf, 1024 * 1024) != 1024 * 1024)
+			barf("write");
+	if (fsync(tmp))
+		barf("fsync");
+	close(tmp);
+	free(buf);
+	return path;
+}
+
+/* libaio */
+
+static long io_setup(unsigned nr, aio_context_t *ctxp)
+{
+	return syscall(__NR_io_setup, nr, ctxp);
+}
+
+static long io_destroy(aio_context_t ctx)
+{
+	return syscall(__NR_io_destroy, ctx);
+}
+
+static long io_submit(aio_context_t ctx, long nr, struct iocb **iocbpp)
+{
+	return syscall(__NR_io_submit, ctx, nr, iocbpp);
+}
+
+static long io_getevents(aio_context_t ctx, long min_nr, long nr,
+			 struct io_event *events)
+{
+	return syscall(__NR_io_getevents, ctx, min_nr, nr, events, NULL);
+}
+
+static void run_libaio(void)
+{
+	struct iocb *iocbs, **iocbpp;
+	struct io_event *events;
+	aio_context_t ctx = 0;
+	int submitted = 0, done = 0, inflight = 0;
+	int i, nr, free_nr, *free_slots;
+
+	if (io_setup(depth, &ctx))
+		barf("io_setup");
+
+	iocbs = calloc(depth, sizeof(*iocbs));
+	iocbpp = calloc(depth, sizeof(*iocbpp));
+	events = calloc(depth, sizeof(*events));
+	free_slots = calloc(depth, sizeof(*free_slots));
+	if (!iocbs || !iocbpp || !events || !free_slots)
+		barf("calloc");
+	for (i = 0; i < depth; i++)
+		free_slots[i] = i;
+	free_nr = depth;
+
+	while (done < nr_ios) {
+		nr = 0;
+		while (free_nr && submitted + nr < nr_ios) {
+			int slot = free_slots[--free_nr];
+			struct iocb *iocb = &iocbs[slot];
+
+			memset(iocb, 0, sizeof(*iocb));
+			iocb->aio_lio_opcode = IOCB_CMD_PREAD;
+			iocb->aio_fildes = fd;
+			iocb->aio_buf = (unsigned long)bufs[slot];
+			iocb->aio_nbytes = block_size;
+			iocb->aio_offset = next_offset();
+			iocb->aio_data = slot;
+			iocbpp[nr++] = iocb;
+		}
+		if (nr) {
+			if (io_submit(ctx, nr, iocbpp) != nr)
+				barf("io_submit");
+			submitted += nr;
+			inflight += nr;
+		}
+
+		nr = io_getevents(ctx, 1, inflight, events);
+		if (nr < 0)
+			barf("io_getevents");
+		for (i = 0; i < nr; i++) {
+			if ((long)events[i].res != block_size) {
+				errno = -(long)events[i].res;
+				barf("libaio read");
+			}
+			free_slots[free_nr++] = events[i].data;
+		}
+		inflight -= nr;
+		done += nr;
+	}
+
+	io_destroy(ctx);
+	free(free_slots);
+	free(events);
+	free(iocbpp);
+	free(iocbs);
+}
+
+/* io_uring */
+
+struct uring {
+	int			ring_fd;
+	unsigned		*sq_head, *sq_tail, *sq_mask, *sq_array;
+	struct io_uring_sqe	*sqes;
+	unsigned		*cq_head, *cq_tail, *cq_mask;
+	struct io_uring_cqe	*cqes;
+};
+
+static int io_uring_setup(unsigned entries, struct io_uring_params *p)
+{
+	return syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int io_uring_enter(int ring_fd, unsigned to_submit,
+			  unsigned min_complete, unsigned flags)
+{
+	return syscall(__NR_io_uring_enter, ring_fd, to_submit,
+		       min_complete, flags);
+}
+
+static int io_uring_register(int ring_fd, unsigned opcode, void *arg,
+			     unsigned nr_args)
+{
+	return syscall(__NR_io_uring_register, ring_fd, opcode, arg,
+		       nr_args);
+}
+
+static void uring_init(struct uring *u)
+{
+	struct io_uring_params p;
+	void *sq, *cq;
+
+	memset(&p, 0, sizeof(p));
+	u->ring_fd = io_uring_setup(depth, &p);
+	if (u->ring_fd < 0)
+		barf("io_uring_setup");
+
+	sq = mmap(NULL, p.sq_off.array + p.sq_entries * sizeof(unsigned),
+		  PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+		  u->ring_fd, IORING_OFF_SQ_RING);
+	if (sq == MAP_FAILED)
+		barf("mmap");
+	u->sq_head = sq + p.sq_off.head;
+	u->sq_tail = sq + p.sq_off.tail;
+	u->sq_mask = sq + p.sq_off.ring_mask;
+	u->sq_array = sq + p.sq_off.array;
+
+	u->sqes = mmap(NULL, p.sq_entries * sizeof(struct io_uring_sqe),
+		       PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+		       u->ring_fd, IORING_OFF_SQES);
+	if (u->sqes == MAP_FAILED)
+		barf("mmap");
+
+	cq = mmap(NULL, p.cq_off.cqes +
+		  p.cq_entries * sizeof(struct io_uring_cqe),
+		  PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+		  u->ring_fd, IORING_OFF_CQ_RING);
+	if (cq == MAP_FAILED)
+		barf("mmap");
+	u->cq_head = cq + p.cq_off.head;
+	u->cq_tail = cq + p.cq_off.tail;
+	u->cq_mask = cq + p.cq_off.ring_mask;
+	u->cqes = cq + p.cq_off.cqes;
+
+	if (fixed) {
+		struct iovec *iovs;
+		int i;
+
+		iovs = calloc(depth, sizeof(*iovs));
+		if (!iovs)
+			barf("calloc");
+		for (i = 0; i < depth; i++) {
+			iovs[i].iov_base = bufs[i];
+			iovs[i].iov_len = block_size;
+		}
+		if (io_uring_register(u->ring_fd, IORING_REGISTER_BUFFERS,
+				      iovs, depth))
+			barf("IORING_REGISTER_BUFFERS");
+		if (io_uring_register(u->ring_fd, IORING_REGISTER_FILES,
+				      &fd, 1))
+			barf("IORING_REGISTER_FILES");
+		free(iovs);
+	}
+}
+
+static void run_uring(void)
+{
+	struct uring u;
+	struct iovec *iovs;
+	int submitted = 0, done = 0, inflight = 0;
+	int i, nr, free_nr, *free_slots;
+	unsigned head, tail;
+
+	uring_init(&u);
+
+	iovs = calloc(depth, sizeof(*iovs));
+	free_slots = calloc(depth, sizeof(*free_slots));
+	if (!iovs || !free_slots)
+		barf("calloc");
+	for (i = 0; i < depth; i++)
+		free_slots[i] = i;
+	free_nr = depth;
+
+	while (done < nr_ios) {
+		nr = 0;
+		tail = *u.sq_tail;
+		while (free_nr && submitted + nr < nr_ios) {
+			int slot = free_slots[--free_nr];
+			unsigned index = tail & *u.sq_mask;
+			struct io_uring_sqe *sqe = &u.sqes[index];
+
+			memset(sqe, 0, sizeof(*sqe));
+			sqe->off = next_offset();
+			sqe->user_data = slot;
+			if (fixed) {
+				sqe->opcode = IORING_OP_READ_FIXED;
+				sqe->flags = IOSQE_FIXED_FILE;
+				sqe->fd = 0;
+				sqe->addr = (unsigned long)bufs[slot];
+				sqe->len = block_size;
+				sqe->buf_index = slot;
+			} else {
+				iovs[slot].iov_base = bufs[slot];
+				iovs[slot].iov_len = block_size;
+				sqe->opcode = IORING_OP_READV;
+				sqe->fd = fd;
+				sqe->addr = (unsigned long)&iovs[slot];
+				sqe->len = 1;
+			}
+			u.sq_array[index] = index;
+			tail++;
+			nr++;
+		}
+		if (nr) {
+			/* sqes must be visible before the tail moves */
+			__sync_synchronize();
+			*u.sq_tail = tail;
+			__sync_synchronize();
+		}
+
+		if (io_uring_enter(u.ring_fd, nr, 1,
+				   IORING_ENTER_GETEVENTS) < 0)
+			barf("io_uring_enter");
+		submitted += nr;
+		inflight += nr;
+
+		/* reap without system calls */
+		head = *u.cq_head;
+		for (;;) {
+			struct io_uring_cqe *cqe;
+
+			rmb();
+			if (head == *u.cq_tail)
+				break;
+			cqe = &u.cqes[head & *u.cq_mask];
+			if (cqe->res != block_size) {
+				errno = -cqe->res;
+				barf("io_uring read");
+			}
+			free_slots[free_nr++] = cqe->user_data;
+			head++;
+			inflight--;
+			done++;
+		}
+		__sync_synchronize();
+		*u.cq_head = head;
+	}
+
+	close(u.ring_fd);
+	free(free_slots);
+	free(iovs);
+}
+
+static void run_engine(const char *name, void (*fn)(void))
+{
+	struct timeval start, stop, diff;
+	unsigned long long result_usec;
+	double mb;
+
+	seed = 0x5eed;
+	gettimeofday(&start, NULL);
+	fn();
+	gettimeofday(&stop, NULL);
+	timersub(&stop, &start, &diff);
+
+	result_usec = diff.tv_sec * 1000000ULL + diff.tv_usec;
+	mb = (double)nr_ios * block_size / (1024 * 1024);
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf(" %s%s:\n", name, fixed && fn == run_uring ?
+		       " (fixed file and buffers)" : "");
+		printf(" %14s: %lu.%03lu [sec]\n", "Total time",
+		       diff.tv_sec,
+		       (unsigned long) (diff.tv_usec/1000));
+		printf(" %14lf usecs/op\n",
+		       (double)result_usec / (double)nr_ios);
+		printf(" %14d ops/sec\n",
+		       (int)((double)nr_ios /
+			     ((double)result_usec / (double)1000000)));
+		printf(" %14lf MB/sec\n\n",
+		       mb / ((double)result_usec / (double)1000000));
+		break;
+
+	case BENCH_FORMAT_SIMPLE:
+		printf("%s %lu.%03lu\n", name,
+		       diff.tv_sec,
+		       (unsigned long) (diff.tv_usec / 1000));
+		break;
+
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+}
+
+int bench_fs_aio(int argc, const char **argv,
+		 const char *prefix __used)
+{
+	bool do_uring, do_libaio;
+	char *created = NULL;
+	struct stat st;
+	int i;
+
+	argc = parse_options(argc, argv, options,
+			     bench_fs_aio_usage, 0);
+
+	do_uring = !strcmp(engine, "uring") || !strcmp(engine, "all");
+	do_libaio = !strcmp(engine, "libaio") || !strcmp(engine, "all");
+	if ((!do_uring && !do_libaio) || block_size < 512 || depth < 1 ||
+	    nr_ios < 1 || file_mb < 1)
+		usage_with_options(bench_fs_aio_usage, options);
+
+	if (!filename)
+		filename = created = create_file();
+
+	fd = open(filename, O_RDONLY | (buffered ? 0 : O_DIRECT));
+	if (fd < 0)
+		barf("open");
+	if (fstat(fd, &st))
+		barf("fstat");
+	nr_blocks = st.st_size / block_size;
+	if (!nr_blocks) {
+		fprintf(stderr, "%s is smaller than one block\n", filename);
+		exit(1);
+	}
+
+	bufs = calloc(depth, sizeof(*bufs));
+	if (!bufs)
+		barf("calloc");
+	for (i = 0; i < depth; i++)
+		if (posix_memalign(&bufs[i], 4096, block_size))
+			barf("posix_memalign");
+
+	if (bench_format == BENCH_FORMAT_DEFAULT)
+		printf("# %d random %s reads of %d bytes, %d in flight\n\n",
+		       nr_ios, buffered ? "buffered" : "O_DIRECT",
+		       block_size, depth);
+
+	if (do_libaio)
+		run_engine("libaio", run_libaio);
+	if (do_uring)
+		run_engine("io_uring", run_uring);
+
+	close(fd);
+	if (created) {
+		unlink(created);
+		free(created);
+	}
+	for (i = 0; i < depth; i++)
+		free(bufs[i]);
+	free(bufs);
+	return 0;
+}
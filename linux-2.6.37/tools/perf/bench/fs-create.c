@@ -0,0 +1,190 @@
+/*
+ *
+ * fs-create.c
+ *
+ * create: Benchmark for inode and dentry creation and teardown
+ *
+ * Several threads each create a batch of empty files and unlink them
+ * again, over and over. Every round trip allocates, hashes, writes back
+ * and evicts an inode and a dentry, so this measures the cost of the
+ * inode and dcache bookkeeping and its scalability over CPUs. By default
+ * each thread works in its own directory; with --shared they all work
+ * in one.
+ *
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "../builtin.h"
+#include "bench.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <limits.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <fcntl.h>
+
+static const char *base_dir = "/tmp";
+static int nr_files = 100;
+static int nr_threads = 2;
+static int loops = 1000;
+static bool shared;
+
+static const struct option options[] = {
+	OPT_STRING('d', "dir", &base_dir, "path",
+		   "Directory to create the files in"),
+	OPT_INTEGER('f', "files", &nr_files,
+		    "Specify number of files per thread"),
+	OPT_INTEGER('t', "threads", &nr_threads,
+		    "Specify number of threads"),
+	OPT_INTEGER('l', "loop", &loops,
+		    "Specify number of create/unlink rounds per thread"),
+	OPT_BOOLEAN('s', "shared", &shared,
+		    "Use one directory for all threads"),
+	OPT_END()
+};
+
+static const char * const bench_fs_create_usage[] = {
+	"perf bench fs create <options>",
+	NULL
+};
+
+static char top[PATH_MAX];
+
+static void barf(const char *msg)
+{
+	fprintf(stderr, "%s (error: %s)\n", msg, strerror(errno));
+	exit(1);
+}
+
+static char *thread_dir(long id)
+{
+	char *dir;
+
+	if (shared)
+		return strdup(top);
+	if (asprintf(&dir, "%s/t%ld", top, id) < 0)
+		return NULL;
+	return dir;
+}
+
+static void *worker(void *arg)
+{
+	long id = (long)arg;
+	char **paths;
+	char *dir;
+	int i, j, fd;
+
+	dir = thread_dir(id);
+	if (!dir)
+		barf("asprintf");
+	if (!shared && mkdir(dir, 0755))
+		barf("mkdir");
+
+	paths = calloc(nr_files, sizeof(*paths));
+	if (!paths)
+		barf("calloc");
+	for (j = 0; j < nr_files; j++)
+		if (asprintf(&paths[j], "%s/f%ld.%d", dir, id, j) < 0)
+			barf("asprintf");
+
+	for (i = 0; i < loops; i++) {
+		for (j = 0; j < nr_files; j++) {
+			fd = open(paths[j], O_CREAT | O_EXCL | O_WRONLY, 0644);
+			if (fd < 0)
+				barf("open");
+			close(fd);
+		}
+		for (j = 0; j < nr_files; j++)
+			if (unlink(paths[j]))
+				barf("unlink");
+	}
+
+	for (j = 0; j < nr_files; j++)
+		free(paths[j]);
+	free(paths);
+	if (!shared)
+		rmdir(dir);
+	free(dir);
+	return NULL;
+}
+
+int bench_fs_create(int argc, const char **argv,
+		    const char *prefix __used)
+{
+	struct timeval start, stop, diff;
+	unsigned long long result_usec, total;
+	pthread_t *threads;
+	long i;
+
+	argc = parse_options(argc, argv, options,
+			     bench_fs_create_usage, 0);
+
+	if (nr_files < 1 || nr_threads < 1 || loops < 1)
+		usage_with_options(bench_fs_create_usage, options);
+
+	threads = calloc(nr_threads, sizeof(*threads));
+	if (!threads)
+		barf("calloc");
+
+	snprintf(top, sizeof(top), "%s/perf-bench-create.%d",
+		 base_dir, getpid());
+	if (mkdir(top, 0755))
+		barf("mkdir");
+
+	gettimeofday(&start, NULL);
+	for (i = 0; i < nr_threads; i++)
+		if (pthread_create(&threads[i], NULL, worker, (void *)i))
+			barf("pthread_create");
+	for (i = 0; i < nr_threads; i++)
+		pthread_join(threads[i], NULL);
+	gettimeofday(&stop, NULL);
+	timersub(&stop, &start, &diff);
+
+	rmdir(top);
+	free(threads);
+
+	/* one create and one unlink per file and round */
+	total = 2ULL * loops * nr_files * nr_threads;
+	result_usec = diff.tv_sec * 1000000ULL + diff.tv_usec;
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf("# %d threads create/unlink %d files each, %s\n\n",
+		       nr_threads, nr_files,
+		       shared ? "one shared directory" :
+				"one directory per thread");
+
+		printf(" %14s: %lu.%03lu [sec]\n\n", "Total time",
+		       diff.tv_sec,
+		       (unsigned long) (diff.tv_usec/1000));
+
+		printf(" %14lf usecs/op\n",
+		       (double)result_usec / (double)total);
+		printf(" %14d ops/sec\n",
+		       (int)((double)total /
+			     ((double)result_usec / (double)1000000)));
+		break;
+
+	case BENCH_FORMAT_SIMPLE:
+		printf("%lu.%03lu\n",
+		       diff.tv_sec,
+		       (unsigned long) (diff.tv_usec / 1000));
+		break;
+
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+
+	return 0;
+}
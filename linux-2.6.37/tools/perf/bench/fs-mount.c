@@ -0,0 +1,125 @@
+/*
+ *
+ * fs-mount.c
+ *
+ * mount: Benchmark for file system mount time
+ *
+ * Mounts and unmounts a device over and over and reports how long the
+ * mount() calls took. This is meant for flash file systems, whose mount
+ * time is dominated by scanning the medium; mount options can be used to
+ * pick the path to measure, e.g. -o no-checkpoint-read makes yaffs2 scan
+ * every time instead of reading its checkpoint. With nandsim the setup is
+ * reproducible without any flash hardware, see perf-bench.txt.
+ *
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "../builtin.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <limits.h>
+#include <sys/mount.h>
+#include <sys/time.h>
+
+static const char *device;
+static const char *dir = "/mnt";
+static const char *fstype = "yaffs2";
+static const char *mount_opts = "";
+static int loops = 5;
+
+static const struct option options[] = {
+	OPT_STRING('D', "device", &device, "path",
+		   "Block device to mount, e.g. /dev/mtdblock0"),
+	OPT_STRING('d', "dir", &dir, "path",
+		   "Directory to mount on (default: /mnt)"),
+	OPT_STRING('t', "type", &fstype, "fstype",
+		   "File system type (default: yaffs2)"),
+	OPT_STRING('o', "options", &mount_opts, "opts",
+		   "Mount options"),
+	OPT_INTEGER('l', "loop", &loops,
+		    "Specify number of mounts"),
+	OPT_END()
+};
+
+static const char * const bench_fs_mount_usage[] = {
+	"perf bench fs mount -D <device> <options>",
+	NULL
+};
+
+static void barf(const char *msg)
+{
+	fprintf(stderr, "%s (error: %s)\n", msg, strerror(errno));
+	exit(1);
+}
+
+int bench_fs_mount(int argc, const char **argv,
+		   const char *prefix __used)
+{
+	struct timeval start, stop, diff;
+	unsigned long long usec, min_usec = ULLONG_MAX, max_usec = 0;
+	unsigned long long total_usec = 0;
+	int i;
+
+	argc = parse_options(argc, argv, options,
+			     bench_fs_mount_usage, 0);
+
+	if (loops < 1)
+		usage_with_options(bench_fs_mount_usage, options);
+
+	if (!device) {
+		/* Nothing sensible to mount by default, e.g. for "all" */
+		printf("# no device given (-D), skipping\n");
+		return 0;
+	}
+
+	for (i = 0; i < loops; i++) {
+		gettimeofday(&start, NULL);
+		if (mount(device, dir, fstype, 0, mount_opts))
+			barf("mount");
+		gettimeofday(&stop, NULL);
+		if (umount(dir))
+			barf("umount");
+
+		timersub(&stop, &start, &diff);
+		usec = diff.tv_sec * 1000000ULL + diff.tv_usec;
+		total_usec += usec;
+		if (usec < min_usec)
+			min_usec = usec;
+		if (usec > max_usec)
+			max_usec = usec;
+	}
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf("# %d mounts of %s (%s%s%s)\n\n", loops, device,
+		       fstype, *mount_opts ? ", " : "", mount_opts);
+
+		printf(" %14s: %llu.%03llu [msec]\n", "Min",
+		       min_usec / 1000, min_usec % 1000);
+		printf(" %14s: %llu.%03llu [msec]\n", "Avg",
+		       total_usec / loops / 1000, total_usec / loops % 1000);
+		printf(" %14s: %llu.%03llu [msec]\n", "Max",
+		       max_usec / 1000, max_usec % 1000);
+		break;
+
+	case BENCH_FORMAT_SIMPLE:
+		printf("%llu.%03llu\n",
+		       total_usec / loops / 1000, total_usec / loops % 1000);
+		break;
+
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+
+	return 0;
+}
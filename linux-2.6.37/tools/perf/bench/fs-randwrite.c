@@ -0,0 +1,157 @@
+/*
+ *
+ * fs-randwrite.c
+ *
+ * randwrite: Benchmark for small random writes to a block device
+ *
+ * Writes blocks of one size at random offsets of a device, or of a part of
+ * it, and reports the throughput including a final fsync(). This is the
+ * access pattern of FAT or ext2 on top of mtdblock, where every write
+ * which misses the cache of flash sectors costs an erase and a rewrite of
+ * a whole sector. The data on the device is overwritten.
+ *
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "../builtin.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/time.h>
+#include <fcntl.h>
+
+#ifndef O_DIRECT
+#define O_DIRECT	00040000
+#endif
+
+static const char *device;
+static int size_mb;
+static int block_size = 4096;
+static int nr_writes = 1000;
+static int sync_every;
+static bool buffered;
+
+static const struct option options[] = {
+	OPT_STRING('D', "device", &device, "path",
+		   "Device or file to write to, its data is destroyed"),
+	OPT_INTEGER('s', "size", &size_mb,
+		    "Size in MiB of the area written to (default: all)"),
+	OPT_INTEGER('b', "bs", &block_size,
+		    "Specify block size of each write"),
+	OPT_INTEGER('n', "writes", &nr_writes,
+		    "Specify number of writes to do"),
+	OPT_INTEGER('y', "fsync", &sync_every,
+		    "fsync() every N writes (default: only at the end)"),
+	OPT_BOOLEAN('B', "buffered", &buffered,
+		    "Use buffered I/O instead of O_DIRECT"),
+	OPT_END()
+};
+
+static const char * const bench_fs_randwrite_usage[] = {
+	"perf bench fs randwrite -D <device> <options>",
+	NULL
+};
+
+static void barf(const char *msg)
+{
+	fprintf(stderr, "%s (error: %s)\n", msg, strerror(errno));
+	exit(1);
+}
+
+int bench_fs_randwrite(int argc, const char **argv,
+		       const char *prefix __used)
+{
+	struct timeval start, stop, diff;
+	unsigned long long usec, bytes;
+	off_t size, nr_blocks, off;
+	void *buf;
+	int fd, i;
+
+	argc = parse_options(argc, argv, options,
+			     bench_fs_randwrite_usage, 0);
+
+	if (block_size < 512 || nr_writes < 1 || size_mb < 0 ||
+	    sync_every < 0)
+		usage_with_options(bench_fs_randwrite_usage, options);
+
+	if (!device) {
+		/* Nothing sensible to overwrite by default, e.g. for "all" */
+		printf("# no device given (-D), skipping\n");
+		return 0;
+	}
+
+	fd = open(device, O_WRONLY | (buffered ? 0 : O_DIRECT));
+	if (fd < 0)
+		barf("open");
+
+	/* st_size is zero for block devices, ask for the end instead */
+	size = lseek(fd, 0, SEEK_END);
+	if (size < 0)
+		barf("lseek");
+	if (size_mb && (off_t)size_mb * 1024 * 1024 < size)
+		size = (off_t)size_mb * 1024 * 1024;
+	nr_blocks = size / block_size;
+	if (!nr_blocks) {
+		fprintf(stderr, "%s is smaller than one block\n", device);
+		exit(1);
+	}
+
+	if (posix_memalign(&buf, 4096, block_size))
+		barf("posix_memalign");
+	memset(buf, 0x5a, block_size);
+	srand48(1);
+
+	gettimeofday(&start, NULL);
+	for (i = 0; i < nr_writes; i++) {
+		off = (lrand48() % nr_blocks) * block_size;
+		if (pwrite(fd, buf, block_size, off) != block_size)
+			barf("pwrite");
+		if (sync_every && (i + 1) % sync_every == 0 && fsync(fd))
+			barf("fsync");
+	}
+	if (fsync(fd))
+		barf("fsync");
+	gettimeofday(&stop, NULL);
+
+	timersub(&stop, &start, &diff);
+	usec = diff.tv_sec * 1000000ULL + diff.tv_usec;
+	if (!usec)
+		usec = 1;
+	bytes = (unsigned long long)nr_writes * block_size;
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf("# %d random %s writes of %d bytes over %llu KiB of %s\n\n",
+		       nr_writes, buffered ? "buffered" : "O_DIRECT",
+		       block_size, (unsigned long long)size / 1024, device);
+
+		printf(" %14s: %llu.%03llu [sec]\n", "Total time",
+		       usec / 1000000, usec / 1000 % 1000);
+		printf(" %14lf MiB/sec\n",
+		       (double)bytes / 1024 / 1024 * 1000000 / usec);
+		printf(" %14llu writes/sec\n",
+		       nr_writes * 1000000ULL / usec);
+		break;
+
+	case BENCH_FORMAT_SIMPLE:
+		printf("%lf\n", (double)bytes / 1024 / 1024 * 1000000 / usec);
+		break;
+
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+
+	close(fd);
+	free(buf);
+	return 0;
+}
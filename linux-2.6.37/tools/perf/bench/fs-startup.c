@@ -0,0 +1,220 @@
+/*
+ *
+ * fs-startup.c
+ *
+ * startup: Benchmark for application start-up latency under write load
+ *
+ * Runs a command over and over from a cold page cache and reports how long
+ * it took from fork() to its exit, while a background process keeps
+ * writing to a file on the same device. This approximates how long it
+ * takes to start an application while, say, an update is being written,
+ * which is what I/O scheduler latency heuristics are about. See
+ * Documentation/block/bfq-iosched.txt.
+ *
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "../builtin.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <limits.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#define WRITE_CHUNK	(1024 * 1024)
+
+static const char *file;
+static unsigned int size_mb = 1024;
+static int loops = 5;
+
+static const struct option options[] = {
+	OPT_STRING('f', "file", &file, "path",
+		   "File written to in the background"),
+	OPT_UINTEGER('s', "size", &size_mb,
+		     "Size in MiB the written file wraps at (default: 1024)"),
+	OPT_INTEGER('l', "loop", &loops,
+		    "Specify number of runs of the command"),
+	OPT_END()
+};
+
+static const char * const bench_fs_startup_usage[] = {
+	"perf bench fs startup <options> [--] <command> [<args>]",
+	NULL
+};
+
+static const char *default_cmd[] = { "/bin/true", NULL };
+
+static void barf(const char *msg)
+{
+	fprintf(stderr, "%s (error: %s)\n", msg, strerror(errno));
+	exit(1);
+}
+
+/*
+ * Write @file sequentially until killed, going back to its start every
+ * size_mb MiB so that the device does not fill up.
+ */
+static pid_t start_writer(void)
+{
+	off_t off = 0, limit = (off_t)size_mb * 1024 * 1024;
+	char *buf;
+	pid_t pid;
+	int fd;
+
+	fd = open(file, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0)
+		barf("open");
+
+	pid = fork();
+	if (pid < 0)
+		barf("fork");
+	if (pid) {
+		close(fd);
+		return pid;
+	}
+
+	buf = malloc(WRITE_CHUNK);
+	if (!buf)
+		barf("malloc");
+	memset(buf, 0x5a, WRITE_CHUNK);
+
+	for (;;) {
+		if (off >= limit) {
+			if (lseek(fd, 0, SEEK_SET) < 0)
+				barf("lseek");
+			off = 0;
+		}
+		if (write(fd, buf, WRITE_CHUNK) != WRITE_CHUNK)
+			barf("write");
+		off += WRITE_CHUNK;
+	}
+}
+
+/*
+ * Returns 0 if the page cache could not be dropped, so the caller can
+ * warn once that the runs are not cold.
+ */
+static int drop_caches(void)
+{
+	int fd, ret;
+
+	sync();
+	fd = open("/proc/sys/vm/drop_caches", O_WRONLY);
+	if (fd < 0)
+		return 0;
+	ret = write(fd, "3", 1) == 1;
+	close(fd);
+	return ret;
+}
+
+static void run_cmd(const char **cmd)
+{
+	pid_t pid;
+	int status;
+
+	pid = fork();
+	if (pid < 0)
+		barf("fork");
+	if (!pid) {
+		execvp(cmd[0], (char **)cmd);
+		fprintf(stderr, "exec %s (error: %s)\n", cmd[0],
+			strerror(errno));
+		_exit(127);
+	}
+
+	if (waitpid(pid, &status, 0) < 0)
+		barf("waitpid");
+	if (!WIFEXITED(status) || WEXITSTATUS(status) == 127) {
+		fprintf(stderr, "%s failed\n", cmd[0]);
+		exit(1);
+	}
+}
+
+int bench_fs_startup(int argc, const char **argv,
+		     const char *prefix __used)
+{
+	struct timeval start, stop, diff;
+	unsigned long long usec, min_usec = ULLONG_MAX, max_usec = 0;
+	unsigned long long total_usec = 0;
+	const char **cmd = default_cmd;
+	pid_t writer = 0;
+	int i, cold = 1;
+
+	argc = parse_options(argc, argv, options, bench_fs_startup_usage,
+			     PARSE_OPT_STOP_AT_NON_OPTION);
+
+	if (loops < 1 || !size_mb)
+		usage_with_options(bench_fs_startup_usage, options);
+
+	if (argc)
+		cmd = argv;
+
+	if (file) {
+		writer = start_writer();
+		/* let the writer fill the device queue first */
+		sleep(2);
+	}
+
+	for (i = 0; i < loops; i++) {
+		if (!drop_caches())
+			cold = 0;
+
+		gettimeofday(&start, NULL);
+		run_cmd(cmd);
+		gettimeofday(&stop, NULL);
+
+		timersub(&stop, &start, &diff);
+		usec = diff.tv_sec * 1000000ULL + diff.tv_usec;
+		total_usec += usec;
+		if (usec < min_usec)
+			min_usec = usec;
+		if (usec > max_usec)
+			max_usec = usec;
+	}
+
+	if (writer) {
+		kill(writer, SIGKILL);
+		waitpid(writer, NULL, 0);
+	}
+
+	if (!cold)
+		fprintf(stderr, "# warning: could not drop the page cache, "
+			"runs were not cold\n");
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf("# %d runs of %s, %s\n\n", loops, cmd[0],
+		       file ? "writing in the background" : "no background I/O");
+
+		printf(" %14s: %llu.%03llu [msec]\n", "Min",
+		       min_usec / 1000, min_usec % 1000);
+		printf(" %14s: %llu.%03llu [msec]\n", "Avg",
+		       total_usec / loops / 1000, total_usec / loops % 1000);
+		printf(" %14s: %llu.%03llu [msec]\n", "Max",
+		       max_usec / 1000, max_usec % 1000);
+		break;
+
+	case BENCH_FORMAT_SIMPLE:
+		printf("%llu.%03llu\n",
+		       total_usec / loops / 1000, total_usec / loops % 1000);
+		break;
+
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+
+	return 0;
+}
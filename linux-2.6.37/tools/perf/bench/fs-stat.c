@@ -0,0 +1,197 @@
+/*
+ *
+ * fs-stat.c
+ *
+ * stat: Benchmark for path lookup, a stat() storm on a cached tree
+ *
+ * Several threads stat() the same set of files, a few directories deep,
+ * like a web server checking its document root. Everything is in the
+ * dcache after the first pass, so this measures the cost of walking the
+ * path and its scalability over CPUs.
+ *
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "../builtin.h"
+#include "bench.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <limits.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <fcntl.h>
+
+static const char *base_dir = "/tmp";
+static int nr_files = 1000;
+static int depth = 4;
+static int nr_threads = 2;
+static int loops = 100000;
+
+static const struct option options[] = {
+	OPT_STRING('d', "dir", &base_dir, "path",
+		   "Directory to create the tree in"),
+	OPT_INTEGER('f', "files", &nr_files,
+		    "Specify number of files"),
+	OPT_INTEGER('D', "depth", &depth,
+		    "Specify number of directories above the files"),
+	OPT_INTEGER('t', "threads", &nr_threads,
+		    "Specify number of threads"),
+	OPT_INTEGER('l', "loop", &loops,
+		    "Specify number of stat() calls per thread"),
+	OPT_END()
+};
+
+static const char * const bench_fs_stat_usage[] = {
+	"perf bench fs stat <options>",
+	NULL
+};
+
+static char top[PATH_MAX];
+static char leaf[PATH_MAX];
+static char **paths;
+
+static void barf(const char *msg)
+{
+	fprintf(stderr, "%s (error: %s)\n", msg, strerror(errno));
+	exit(1);
+}
+
+static void create_tree(void)
+{
+	int i, fd;
+	size_t len;
+
+	snprintf(top, sizeof(top), "%s/perf-bench-stat.%d",
+		 base_dir, getpid());
+	if (mkdir(top, 0755))
+		barf("mkdir");
+
+	strcpy(leaf, top);
+	for (i = 0; i < depth; i++) {
+		len = strlen(leaf);
+		snprintf(leaf + len, sizeof(leaf) - len, "/d%d", i);
+		if (mkdir(leaf, 0755))
+			barf("mkdir");
+	}
+
+	paths = calloc(nr_files, sizeof(*paths));
+	if (!paths)
+		barf("calloc");
+	for (i = 0; i < nr_files; i++) {
+		if (asprintf(&paths[i], "%s/file%d", leaf, i) < 0)
+			barf("asprintf");
+		fd = open(paths[i], O_CREAT | O_WRONLY, 0644);
+		if (fd < 0)
+			barf("open");
+		close(fd);
+	}
+}
+
+static void remove_tree(void)
+{
+	int i;
+	char *p;
+
+	for (i = 0; i < nr_files; i++) {
+		unlink(paths[i]);
+		free(paths[i]);
+	}
+	free(paths);
+
+	while (strcmp(leaf, top)) {
+		rmdir(leaf);
+		p = strrchr(leaf, '/');
+		*p = '\0';
+	}
+	rmdir(top);
+}
+
+static void *worker(void *arg)
+{
+	long id = (long)arg;
+	struct stat st;
+	int i, f = (id * nr_files) / nr_threads;
+
+	for (i = 0; i < loops; i++) {
+		if (stat(paths[f], &st))
+			barf("stat");
+		if (++f == nr_files)
+			f = 0;
+	}
+	return NULL;
+}
+
+int bench_fs_stat(int argc, const char **argv,
+		  const char *prefix __used)
+{
+	struct timeval start, stop, diff;
+	unsigned long long result_usec, total;
+	pthread_t *threads;
+	long i;
+
+	argc = parse_options(argc, argv, options,
+			     bench_fs_stat_usage, 0);
+
+	if (nr_files < 1 || depth < 0 || nr_threads < 1 || loops < 1)
+		usage_with_options(bench_fs_stat_usage, options);
+
+	threads = calloc(nr_threads, sizeof(*threads));
+	if (!threads)
+		barf("calloc");
+
+	create_tree();
+
+	gettimeofday(&start, NULL);
+	for (i = 0; i < nr_threads; i++)
+		if (pthread_create(&threads[i], NULL, worker, (void *)i))
+			barf("pthread_create");
+	for (i = 0; i < nr_threads; i++)
+		pthread_join(threads[i], NULL);
+	gettimeofday(&stop, NULL);
+	timersub(&stop, &start, &diff);
+
+	remove_tree();
+	free(threads);
+
+	total = (unsigned long long)loops * nr_threads;
+	result_usec = diff.tv_sec * 1000000ULL + diff.tv_usec;
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf("# %d threads stat() %d files, %d directories deep\n\n",
+		       nr_threads, nr_files, depth + 1);
+
+		printf(" %14s: %lu.%03lu [sec]\n\n", "Total time",
+		       diff.tv_sec,
+		       (unsigned long) (diff.tv_usec/1000));
+
+		printf(" %14lf usecs/op\n",
+		       (double)result_usec / (double)total);
+		printf(" %14d ops/sec\n",
+		       (int)((double)total /
+			     ((double)result_usec / (double)1000000)));
+		break;
+
+	case BENCH_FORMAT_SIMPLE:
+		printf("%lu.%03lu\n",
+		       diff.tv_sec,
+		       (unsigned long) (diff.tv_usec / 1000));
+		break;
+
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+
+	return 0;
+}
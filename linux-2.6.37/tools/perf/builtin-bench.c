@@ -58,6 +58,31 @@ static struct bench_suite mem_suites[] = {
 	  NULL             }
 };
 
+static struct bench_suite fs_suites[] = {
+	{ "stat",
+	  "Storm of stat() calls on a cached directory tree",
+	  bench_fs_stat },
+	{ "create",
+	  "Parallel create and unlink of empty files",
+	  bench_fs_create },
+	{ "aio",
+	  "Asynchronous random reads, io_uring against libaio",
+	  bench_fs_aio },
+	{ "mount",
+	  "Mount time of a (flash) file system",
+	  bench_fs_mount },
+	{ "startup",
+	  "Cold start time of a command under background writes",
+	  bench_fs_startup },
+	{ "randwrite",
+	  "Small random writes to a (flash) block device",
+	  bench_fs_randwrite },
+	suite_all,
+	{ NULL,
+	  NULL,
+	  NULL          }
+};
+
 struct bench_subsys {
 	const char *name;
 	const char *summary;
@@ -71,6 +96,9 @@ static struct bench_subsys subsystems[] = {
 	{ "mem",
 	  "memory access performance",
 	  mem_suites },
+	{ "fs",
+	  "filesystem and VFS operations",
+	  fs_suites },
 	{ "all",		/* sentinel: easy for help */
 	  "test all subsystem (pseudo subsystem)",
 	  NULL },